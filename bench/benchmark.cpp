@@ -0,0 +1,494 @@
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <new>
+#include <random>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+#include "../include/IVector.h"
+#include "../include/ISet.h"
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <sys/resource.h>
+#endif
+
+/*
+ * Scaling benchmark of ISet: time, heap allocations and peak resident memory of the set operations for every size,
+ * dimension and norm of the grid, written as JSON. Run with --help for the options
+ */
+
+namespace {
+    std::atomic<size_t> allocations(0);
+}
+
+void* operator new(size_t size){
+    allocations.fetch_add(1, std::memory_order_relaxed);
+    if (void* ptr = std::malloc(size == 0 ? 1 : size))
+        return ptr;
+    throw std::bad_alloc();
+}
+
+void* operator new[](size_t size){
+    return operator new(size);
+}
+
+void* operator new(size_t size, std::nothrow_t const&) noexcept{
+    allocations.fetch_add(1, std::memory_order_relaxed);
+    return std::malloc(size == 0 ? 1 : size);
+}
+
+void* operator new[](size_t size, std::nothrow_t const& tag) noexcept{
+    return operator new(size, tag);
+}
+
+void operator delete(void* ptr) noexcept{
+    std::free(ptr);
+}
+
+void operator delete[](void* ptr) noexcept{
+    std::free(ptr);
+}
+
+void operator delete(void* ptr, std::nothrow_t const&) noexcept{
+    std::free(ptr);
+}
+
+void operator delete[](void* ptr, std::nothrow_t const&) noexcept{
+    std::free(ptr);
+}
+
+namespace {
+    double const tol = 1e-9;
+    // Lookups and removals per measurement, the rest of the set is only the background they run against
+    size_t const maxQueries = 10000;
+    // Shards and cell side of the concurrent set, rows are uniform in the unit cube
+    size_t const concurrentShards = 64;
+    double const concurrentCell = 1. / 16;
+
+    struct Options {
+        std::vector<size_t> sizes{100, 1000, 10000, 100000, 1000000, 10000000};
+        std::vector<size_t> dims{2, 8, 32, 128};
+        std::vector<IVector::NORM> norms{IVector::NORM::FIRST, IVector::NORM::SECOND, IVector::NORM::CHEBYSHEV};
+        double minTime = 0.05;
+        size_t maxBytes = size_t(4) << 30;
+        double maxCaseTime = 600;
+        std::vector<size_t> threads{1, 2, 4, 8, 16, 32};
+        std::string out;
+    };
+
+    struct Result {
+        std::string op;
+        size_t size;
+        size_t dim;
+        char const* norm;
+        size_t threads;
+        size_t ops;
+        double nsPerOp;
+        double allocsPerOp;
+        size_t peakRss;
+    };
+
+    struct Skipped {
+        size_t size;
+        size_t dim;
+        char const* reason;
+    };
+
+    char const* normName(IVector::NORM n){
+        switch (n){
+            case IVector::NORM::FIRST: return "FIRST";
+            case IVector::NORM::SECOND: return "SECOND";
+            case IVector::NORM::CHEBYSHEV: return "CHEBYSHEV";
+            default: return "";
+        }
+    }
+
+    /*
+     * Linux keeps the high water mark of the resident set in /proc/self/status and resets it on writing 5 to
+     * /proc/self/clear_refs, so the peak is measured per operation. Elsewhere it is the peak of the process
+     */
+    bool resetPeakRss(){
+        std::ofstream clear("/proc/self/clear_refs");
+        if (!clear)
+            return false;
+        clear << "5";
+        clear.close();
+        return !clear.fail();
+    }
+
+    size_t peakRss(){
+        std::ifstream status("/proc/self/status");
+        std::string line;
+        while (std::getline(status, line))
+            if (line.compare(0, 6, "VmHWM:") == 0)
+                return std::strtoull(line.c_str() + 6, nullptr, 10) * 1024;
+#if defined(__APPLE__)
+        rusage usage;
+        if (getrusage(RUSAGE_SELF, &usage) == 0)
+            return size_t(usage.ru_maxrss);
+#elif defined(__unix__)
+        rusage usage;
+        if (getrusage(RUSAGE_SELF, &usage) == 0)
+            return size_t(usage.ru_maxrss) * 1024;
+#endif
+        return 0;
+    }
+
+    /*
+     * Repeats prepare (not measured) and body until body has taken minTime, ops is the number of operations
+     * done by one call of body
+     */
+    Result measure(Options const& options, std::string const& op, size_t size, size_t dim, char const* norm, size_t ops,
+                   std::function<void()> const& prepare, std::function<void()> const& body,
+                   std::function<void()> const& cleanup, size_t threads = 1){
+        resetPeakRss();
+        double elapsed = 0;
+        size_t allocated = 0, runs = 0;
+        do {
+            prepare();
+            size_t before = allocations.load(std::memory_order_relaxed);
+            auto start = std::chrono::steady_clock::now();
+            body();
+            auto end = std::chrono::steady_clock::now();
+            allocated += allocations.load(std::memory_order_relaxed) - before;
+            cleanup();
+            elapsed += std::chrono::duration<double>(end - start).count();
+            ++runs;
+        } while (elapsed < options.minTime);
+        double total = double(runs) * double(ops);
+        return Result{op, size, dim, norm, threads, ops, elapsed * 1e9 / total, double(allocated) / total, peakRss()};
+    }
+
+    /*
+     * Set of the first count rows, created by createSet(dim) unless generic, then by createSet()
+     */
+    ISet* fill(std::vector<double> const& rows, size_t count, size_t dim, IVector::NORM n, bool generic = false){
+        ISet* set = generic ? ISet::createSet() : ISet::createSet(dim);
+        size_t inserted = 0;
+        if (set != nullptr && set->insertBatch(rows.data(), count, dim, n, tol, inserted) != RC::SUCCESS){
+            delete set;
+            return nullptr;
+        }
+        return set;
+    }
+
+    /*
+     * Inserts of all rows into createConcurrentSet by threads writers, writer t inserts rows t, t + threads, ...
+     * Threads are started inside of the measurement, ns_per_op is wall time per vector, so throughput of all
+     * writers is 1e9 / ns_per_op vectors per second
+     */
+    Result measureConcurrentInsert(Options const& options, std::vector<double> const& rows, size_t size, size_t dim,
+                                   IVector::NORM n, size_t threads){
+        ISet* target = nullptr;
+        return measure(options, "concurrentInsert", size, dim, normName(n), size,
+            [&](){ target = ISet::createConcurrentSet(concurrentShards, concurrentCell); },
+            [&](){
+                std::vector<std::thread> writers;
+                for (size_t t = 0; t < threads; ++t)
+                    writers.emplace_back([&, t](){
+                        IVector* vector = IVector::createVector(dim, rows.data());
+                        if (vector == nullptr)
+                            return;
+                        for (size_t i = t; i < size; i += threads){
+                            vector->setData(dim, rows.data() + i * dim);
+                            target->insert(vector, n, tol);
+                        }
+                        delete vector;
+                    });
+                for (auto& writer : writers)
+                    writer.join();
+            },
+            [&](){ delete target; target = nullptr; }, threads);
+    }
+
+    /*
+     * Operations of one size and dimension. Set a holds rows [0, size) and set b holds rows [size / 2, size + size / 2),
+     * so the algebra works on sets sharing half of their vectors. Set half holds the first half of b, subSet checks
+     * that it is a subset of b, so every vector of it is looked up
+     */
+    bool runCase(Options const& options, size_t size, size_t dim, std::vector<Result>& results){
+        std::mt19937_64 random(size * 131 + dim);
+        std::uniform_real_distribution<double> uniform(0., 1.);
+        std::vector<double> rows((size + size / 2) * dim);
+        for (auto& x : rows)
+            x = uniform(random);
+        std::vector<double> rowsB(rows.begin() + (size / 2) * dim, rows.end());
+        size_t queries = size < maxQueries ? size : maxQueries;
+        std::vector<size_t> picks(queries);
+        for (auto& pick : picks)
+            pick = random() % size;
+
+        IVector* vector = IVector::createVector(dim, rows.data());
+        if (vector == nullptr)
+            return false;
+        bool ok = true;
+        for (size_t k = 0; ok && k < options.norms.size(); ++k){
+            IVector::NORM n = options.norms[k];
+            char const* norm = normName(n);
+            ISet* a = fill(rows, size, dim, n);
+            ISet* b = fill(rowsB, size, dim, n);
+            ISet* half = fill(rowsB, size / 2, dim, n);
+            if (a == nullptr || b == nullptr || half == nullptr){
+                delete a;
+                delete b;
+                delete half;
+                ok = false;
+                break;
+            }
+            ISet* target = nullptr;
+            auto dropTarget = [&target](){ delete target; target = nullptr; };
+            auto none = [](){};
+
+            results.push_back(measure(options, "insert", size, dim, norm, size,
+                [&](){ target = ISet::createSet(dim); },
+                [&](){
+                    for (size_t i = 0; i < size; ++i){
+                        vector->setData(dim, rows.data() + i * dim);
+                        target->insert(vector, n, tol);
+                    }
+                }, dropTarget));
+            results.push_back(measure(options, "findFirst", size, dim, norm, queries, none,
+                [&](){
+                    for (size_t pick : picks){
+                        vector->setData(dim, rows.data() + pick * dim);
+                        a->findFirst(vector, n, tol);
+                    }
+                }, none));
+            // The same lookups in a set that does not know its dimension in advance and compares rows through calls
+            ISet* generic = fill(rows, size, dim, n, true);
+            if (generic != nullptr)
+                results.push_back(measure(options, "findFirstGeneric", size, dim, norm, queries, none,
+                    [&](){
+                        for (size_t pick : picks){
+                            vector->setData(dim, rows.data() + pick * dim);
+                            generic->findFirst(vector, n, tol);
+                        }
+                    }, none));
+            delete generic;
+            results.push_back(measure(options, "removeByIndex", size, dim, norm, queries,
+                [&](){ target = a->clone(); },
+                [&](){
+                    for (size_t pick : picks)
+                        target->remove(pick % target->getSize());
+                }, dropTarget));
+            results.push_back(measure(options, "removeByPattern", size, dim, norm, queries,
+                [&](){ target = a->clone(); },
+                [&](){
+                    for (size_t pick : picks){
+                        vector->setData(dim, rows.data() + pick * dim);
+                        target->remove(vector, n, tol);
+                    }
+                }, dropTarget));
+            if (k == 0){
+                // Iteration and clone do not depend on the norm
+                results.push_back(measure(options, "iterate", size, dim, nullptr, size, none,
+                    [&](){
+                        auto it = a->getBegin();
+                        for (; it != nullptr && it->isValid(); it->next())
+                            it->getVectorCoords(vector);
+                        delete it;
+                    }, none));
+                results.push_back(measure(options, "clone", size, dim, nullptr, 1, none,
+                    [&](){ target = a->clone(); }, dropTarget));
+                /*
+                 * First insert after clone: the set that appends first takes the free tail of the shared storage,
+                 * the other one copies the whole storage. Rows are in the unit cube, so both inserts add a vector
+                 */
+                std::vector<double> extraRow(dim, 2.);
+                double const* extra = extraRow.data();
+                results.push_back(measure(options, "insertAfterClone", size, dim, norm, 1,
+                    [&](){ target = a->clone(); },
+                    [&](){
+                        vector->setData(dim, extra);
+                        target->insert(vector, n, tol);
+                    }, dropTarget));
+                ISet* source = nullptr;
+                results.push_back(measure(options, "detachAfterClone", size, dim, norm, 1,
+                    [&](){
+                        source = a->clone();
+                        target = source->clone();
+                        vector->setData(dim, extra);
+                        target->insert(vector, n, tol);
+                    },
+                    [&](){ source->insert(vector, n, tol); },
+                    [&](){ delete source; source = nullptr; dropTarget(); }));
+                // Scaling of concurrent inserts is measured for the first norm only, it is only meaningful with a core per thread
+                for (size_t threads : options.threads)
+                    results.push_back(measureConcurrentInsert(options, rows, size, dim, n, threads));
+            }
+            results.push_back(measure(options, "makeIntersection", size, dim, norm, 1, none,
+                [&](){ target = ISet::makeIntersection(a, b, n, tol); }, dropTarget));
+            results.push_back(measure(options, "makeUnion", size, dim, norm, 1, none,
+                [&](){ target = ISet::makeUnion(a, b, n, tol); }, dropTarget));
+            results.push_back(measure(options, "sub", size, dim, norm, 1, none,
+                [&](){ target = ISet::sub(a, b, n, tol); }, dropTarget));
+            results.push_back(measure(options, "symSub", size, dim, norm, 1, none,
+                [&](){ target = ISet::symSub(a, b, n, tol); }, dropTarget));
+            // The same result as symSub from two subs and their union, the way it is built without symSub
+            results.push_back(measure(options, "symSubOfSubs", size, dim, norm, 1, none,
+                [&](){
+                    ISet* left = ISet::sub(a, b, n, tol);
+                    ISet* right = ISet::sub(b, a, n, tol);
+                    target = ISet::makeUnion(left, right, n, tol);
+                    delete right;
+                    delete left;
+                }, dropTarget));
+            results.push_back(measure(options, "equals", size, dim, norm, 1,
+                [&](){ target = a->clone(); },
+                [&](){ ISet::equals(a, target, n, tol); }, dropTarget));
+            results.push_back(measure(options, "subSet", size, dim, norm, 1, none,
+                [&](){ ISet::subSet(b, half, n, tol); }, none));
+            delete a;
+            delete b;
+            delete half;
+        }
+        delete vector;
+        return ok;
+    }
+
+    bool parseList(char const* text, std::vector<size_t>& values){
+        values.clear();
+        std::stringstream stream(text);
+        std::string item;
+        while (std::getline(stream, item, ',')){
+            char* end = nullptr;
+            double value = std::strtod(item.c_str(), &end);
+            if (end == item.c_str() || *end != '\0' || value < 1)
+                return false;
+            values.push_back(size_t(value));
+        }
+        return !values.empty();
+    }
+
+    bool parseNorms(char const* text, std::vector<IVector::NORM>& norms){
+        norms.clear();
+        std::stringstream stream(text);
+        std::string item;
+        while (std::getline(stream, item, ',')){
+            if (item == "FIRST")
+                norms.push_back(IVector::NORM::FIRST);
+            else if (item == "SECOND")
+                norms.push_back(IVector::NORM::SECOND);
+            else if (item == "CHEBYSHEV")
+                norms.push_back(IVector::NORM::CHEBYSHEV);
+            else
+                return false;
+        }
+        return !norms.empty();
+    }
+
+    void usage(){
+        std::cerr << "usage: GradientLibBench [--sizes 100,1e3,...] [--dims 2,8,...] [--norms FIRST,SECOND,CHEBYSHEV]\n"
+                     "                        [--min-time seconds] [--max-bytes bytes] [--max-case-time seconds]\n"
+                     "                        [--threads 1,2,...,32] [--out file.json]\n"
+                     "Cases whose sets would take more than --max-bytes (4 GiB by default) are skipped, as are larger\n"
+                     "sizes of a dimension once one of its cases has run longer than --max-case-time (600 s by default).\n";
+    }
+
+    bool parseOptions(int argc, char** argv, Options& options){
+        for (int i = 1; i < argc; ++i){
+            std::string arg = argv[i];
+            if (i + 1 >= argc)
+                return false;
+            char const* value = argv[++i];
+            bool ok = true;
+            if (arg == "--sizes")
+                ok = parseList(value, options.sizes);
+            else if (arg == "--dims")
+                ok = parseList(value, options.dims);
+            else if (arg == "--norms")
+                ok = parseNorms(value, options.norms);
+            else if (arg == "--min-time")
+                ok = (options.minTime = std::strtod(value, nullptr)) >= 0;
+            else if (arg == "--max-bytes")
+                ok = (options.maxBytes = size_t(std::strtod(value, nullptr))) > 0;
+            else if (arg == "--max-case-time")
+                ok = (options.maxCaseTime = std::strtod(value, nullptr)) > 0;
+            else if (arg == "--threads")
+                ok = parseList(value, options.threads);
+            else if (arg == "--out")
+                options.out = value;
+            else
+                ok = false;
+            if (!ok)
+                return false;
+        }
+        return true;
+    }
+
+    void writeJson(std::ostream& out, Options const& options, bool peakPerOp, std::vector<Result> const& results,
+                   std::vector<Skipped> const& skipped){
+        out << "{\n  \"benchmark\": \"GradientLibBench\",\n";
+        out << "  \"threads\": " << std::thread::hardware_concurrency() << ",\n";
+        out << "  \"min_time_s\": " << options.minTime << ",\n";
+        out << "  \"tol\": " << tol << ",\n";
+        out << "  \"peak_rss_per_op\": " << (peakPerOp ? "true" : "false") << ",\n";
+        out << "  \"results\": [";
+        for (size_t i = 0; i < results.size(); ++i){
+            Result const& r = results[i];
+            out << (i == 0 ? "\n" : ",\n") << "    {\"op\": \"" << r.op << "\", \"size\": " << r.size
+                << ", \"dim\": " << r.dim << ", \"norm\": ";
+            if (r.norm == nullptr)
+                out << "null";
+            else
+                out << "\"" << r.norm << "\"";
+            out << ", \"threads\": " << r.threads << ", \"ops\": " << r.ops << ", \"ns_per_op\": " << r.nsPerOp
+                << ", \"allocs_per_op\": " << r.allocsPerOp << ", \"peak_rss_bytes\": " << r.peakRss << "}";
+        }
+        out << "\n  ],\n  \"skipped\": [";
+        for (size_t i = 0; i < skipped.size(); ++i)
+            out << (i == 0 ? "\n" : ",\n") << "    {\"size\": " << skipped[i].size << ", \"dim\": " << skipped[i].dim
+                << ", \"reason\": \"" << skipped[i].reason << "\"}";
+        out << (skipped.empty() ? "" : "\n  ") << "]\n}\n";
+    }
+}
+
+int main(int argc, char** argv){
+    Options options;
+    if (!parseOptions(argc, argv, options)){
+        usage();
+        return 1;
+    }
+    bool peakPerOp = resetPeakRss();
+    std::vector<Result> results;
+    std::vector<Skipped> skipped;
+    std::vector<bool> slow(options.dims.size(), false);
+    for (size_t size : options.sizes){
+        for (size_t d = 0; d < options.dims.size(); ++d){
+            size_t dim = options.dims[d];
+            // Source rows, sets a and b, a half set and the result or copy of the operation
+            double bytes = double(size) * double(dim * sizeof(double) + 2 * sizeof(size_t)) * 6;
+            char const* reason = nullptr;
+            if (slow[d])
+                reason = "time";
+            else if (bytes > double(options.maxBytes))
+                reason = "memory";
+            if (reason != nullptr){
+                std::cerr << "skip size " << size << " dim " << dim << " (" << reason << ")" << std::endl;
+                skipped.push_back(Skipped{size, dim, reason});
+                continue;
+            }
+            std::cerr << "size " << size << " dim " << dim << std::endl;
+            auto start = std::chrono::steady_clock::now();
+            if (!runCase(options, size, dim, results)){
+                std::cerr << "could not build sets of size " << size << " dim " << dim << std::endl;
+                skipped.push_back(Skipped{size, dim, "allocation"});
+            }
+            slow[d] = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count() > options.maxCaseTime;
+        }
+    }
+    if (options.out.empty()){
+        writeJson(std::cout, options, peakPerOp, results, skipped);
+        return 0;
+    }
+    std::ofstream out(options.out);
+    writeJson(out, options, peakPerOp, results, skipped);
+    return out ? 0 : 1;
+}
@@ -1,22 +1,130 @@
 #pragma once
 #include <cstddef>
+#include <cstdint>
+#include <functional>
 #include "IVector.h"
 #include "RC.h"
 #include "Interfacedllexport.h"
 
+class ICompact;
+class ISetAllocator;
+
 class LIB_EXPORT ISet {
 public:
     static RC setLogger(ILogger* const logger);
     static ILogger* getLogger();
 
     static ISet* createSet();
+    /*
+     * Set of vectors of dim coordinates with storage allocated at once. For dim up to 8 it is a set class compiled
+     * for that dimension, its lookups compare rows inline with constant stride. Clones and snapshots keep the class
+     */
+    static ISet* createSet(size_t dim);
+    /*
+     * Set which storage is allocated by allocator, the allocator must outlive the set, its clones and snapshots
+     */
+    static ISet* createSet(ISetAllocator* const& allocator);
+    /*
+     * Set safe for concurrent use from many threads, lookups take no locks. Writers to different shards do not wait
+     * for each other, how insert throughput grows with writers depends on the cores and on how rows spread over shards
+     *
+     * @param [in] shardCount Quantity of independently locked shards
+     * @param [in] cellSize Side of space cells hashed to shards, inserts with tol <= cellSize lock only nearby shards
+     */
+    static ISet* createConcurrentSet(size_t shardCount, double cellSize);
+    /*
+     * Set partitioned over shards, each of them has its own allocator and its own thread. Batches, scans and set algebra
+     * with the sharded set as op1 are split over all shard threads, single vectors are handled by the calling thread.
+     * Sharding is in-process: shards share the address space of the set and are called directly, they are not
+     * independent units that could run in other processes or on other machines
+     *
+     * @param [in] shardCount Quantity of shards
+     * @param [in] cellSize Side of space cells hashed to shards, lookups with tol <= cellSize visit only nearby shards
+     */
+    static ISet* createShardedSet(size_t shardCount, double cellSize);
+    /*
+     * Set keeping every coordinate as a code of bits (8 or 16) bits on a uniform grid over the box [lower, upper],
+     * vectors are decoded to doubles only when they are copied out. Decoded vector differs from the inserted one
+     * by at most half of the grid step along every axis, lookups compare decoded vectors with tol widened by that
+     * error in the norm of the lookup, so every vector inserted within tol of the pattern is found, but vectors
+     * up to tol plus twice the error away may be found too. Vectors outside of the box are rejected
+     */
+    static ISet* createQuantizedSet(IVector const* const& lower, IVector const* const& upper, size_t bits);
+    /*
+     * Quantized copy of source over its bounding box, vectors of source are copied without lookups
+     */
+    static ISet* createQuantizedSet(ISet const* const& source, size_t bits);
+    /*
+     * Set in POSIX shared memory object name ("/name"), which other processes on the host read through
+     * openSharedSet instead of holding their own copies. The creating process is the only writer,
+     * storage for capacity vectors is reserved at creation, the object is unlinked when the writer is deleted
+     */
+    static ISet* createSharedSet(char const* const& name, size_t dim, size_t capacity);
+    /*
+     * Attaches to a set created by createSharedSet, the attached set rejects modification. Readers take no locks
+     * and never block the writer, they retry only reads overlapped by the writer dropping removed vectors
+     */
+    static ISet* openSharedSet(char const* const& name);
+    /*
+     * Clone shares storage with the set, storage is copied only before one of them changes vectors the other reads.
+     * Storage is one block, not chunks: the first of them to insert appends into the free tail, the other one then
+     * copies all of its vectors on its first insert, compaction or removeIf
+     */
     virtual ISet* clone() const = 0;
 
+    enum class FILE_MODE {
+        READ_ONLY,
+        READ_WRITE
+    };
+
+    /*
+     * Writes set into binary file: vectors, their unique indices and queryBox index if it was built
+     */
+    RC save(char const* const& path) const;
+    /*
+     * Maps set file into memory without reading vectors. Set opened with FILE_MODE::READ_ONLY rejects
+     * modification, set opened with FILE_MODE::READ_WRITE changes the file in place
+     */
+    static ISet* openFile(char const* const& path, FILE_MODE mode);
+    /*
+     * Flushes set opened with FILE_MODE::READ_WRITE to its file, file is consistent after sync and after
+     * the set is deleted. Sets in memory have nothing to flush
+     */
+    virtual RC sync() = 0;
+
+    enum class LOAD_FORMAT {
+        CSV,
+        BINARY
+    };
+
+    /*
+     * Streams vectors of a file into set through insertBatch. CSV file holds one vector per line with comma
+     * separated coordinates, first line that is not a vector is skipped as a header. BINARY file holds
+     * little-endian doubles of vectors one after another. File is read in chunks parsed by threadCount threads,
+     * at most two chunks per thread are kept in memory
+     *
+     * @param [in] dim Dimension of vectors, 0 takes it from the set or from the first line of CSV file
+     * @param [in] progress Called after every inserted chunk with bytes of file processed and file size, may be empty
+     * @param [in] threadCount Quantity of parsing threads, 0 for the number of hardware threads
+     */
+    static RC load(ISet* const& set, char const* const& path, LOAD_FORMAT format, size_t dim, IVector::NORM n, double tol,
+                   std::function<void(size_t, size_t)> const& progress, size_t threadCount = 0);
+    /*
+     * Immutable view of the set at the moment of the call, it shares storage with the set instead of copying it.
+     * Lookups and iterators of the snapshot keep working while the set is changed, the snapshot may be read
+     * from other threads, but snapshot itself must be called from the thread that changes the set
+     */
+    virtual ISet const* snapshot() const = 0;
+
     static ISet* makeIntersection(ISet const * const& op1, ISet const * const& op2, IVector::NORM n, double tol);
     static ISet* makeUnion(ISet const * const& op1, ISet const * const& op2, IVector::NORM n, double tol);
     static ISet* sub(ISet const * const& op1, ISet const * const& op2, IVector::NORM n, double tol);
     static ISet* symSub(ISet const * const& op1, ISet const * const& op2, IVector::NORM n, double tol);
 
+    /*
+     * Sets are equal if they have equal sizes and every vector of each of them is within tol of a vector of the other.
+     * The answer is exact, fingerprints only decide which vectors have to be compared
+     */
     static bool equals(ISet const * const& op1, ISet const * const& op2, IVector::NORM n, double tol);
     static bool subSet(ISet const * const& op1, ISet const * const& op2, IVector::NORM n, double tol);
 
@@ -35,11 +143,67 @@ public:
     virtual RC getCoords(size_t index, IVector * const& val) const = 0;
     virtual RC findFirstAndCopyCoords(IVector const * const& pat, IVector::NORM n, double tol, IVector * const& val) const = 0;
     virtual RC findFirst(IVector const * const& pat, IVector::NORM n, double tol) const = 0;
+    /*
+     * Looks up count rows of dim coordinates stored one after another, patterns are validated once for the whole batch
+     * and may be answered in any order and by several threads
+     *
+     * @param [out] indices Index of the vector findFirst would find for every row, or the size of the set if there is none
+     */
+    virtual RC findFirstMany(double const* patterns, size_t count, size_t dim, IVector::NORM n, double tol, size_t * const& indices) const = 0;
 
     virtual RC insert(IVector const * const& val, IVector::NORM n, double tol) = 0;
+    /*
+     * Inserts count rows of dim coordinates stored one after another, rows equal to a vector of the set or to
+     * an earlier row of the batch are skipped. Storage is grown once for the whole batch
+     *
+     * @param [out] inserted Quantity of rows inserted
+     */
+    virtual RC insertBatch(double const* rows, size_t count, size_t dim, IVector::NORM n, double tol, size_t& inserted) = 0;
 
     virtual RC remove(size_t index) = 0;
     virtual RC remove(IVector const * const& pat, IVector::NORM n, double tol) = 0;
+    /*
+     * Removes every vector for which pred(coords, dim) returns true, storage is compacted in the same pass
+     */
+    virtual RC removeIf(std::function<bool(double const*, size_t)> const& pred) = 0;
+
+    /*
+     * Calls callback(coords, dim) for every vector inside of box (borders included) in the order of the set
+     */
+    virtual RC queryBox(ICompact const* const& box, std::function<void(double const*, size_t)> const& callback) const = 0;
+    /*
+     * Inserts every vector inside of box into out
+     */
+    RC queryBox(ICompact const* const& box, ISet* const& out) const;
+
+    /*
+     * Removed vectors are only marked dead, storage is compacted when dead vectors
+     * take more than ratio of it or when compact is called
+     *
+     * @param [in] ratio Share of dead vectors in [0, 1], 0 compacts storage on every removal
+     */
+    virtual RC setGarbageRatio(double ratio) = 0;
+    virtual RC compact() = 0;
+
+    /*
+     * Least and greatest coordinates of vectors along every axis, ready for ICompact::createCompact.
+     * Summaries are kept up to date by insertion and removal, the set is scanned only after removal of a vector
+     * on the border of the box and on the first call for a snapshot or set file
+     */
+    virtual RC getBounds(IVector*& lower, IVector*& upper) const = 0;
+    /*
+     * Mean of vectors
+     */
+    virtual RC getCentroid(IVector*& centroid) const = 0;
+    /*
+     * Population variance of vectors along every axis
+     */
+    virtual RC getVariance(IVector*& variance) const = 0;
+
+    /*
+     * Version of the set, every mutation changes it. Views of ISetRawView and changes of ISetJournal are stamped with it
+     */
+    virtual uint64_t getVersion() const = 0;
 
     /*
     * Iterator object can be created with ISet methods ISet::getIterator, ISet::getBegin, ISet::getEnd
@@ -92,6 +256,50 @@ public:
     virtual IIterator *getBegin() const = 0;
     virtual IIterator *getEnd() const = 0;
 
+    /*
+    * Iterator over chunks of the set: up to chunkRows vectors stored one after another with their unique indices,
+    * so a consumer reads coordinates in place instead of a virtual call and a copy per vector.
+    * Iterator object can be created with ISet::getChunkIterator
+    */
+    class IChunkIterator {
+    public:
+        /*
+        * Moves iterator to the next chunk, returns INDEX_OUT_OF_BOUND after the last one
+        */
+        virtual RC next() = 0;
+
+        virtual bool isValid() const = 0;
+
+        /*
+        * getCount() rows of getDim() coordinates and unique indices of their vectors, valid until the next call of next
+        */
+        virtual double const* getRows() const = 0;
+        virtual size_t const* getHashes() const = 0;
+        virtual size_t getCount() const = 0;
+        virtual size_t getDim() const = 0;
+
+        virtual ~IChunkIterator() = 0;
+
+    private:
+        IChunkIterator(const IChunkIterator&);
+        IChunkIterator& operator=(const IChunkIterator&);
+
+    protected:
+        IChunkIterator() = default;
+    };
+
+    /*
+     * Iterator standing at the first chunk, the next chunk is prefetched while the current one is read.
+     * Iterator of a set in memory reads its snapshot, so it may be kept while the set is changed, iterators of other
+     * sets copy chunks into their buffer and return SOURCE_SET_CHANGED from next if the set was changed
+     */
+    virtual IChunkIterator* getChunkIterator(size_t chunkRows) const = 0;
+    /*
+     * Calls callback(rows, hashes, count, dim) for chunks of up to chunkRows vectors covering the set. The set is split
+     * into parts read by a pool of threads, so callback is called from several threads at once and must not change the set
+     */
+    virtual RC forEachChunk(size_t chunkRows, std::function<void(double const*, size_t const*, size_t, size_t)> const& callback) const = 0;
+
     virtual ~ISet() = 0;
 
 private:
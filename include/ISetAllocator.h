@@ -0,0 +1,40 @@
+#pragma once
+#include <cstddef>
+#include "Interfacedllexport.h"
+
+/*
+ * Source of memory for set storage. Sets do not own their allocator, it must outlive every set and snapshot using it
+ */
+class LIB_EXPORT ISetAllocator {
+public:
+    /*
+     * Allocator used by sets created without one: malloc/realloc/free, large blocks are grown by the C library without copying
+     */
+    static ISetAllocator* getHeapAllocator();
+    /*
+     * Allocator of anonymous memory pages grown in place by mremap where it is available. Pages land on the NUMA node
+     * of the thread that touches them first
+     *
+     * @param [in] hugePages Requests transparent huge pages for the blocks
+     *
+     * @return nullptr where memory pages can not be mapped
+     */
+    static ISetAllocator* createPageAllocator(bool hugePages);
+
+    virtual void* allocate(size_t size) = 0;
+    /*
+     * Resizes block keeping its first min(size, newSize) bytes, the block may move.
+     * On failure nullptr is returned and the block stays valid
+     */
+    virtual void* reallocate(void* block, size_t size, size_t newSize) = 0;
+    virtual void deallocate(void* block, size_t size) = 0;
+
+    virtual ~ISetAllocator() = default;
+
+private:
+    ISetAllocator(const ISetAllocator&) = delete;
+    ISetAllocator& operator=(const ISetAllocator&) = delete;
+
+protected:
+    ISetAllocator() = default;
+};
@@ -0,0 +1,40 @@
+#pragma once
+#include <cstddef>
+#include "ISet.h"
+#include "RC.h"
+#include "Interfacedllexport.h"
+
+/*
+ * Control of storage growth for sets that keep their vectors in growing arrays: createSet, openFile,
+ * createQuantizedSet and createShardedSet. Other sets do not implement it, ISetCapacity::of returns nullptr for them
+ */
+class LIB_EXPORT ISetCapacity {
+public:
+    static ISetCapacity* of(ISet* const& set) {
+        return dynamic_cast<ISetCapacity*>(set);
+    }
+
+    /*
+     * Prepares storage for capacity vectors, inserting up to capacity vectors does not reallocate it
+     */
+    virtual RC reserve(size_t capacity) = 0;
+    /*
+     * Compacts storage and releases memory not taken by vectors
+     */
+    virtual RC shrinkToFit() = 0;
+    /*
+     * Full storage grows factor times
+     *
+     * @param [in] factor Finite number greater than 1
+     */
+    virtual RC setGrowthFactor(double factor) = 0;
+
+private:
+    ISetCapacity(const ISetCapacity&) = delete;
+    ISetCapacity& operator=(const ISetCapacity&) = delete;
+
+protected:
+    ISetCapacity() = default;
+    // sets are deleted through ISet
+    virtual ~ISetCapacity() = default;
+};
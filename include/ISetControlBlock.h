@@ -4,11 +4,17 @@
 
 class ISetControlBlock {
 public:
-    virtual RC getNext(IVector *const &vec, size_t &index, size_t indexInc = 1) const = 0;
-    virtual RC getPrevious(IVector *const &vec, size_t &index, size_t indexInc = 1) const = 0;
+    /*
+    * Copies coordinates of the requested vector to data, which must hold getDim() elements of the set
+    *
+    * @param [in, out] index Unique index of the vector under iterator
+    * @param [in, out] pos Position of the vector in set storage cached by iterator, it is checked against index before use
+    */
+    virtual RC getNext(double *const &data, size_t &index, size_t &pos, size_t indexInc = 1) const = 0;
+    virtual RC getPrevious(double *const &data, size_t &index, size_t &pos, size_t indexInc = 1) const = 0;
     
-    virtual RC getBegin(IVector *const &vec, size_t &index) const = 0;
-    virtual RC getEnd(IVector *const &vec, size_t &index) const = 0;
+    virtual RC getBegin(double *const &data, size_t &index, size_t &pos) const = 0;
+    virtual RC getEnd(double *const &data, size_t &index, size_t &pos) const = 0;
 
     virtual ~ISetControlBlock() = 0;
 
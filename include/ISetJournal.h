@@ -0,0 +1,59 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include "ISet.h"
+#include "RC.h"
+#include "Interfacedllexport.h"
+
+/*
+ * Journal of changes for sets made by createSet and openFile, copies of the set (caches, indexes, replicas)
+ * follow it instead of comparing whole sets. Other sets do not implement it, ISetJournal::of returns nullptr for them
+ */
+class LIB_EXPORT ISetJournal {
+public:
+    static ISetJournal* of(ISet* const& set) {
+        return dynamic_cast<ISetJournal*>(set);
+    }
+
+    static ISetJournal const* of(ISet const* const& set) {
+        return dynamic_cast<ISetJournal const*>(set);
+    }
+
+    enum class CHANGE {
+        INSERT,
+        REMOVE,
+        // consumer must drop its copy of the set, INSERT changes of every vector of the set follow
+        RESET
+    };
+
+    struct Change {
+        CHANGE kind;
+        // version of the set after the change, see ISet::getVersion
+        uint64_t version;
+        // unique index of the vector, it is never given to another vector of the set
+        size_t hash;
+    };
+
+    /*
+     * Journal of the last capacity inserted and removed vectors, 0 disables it. Set is not changed by the call
+     */
+    virtual RC setJournalCapacity(size_t capacity) = 0;
+    /*
+     * Calls callback(change, coords) for every change made after version in the order of changes, coords are
+     * nullptr for REMOVE and for INSERT of a vector removed later. If version is 0 or older than the journal,
+     * RESET and INSERT of every vector are reported instead, so a consumer without a copy starts from version 0
+     *
+     * @param [out] current Version of the set the consumer is up to date with, the next call passes it as version
+     */
+    virtual RC getChangesSince(uint64_t version, std::function<void(Change const&, double const*)> const& callback, uint64_t& current) const = 0;
+
+private:
+    ISetJournal(const ISetJournal&) = delete;
+    ISetJournal& operator=(const ISetJournal&) = delete;
+
+protected:
+    ISetJournal() = default;
+    // sets are deleted through ISet
+    virtual ~ISetJournal() = default;
+};
@@ -0,0 +1,61 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include "ISet.h"
+#include "IVector.h"
+#include "RC.h"
+#include "Interfacedllexport.h"
+
+/*
+ * Approximate lookups for sets made by createSet, openFile and createShardedSet.
+ * Other sets do not implement it, ISetLsh::of returns nullptr for them
+ */
+class LIB_EXPORT ISetLsh {
+public:
+    static ISetLsh* of(ISet* const& set) {
+        return dynamic_cast<ISetLsh*>(set);
+    }
+
+    static ISetLsh const* of(ISet const* const& set) {
+        return dynamic_cast<ISetLsh const*>(set);
+    }
+
+    /*
+     * Counters of lookups answered by the LSH index since enableLsh
+     */
+    struct LshStats {
+        uint64_t queries;
+        // candidates taken from hash buckets and verified against tol
+        uint64_t candidates;
+        uint64_t found;
+        // lookups repeated by exact search, found by it and missed by the index: recall is 1 - checkedMissed / checkedFound
+        uint64_t checked;
+        uint64_t checkedFound;
+        uint64_t checkedMissed;
+        // total time of index lookups and of exact searches of checked lookups
+        double lookupSeconds;
+        double exactSeconds;
+    };
+
+    /*
+     * Approximate lookups for vectors of high dimension. Lookups in norm n take candidates from tables hash tables
+     * of p-stable projections (Gaussian for NORM::SECOND, Cauchy for NORM::FIRST) and verify them against tol, so
+     * a vector farther than tol is never returned, but an equal one may be missed and insert then adds a near duplicate.
+     * Recall grows with tables and bucketWidth, which should be several times tol, hashesPerTable makes buckets
+     * smaller: lookups get faster and recall falls. Lookups in other norms stay exact
+     *
+     * @param [in] checkEvery Every checkEvery-th lookup is repeated by exact search to estimate recall, 0 for none
+     */
+    virtual RC enableLsh(IVector::NORM n, size_t tables, size_t hashesPerTable, double bucketWidth, size_t checkEvery) = 0;
+    virtual RC disableLsh() = 0;
+    virtual RC getLshStats(LshStats& stats) const = 0;
+
+private:
+    ISetLsh(const ISetLsh&) = delete;
+    ISetLsh& operator=(const ISetLsh&) = delete;
+
+protected:
+    ISetLsh() = default;
+    // sets are deleted through ISet
+    virtual ~ISetLsh() = default;
+};
@@ -0,0 +1,91 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include "ISet.h"
+#include "RC.h"
+#include "Interfacedllexport.h"
+
+/*
+ * Zero-copy read-only access to sets that keep their vectors in one array: createSet, openFile and the shared sets.
+ * Other sets do not implement it, ISetRawView::of returns nullptr for them
+ */
+class LIB_EXPORT ISetRawView {
+public:
+    static ISetRawView const* of(ISet const* const& set) {
+        return dynamic_cast<ISetRawView const*>(set);
+    }
+
+    /*
+     * Count vectors of dim coordinates stored one after another
+     *
+     * View is valid while ISet::getVersion() returns the same version, every mutation of the set changes it.
+     * Returns OPERATION_NOT_SUPPORTED while removed vectors wait for compaction, since a const call never moves
+     * storage other readers may use; compact() makes the view available again
+     */
+    virtual RC getRawView(double const*& rows, size_t& count, size_t& dim, uint64_t& version) const = 0;
+
+    /*
+    * Read-only iterator over getRawView rows, it never copies coordinates. It is empty if the set has no view
+    */
+    class SpanIterator {
+    public:
+        explicit SpanIterator(ISet const* const& set) :
+                _set(set),
+                _rows(nullptr),
+                _count(0),
+                _dim(0),
+                _version(0),
+                _index(0){
+            ISetRawView const* view = of(set);
+            if (view == nullptr || view->getRawView(_rows, _count, _dim, _version) != RC::SUCCESS)
+                _count = 0;
+        }
+
+        /*
+        * Iterator is invalid, if it was moved out of the view or the set was modified after the view was taken
+        */
+        bool isValid() const {
+            return _index < _count && !isStale();
+        }
+
+        bool isStale() const {
+            return _set == nullptr || _set->getVersion() != _version;
+        }
+
+        RC next(size_t indexInc = 1) {
+            if (isStale())
+                return RC::SOURCE_SET_CHANGED;
+            _index = indexInc >= _count - _index ? _count : _index + indexInc;
+            return _index < _count ? RC::SUCCESS : RC::INDEX_OUT_OF_BOUND;
+        }
+
+        double const* getRow() const {
+            return _index < _count ? _rows + _index * _dim : nullptr;
+        }
+
+        size_t getIndex() const {
+            return _index;
+        }
+
+        size_t getDim() const {
+            return _dim;
+        }
+
+    private:
+        ISet const* _set;
+        double const* _rows;
+        size_t _count;
+        size_t _dim;
+        uint64_t _version;
+        size_t _index;
+    };
+
+private:
+    ISetRawView(const ISetRawView&) = delete;
+    ISetRawView& operator=(const ISetRawView&) = delete;
+
+protected:
+    ISetRawView() = default;
+    // sets are deleted through ISet
+    virtual ~ISetRawView() = default;
+};
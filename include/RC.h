@@ -22,5 +22,7 @@ enum class RC {
     NO_ARGS_SET, // no arguments set for problem to evaluate or for solver to solve
     NO_PARAMS_SET, // no params set for problem to evaluate or for solver to solve
     NO_PROBLEM_SET, // no problem set for solver to solve
+    SOURCE_SET_CHANGED, // View of set storage is outdated by set modification
+    OPERATION_NOT_SUPPORTED, // Implementation can not provide requested access to its data
     AMOUNT
 };
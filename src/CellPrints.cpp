@@ -0,0 +1,103 @@
+#include "CellPrints.h"
+#include "SetKernels.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <new>
+
+CellPrints::CellPrints() :
+        _dim(0),
+        _step(1.),
+        _rows(nullptr){
+}
+
+uint64_t CellPrints::printOf(double const* row) const {
+    uint64_t print = 0xcbf29ce484222325ULL;
+    for (size_t i = 0; i < _dim; i++){
+        double cell = std::floor(row[i] / _step);
+        long long key = 0;
+        if (cell >= 9.0e18)
+            key = 9000000000000000000LL;
+        else if (cell <= -9.0e18 || std::isnan(cell))
+            key = -9000000000000000000LL;
+        else
+            key = static_cast<long long>(cell);
+        print ^= static_cast<uint64_t>(key);
+        print *= 0x100000001b3ULL;
+        print ^= print >> 29;
+    }
+    return print;
+}
+
+uint64_t CellPrints::hashOf(double const* row) const {
+    uint64_t hash = 0xcbf29ce484222325ULL;
+    for (size_t i = 0; i < _dim; i++){
+        uint64_t bits = 0;
+        std::memcpy(&bits, row + i, sizeof(bits));
+        hash ^= bits;
+        hash *= 0x100000001b3ULL;
+        hash ^= hash >> 31;
+    }
+    return hash;
+}
+
+RC CellPrints::build(RowIndex const& rows, size_t dim, double step) {
+    _dim = dim;
+    _step = step;
+    _rows = &rows;
+    try {
+        _prints.resize(rows.getSize());
+        for (size_t row = 0; row < _prints.size(); row++)
+            _prints[row] = Entry{printOf(rows.getRow(row)), hashOf(rows.getRow(row)), row};
+        std::sort(_prints.begin(), _prints.end());
+        _cells.clear();
+        for (size_t pos = 0; pos < _prints.size(); pos++){
+            if (_cells.empty() || _cells.back().print != _prints[pos].print)
+                _cells.push_back(Cell{_prints[pos].print, pos, pos, 0, 0});
+            uint64_t hash = _prints[pos].hash;
+            Cell& cell = _cells.back();
+            cell.end = pos + 1;
+            cell.sum += hash;
+            // second fingerprint of the cell, mixed so that it is not a function of the sum
+            hash *= 0x9e3779b97f4a7c15ULL;
+            cell.mix ^= hash ^ (hash >> 32);
+        }
+    }
+    catch (std::bad_alloc const&){
+        return RC::ALLOCATION_ERROR;
+    }
+    return RC::SUCCESS;
+}
+
+size_t CellPrints::getCellCount() const {
+    return _cells.size();
+}
+
+CellPrints::Cell const& CellPrints::getCell(size_t cell) const {
+    return _cells[cell];
+}
+
+double const* CellPrints::getRow(size_t position) const {
+    return _rows->getRow(_prints[position].row);
+}
+
+bool CellPrints::sameRows(Cell const& cell, CellPrints const& prints, Cell const& other) const {
+    if (cell.print != other.print || cell.end - cell.begin != other.end - other.begin || cell.sum != other.sum || cell.mix != other.mix)
+        return false;
+    for (size_t pos = cell.begin, otherPos = other.begin; pos < cell.end; pos++, otherPos++)
+        if (std::memcmp(getRow(pos), prints.getRow(otherPos), _dim * sizeof(double)) != 0)
+            return false;
+    return true;
+}
+
+bool CellPrints::contains(double const* pat, IVector::NORM n, double tol) const {
+    auto range = std::equal_range(_prints.begin(), _prints.end(), Entry{printOf(pat), 0, 0}, [](Entry const& lhs, Entry const& rhs){
+        return lhs.print < rhs.print;
+    });
+    kernel::RowComparer equal = kernel::rowComparer(_dim, n);
+    for (auto it = range.first; it != range.second; it++){
+        if (equal(_dim, _rows->getRow(it->row), pat, tol))
+            return true;
+    }
+    return false;
+}
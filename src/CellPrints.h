@@ -0,0 +1,72 @@
+#pragma once
+#include "../include/RC.h"
+#include "../include/IVector.h"
+#include "RowIndex.h"
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+/*
+ * Rows of a RowIndex in canonical order of fingerprints of their cells on the grid with step tol,
+ * rows of a cell are ordered by hashes of their exact bits.
+ * Every cell is summarized by the count of its rows and by the sum and the xor of those hashes,
+ * which do not depend on the order of rows, so two sets are compared cell by cell in one merge pass.
+ * Vectors equal with tolerance tol mostly share a cell, so a pattern is compared with rows of its own cell first,
+ * and only patterns without a match there need RowIndex::contains
+ */
+class CellPrints {
+public:
+    struct Cell {
+        uint64_t print;
+        // rows of the cell are [begin, end) in the order of prints
+        size_t begin;
+        size_t end;
+        uint64_t sum;
+        uint64_t mix;
+    };
+
+    /*
+     * True if cell and cell other of prints hold bitwise the same rows. Fingerprints reject most
+     * differing cells, cells with equal fingerprints are compared row by row in the order of hashes.
+     * Distinct rows with equal hashes may be ordered differently in the two cells, then the cells are
+     * reported as different and the caller looks their rows up
+     */
+    bool sameRows(Cell const& cell, CellPrints const& prints, Cell const& other) const;
+
+private:
+    /*
+     * Row number in RowIndex with the print of its cell and the hash of its bits
+     */
+    struct Entry {
+        uint64_t print;
+        uint64_t hash;
+        size_t row;
+
+        inline bool operator<(Entry const& other) const {
+            return print < other.print || (print == other.print && (hash < other.hash || (hash == other.hash && row < other.row)));
+        }
+    };
+
+    size_t _dim;
+    double _step;
+    RowIndex const* _rows;
+    std::vector<Entry> _prints;
+    std::vector<Cell> _cells;
+
+    uint64_t printOf(double const* row) const;
+    uint64_t hashOf(double const* row) const;
+
+public:
+    CellPrints();
+
+    RC build(RowIndex const& rows, size_t dim, double step);
+
+    size_t getCellCount() const;
+    Cell const& getCell(size_t cell) const;
+    /*
+     * Row at position of the order of prints
+     */
+    double const* getRow(size_t position) const;
+
+    bool contains(double const* pat, IVector::NORM n, double tol) const;
+};
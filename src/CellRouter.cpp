@@ -0,0 +1,129 @@
+#include "CellRouter.h"
+#include <algorithm>
+#include <cmath>
+
+namespace{
+    // boxes crossing cell borders along more axes are sent to all shards
+    size_t const maxSplitAxes = 12;
+}
+
+CellRouter::CellRouter(size_t shardCount, double cellSize) :
+        _shardCount(shardCount),
+        _cellSize(cellSize){
+}
+
+size_t CellRouter::getShardCount() const {
+    return _shardCount;
+}
+
+double CellRouter::getCellSize() const {
+    return _cellSize;
+}
+
+long long CellRouter::cellOf(double x) const {
+    double cell = std::floor(x / _cellSize);
+    if (cell >= 9.0e18)
+        return 9000000000000000000LL;
+    if (cell <= -9.0e18 || std::isnan(cell))
+        return -9000000000000000000LL;
+    return static_cast<long long>(cell);
+}
+
+uint64_t CellRouter::mixCell(uint64_t h, long long cell) {
+    h ^= static_cast<uint64_t>(cell) + 0x9e3779b97f4a7c15ULL + (h << 6) + (h >> 2);
+    return h;
+}
+
+size_t CellRouter::shardOfHash(uint64_t h) const {
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdULL;
+    h ^= h >> 33;
+    return static_cast<size_t>(h % _shardCount);
+}
+
+size_t CellRouter::shardOf(double const* row, size_t dim) const {
+    uint64_t h = 0xcbf29ce484222325ULL;
+    for (size_t i = 0; i < dim; i++)
+        h = mixCell(h, cellOf(row[i]));
+    return shardOfHash(h);
+}
+
+void CellRouter::allShards(std::vector<size_t>& ids) const {
+    ids.resize(_shardCount);
+    for (size_t i = 0; i < _shardCount; i++)
+        ids[i] = i;
+}
+
+void CellRouter::candidateShards(double const* pat, size_t dim, double tol, std::vector<size_t>& ids) const {
+    ids.clear();
+    if (_shardCount == 1 || !(tol <= _cellSize)){
+        allShards(ids);
+        return;
+    }
+    std::vector<long long> cells(dim);
+    std::vector<size_t> splitAxes;
+    /*
+     * Vectors within tol from pat lie in cells of the box pat +- tol, tol <= cellSize,
+     * so every axis crosses at most one cell border
+     */
+    for (size_t i = 0; i < dim; i++){
+        cells[i] = cellOf(pat[i] - tol);
+        if (cellOf(pat[i] + tol) != cells[i]){
+            splitAxes.push_back(i);
+            if (splitAxes.size() > maxSplitAxes || (size_t(1) << splitAxes.size()) >= _shardCount){
+                allShards(ids);
+                return;
+            }
+        }
+    }
+    for (size_t mask = 0; mask < (size_t(1) << splitAxes.size()); mask++){
+        uint64_t h = 0xcbf29ce484222325ULL;
+        size_t split = 0;
+        for (size_t i = 0; i < dim; i++){
+            long long cell = cells[i];
+            if (split < splitAxes.size() && splitAxes[split] == i){
+                if ((mask >> split) & 1)
+                    cell++;
+                split++;
+            }
+            h = mixCell(h, cell);
+        }
+        ids.push_back(shardOfHash(h));
+    }
+    ids.push_back(shardOf(pat, dim));
+    std::sort(ids.begin(), ids.end());
+    ids.erase(std::unique(ids.begin(), ids.end()), ids.end());
+}
+
+void CellRouter::boxShards(double const* lower, double const* upper, size_t dim, std::vector<size_t>& ids) const {
+    ids.clear();
+    std::vector<long long> first(dim), last(dim), cells(dim);
+    double total = 1.;
+    for (size_t i = 0; i < dim; i++){
+        first[i] = cellOf(lower[i]);
+        last[i] = cellOf(upper[i]);
+        if (last[i] < first[i])
+            return;
+        total *= static_cast<double>(last[i] - first[i]) + 1.;
+    }
+    // enumerating cells pays off only while there are fewer of them than shards
+    if (total > static_cast<double>(_shardCount)){
+        allShards(ids);
+        return;
+    }
+    cells = first;
+    while (true){
+        uint64_t h = 0xcbf29ce484222325ULL;
+        for (size_t i = 0; i < dim; i++)
+            h = mixCell(h, cells[i]);
+        ids.push_back(shardOfHash(h));
+        size_t axis = 0;
+        for (; axis < dim && cells[axis] == last[axis]; axis++)
+            cells[axis] = first[axis];
+        if (axis == dim)
+            break;
+        cells[axis]++;
+    }
+    std::sort(ids.begin(), ids.end());
+    ids.erase(std::unique(ids.begin(), ids.end()), ids.end());
+}
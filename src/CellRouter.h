@@ -0,0 +1,35 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+/*
+ * Spatial key of sharded sets: space is split into cubic cells of cellSize and cells are hashed to shards,
+ * so vectors within tol <= cellSize from a pattern are kept by the few shards of the cells around it
+ */
+class CellRouter {
+public:
+    CellRouter(size_t shardCount, double cellSize);
+
+    size_t getShardCount() const;
+    double getCellSize() const;
+
+    size_t shardOf(double const* row, size_t dim) const;
+    /*
+     * Sorted ids of shards that may keep vectors within tol from pat
+     */
+    void candidateShards(double const* pat, size_t dim, double tol, std::vector<size_t>& ids) const;
+    /*
+     * Sorted ids of shards that may keep vectors inside of box [lower, upper]
+     */
+    void boxShards(double const* lower, double const* upper, size_t dim, std::vector<size_t>& ids) const;
+    void allShards(std::vector<size_t>& ids) const;
+
+private:
+    size_t _shardCount;
+    double _cellSize;
+
+    inline long long cellOf(double x) const;
+    static inline uint64_t mixCell(uint64_t h, long long cell);
+    inline size_t shardOfHash(uint64_t h) const;
+};
@@ -0,0 +1,57 @@
+#include "ChangeJournal.h"
+#include <algorithm>
+#include <new>
+
+ChangeJournal::ChangeJournal() :
+        _capacity(0),
+        _base(0){
+}
+
+size_t ChangeJournal::getCapacity() const {
+    return _capacity;
+}
+
+void ChangeJournal::setCapacity(size_t capacity, uint64_t version) {
+    _capacity = capacity;
+    while (_changes.size() > capacity){
+        _base = _changes.front().version;
+        _changes.pop_front();
+    }
+    if (capacity == 0)
+        _base = version;
+}
+
+void ChangeJournal::restart(uint64_t version) {
+    _changes.clear();
+    _base = version;
+}
+
+void ChangeJournal::record(ISetJournal::CHANGE kind, size_t hash, uint64_t version) {
+    if (_capacity == 0){
+        _base = version;
+        return;
+    }
+    if (_changes.size() >= _capacity){
+        _base = _changes.front().version;
+        _changes.pop_front();
+    }
+    try {
+        _changes.push_back(ISetJournal::Change{kind, version, hash});
+    }
+    catch (std::bad_alloc const&){
+        // consumers behind this change are reset
+        restart(version);
+    }
+}
+
+bool ChangeJournal::covers(uint64_t version) const {
+    return version >= _base;
+}
+
+void ChangeJournal::forEachSince(uint64_t version, std::function<void(ISetJournal::Change const&)> const& visit) const {
+    auto first = std::upper_bound(_changes.begin(), _changes.end(), version, [](uint64_t since, ISetJournal::Change const& change){
+        return since < change.version;
+    });
+    for (auto change = first; change != _changes.end(); ++change)
+        visit(*change);
+}
@@ -0,0 +1,48 @@
+#pragma once
+#include "../include/ISetJournal.h"
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+
+/*
+ * Last capacity changes of a set, stamped with the versions the set got from them. Every change made after the base
+ * version is kept, older ones are dropped when the journal overflows and consumers behind the base start over
+ */
+class ChangeJournal {
+public:
+    ChangeJournal();
+
+    size_t getCapacity() const;
+
+    /*
+     * Drops the oldest changes over capacity, journal of capacity 0 starts at version of the set
+     */
+    void setCapacity(size_t capacity, uint64_t version);
+
+    /*
+     * Drops every change, the journal starts at version
+     */
+    void restart(uint64_t version);
+
+    /*
+     * Appends change of vector with unique index hash made by the mutation that gives the set version,
+     * the journal restarts at version if memory can not be allocated
+     */
+    void record(ISetJournal::CHANGE kind, size_t hash, uint64_t version);
+
+    /*
+     * True if every change made after version is kept
+     */
+    bool covers(uint64_t version) const;
+
+    /*
+     * Calls visit for every change made after version in the order of changes
+     */
+    void forEachSince(uint64_t version, std::function<void(ISetJournal::Change const&)> const& visit) const;
+
+private:
+    std::deque<ISetJournal::Change> _changes;
+    size_t _capacity;
+    uint64_t _base;
+};
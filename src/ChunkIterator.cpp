@@ -0,0 +1,64 @@
+#include "ChunkIterator.h"
+#include <new>
+
+#define SendInfo(Logger, Code) if (Logger != nullptr) Logger->info((Code), __FILE__, __func__, __LINE__)
+
+ChunkIterator::ChunkIterator(size_t dim, Reader const& reader) :
+        _reader(reader),
+        _dim(dim),
+        _rows(nullptr),
+        _hashes(nullptr),
+        _count(0){
+}
+
+ChunkIterator* ChunkIterator::createIterator(size_t dim, Reader const& reader) {
+    ChunkIterator* it = nullptr;
+    try {
+        it = new ChunkIterator(dim, reader);
+    }
+    catch (std::bad_alloc const&){
+        SendInfo(ISet::getLogger(), RC::ALLOCATION_ERROR);
+        return nullptr;
+    }
+    RC rc = it->_reader(it->_rows, it->_hashes, it->_count);
+    if (rc != RC::SUCCESS){
+        SendInfo(ISet::getLogger(), rc);
+        delete it;
+        return nullptr;
+    }
+    return it;
+}
+
+RC ChunkIterator::next() {
+    if (_count == 0)
+        return RC::INDEX_OUT_OF_BOUND;
+    RC rc = _reader(_rows, _hashes, _count);
+    if (rc != RC::SUCCESS){
+        _count = 0;
+        SendInfo(ISet::getLogger(), rc);
+        return rc;
+    }
+    return _count != 0 ? RC::SUCCESS : RC::INDEX_OUT_OF_BOUND;
+}
+
+bool ChunkIterator::isValid() const {
+    return _count != 0;
+}
+
+double const* ChunkIterator::getRows() const {
+    return _count != 0 ? _rows : nullptr;
+}
+
+size_t const* ChunkIterator::getHashes() const {
+    return _count != 0 ? _hashes : nullptr;
+}
+
+size_t ChunkIterator::getCount() const {
+    return _count;
+}
+
+size_t ChunkIterator::getDim() const {
+    return _dim;
+}
+
+ChunkIterator::~ChunkIterator() = default;
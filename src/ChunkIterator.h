@@ -0,0 +1,40 @@
+#pragma once
+#include "../include/ISet.h"
+#include <functional>
+
+/*
+ * Chunk iterator of ISet implementations. Chunks are produced by the reader given by the set, it points rows and hashes
+ * at the next chunk, into the set storage or into a buffer it owns, and sets count to its size, 0 after the last chunk
+ */
+class ChunkIterator : public ISet::IChunkIterator {
+public:
+    typedef std::function<RC(double const*& rows, size_t const*& hashes, size_t& count)> Reader;
+
+    /*
+     * Iterator standing at the first chunk of reader, nullptr if it can not be read
+     */
+    static ChunkIterator* createIterator(size_t dim, Reader const& reader);
+
+    RC next() override;
+
+    bool isValid() const override;
+
+    double const* getRows() const override;
+
+    size_t const* getHashes() const override;
+
+    size_t getCount() const override;
+
+    size_t getDim() const override;
+
+    ~ChunkIterator() override;
+
+private:
+    Reader _reader;
+    size_t _dim;
+    double const* _rows;
+    size_t const* _hashes;
+    size_t _count;
+
+    ChunkIterator(size_t dim, Reader const& reader);
+};
@@ -0,0 +1,1674 @@
+#include "../include/ISet.h"
+#include "../include/ICompact.h"
+#include "SetKernels.h"
+#include "ScanPool.h"
+#include "SetSummary.h"
+#include "ChunkIterator.h"
+#include "CellRouter.h"
+#include <atomic>
+#include <mutex>
+#include <memory>
+#include <vector>
+#include <cstring>
+#include <cmath>
+#include <algorithm>
+#include <utility>
+
+#define SendInfo(Logger, Code) if (Logger != nullptr) Logger->info((Code), __FILE__, __func__, __LINE__)
+
+
+namespace{
+    size_t const chunkRows = 1024;
+    size_t const startChunkCapacity = 4;
+    double const defaultGarbageRatio = 0.25;
+    // batched lookups are split over ScanPool threads in parts of at least this many rows
+    size_t const batchPartRows = 64;
+
+    /*
+     * Epoch based reclamation: readers enter an epoch without locks, memory unlinked by writers
+     * is freed only when every reader that could see it has left its epoch
+     */
+    class EpochDomain {
+    public:
+        struct ThreadRecord {
+            std::atomic<uint64_t> epoch;
+            std::atomic<bool> active;
+            std::atomic<bool> inUse;
+            size_t nesting;
+        };
+
+        static EpochDomain& instance();
+
+        ThreadRecord* acquireRecord();
+        void releaseRecord(ThreadRecord* record);
+
+        void enter(ThreadRecord* record);
+        void leave(ThreadRecord* record);
+
+        void retire(void* ptr, void (*deleter)(void*));
+
+    private:
+        struct Retired {
+            void* ptr;
+            void (*deleter)(void*);
+            uint64_t epoch;
+        };
+
+        std::atomic<uint64_t> _epoch;
+        std::mutex _lock;
+        std::vector<ThreadRecord*> _records;
+        std::vector<Retired> _retired;
+
+        EpochDomain();
+        // the domain lives until the process exits, see instance
+        ~EpochDomain() = delete;
+
+        /*
+         * Called with _lock held
+         */
+        bool tryAdvance();
+        void reclaim();
+    };
+
+    /*
+     * Registers calling thread in EpochDomain once and keeps it in the epoch while alive
+     */
+    class EpochGuard {
+    public:
+        EpochGuard();
+        ~EpochGuard();
+
+    private:
+        struct Holder {
+            EpochDomain::ThreadRecord* record;
+            Holder();
+            ~Holder();
+        };
+
+        EpochDomain::ThreadRecord* _record;
+
+        EpochGuard(EpochGuard const&) = delete;
+        EpochGuard& operator=(EpochGuard const&) = delete;
+    };
+
+    class Chunk {
+    public:
+        double* rows;
+        size_t* hashes;
+        std::atomic<unsigned char>* alive;
+
+        static Chunk* create(size_t dim);
+        ~Chunk();
+
+    private:
+        Chunk();
+    };
+
+    /*
+     * Storage of a shard published to readers, only first count slots are visible
+     *
+     * Published rows are never rewritten: growth copies chunk table, compaction builds new state,
+     * replaced storage is retired to EpochDomain
+     */
+    class ShardState {
+    public:
+        Chunk** chunks;
+        size_t chunkCapacity;
+        std::atomic<size_t> count;
+
+        static ShardState* create(size_t chunkCapacity);
+        static void destroyTable(void* state);
+        static void destroyWithChunks(void* state);
+
+        inline double const* row(size_t slot, size_t dim) const;
+        inline size_t hash(size_t slot) const;
+        inline bool isAlive(size_t slot) const;
+
+        /*
+         * First slot with hash not less than hash
+         */
+        size_t lowerBound(size_t count, size_t hash) const;
+
+        ~ShardState();
+
+    private:
+        ShardState();
+    };
+
+    class Shard {
+    public:
+        std::mutex lock;
+        std::atomic<ShardState*> state;
+        std::atomic<size_t> alive;
+        /*
+         * Guarded by lock
+         */
+        size_t dead;
+        SetSummary summary;
+
+        Shard();
+    };
+
+    /*
+     * Shared by ConcurrentSet and its iterators, vectors are ordered shard by shard
+     * and by insertion inside of a shard
+     */
+    class SetCore {
+    public:
+        size_t const shardCount;
+        double const cellSize;
+        CellRouter const router;
+        std::unique_ptr<Shard[]> shards;
+        std::atomic<size_t> dim;
+        std::atomic<size_t> nextHash;
+        std::atomic<uint64_t> version;
+        std::atomic<double> garbageRatio;
+        std::atomic<bool> isValid;
+
+        SetCore(size_t shardCount, double cellSize);
+        ~SetCore();
+
+        bool adoptDim(size_t newDim);
+
+        size_t shardOf(double const* row) const;
+        /*
+         * Sorted ids of shards that may keep vectors within tol from pat
+         */
+        void candidateShards(double const* pat, double tol, std::vector<size_t>& ids) const;
+        /*
+         * Sorted ids of shards that may keep vectors inside of box [lower, upper]
+         */
+        void boxShards(double const* lower, double const* upper, std::vector<size_t>& ids) const;
+        void allShards(std::vector<size_t>& ids) const;
+        void lock(std::vector<size_t> const& ids);
+        void unlock(std::vector<size_t> const& ids);
+
+        /*
+         * Lookup methods must be called inside of EpochGuard
+         */
+        bool findInShard(size_t shard, double const* pat, IVector::NORM n, double tol, ShardState*& state, size_t& slot) const;
+        bool seekForward(size_t& shard, ShardState*& state, size_t& count, size_t& slot) const;
+        bool seekBackward(size_t& shard, ShardState*& state, size_t& count, size_t& slot) const;
+        bool locateIndex(size_t index, size_t& shard, ShardState*& state, size_t& slot) const;
+        size_t size() const;
+
+        /*
+         * Mutating methods must be called with the shard lock held
+         */
+        RC append(size_t shard, double const* row);
+        void markDead(size_t shard, size_t slot);
+        RC rebuild(size_t shard, std::function<bool(double const*, size_t)> const* pred);
+        RC collectGarbage(size_t shard);
+
+        /*
+         * Adds summaries of all shards to total, shard summaries that do not describe their shards are rebuilt.
+         * Must be called with all shard locks held, returns false if memory can not be allocated
+         */
+        bool summarize(SetSummary& total);
+    };
+
+    class ConcurrentIterator : public ISet::IIterator {
+    private:
+        std::shared_ptr<SetCore> _core;
+        double* _data;
+        size_t _dim;
+        size_t _shard;
+        size_t _slot;
+        size_t _hash;
+
+        ConcurrentIterator(std::shared_ptr<SetCore> core, size_t dim);
+
+        /*
+         * Loads position of the iterator, slot is moved to the successor if the vector was removed
+         */
+        inline bool relocate(ShardState*& state, size_t& count, size_t& slot) const;
+        inline void assign(size_t shard, ShardState const* state, size_t slot);
+        inline RC invalidate(RC rc);
+
+    public:
+        static ConcurrentIterator* create(std::shared_ptr<SetCore> core, size_t shard, ShardState const* state, size_t slot);
+
+        IIterator * getNext(size_t indexInc = 1) const override;
+        IIterator * getPrevious(size_t indexInc = 1) const override;
+        IIterator * clone() const override;
+
+        RC next(size_t indexInc = 1) override;
+        RC previous(size_t indexInc = 1) override;
+
+        bool isValid() const override;
+
+        RC makeBegin() override;
+        RC makeEnd() override;
+
+        RC getVectorCopy(IVector *& val) const override;
+        RC getVectorCoords(IVector * const& val) const override;
+
+        ~ConcurrentIterator() override;
+    };
+
+    /*
+     * ISet safe for concurrent use: space is split into cells of cellSize and cells are hashed
+     * to shards, writers lock only shards reachable within tol, readers take no locks
+     */
+    class ConcurrentSet : public ISet {
+    private:
+        std::shared_ptr<SetCore> _core;
+
+        explicit ConcurrentSet(std::shared_ptr<SetCore> core);
+
+        inline RC checkVector(IVector const* const& vec) const;
+        inline RC checkTol(double tol) const;
+
+        /*
+         * Summary of all vectors taken while writers are stopped
+         */
+        RC summarize(SetSummary& total) const;
+
+        RC insertRow(double const* row, IVector::NORM n, double tol);
+
+    public:
+        static ConcurrentSet* create(size_t shardCount, double cellSize);
+
+        ISet* clone() const override;
+
+        ISet const* snapshot() const override;
+
+        size_t getDim() const override;
+        size_t getSize() const override;
+
+        RC getCopy(size_t index, IVector *& val) const override;
+        RC findFirstAndCopy(IVector const * const& pat, IVector::NORM n, double tol, IVector *& val) const override;
+
+        RC getCoords(size_t index, IVector * const& val) const override;
+        RC findFirstAndCopyCoords(IVector const * const& pat, IVector::NORM n, double tol, IVector * const& val) const override;
+        RC findFirst(IVector const * const& pat, IVector::NORM n, double tol) const override;
+
+        /*
+         * Rows are looked up shard by shard, indices are counted over shards as they are after the lookups
+         */
+        RC findFirstMany(double const* patterns, size_t count, size_t dim, IVector::NORM n, double tol, size_t * const& indices) const override;
+
+        RC insert(IVector const * const& val, IVector::NORM n, double tol) override;
+
+        /*
+         * Rows of the batch are inserted one by one, every row locks only shards near it
+         */
+        RC insertBatch(double const* rows, size_t count, size_t dim, IVector::NORM n, double tol, size_t& inserted) override;
+
+        RC remove(size_t index) override;
+        RC remove(IVector const * const& pat, IVector::NORM n, double tol) override;
+        RC removeIf(std::function<bool(double const*, size_t)> const& pred) override;
+
+        using ISet::queryBox;
+
+        RC queryBox(ICompact const* const& box, std::function<void(double const*, size_t)> const& callback) const override;
+
+        RC setGarbageRatio(double ratio) override;
+        RC compact() override;
+
+        /*
+         * Every shard keeps its own summary, they are merged while all shards are locked
+         */
+        RC getBounds(IVector*& lower, IVector*& upper) const override;
+        RC getCentroid(IVector*& centroid) const override;
+        RC getVariance(IVector*& variance) const override;
+
+        uint64_t getVersion() const override;
+
+        RC sync() override;
+
+        IIterator *getIterator(size_t index) const override;
+        IIterator *getBegin() const override;
+        IIterator *getEnd() const override;
+
+        /*
+         * Chunks are copied shard by shard, the iterator continues after the last unique index it read,
+         * so like ConcurrentIterator it sees vectors inserted and removed meanwhile
+         */
+        IChunkIterator *getChunkIterator(size_t rowsPerChunk) const override;
+
+        /*
+         * Every shard is a part, chunks are runs of alive rows inside of storage chunks
+         */
+        RC forEachChunk(size_t rowsPerChunk, std::function<void(double const*, size_t const*, size_t, size_t)> const& callback) const override;
+
+        ~ConcurrentSet() override;
+    };
+}
+
+
+EpochDomain& EpochDomain::instance() {
+    /*
+     * Never destroyed: thread records are released by threads exiting after static destructors,
+     * ScanPool workers among them
+     */
+    static EpochDomain* domain = new EpochDomain;
+    return *domain;
+}
+
+EpochDomain::EpochDomain() :
+        _epoch(0){
+}
+
+EpochDomain::ThreadRecord* EpochDomain::acquireRecord() {
+    std::lock_guard<std::mutex> guard(_lock);
+    for (auto record : _records){
+        if (!record->inUse.load()){
+            record->inUse.store(true);
+            record->nesting = 0;
+            return record;
+        }
+    }
+    auto record = new(std::nothrow) ThreadRecord;
+    if (record == nullptr)
+        return nullptr;
+    record->epoch.store(0);
+    record->active.store(false);
+    record->inUse.store(true);
+    record->nesting = 0;
+    _records.push_back(record);
+    return record;
+}
+
+void EpochDomain::releaseRecord(ThreadRecord* record) {
+    std::lock_guard<std::mutex> guard(_lock);
+    record->active.store(false);
+    record->inUse.store(false);
+}
+
+void EpochDomain::enter(ThreadRecord* record) {
+    if (record->nesting++ != 0)
+        return;
+    /*
+     * Epoch is published before it is rechecked, so tryAdvance either sees this reader or the reader sees new epoch
+     */
+    uint64_t epoch = _epoch.load();
+    while (true){
+        record->epoch.store(epoch);
+        record->active.store(true);
+        uint64_t current = _epoch.load();
+        if (current == epoch)
+            break;
+        epoch = current;
+    }
+}
+
+void EpochDomain::leave(ThreadRecord* record) {
+    if (--record->nesting == 0)
+        record->active.store(false);
+}
+
+void EpochDomain::retire(void* ptr, void (*deleter)(void*)) {
+    if (ptr == nullptr)
+        return;
+    std::lock_guard<std::mutex> guard(_lock);
+    _retired.push_back(Retired{ptr, deleter, _epoch.load()});
+    tryAdvance();
+    reclaim();
+}
+
+bool EpochDomain::tryAdvance() {
+    uint64_t epoch = _epoch.load();
+    for (auto record : _records)
+        if (record->active.load() && record->epoch.load() != epoch)
+            return false;
+    _epoch.store(epoch + 1);
+    return true;
+}
+
+void EpochDomain::reclaim() {
+    uint64_t epoch = _epoch.load();
+    size_t kept = 0;
+    for (size_t i = 0; i < _retired.size(); i++){
+        /*
+         * Readers are at most one epoch behind global one, so after two advances nobody sees retired memory
+         */
+        if (_retired[i].epoch + 2 <= epoch)
+            _retired[i].deleter(_retired[i].ptr);
+        else
+            _retired[kept++] = _retired[i];
+    }
+    _retired.resize(kept);
+}
+
+EpochGuard::Holder::Holder() :
+        record(EpochDomain::instance().acquireRecord()){
+}
+
+EpochGuard::Holder::~Holder() {
+    if (record != nullptr)
+        EpochDomain::instance().releaseRecord(record);
+}
+
+EpochGuard::EpochGuard() {
+    static thread_local Holder holder;
+    _record = holder.record;
+    if (_record != nullptr)
+        EpochDomain::instance().enter(_record);
+}
+
+EpochGuard::~EpochGuard() {
+    if (_record != nullptr)
+        EpochDomain::instance().leave(_record);
+}
+
+
+Chunk::Chunk() :
+        rows(nullptr),
+        hashes(nullptr),
+        alive(nullptr){
+}
+
+Chunk* Chunk::create(size_t dim) {
+    auto chunk = new(std::nothrow) Chunk;
+    if (chunk == nullptr)
+        return nullptr;
+    chunk->rows = new(std::nothrow) double[chunkRows * dim];
+    chunk->hashes = new(std::nothrow) size_t[chunkRows];
+    chunk->alive = new(std::nothrow) std::atomic<unsigned char>[chunkRows];
+    if (chunk->rows == nullptr || chunk->hashes == nullptr || chunk->alive == nullptr){
+        delete chunk;
+        return nullptr;
+    }
+    return chunk;
+}
+
+Chunk::~Chunk() {
+    delete[] rows;
+    delete[] hashes;
+    delete[] alive;
+}
+
+
+ShardState::ShardState() :
+        chunks(nullptr),
+        chunkCapacity(0),
+        count(0){
+}
+
+ShardState* ShardState::create(size_t chunkCapacity) {
+    auto state = new(std::nothrow) ShardState;
+    if (state == nullptr)
+        return nullptr;
+    state->chunks = new(std::nothrow) Chunk*[chunkCapacity]();
+    if (state->chunks == nullptr){
+        delete state;
+        return nullptr;
+    }
+    state->chunkCapacity = chunkCapacity;
+    return state;
+}
+
+void ShardState::destroyTable(void* state) {
+    delete static_cast<ShardState*>(state);
+}
+
+void ShardState::destroyWithChunks(void* state) {
+    auto shardState = static_cast<ShardState*>(state);
+    if (shardState == nullptr)
+        return;
+    for (size_t i = 0; i < shardState->chunkCapacity; i++)
+        delete shardState->chunks[i];
+    delete shardState;
+}
+
+ShardState::~ShardState() {
+    delete[] chunks;
+}
+
+double const* ShardState::row(size_t slot, size_t dim) const {
+    return chunks[slot / chunkRows]->rows + (slot % chunkRows) * dim;
+}
+
+size_t ShardState::hash(size_t slot) const {
+    return chunks[slot / chunkRows]->hashes[slot % chunkRows];
+}
+
+bool ShardState::isAlive(size_t slot) const {
+    return chunks[slot / chunkRows]->alive[slot % chunkRows].load(std::memory_order_acquire) != 0;
+}
+
+size_t ShardState::lowerBound(size_t count, size_t hash) const {
+    size_t first = 0;
+    while (count > 0){
+        size_t half = count / 2;
+        if (this->hash(first + half) < hash){
+            first += half + 1;
+            count -= half + 1;
+        }
+        else
+            count = half;
+    }
+    return first;
+}
+
+
+Shard::Shard() :
+        state(nullptr),
+        alive(0),
+        dead(0){
+}
+
+
+SetCore::SetCore(size_t shardCount, double cellSize) :
+        shardCount(shardCount),
+        cellSize(cellSize),
+        router(shardCount, cellSize),
+        shards(new(std::nothrow) Shard[shardCount]),
+        dim(0),
+        nextHash(0),
+        version(0),
+        garbageRatio(defaultGarbageRatio),
+        isValid(true){
+    if (shards == nullptr)
+        return;
+    for (size_t i = 0; i < shardCount; i++){
+        ShardState* state = ShardState::create(startChunkCapacity);
+        if (state == nullptr){
+            shards.reset();
+            return;
+        }
+        shards[i].state.store(state);
+    }
+}
+
+SetCore::~SetCore() {
+    if (shards == nullptr)
+        return;
+    for (size_t i = 0; i < shardCount; i++)
+        ShardState::destroyWithChunks(shards[i].state.load());
+}
+
+bool SetCore::adoptDim(size_t newDim) {
+    size_t expected = 0;
+    return dim.compare_exchange_strong(expected, newDim) || expected == newDim;
+}
+
+size_t SetCore::shardOf(double const* row) const {
+    return router.shardOf(row, dim.load());
+}
+
+void SetCore::allShards(std::vector<size_t>& ids) const {
+    router.allShards(ids);
+}
+
+void SetCore::candidateShards(double const* pat, double tol, std::vector<size_t>& ids) const {
+    router.candidateShards(pat, dim.load(), tol, ids);
+}
+
+void SetCore::boxShards(double const* lower, double const* upper, std::vector<size_t>& ids) const {
+    router.boxShards(lower, upper, dim.load(), ids);
+}
+
+void SetCore::lock(std::vector<size_t> const& ids) {
+    for (size_t id : ids)
+        shards[id].lock.lock();
+}
+
+void SetCore::unlock(std::vector<size_t> const& ids) {
+    for (auto it = ids.rbegin(); it != ids.rend(); ++it)
+        shards[*it].lock.unlock();
+}
+
+size_t SetCore::size() const {
+    size_t res = 0;
+    for (size_t i = 0; i < shardCount; i++)
+        res += shards[i].alive.load();
+    return res;
+}
+
+bool SetCore::findInShard(size_t shard, double const* pat, IVector::NORM n, double tol, ShardState*& state, size_t& slot) const {
+    size_t rowDim = dim.load();
+    state = shards[shard].state.load();
+    size_t count = state->count.load();
+    kernel::RowComparer equal = kernel::rowComparer(rowDim, n);
+    for (slot = 0; slot < count; slot++)
+        if (state->isAlive(slot) && equal(rowDim, state->row(slot, rowDim), pat, tol))
+            return true;
+    return false;
+}
+
+bool SetCore::seekForward(size_t& shard, ShardState*& state, size_t& count, size_t& slot) const {
+    while (true){
+        for (; slot < count; slot++)
+            if (state->isAlive(slot))
+                return true;
+        if (++shard >= shardCount)
+            return false;
+        state = shards[shard].state.load();
+        count = state->count.load();
+        slot = 0;
+    }
+}
+
+bool SetCore::seekBackward(size_t& shard, ShardState*& state, size_t& count, size_t& slot) const {
+    while (true){
+        while (slot > 0)
+            if (state->isAlive(--slot))
+                return true;
+        if (shard == 0)
+            return false;
+        shard--;
+        state = shards[shard].state.load();
+        count = state->count.load();
+        slot = count;
+    }
+}
+
+bool SetCore::locateIndex(size_t index, size_t& shard, ShardState*& state, size_t& slot) const {
+    for (shard = 0; shard < shardCount; shard++){
+        state = shards[shard].state.load();
+        size_t count = state->count.load();
+        for (slot = 0; slot < count; slot++){
+            if (!state->isAlive(slot))
+                continue;
+            if (index == 0)
+                return true;
+            index--;
+        }
+    }
+    return false;
+}
+
+RC SetCore::append(size_t shard, double const* row) {
+    size_t rowDim = dim.load();
+    Shard& target = shards[shard];
+    ShardState* state = target.state.load();
+    size_t count = state->count.load(std::memory_order_relaxed);
+    size_t chunk = count / chunkRows;
+    if (chunk >= state->chunkCapacity){
+        ShardState* grown = ShardState::create(state->chunkCapacity * 2);
+        if (grown == nullptr)
+            return RC::ALLOCATION_ERROR;
+        std::memcpy(grown->chunks, state->chunks, state->chunkCapacity * sizeof(Chunk*));
+        grown->count.store(count);
+        target.state.store(grown);
+        EpochDomain::instance().retire(state, &ShardState::destroyTable);
+        state = grown;
+    }
+    if (state->chunks[chunk] == nullptr){
+        state->chunks[chunk] = Chunk::create(rowDim);
+        if (state->chunks[chunk] == nullptr)
+            return RC::ALLOCATION_ERROR;
+    }
+    size_t local = count % chunkRows;
+    Chunk* dst = state->chunks[chunk];
+    std::memcpy(dst->rows + local * rowDim, row, rowDim * sizeof(double));
+    dst->hashes[local] = nextHash.fetch_add(1);
+    dst->alive[local].store(1, std::memory_order_relaxed);
+    state->count.store(count + 1, std::memory_order_release);
+    if (target.summary.getDim() != rowDim)
+        target.summary.reset(rowDim);
+    if (target.summary.getDim() == rowDim)
+        target.summary.add(row);
+    target.alive.fetch_add(1);
+    version.fetch_add(1);
+    return RC::SUCCESS;
+}
+
+void SetCore::markDead(size_t shard, size_t slot) {
+    Shard& target = shards[shard];
+    ShardState* state = target.state.load();
+    if (target.summary.getDim() == dim.load())
+        target.summary.remove(state->row(slot, dim.load()));
+    state->chunks[slot / chunkRows]->alive[slot % chunkRows].store(0, std::memory_order_release);
+    target.alive.fetch_sub(1);
+    target.dead++;
+    version.fetch_add(1);
+}
+
+RC SetCore::collectGarbage(size_t shard) {
+    Shard& target = shards[shard];
+    size_t used = target.state.load()->count.load();
+    if (target.dead == 0 || static_cast<double>(target.dead) <= garbageRatio.load() * static_cast<double>(used))
+        return RC::SUCCESS;
+    return rebuild(shard, nullptr);
+}
+
+RC SetCore::rebuild(size_t shard, std::function<bool(double const*, size_t)> const* pred) {
+    size_t rowDim = dim.load();
+    Shard& target = shards[shard];
+    ShardState* state = target.state.load();
+    size_t count = state->count.load();
+    size_t alive = target.alive.load();
+
+    size_t chunkCapacity = std::max(startChunkCapacity, (alive + chunkRows - 1) / chunkRows);
+    ShardState* fresh = ShardState::create(chunkCapacity);
+    if (fresh == nullptr)
+        return RC::ALLOCATION_ERROR;
+
+    size_t kept = 0;
+    size_t removed = 0;
+    for (size_t slot = 0; slot < count; slot++){
+        if (!state->isAlive(slot))
+            continue;
+        double const* row = state->row(slot, rowDim);
+        if (pred != nullptr && (*pred)(row, rowDim)){
+            if (target.summary.getDim() == rowDim)
+                target.summary.remove(row);
+            removed++;
+            continue;
+        }
+        size_t chunk = kept / chunkRows;
+        if (fresh->chunks[chunk] == nullptr){
+            fresh->chunks[chunk] = Chunk::create(rowDim);
+            if (fresh->chunks[chunk] == nullptr){
+                ShardState::destroyWithChunks(fresh);
+                return RC::ALLOCATION_ERROR;
+            }
+        }
+        size_t local = kept % chunkRows;
+        std::memcpy(fresh->chunks[chunk]->rows + local * rowDim, row, rowDim * sizeof(double));
+        fresh->chunks[chunk]->hashes[local] = state->hash(slot);
+        fresh->chunks[chunk]->alive[local].store(1, std::memory_order_relaxed);
+        kept++;
+    }
+    fresh->count.store(kept);
+
+    target.state.store(fresh);
+    target.alive.store(kept);
+    target.dead = 0;
+    EpochDomain::instance().retire(state, &ShardState::destroyWithChunks);
+    if (removed != 0)
+        version.fetch_add(1);
+    return RC::SUCCESS;
+}
+
+bool SetCore::summarize(SetSummary& total) {
+    size_t rowDim = dim.load();
+    if (!total.reset(rowDim))
+        return false;
+    for (size_t id = 0; id < shardCount; id++){
+        Shard& shard = shards[id];
+        ShardState* state = shard.state.load();
+        size_t count = state->count.load();
+        if (shard.summary.getDim() != rowDim || shard.summary.getCount() != shard.alive.load()){
+            if (!shard.summary.reset(rowDim))
+                return false;
+            for (size_t slot = 0; slot < count; slot++)
+                if (state->isAlive(slot))
+                    shard.summary.add(state->row(slot, rowDim));
+        }
+        else if (shard.summary.boundsAreStale()){
+            shard.summary.clearBounds();
+            for (size_t slot = 0; slot < count; slot++)
+                if (state->isAlive(slot))
+                    shard.summary.extendBounds(state->row(slot, rowDim));
+        }
+        total.merge(shard.summary);
+    }
+    return true;
+}
+
+
+ConcurrentIterator::ConcurrentIterator(std::shared_ptr<SetCore> core, size_t dim) :
+        _core(std::move(core)),
+        _data(nullptr),
+        _dim(dim),
+        _shard(0),
+        _slot(0),
+        _hash(0){
+}
+
+ConcurrentIterator* ConcurrentIterator::create(std::shared_ptr<SetCore> core, size_t shard, ShardState const* state, size_t slot) {
+    size_t dim = core->dim.load();
+    auto it = new(std::nothrow) ConcurrentIterator(std::move(core), dim);
+    if (it == nullptr)
+        return nullptr;
+    it->_data = new(std::nothrow) double[dim];
+    if (it->_data == nullptr){
+        delete it;
+        return nullptr;
+    }
+    it->assign(shard, state, slot);
+    return it;
+}
+
+ConcurrentIterator::~ConcurrentIterator() {
+    delete[] _data;
+}
+
+bool ConcurrentIterator::relocate(ShardState*& state, size_t& count, size_t& slot) const {
+    state = _core->shards[_shard].state.load();
+    count = state->count.load();
+    if (_slot < count && state->hash(_slot) == _hash)
+        slot = _slot;
+    else
+        slot = state->lowerBound(count, _hash);
+    return slot < count && state->hash(slot) == _hash && state->isAlive(slot);
+}
+
+void ConcurrentIterator::assign(size_t shard, ShardState const* state, size_t slot) {
+    _shard = shard;
+    _slot = slot;
+    _hash = state->hash(slot);
+    std::memcpy(_data, state->row(slot, _dim), _dim * sizeof(double));
+}
+
+RC ConcurrentIterator::invalidate(RC rc) {
+    delete[] _data;
+    _data = nullptr;
+    SendInfo(ISet::getLogger(), rc);
+    return rc;
+}
+
+ISet::IIterator* ConcurrentIterator::getNext(size_t indexInc) const {
+    auto it = clone();
+    if (it == nullptr)
+        return nullptr;
+    if (it->next(indexInc) != RC::SUCCESS){
+        delete it;
+        return nullptr;
+    }
+    return it;
+}
+
+ISet::IIterator* ConcurrentIterator::getPrevious(size_t indexInc) const {
+    auto it = clone();
+    if (it == nullptr)
+        return nullptr;
+    if (it->previous(indexInc) != RC::SUCCESS){
+        delete it;
+        return nullptr;
+    }
+    return it;
+}
+
+ISet::IIterator* ConcurrentIterator::clone() const {
+    if (!isValid()){
+        SendInfo(ISet::getLogger(), RC::NULLPTR_ERROR);
+        return nullptr;
+    }
+    auto it = new(std::nothrow) ConcurrentIterator(_core, _dim);
+    if (it == nullptr)
+        return nullptr;
+    it->_data = new(std::nothrow) double[_dim];
+    if (it->_data == nullptr){
+        delete it;
+        return nullptr;
+    }
+    std::memcpy(it->_data, _data, _dim * sizeof(double));
+    it->_shard = _shard;
+    it->_slot = _slot;
+    it->_hash = _hash;
+    return it;
+}
+
+RC ConcurrentIterator::next(size_t indexInc) {
+    if (_data == nullptr)
+        return RC::INDEX_OUT_OF_BOUND;
+    if (!_core->isValid.load())
+        return invalidate(RC::SOURCE_SET_DESTROYED);
+    EpochGuard guard;
+    ShardState* state;
+    size_t count, slot;
+    size_t shard = _shard;
+    if (!relocate(state, count, slot)){
+        /*
+         * Vector of the iterator was removed, its successor is the first step
+         */
+        if (indexInc == 0)
+            return RC::SUCCESS;
+        if (!_core->seekForward(shard, state, count, slot))
+            return invalidate(RC::INDEX_OUT_OF_BOUND);
+        indexInc--;
+    }
+    for (; indexInc > 0; indexInc--){
+        slot++;
+        if (!_core->seekForward(shard, state, count, slot))
+            return invalidate(RC::INDEX_OUT_OF_BOUND);
+    }
+    assign(shard, state, slot);
+    return RC::SUCCESS;
+}
+
+RC ConcurrentIterator::previous(size_t indexInc) {
+    if (_data == nullptr)
+        return RC::INDEX_OUT_OF_BOUND;
+    if (!_core->isValid.load())
+        return invalidate(RC::SOURCE_SET_DESTROYED);
+    EpochGuard guard;
+    ShardState* state;
+    size_t count, slot;
+    size_t shard = _shard;
+    if (!relocate(state, count, slot) && indexInc == 0)
+        return RC::SUCCESS;
+    for (; indexInc > 0; indexInc--){
+        if (!_core->seekBackward(shard, state, count, slot))
+            return invalidate(RC::INDEX_OUT_OF_BOUND);
+    }
+    assign(shard, state, slot);
+    return RC::SUCCESS;
+}
+
+bool ConcurrentIterator::isValid() const {
+    return _data != nullptr && _core->isValid.load();
+}
+
+RC ConcurrentIterator::makeBegin() {
+    if (_data == nullptr)
+        return RC::INDEX_OUT_OF_BOUND;
+    if (!_core->isValid.load())
+        return invalidate(RC::SOURCE_SET_DESTROYED);
+    EpochGuard guard;
+    size_t shard = 0;
+    ShardState* state = _core->shards[0].state.load();
+    size_t count = state->count.load();
+    size_t slot = 0;
+    if (!_core->seekForward(shard, state, count, slot))
+        return invalidate(RC::SOURCE_SET_EMPTY);
+    assign(shard, state, slot);
+    return RC::SUCCESS;
+}
+
+RC ConcurrentIterator::makeEnd() {
+    if (_data == nullptr)
+        return RC::INDEX_OUT_OF_BOUND;
+    if (!_core->isValid.load())
+        return invalidate(RC::SOURCE_SET_DESTROYED);
+    EpochGuard guard;
+    size_t shard = _core->shardCount - 1;
+    ShardState* state = _core->shards[shard].state.load();
+    size_t count = state->count.load();
+    size_t slot = count;
+    if (!_core->seekBackward(shard, state, count, slot))
+        return invalidate(RC::SOURCE_SET_EMPTY);
+    assign(shard, state, slot);
+    return RC::SUCCESS;
+}
+
+RC ConcurrentIterator::getVectorCopy(IVector *&val) const {
+    if (!isValid()){
+        SendInfo(ISet::getLogger(), RC::SOURCE_SET_DESTROYED);
+        return RC::SOURCE_SET_DESTROYED;
+    }
+    val = IVector::createVector(_dim, _data);
+    if (val == nullptr){
+        SendInfo(ISet::getLogger(), RC::ALLOCATION_ERROR);
+        return RC::ALLOCATION_ERROR;
+    }
+    return RC::SUCCESS;
+}
+
+RC ConcurrentIterator::getVectorCoords(IVector *const &val) const {
+    if (!isValid()){
+        SendInfo(ISet::getLogger(), RC::SOURCE_SET_DESTROYED);
+        return RC::SOURCE_SET_DESTROYED;
+    }
+    if (val == nullptr){
+        SendInfo(ISet::getLogger(), RC::NULLPTR_ERROR);
+        return RC::NULLPTR_ERROR;
+    }
+    return val->setData(_dim, _data);
+}
+
+
+ConcurrentSet::ConcurrentSet(std::shared_ptr<SetCore> core) :
+        _core(std::move(core)){
+}
+
+ConcurrentSet* ConcurrentSet::create(size_t shardCount, double cellSize) {
+    std::shared_ptr<SetCore> core(new(std::nothrow) SetCore(shardCount, cellSize));
+    if (core == nullptr || core->shards == nullptr)
+        return nullptr;
+    return new(std::nothrow) ConcurrentSet(core);
+}
+
+ConcurrentSet::~ConcurrentSet() {
+    _core->isValid.store(false);
+}
+
+RC ConcurrentSet::checkVector(IVector const* const& vec) const {
+    if (vec == nullptr){
+        SendInfo(ISet::getLogger(), RC::NULLPTR_ERROR);
+        return RC::NULLPTR_ERROR;
+    }
+    if (vec->getDim() != _core->dim.load()){
+        SendInfo(ISet::getLogger(), RC::MISMATCHING_DIMENSIONS);
+        return RC::MISMATCHING_DIMENSIONS;
+    }
+    if (vec->getData() == nullptr){
+        SendInfo(ISet::getLogger(), RC::NULLPTR_ERROR);
+        return RC::NULLPTR_ERROR;
+    }
+    return RC::SUCCESS;
+}
+
+RC ConcurrentSet::checkTol(double tol) const {
+    if (std::isnan(tol) || tol < 0.){
+        SendInfo(ISet::getLogger(), RC::INVALID_ARGUMENT);
+        return RC::INVALID_ARGUMENT;
+    }
+    return RC::SUCCESS;
+}
+
+ISet* ConcurrentSet::clone() const {
+    auto res = ConcurrentSet::create(_core->shardCount, _core->cellSize);
+    if (res == nullptr){
+        SendInfo(ISet::getLogger(), RC::ALLOCATION_ERROR);
+        return nullptr;
+    }
+    SetCore& dst = *res->_core;
+    size_t dim = _core->dim.load();
+    dst.dim.store(dim);
+    dst.garbageRatio.store(_core->garbageRatio.load());
+    EpochGuard guard;
+    for (size_t shard = 0; shard < _core->shardCount; shard++){
+        ShardState* state = _core->shards[shard].state.load();
+        size_t count = state->count.load();
+        for (size_t slot = 0; slot < count; slot++){
+            if (!state->isAlive(slot))
+                continue;
+            if (dst.append(shard, state->row(slot, dim)) != RC::SUCCESS){
+                delete res;
+                SendInfo(ISet::getLogger(), RC::ALLOCATION_ERROR);
+                return nullptr;
+            }
+        }
+    }
+    return res;
+}
+
+ISet const* ConcurrentSet::snapshot() const {
+    /*
+     * Shard storage is not shared with another set, so the snapshot is a copy taken while writers are stopped
+     */
+    std::vector<size_t> ids;
+    _core->allShards(ids);
+    _core->lock(ids);
+    ISet const* res = clone();
+    _core->unlock(ids);
+    return res;
+}
+
+size_t ConcurrentSet::getDim() const {
+    return _core->dim.load();
+}
+
+size_t ConcurrentSet::getSize() const {
+    return _core->size();
+}
+
+RC ConcurrentSet::getCopy(size_t index, IVector *&val) const {
+    EpochGuard guard;
+    size_t shard, slot;
+    ShardState* state;
+    if (!_core->locateIndex(index, shard, state, slot)){
+        SendInfo(ISet::getLogger(), RC::INDEX_OUT_OF_BOUND);
+        return RC::INDEX_OUT_OF_BOUND;
+    }
+    val = IVector::createVector(_core->dim.load(), state->row(slot, _core->dim.load()));
+    if (val == nullptr){
+        SendInfo(ISet::getLogger(), RC::ALLOCATION_ERROR);
+        return RC::ALLOCATION_ERROR;
+    }
+    return RC::SUCCESS;
+}
+
+RC ConcurrentSet::getCoords(size_t index, IVector *const &val) const {
+    RC rc = checkVector(val);
+    if (rc != RC::SUCCESS)
+        return rc;
+    EpochGuard guard;
+    size_t shard, slot;
+    ShardState* state;
+    if (!_core->locateIndex(index, shard, state, slot)){
+        SendInfo(ISet::getLogger(), RC::INDEX_OUT_OF_BOUND);
+        return RC::INDEX_OUT_OF_BOUND;
+    }
+    size_t dim = _core->dim.load();
+    return val->setData(dim, state->row(slot, dim));
+}
+
+RC ConcurrentSet::findFirst(IVector const *const &pat, IVector::NORM n, double tol) const {
+    RC rc = checkVector(pat);
+    if (rc == RC::SUCCESS)
+        rc = checkTol(tol);
+    if (rc != RC::SUCCESS)
+        return rc;
+    std::vector<size_t> ids;
+    _core->candidateShards(pat->getData(), tol, ids);
+    EpochGuard guard;
+    ShardState* state;
+    size_t slot;
+    for (size_t id : ids)
+        if (_core->findInShard(id, pat->getData(), n, tol, state, slot))
+            return RC::SUCCESS;
+    return RC::VECTOR_NOT_FOUND;
+}
+
+RC ConcurrentSet::findFirstAndCopy(IVector const *const &pat, IVector::NORM n, double tol, IVector *&val) const {
+    RC rc = checkVector(pat);
+    if (rc == RC::SUCCESS)
+        rc = checkTol(tol);
+    if (rc != RC::SUCCESS)
+        return rc;
+    std::vector<size_t> ids;
+    _core->candidateShards(pat->getData(), tol, ids);
+    EpochGuard guard;
+    ShardState* state;
+    size_t slot;
+    for (size_t id : ids){
+        if (_core->findInShard(id, pat->getData(), n, tol, state, slot)){
+            size_t dim = _core->dim.load();
+            val = IVector::createVector(dim, state->row(slot, dim));
+            if (val == nullptr){
+                SendInfo(ISet::getLogger(), RC::ALLOCATION_ERROR);
+                return RC::ALLOCATION_ERROR;
+            }
+            return RC::SUCCESS;
+        }
+    }
+    return RC::VECTOR_NOT_FOUND;
+}
+
+RC ConcurrentSet::findFirstAndCopyCoords(IVector const *const &pat, IVector::NORM n, double tol, IVector *const &val) const {
+    RC rc = checkVector(pat);
+    if (rc == RC::SUCCESS)
+        rc = checkVector(val);
+    if (rc == RC::SUCCESS)
+        rc = checkTol(tol);
+    if (rc != RC::SUCCESS)
+        return rc;
+    std::vector<size_t> ids;
+    _core->candidateShards(pat->getData(), tol, ids);
+    EpochGuard guard;
+    ShardState* state;
+    size_t slot;
+    for (size_t id : ids){
+        if (_core->findInShard(id, pat->getData(), n, tol, state, slot)){
+            size_t dim = _core->dim.load();
+            return val->setData(dim, state->row(slot, dim));
+        }
+    }
+    return RC::VECTOR_NOT_FOUND;
+}
+
+RC ConcurrentSet::findFirstMany(double const* patterns, size_t count, size_t dim, IVector::NORM n, double tol, size_t * const& indices) const {
+    if (count == 0)
+        return RC::SUCCESS;
+    if (patterns == nullptr || indices == nullptr){
+        SendInfo(ISet::getLogger(), RC::NULLPTR_ERROR);
+        return RC::NULLPTR_ERROR;
+    }
+    RC rc = checkTol(tol);
+    if (rc != RC::SUCCESS)
+        return rc;
+    if (dim != _core->dim.load()){
+        SendInfo(ISet::getLogger(), RC::MISMATCHING_DIMENSIONS);
+        return RC::MISMATCHING_DIMENSIONS;
+    }
+    // (shard, slot) of the match of every row, shardCount if there is none
+    std::vector<std::pair<size_t, size_t>> order, found;
+    try {
+        order.resize(count);
+        found.resize(count);
+    }
+    catch (std::bad_alloc const&){
+        SendInfo(ISet::getLogger(), RC::ALLOCATION_ERROR);
+        return RC::ALLOCATION_ERROR;
+    }
+    for (size_t k = 0; k < count; k++)
+        order[k] = std::make_pair(_core->shardOf(patterns + k * dim), k);
+    std::sort(order.begin(), order.end());
+
+    ScanPool& pool = ScanPool::instance();
+    size_t parts = std::max(size_t(1), std::min(pool.getThreadCount(), count / batchPartRows));
+    size_t partRows = (count + parts - 1) / parts;
+    std::atomic<bool> failed(false);
+    pool.run(parts, [&](size_t part){
+        EpochGuard guard;
+        std::vector<size_t> ids;
+        ShardState* state;
+        size_t slot;
+        try {
+            for (size_t k = part * partRows; k < std::min(count, (part + 1) * partRows); k++){
+                size_t row = order[k].second;
+                found[row] = std::make_pair(_core->shardCount, size_t(0));
+                _core->candidateShards(patterns + row * dim, tol, ids);
+                for (size_t id : ids){
+                    if (_core->findInShard(id, patterns + row * dim, n, tol, state, slot)){
+                        found[row] = std::make_pair(id, slot);
+                        break;
+                    }
+                }
+            }
+        }
+        catch (std::bad_alloc const&){
+            failed.store(true);
+        }
+    });
+    if (failed.load()){
+        SendInfo(ISet::getLogger(), RC::ALLOCATION_ERROR);
+        return RC::ALLOCATION_ERROR;
+    }
+
+    // one walk over the shards counts alive vectors before every match
+    std::sort(order.begin(), order.end(), [&found](std::pair<size_t, size_t> const& a, std::pair<size_t, size_t> const& b){
+        return found[a.second] < found[b.second];
+    });
+    EpochGuard guard;
+    size_t size = _core->size();
+    size_t shard = 0, slot = 0, index = 0;
+    ShardState* state = _core->shards[0].state.load();
+    size_t used = state->count.load();
+    for (auto const& entry : order){
+        std::pair<size_t, size_t> const& match = found[entry.second];
+        if (match.first == _core->shardCount){
+            indices[entry.second] = size;
+            continue;
+        }
+        while (shard < match.first || (shard == match.first && slot < match.second && slot < used)){
+            if (slot < used){
+                if (state->isAlive(slot))
+                    index++;
+                slot++;
+                continue;
+            }
+            state = _core->shards[++shard].state.load();
+            used = state->count.load();
+            slot = 0;
+        }
+        indices[entry.second] = index;
+    }
+    return RC::SUCCESS;
+}
+
+RC ConcurrentSet::insert(IVector const *const &val, IVector::NORM n, double tol) {
+    if (val != nullptr && val->getDim() != 0 && !_core->adoptDim(val->getDim())){
+        SendInfo(ISet::getLogger(), RC::MISMATCHING_DIMENSIONS);
+        return RC::MISMATCHING_DIMENSIONS;
+    }
+    RC rc = checkVector(val);
+    if (rc == RC::SUCCESS)
+        rc = checkTol(tol);
+    if (rc != RC::SUCCESS)
+        return rc;
+
+    return insertRow(val->getData(), n, tol);
+}
+
+RC ConcurrentSet::insertBatch(double const* rows, size_t count, size_t dim, IVector::NORM n, double tol, size_t& inserted) {
+    inserted = 0;
+    if (count == 0)
+        return RC::SUCCESS;
+    if (rows == nullptr){
+        SendInfo(ISet::getLogger(), RC::NULLPTR_ERROR);
+        return RC::NULLPTR_ERROR;
+    }
+    if (dim == 0 || !_core->adoptDim(dim)){
+        SendInfo(ISet::getLogger(), RC::MISMATCHING_DIMENSIONS);
+        return RC::MISMATCHING_DIMENSIONS;
+    }
+    RC rc = checkTol(tol);
+    for (size_t i = 0; i < count && rc == RC::SUCCESS; i++){
+        rc = insertRow(rows + i * dim, n, tol);
+        if (rc == RC::SUCCESS)
+            inserted++;
+        else if (rc == RC::VECTOR_ALREADY_EXIST)
+            rc = RC::SUCCESS;
+    }
+    return rc;
+}
+
+RC ConcurrentSet::insertRow(double const* row, IVector::NORM n, double tol) {
+    std::vector<size_t> ids;
+    _core->candidateShards(row, tol, ids);
+    _core->lock(ids);
+    {
+        EpochGuard guard;
+        ShardState* state;
+        size_t slot;
+        for (size_t id : ids){
+            if (_core->findInShard(id, row, n, tol, state, slot)){
+                _core->unlock(ids);
+                return RC::VECTOR_ALREADY_EXIST;
+            }
+        }
+    }
+    RC rc = _core->append(_core->shardOf(row), row);
+    _core->unlock(ids);
+    if (rc != RC::SUCCESS)
+        SendInfo(ISet::getLogger(), rc);
+    return rc;
+}
+
+RC ConcurrentSet::remove(size_t index) {
+    std::vector<size_t> ids;
+    _core->allShards(ids);
+    _core->lock(ids);
+    size_t shard, slot;
+    ShardState* state;
+    RC rc = RC::SUCCESS;
+    if (_core->locateIndex(index, shard, state, slot)){
+        _core->markDead(shard, slot);
+        rc = _core->collectGarbage(shard);
+    }
+    else
+        rc = RC::INDEX_OUT_OF_BOUND;
+    _core->unlock(ids);
+    if (rc != RC::SUCCESS)
+        SendInfo(ISet::getLogger(), rc);
+    return rc;
+}
+
+RC ConcurrentSet::remove(IVector const *const &pat, IVector::NORM n, double tol) {
+    RC rc = checkVector(pat);
+    if (rc == RC::SUCCESS)
+        rc = checkTol(tol);
+    if (rc != RC::SUCCESS)
+        return rc;
+    std::vector<size_t> ids;
+    _core->candidateShards(pat->getData(), tol, ids);
+    _core->lock(ids);
+    ShardState* state;
+    size_t slot;
+    rc = RC::VECTOR_NOT_FOUND;
+    for (size_t id : ids){
+        if (_core->findInShard(id, pat->getData(), n, tol, state, slot)){
+            _core->markDead(id, slot);
+            rc = _core->collectGarbage(id);
+            break;
+        }
+    }
+    _core->unlock(ids);
+    if (rc != RC::SUCCESS)
+        SendInfo(ISet::getLogger(), rc);
+    return rc;
+}
+
+RC ConcurrentSet::removeIf(std::function<bool(double const*, size_t)> const& pred) {
+    if (!pred){
+        SendInfo(ISet::getLogger(), RC::NULLPTR_ERROR);
+        return RC::NULLPTR_ERROR;
+    }
+    std::vector<size_t> ids;
+    _core->allShards(ids);
+    _core->lock(ids);
+    RC rc = RC::SUCCESS;
+    for (size_t id = 0; id < _core->shardCount && rc == RC::SUCCESS; id++)
+        rc = _core->rebuild(id, &pred);
+    _core->unlock(ids);
+    if (rc != RC::SUCCESS)
+        SendInfo(ISet::getLogger(), rc);
+    return rc;
+}
+
+RC ConcurrentSet::queryBox(ICompact const* const& box, std::function<void(double const*, size_t)> const& callback) const {
+    if (box == nullptr || !callback){
+        SendInfo(ISet::getLogger(), RC::NULLPTR_ERROR);
+        return RC::NULLPTR_ERROR;
+    }
+    size_t dim = _core->dim.load();
+    if (dim == 0)
+        return RC::SUCCESS;
+    if (box->getDim() != dim){
+        SendInfo(ISet::getLogger(), RC::MISMATCHING_DIMENSIONS);
+        return RC::MISMATCHING_DIMENSIONS;
+    }
+    IVector* lowerVec = nullptr;
+    IVector* upperVec = nullptr;
+    RC rc = box->getLeftBoundary(lowerVec);
+    if (rc == RC::SUCCESS)
+        rc = box->getRightBoundary(upperVec);
+    if (rc != RC::SUCCESS){
+        delete lowerVec;
+        SendInfo(ISet::getLogger(), rc);
+        return rc;
+    }
+    double const* lower = lowerVec->getData();
+    double const* upper = upperVec->getData();
+    std::vector<size_t> ids;
+    _core->boxShards(lower, upper, ids);
+    {
+        EpochGuard guard;
+        for (size_t id : ids){
+            ShardState* state = _core->shards[id].state.load();
+            size_t count = state->count.load();
+            for (size_t slot = 0; slot < count; slot++){
+                if (!state->isAlive(slot))
+                    continue;
+                double const* row = state->row(slot, dim);
+                size_t i = 0;
+                for (; i < dim && lower[i] <= row[i] && row[i] <= upper[i]; i++);
+                if (i == dim)
+                    callback(row, dim);
+            }
+        }
+    }
+    delete lowerVec;
+    delete upperVec;
+    return RC::SUCCESS;
+}
+
+RC ConcurrentSet::setGarbageRatio(double ratio) {
+    if (std::isnan(ratio) || ratio < 0. || ratio > 1.){
+        SendInfo(ISet::getLogger(), RC::INVALID_ARGUMENT);
+        return RC::INVALID_ARGUMENT;
+    }
+    std::vector<size_t> ids;
+    _core->allShards(ids);
+    _core->lock(ids);
+    _core->garbageRatio.store(ratio);
+    RC rc = RC::SUCCESS;
+    for (size_t id = 0; id < _core->shardCount && rc == RC::SUCCESS; id++)
+        rc = _core->collectGarbage(id);
+    _core->unlock(ids);
+    return rc;
+}
+
+RC ConcurrentSet::compact() {
+    std::vector<size_t> ids;
+    _core->allShards(ids);
+    _core->lock(ids);
+    RC rc = RC::SUCCESS;
+    for (size_t id = 0; id < _core->shardCount && rc == RC::SUCCESS; id++)
+        if (_core->shards[id].dead != 0)
+            rc = _core->rebuild(id, nullptr);
+    _core->unlock(ids);
+    return rc;
+}
+
+RC ConcurrentSet::summarize(SetSummary& total) const {
+    if (_core->size() == 0)
+        return RC::SOURCE_SET_EMPTY;
+    std::vector<size_t> ids;
+    _core->allShards(ids);
+    _core->lock(ids);
+    bool summarized = _core->summarize(total);
+    _core->unlock(ids);
+    if (!summarized){
+        SendInfo(ISet::getLogger(), RC::ALLOCATION_ERROR);
+        return RC::ALLOCATION_ERROR;
+    }
+    // every vector could be removed before the shards were locked
+    return total.getCount() == 0 ? RC::SOURCE_SET_EMPTY : RC::SUCCESS;
+}
+
+RC ConcurrentSet::getBounds(IVector*& lower, IVector*& upper) const {
+    SetSummary total;
+    RC rc = summarize(total);
+    if (rc != RC::SUCCESS)
+        return rc;
+    IVector* lowerVec = IVector::createVector(total.getDim(), total.getLower());
+    IVector* upperVec = IVector::createVector(total.getDim(), total.getUpper());
+    if (lowerVec == nullptr || upperVec == nullptr){
+        delete lowerVec;
+        delete upperVec;
+        SendInfo(ISet::getLogger(), RC::ALLOCATION_ERROR);
+        return RC::ALLOCATION_ERROR;
+    }
+    lower = lowerVec;
+    upper = upperVec;
+    return RC::SUCCESS;
+}
+
+RC ConcurrentSet::getCentroid(IVector*& centroid) const {
+    SetSummary total;
+    RC rc = summarize(total);
+    if (rc != RC::SUCCESS)
+        return rc;
+    IVector* mean = IVector::createVector(total.getDim(), total.getMean());
+    if (mean == nullptr){
+        SendInfo(ISet::getLogger(), RC::ALLOCATION_ERROR);
+        return RC::ALLOCATION_ERROR;
+    }
+    centroid = mean;
+    return RC::SUCCESS;
+}
+
+RC ConcurrentSet::getVariance(IVector*& variance) const {
+    SetSummary total;
+    RC rc = summarize(total);
+    if (rc != RC::SUCCESS)
+        return rc;
+    std::vector<double> coords(total.getDim());
+    total.getVariance(coords.data());
+    IVector* spread = IVector::createVector(total.getDim(), coords.data());
+    if (spread == nullptr){
+        SendInfo(ISet::getLogger(), RC::ALLOCATION_ERROR);
+        return RC::ALLOCATION_ERROR;
+    }
+    variance = spread;
+    return RC::SUCCESS;
+}
+
+uint64_t ConcurrentSet::getVersion() const {
+    return _core->version.load();
+}
+
+RC ConcurrentSet::sync() {
+    return RC::SUCCESS;
+}
+
+ISet::IIterator* ConcurrentSet::getIterator(size_t index) const {
+    EpochGuard guard;
+    size_t shard, slot;
+    ShardState* state;
+    if (!_core->locateIndex(index, shard, state, slot)){
+        SendInfo(ISet::getLogger(), RC::INDEX_OUT_OF_BOUND);
+        return nullptr;
+    }
+    return ConcurrentIterator::create(_core, shard, state, slot);
+}
+
+ISet::IIterator* ConcurrentSet::getBegin() const {
+    EpochGuard guard;
+    size_t shard = 0;
+    ShardState* state = _core->shards[0].state.load();
+    size_t count = state->count.load();
+    size_t slot = 0;
+    if (!_core->seekForward(shard, state, count, slot)){
+        SendInfo(ISet::getLogger(), RC::SOURCE_SET_EMPTY);
+        return nullptr;
+    }
+    return ConcurrentIterator::create(_core, shard, state, slot);
+}
+
+ISet::IIterator* ConcurrentSet::getEnd() const {
+    EpochGuard guard;
+    size_t shard = _core->shardCount - 1;
+    ShardState* state = _core->shards[shard].state.load();
+    size_t count = state->count.load();
+    size_t slot = count;
+    if (!_core->seekBackward(shard, state, count, slot)){
+        SendInfo(ISet::getLogger(), RC::SOURCE_SET_EMPTY);
+        return nullptr;
+    }
+    return ConcurrentIterator::create(_core, shard, state, slot);
+}
+
+ISet::IChunkIterator* ConcurrentSet::getChunkIterator(size_t rowsPerChunk) const {
+    if (rowsPerChunk == 0){
+        SendInfo(ISet::getLogger(), RC::INVALID_ARGUMENT);
+        return nullptr;
+    }
+    if (_core->size() == 0){
+        SendInfo(ISet::getLogger(), RC::SOURCE_SET_EMPTY);
+        return nullptr;
+    }
+    // buffers hold at most the vectors the set has now, later chunks are only shorter
+    rowsPerChunk = std::min(rowsPerChunk, _core->size());
+    size_t dim = _core->dim.load();
+    std::shared_ptr<std::vector<double>> rowBuffer;
+    std::shared_ptr<std::vector<size_t>> hashBuffer;
+    try {
+        rowBuffer = std::make_shared<std::vector<double>>(rowsPerChunk * dim);
+        hashBuffer = std::make_shared<std::vector<size_t>>(rowsPerChunk);
+    }
+    catch (std::bad_alloc const&){
+        SendInfo(ISet::getLogger(), RC::ALLOCATION_ERROR);
+        return nullptr;
+    }
+    std::shared_ptr<SetCore> core = _core;
+    size_t shard = 0, hash = 0;
+    return ChunkIterator::createIterator(dim, [core, rowBuffer, hashBuffer, shard, hash, rowsPerChunk, dim](double const*& rows, size_t const*& hashes, size_t& count) mutable {
+        if (!core->isValid.load())
+            return RC::SOURCE_SET_DESTROYED;
+        EpochGuard guard;
+        count = 0;
+        while (count < rowsPerChunk && shard < core->shardCount){
+            ShardState* state = core->shards[shard].state.load();
+            size_t used = state->count.load();
+            size_t slot = state->lowerBound(used, hash);
+            for (; slot < used && count < rowsPerChunk; slot++){
+                if (!state->isAlive(slot))
+                    continue;
+                std::memcpy(rowBuffer->data() + count * dim, state->row(slot, dim), dim * sizeof(double));
+                (*hashBuffer)[count++] = state->hash(slot);
+            }
+            if (slot < used){
+                hash = state->hash(slot);
+                kernel::prefetch(state->row(slot, dim), std::min(rowsPerChunk, chunkRows - slot % chunkRows) * dim * sizeof(double));
+                break;
+            }
+            shard++;
+            hash = 0;
+        }
+        rows = rowBuffer->data();
+        hashes = hashBuffer->data();
+        return RC::SUCCESS;
+    });
+}
+
+RC ConcurrentSet::forEachChunk(size_t rowsPerChunk, std::function<void(double const*, size_t const*, size_t, size_t)> const& callback) const {
+    if (!callback){
+        SendInfo(ISet::getLogger(), RC::NULLPTR_ERROR);
+        return RC::NULLPTR_ERROR;
+    }
+    if (rowsPerChunk == 0){
+        SendInfo(ISet::getLogger(), RC::INVALID_ARGUMENT);
+        return RC::INVALID_ARGUMENT;
+    }
+    size_t dim = _core->dim.load();
+    ScanPool::instance().run(_core->shardCount, [&](size_t shard){
+        EpochGuard guard;
+        ShardState* state = _core->shards[shard].state.load();
+        size_t used = state->count.load();
+        for (size_t slot = 0; slot < used;){
+            if (!state->isAlive(slot)){
+                slot++;
+                continue;
+            }
+            // rows of a run are adjacent in one storage chunk
+            size_t last = std::min(used, (slot / chunkRows + 1) * chunkRows);
+            if (last - slot > rowsPerChunk)
+                last = slot + rowsPerChunk;
+            size_t end = slot + 1;
+            for (; end < last && state->isAlive(end); end++);
+            if (end < used)
+                kernel::prefetch(state->row(end, dim), std::min(rowsPerChunk, chunkRows - end % chunkRows) * dim * sizeof(double));
+            callback(state->row(slot, dim), state->chunks[slot / chunkRows]->hashes + slot % chunkRows, end - slot, dim);
+            slot = end;
+        }
+    });
+    return RC::SUCCESS;
+}
+
+LIB_EXPORT ISet* ISet::createConcurrentSet(size_t shardCount, double cellSize) {
+    if (shardCount == 0 || std::isnan(cellSize) || std::isinf(cellSize) || cellSize <= 0.){
+        SendInfo(ISet::getLogger(), RC::INVALID_ARGUMENT);
+        return nullptr;
+    }
+    return ConcurrentSet::create(shardCount, cellSize);
+}
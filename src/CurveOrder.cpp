@@ -0,0 +1,45 @@
+#include "CurveOrder.h"
+#include "SetKernels.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <utility>
+
+namespace{
+    size_t const wordBits = 64;
+    // batched patterns are ordered along the Morton curve over at most this many widest axes
+    size_t const curveMaxAxes = 64;
+}
+
+void curveOrder(double const* rows, size_t count, size_t dim, std::vector<size_t>& order){
+    std::vector<double> lower(rows, rows + dim), upper(lower);
+    for (size_t k = 1; k < count; k++){
+        for (size_t i = 0; i < dim; i++){
+            lower[i] = std::min(lower[i], rows[k * dim + i]);
+            upper[i] = std::max(upper[i], rows[k * dim + i]);
+        }
+    }
+    std::vector<size_t> axes(dim);
+    for (size_t i = 0; i < dim; i++)
+        axes[i] = i;
+    std::stable_sort(axes.begin(), axes.end(), [&lower, &upper](size_t a, size_t b){
+        return upper[a] - lower[a] > upper[b] - lower[b];
+    });
+    axes.resize(std::min(dim, curveMaxAxes));
+    std::vector<uint32_t> cells(axes.size());
+    size_t bits = std::min(size_t(32), wordBits / axes.size());
+    double top = std::ldexp(1., static_cast<int>(bits)) - 1.;
+    std::vector<std::pair<uint64_t, size_t>> keys(count);
+    for (size_t k = 0; k < count; k++){
+        for (size_t i = 0; i < axes.size(); i++){
+            double span = upper[axes[i]] - lower[axes[i]];
+            double cell = span > 0. ? std::floor((rows[k * dim + axes[i]] - lower[axes[i]]) / span * top) : 0.;
+            cells[i] = cell >= top ? static_cast<uint32_t>(top) : cell > 0. ? static_cast<uint32_t>(cell) : 0;
+        }
+        keys[k] = std::make_pair(kernel::mortonKey(axes.size(), cells.data(), bits), k);
+    }
+    std::sort(keys.begin(), keys.end());
+    order.resize(count);
+    for (size_t k = 0; k < count; k++)
+        order[k] = keys[k].second;
+}
@@ -0,0 +1,9 @@
+#pragma once
+#include <cstddef>
+#include <vector>
+
+/*
+ * Fills order with numbers of count rows sorted along the Morton curve over their bounding box, so rows looked up
+ * one after another hit neighbouring grid cells and stored vectors. Throws std::bad_alloc
+ */
+void curveOrder(double const* rows, size_t count, size_t dim, std::vector<size_t>& order);
@@ -0,0 +1,165 @@
+#include "GridIndex.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <memory>
+#include <new>
+
+GridIndex::GridIndex(size_t dim, double const* lower, double const* upper, size_t count) :
+        _axisCount(0),
+        _entries(0),
+        _builtFor(count){
+    std::vector<size_t> order;
+    for (size_t i = 0; i < dim; i++)
+        if (upper[i] > lower[i])
+            order.push_back(i);
+    std::sort(order.begin(), order.end(), [lower, upper](size_t a, size_t b){
+        return upper[a] - lower[a] > upper[b] - lower[b];
+    });
+    _axisCount = std::min(order.size(), gridAxes);
+    size_t cells = std::max(count / gridCellLoad, size_t(1));
+    double perAxis = _axisCount == 0 ? 1. : std::ceil(std::pow(static_cast<double>(cells), 1. / static_cast<double>(_axisCount)));
+    for (size_t i = 0; i < _axisCount; i++){
+        _axes[i] = order[i];
+        _origin[i] = lower[order[i]];
+        _cellSize[i] = (upper[order[i]] - lower[order[i]]) / perAxis;
+        if (!(_cellSize[i] > 0.) || std::isinf(_cellSize[i]))
+            _cellSize[i] = 1.;
+    }
+}
+
+long long GridIndex::cellOf(size_t axis, double x) const {
+    double cell = std::floor((x - _origin[axis]) / _cellSize[axis]);
+    if (cell >= 9.0e18)
+        return 9000000000000000000LL;
+    if (cell <= -9.0e18 || std::isnan(cell))
+        return -9000000000000000000LL;
+    return static_cast<long long>(cell);
+}
+
+uint64_t GridIndex::keyOf(long long const* cells) const {
+    uint64_t key = 0xcbf29ce484222325ULL;
+    for (size_t i = 0; i < _axisCount; i++){
+        key ^= static_cast<uint64_t>(cells[i]);
+        key *= 0x100000001b3ULL;
+        key ^= key >> 29;
+    }
+    return key;
+}
+
+RC GridIndex::add(double const* row, size_t hash) {
+    long long cells[gridAxes];
+    for (size_t i = 0; i < _axisCount; i++)
+        cells[i] = cellOf(i, row[_axes[i]]);
+    try {
+        _cells[keyOf(cells)].push_back(hash);
+    }
+    catch (std::bad_alloc const&){
+        return RC::ALLOCATION_ERROR;
+    }
+    _entries++;
+    return RC::SUCCESS;
+}
+
+size_t GridIndex::getEntries() const {
+    return _entries;
+}
+
+size_t GridIndex::getBuiltFor() const {
+    return _builtFor;
+}
+
+bool GridIndex::collect(double const* lower, double const* upper, std::vector<size_t>& hashes) const {
+    long long first[gridAxes], last[gridAxes], cells[gridAxes];
+    double total = 1.;
+    for (size_t i = 0; i < _axisCount; i++){
+        first[i] = cellOf(i, lower[_axes[i]]);
+        last[i] = cellOf(i, upper[_axes[i]]);
+        if (last[i] < first[i])
+            return true;
+        total *= static_cast<double>(last[i] - first[i]) + 1.;
+    }
+    if (total > static_cast<double>(_entries))
+        return false;
+    std::copy(first, first + _axisCount, cells);
+    while (true){
+        auto cell = _cells.find(keyOf(cells));
+        if (cell != _cells.end())
+            hashes.insert(hashes.end(), cell->second.begin(), cell->second.end());
+        size_t axis = 0;
+        for (; axis < _axisCount && cells[axis] == last[axis]; axis++)
+            cells[axis] = first[axis];
+        if (axis == _axisCount)
+            break;
+        cells[axis]++;
+    }
+    return true;
+}
+
+GridIndex::GridIndex() :
+        _axisCount(0),
+        _entries(0),
+        _builtFor(0){
+}
+
+size_t GridIndex::getImageSize() const {
+    return (3 + 3 * gridAxes + 2 * _entries) * sizeof(uint64_t);
+}
+
+void GridIndex::writeImage(unsigned char* dst) const {
+    uint64_t head[3] = {_axisCount, _builtFor, _entries};
+    std::memcpy(dst, head, sizeof(head));
+    dst += sizeof(head);
+    for (size_t i = 0; i < gridAxes; i++){
+        uint64_t axis = i < _axisCount ? _axes[i] : 0;
+        double origin = i < _axisCount ? _origin[i] : 0.;
+        double cellSize = i < _axisCount ? _cellSize[i] : 1.;
+        std::memcpy(dst, &axis, sizeof(axis));
+        std::memcpy(dst + sizeof(uint64_t), &origin, sizeof(origin));
+        std::memcpy(dst + 2 * sizeof(uint64_t), &cellSize, sizeof(cellSize));
+        dst += 3 * sizeof(uint64_t);
+    }
+    for (auto const& cell : _cells){
+        for (size_t hash : cell.second){
+            uint64_t entry[2] = {cell.first, hash};
+            std::memcpy(dst, entry, sizeof(entry));
+            dst += sizeof(entry);
+        }
+    }
+}
+
+GridIndex* GridIndex::readImage(unsigned char const* src, size_t size) {
+    uint64_t head[3];
+    if (size < (3 + 3 * gridAxes) * sizeof(uint64_t))
+        return nullptr;
+    std::memcpy(head, src, sizeof(head));
+    if (head[0] > gridAxes || size != (3 + 3 * gridAxes + 2 * head[2]) * sizeof(uint64_t))
+        return nullptr;
+    std::unique_ptr<GridIndex> grid(new(std::nothrow) GridIndex());
+    if (grid == nullptr)
+        return nullptr;
+    grid->_axisCount = head[0];
+    grid->_builtFor = head[1];
+    src += sizeof(head);
+    for (size_t i = 0; i < gridAxes; i++){
+        uint64_t axis;
+        std::memcpy(&axis, src, sizeof(axis));
+        std::memcpy(&grid->_origin[i], src + sizeof(uint64_t), sizeof(double));
+        std::memcpy(&grid->_cellSize[i], src + 2 * sizeof(uint64_t), sizeof(double));
+        grid->_axes[i] = axis;
+        src += 3 * sizeof(uint64_t);
+    }
+    try {
+        for (uint64_t i = 0; i < head[2]; i++){
+            uint64_t entry[2];
+            std::memcpy(entry, src, sizeof(entry));
+            grid->_cells[entry[0]].push_back(entry[1]);
+            src += sizeof(entry);
+        }
+    }
+    catch (std::bad_alloc const&){
+        return nullptr;
+    }
+    grid->_entries = head[2];
+    return grid.release();
+}
@@ -0,0 +1,60 @@
+#pragma once
+#include "../include/RC.h"
+#include <cstddef>
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+// axes hashed by the grid, the widest ones
+size_t const gridAxes = 3;
+// vectors per cell the grid is tuned for
+size_t const gridCellLoad = 4;
+
+/*
+ * Unique indices of set vectors hashed by cells of a regular grid over up to gridAxes widest axes.
+ * Cells are not bounded, so vectors added after build outside of the initial bounds are hashed as well
+ */
+class GridIndex {
+private:
+    size_t _axes[gridAxes];
+    double _origin[gridAxes];
+    double _cellSize[gridAxes];
+    size_t _axisCount;
+    size_t _entries;
+    size_t _builtFor;
+    std::unordered_map<uint64_t, std::vector<size_t>> _cells;
+
+    inline long long cellOf(size_t axis, double x) const;
+
+    inline uint64_t keyOf(long long const* cells) const;
+
+public:
+    /*
+     * Chooses axes and cell sizes for count vectors inside of [lower, upper]
+     */
+    GridIndex(size_t dim, double const* lower, double const* upper, size_t count);
+
+    RC add(double const* row, size_t hash);
+
+    size_t getEntries() const;
+
+    size_t getBuiltFor() const;
+
+    /*
+     * Appends unique indices from cells intersecting box [lower, upper] to hashes.
+     * Returns false without collecting if there are more such cells than entries, a scan is cheaper then
+     */
+    bool collect(double const* lower, double const* upper, std::vector<size_t>& hashes) const;
+
+    size_t getImageSize() const;
+
+    void writeImage(unsigned char* dst) const;
+
+    /*
+     * Restores index written by writeImage, nullptr if image is damaged
+     */
+    static GridIndex* readImage(unsigned char const* src, size_t size);
+
+private:
+    GridIndex();
+};
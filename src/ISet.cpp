@@ -1,10 +1,34 @@
 #include "../include/ISet.h"
+#include "../include/ISetRawView.h"
+#include "../include/ISetCapacity.h"
+#include "../include/ISetLsh.h"
+#include "../include/ISetJournal.h"
 #include "../include/ISetControlBlock.h"
+#include "../include/ICompact.h"
+#include "../include/ISetAllocator.h"
+#include "SetKernels.h"
+#include "ScanPool.h"
+#include "SetSummary.h"
+#include "GridIndex.h"
+#include "LshIndex.h"
+#include "SetStorage.h"
+#include "SetFile.h"
+#include "ChangeJournal.h"
+#include "RowIndex.h"
+#include "CellPrints.h"
+#include "CurveOrder.h"
+#include "SetIterator.h"
+#include "ChunkIterator.h"
+#include "ShardedSet.h"
 #include <cstring>
+#include <atomic>
 #include <memory>
-#include <functional>
 #include <utility>
 #include <cmath>
+#include <algorithm>
+#include <vector>
+#include <mutex>
+#include <chrono>
 
 #define SendLog(Logger, Code, Level) if (Logger != nullptr) Logger->log((Code), (Level), __FILE__, __func__, __LINE__)
 #define SendSevere(Logger, Code) if (Logger != nullptr) Logger->severe((Code), __FILE__, __func__, __LINE__)
@@ -23,13 +47,13 @@ namespace{
 
     public:
 
-        RC getNext(IVector *const &vec, size_t &index, size_t indexInc) const override;
+        RC getNext(double *const &data, size_t &index, size_t &pos, size_t indexInc) const override;
 
-        RC getPrevious(IVector *const &vec, size_t &index, size_t indexInc) const override;
+        RC getPrevious(double *const &data, size_t &index, size_t &pos, size_t indexInc) const override;
 
-        RC getBegin(IVector *const &vec, size_t &index) const override;
+        RC getBegin(double *const &data, size_t &index, size_t &pos) const override;
 
-        RC getEnd(IVector *const &vec, size_t &index) const override;
+        RC getEnd(double *const &data, size_t &index, size_t &pos) const override;
 
         ~SetControlBlock() override;
 
@@ -38,62 +62,195 @@ namespace{
 
     ILogger* SetControlBlock::_logger = nullptr;
 
-
-
-    class Iterator : public ISet::IIterator{
-    private:
-        static ILogger * _logger;
-
-        double* _data;
-        size_t _dim;
-        size_t _hash;
-        std::shared_ptr<ISetControlBlock> _setCB;
-
-        Iterator(size_t dim, size_t hash, double const *const &data, std::shared_ptr<ISetControlBlock> setCB);
-
-        inline RC moveIterator(std::function<RC(IVector* const&, size_t&)> const & moveTo);
-
-    public:
-
-        IIterator * getNext(size_t indexInc) const override;
-
-        IIterator * getPrevious(size_t indexInc) const override;
-
-        IIterator * clone() const override;
-
-        RC next(size_t indexInc) override;
-
-        RC previous(size_t indexInc) override;
-
-        bool isValid() const override;
-
-        RC makeBegin() override;
-
-        RC makeEnd() override;
-
-        RC getVectorCopy(IVector *& val) const override;
-
-        RC getVectorCoords(IVector * const& val) const override;
-
-        ~Iterator() override;
-
-        static Iterator *createIterator(size_t dim, double const *const &data, size_t hash, std::shared_ptr<ISetControlBlock> setCB);
-    };
-
-    ILogger* Iterator::_logger = nullptr;
-
-    class Set : public ISet
+    class Set : public ISet, public ISetRawView, public ISetCapacity, public ISetLsh, public ISetJournal
     {
     private:
         size_t _dim;
         size_t _size;
+        // slots taken by alive and removed vectors, removed ones are marked in _dead until compaction
+        size_t _used;
         size_t _capacity;
+        // _data and _hashCodes point into _storage
+        std::shared_ptr<SetStorage> _storage;
         double* _data;
         size_t* _hashCodes;
+        uint64_t* _dead;
         size_t _nextHash;
+        uint64_t _version;
+        double _garbageRatio;
+        ISetAllocator* _allocator;
+        double _growthFactor;
+        // capacity allocated by init, set by reserve before the first vector
+        size_t _reserved;
+        /*
+         * Indices follow the rule of the set: one writer, and no reader while it writes. Mutators change them
+         * without locks. Const methods may run on several threads at once and build or rebuild an index lazily,
+         * so readers take the lock of the index around updateGrid or updateLsh and around reading it.
+         * A reader may hand the index to ScanPool threads while it holds the lock for them
+         */
+        // built by the first queryBox and kept up to date by append, removed vectors are skipped on lookup
+        mutable std::unique_ptr<GridIndex> _grid;
+        mutable std::mutex _gridLock;
+        LshConfig _lshConfig;
+        // built by enableLsh and kept up to date by append, removed vectors are skipped on lookup
+        mutable std::unique_ptr<LshIndex> _lsh;
+        mutable std::mutex _lshLock;
+        mutable LshCounters _lshCounters;
+        // bounds and moments of alive vectors, rebuilt by a scan if its count does not match _size
+        mutable SetSummary _summary;
+        mutable std::mutex _summaryLock;
+        ChangeJournal _journal;
+        // file of a set opened with FILE_MODE::READ_WRITE, -1 otherwise
+        int _fd;
+        bool _readOnly;
         std::shared_ptr<ISetControlBlock> _setCB;
         bool* _setIsValid;
 
+        inline bool isDead(size_t slot) const;
+
+        /*
+         * Slot of the vector with index among alive vectors
+         */
+        inline size_t slotOf(size_t index) const;
+
+        /*
+         * First alive slot not less than slot, or _used if there is none
+         */
+        inline size_t nextAlive(size_t slot) const;
+
+        /*
+         * Last alive slot less than slot, or _used if there is none
+         */
+        inline size_t prevAlive(size_t slot) const;
+
+        /*
+         * First removed slot in [slot, last), or last if there is none
+         */
+        inline size_t nextDead(size_t slot, size_t last) const;
+
+        /*
+         * Moves alive vectors over removed ones keeping their order and unique indices.
+         * Called by mutators only, const methods skip removed vectors through _dead, so concurrent readers
+         * never see storage moved under them
+         */
+        void dropTombstones();
+
+        /*
+         * Storage is shared if a snapshot or a clone of the set is alive
+         */
+        inline bool isShared() const;
+
+        /*
+         * Claims slot _used of shared storage for append, returns false if another set sharing the storage may read it
+         */
+        bool claimSlot() const;
+
+        /*
+         * Moves set to a private copy of its storage
+         */
+        RC detach();
+
+        inline void adopt(std::shared_ptr<SetStorage> storage);
+
+        /*
+         * Moves set to storage of the given capacity, capacity must not be less than _used.
+         * Storage not shared with snapshots is resized by the allocator, which may avoid copying rows
+         */
+        RC resize(size_t capacity);
+
+        /*
+         * Capacity after growth by _growthFactor, but not less than needed
+         */
+        inline size_t grownCapacity(size_t needed) const;
+
+        /*
+         * Grows set opened with FILE_MODE::READ_WRITE by extending and remapping its file
+         */
+        RC growFile(size_t capacity);
+
+        inline RC checkWritable(const char* const& function, int line) const;
+
+        RC findSlot(IVector const * const& pat, IVector::NORM n, double tol, size_t& slot) const;
+
+        RC removeSlot(size_t slot);
+
+        /*
+         * Searches row among vectors of _grid cells within tol from it, falls back to a scan of the set
+         * if the cells are too many. Called by a mutator or by a reader holding _gridLock
+         */
+        bool containsRow(double const* row, IVector::NORM n, double tol, std::vector<double>& box, std::vector<size_t>& hashes) const;
+
+        /*
+         * Fills box with bounds of the cube of half side tol around row, every norm ball of radius tol lies inside of it.
+         * Returns false if _grid can not narrow the search. Called by a mutator or by a reader holding _gridLock
+         */
+        bool collectNear(double const* row, double tol, std::vector<double>& box, std::vector<size_t>& hashes) const;
+
+        /*
+         * Least alive slot equal to row, or _used if there is none. Large sets are split over ScanPool threads,
+         * which stop scanning their parts once a match before the part is found
+         */
+        size_t scanSlots(double const* row, IVector::NORM n, double tol) const;
+
+        /*
+         * Least alive slot of [first, last) equal to row, or last if there is none, scan stops once stop is at most
+         * the slot reached
+         */
+        size_t scanRange(size_t first, size_t last, double const* row, IVector::NORM n, double tol, std::atomic<size_t> const* stop) const;
+
+        /*
+         * Rebuilds _grid if it holds too many removed vectors or was tuned for a much smaller set.
+         * Called by a mutator or by a reader holding _gridLock
+         */
+        void updateGrid() const;
+
+        inline bool isInside(double const* row, double const* lower, double const* upper) const;
+
+        /*
+         * Looks row up among candidates of _lsh if it is enabled for norm n, slot is _used if none is equal to row.
+         * Returns false if the lookup must be exact
+         */
+        bool findHashed(double const* row, IVector::NORM n, double tol, std::vector<size_t>& hashes, size_t& slot) const;
+
+        /*
+         * Rebuilds _lsh if it is missing or holds too many removed vectors.
+         * Called by a mutator or by a reader holding _lshLock
+         */
+        void updateLsh() const;
+
+        /*
+         * Rebuilds _summary if it does not describe the set and recomputes its stale bounds.
+         * Called with _summaryLock held, returns false if memory can not be allocated
+         */
+        bool updateSummary() const;
+
+        /*
+         * Set with alive vectors copied into new storage and renumbered from 0
+         */
+        Set* copy() const;
+
+    protected:
+        /*
+         * Empty set of the same class, clones, snapshots and copies keep the kernels of their source
+         */
+        virtual Set* createEmpty() const;
+
+        /*
+         * Least alive slot among vectors with unique indices hashes equal to row, or _used if there is none
+         */
+        virtual size_t firstAmong(std::vector<size_t> const& hashes, double const* row, IVector::NORM n, double tol) const;
+
+        /*
+         * Least alive slot among vectors with unique indices hashes whose rows satisfy equal, or _used if there is none
+         */
+        template<class Equal>
+        size_t firstAmongOf(std::vector<size_t> const& hashes, Equal const& equal) const;
+
+        /*
+         * Position of the first of count alive rows equal to pat, or count if there is none
+         */
+        virtual size_t findIn(double const* rows, size_t count, double const* pat, IVector::NORM n, double tol) const;
+
     public:
 
         Set();
@@ -102,6 +259,8 @@ namespace{
 
         ISet* clone() const override;
 
+        ISet const* snapshot() const override;
+
         size_t getDim() const override;
 
         size_t getSize() const override;
@@ -116,25 +275,102 @@ namespace{
 
         RC findFirst(IVector const * const& pat, IVector::NORM n, double tol) const override;
 
+        RC findFirstMany(double const* patterns, size_t count, size_t dim, IVector::NORM n, double tol, size_t * const& indices) const override;
+
         RC insert(IVector const * const& val, IVector::NORM n, double tol) override;
 
+        RC insertBatch(double const* rows, size_t count, size_t dim, IVector::NORM n, double tol, size_t& inserted) override;
+
+        /*
+         * Appends row to the end of the set without searching for equal vectors
+         */
+        RC append(size_t dim, double const* row);
+
+        /*
+         * Allocates storage for the first vector of dimension dim
+         */
+        RC init(size_t dim);
+
         RC remove(size_t index) override;
 
         RC remove(IVector const * const& pat, IVector::NORM n, double tol) override;
 
+        RC removeIf(std::function<bool(double const*, size_t)> const& pred) override;
+
+        using ISet::queryBox;
+
+        RC queryBox(ICompact const* const& box, std::function<void(double const*, size_t)> const& callback) const override;
+
+        RC setGarbageRatio(double ratio) override;
+
+        RC compact() override;
+
+        RC reserve(size_t capacity) override;
+
+        RC shrinkToFit() override;
+
+        RC setGrowthFactor(double factor) override;
+
+        /*
+         * Storage of the set is allocated by allocator
+         */
+        void setAllocator(ISetAllocator* allocator);
+
+        RC enableLsh(IVector::NORM n, size_t tables, size_t hashesPerTable, double bucketWidth, size_t checkEvery) override;
+
+        RC disableLsh() override;
+
+        RC getLshStats(LshStats& stats) const override;
+
+        RC setJournalCapacity(size_t capacity) override;
+
+        RC getChangesSince(uint64_t version, std::function<void(Change const&, double const*)> const& callback, uint64_t& current) const override;
+
+        RC getBounds(IVector*& lower, IVector*& upper) const override;
+
+        RC getCentroid(IVector*& centroid) const override;
+
+        RC getVariance(IVector*& variance) const override;
+
+        RC getRawView(double const*& rows, size_t& count, size_t& dim, uint64_t& version) const override;
+
+        uint64_t getVersion() const override;
+
+        RC sync() override;
+
+        /*
+         * Writes alive vectors compacted, queryBox index is written if it was built
+         */
+        RC saveFile(char const* const& path) const;
+
+        static Set* openFile(char const* const& path, FILE_MODE mode);
+
         IIterator *getIterator(size_t index) const override;
 
         IIterator *getBegin() const override;
 
         IIterator *getEnd() const override;
 
-        RC getNext(IVector *const &vec, size_t &index, size_t indexInc) const;
+        /*
+         * Chunks are runs of vectors of a snapshot, rows and hashes point into the shared storage
+         */
+        IChunkIterator *getChunkIterator(size_t chunkRows) const override;
+
+        RC forEachChunk(size_t chunkRows, std::function<void(double const*, size_t const*, size_t, size_t)> const& callback) const override;
 
-        RC getPrevious(IVector *const &vec, size_t &index, size_t indexInc) const;
+        RC getNext(double *const &data, size_t &index, size_t &pos, size_t indexInc) const;
 
-        RC getBegin(IVector *const &vec, size_t &index) const;
+        RC getPrevious(double *const &data, size_t &index, size_t &pos, size_t indexInc) const;
 
-        RC getEnd(IVector *const &vec, size_t &index) const;
+        RC getBegin(double *const &data, size_t &index, size_t &pos) const;
+
+        RC getEnd(double *const &data, size_t &index, size_t &pos) const;
+
+        /*
+         * Slot of the vector with unique index or, if it was removed, of the first vector added after it.
+         * Cached slot pos is used if it still holds index, otherwise sorted _hashCodes are searched
+         */
+        inline size_t locate(size_t index, size_t pos) const;
 
         inline static void log(RC code, ILogger::Level level, const char* const& srcfile, const char* const& function, int line);
 
@@ -145,33 +381,145 @@ namespace{
         static ILogger* _logger;
     };
 
+    /*
+     * Set of rows of Dim coordinates, created by ISet::createSet(dim) for dimensions up to kernel::maxFixedDim.
+     * Its lookups compare rows with kernels inlined into the loops over candidates and storage, so row stride
+     * and trip counts are compile-time constants and no row costs a call
+     */
+    template<size_t Dim>
+    class FixedSet final : public Set
+    {
+    protected:
+        Set* createEmpty() const override {
+            return new(std::nothrow) FixedSet<Dim>();
+        }
+
+        size_t firstAmong(std::vector<size_t> const& hashes, double const* row, IVector::NORM n, double tol) const override {
+            switch (n){
+                case IVector::NORM::FIRST:
+                    return firstAmongOf(hashes, [row, tol](double const* other){
+                        return kernel::compareRows<IVector::NORM::FIRST>(Dim, other, row, tol);
+                    });
+                case IVector::NORM::SECOND:
+                    return firstAmongOf(hashes, [row, tol](double const* other){
+                        return kernel::compareRows<IVector::NORM::SECOND>(Dim, other, row, tol);
+                    });
+                case IVector::NORM::CHEBYSHEV:
+                    return firstAmongOf(hashes, [row, tol](double const* other){
+                        return kernel::compareRows<IVector::NORM::CHEBYSHEV>(Dim, other, row, tol);
+                    });
+                default:
+                    return Set::firstAmong(hashes, row, n, tol);
+            }
+        }
+
+        size_t findIn(double const* rows, size_t count, double const* pat, IVector::NORM n, double tol) const override {
+            switch (n){
+                case IVector::NORM::FIRST:
+                    return kernel::findRowIn<IVector::NORM::FIRST>(Dim, rows, count, pat, tol);
+                case IVector::NORM::SECOND:
+                    return kernel::findRowIn<IVector::NORM::SECOND>(Dim, rows, count, pat, tol);
+                case IVector::NORM::CHEBYSHEV:
+                    return kernel::findRowIn<IVector::NORM::CHEBYSHEV>(Dim, rows, count, pat, tol);
+                default:
+                    return count;
+            }
+        }
+    };
+
+    /*
+     * Empty set for vectors of dimension dim, FixedSet if there is one for it
+     */
+    Set* createSetOf(size_t dim){
+        static_assert(kernel::maxFixedDim == 8, "createSetOf must cover every fixed dimension");
+        switch (dim){
+            case 1: return new(std::nothrow) FixedSet<1>();
+            case 2: return new(std::nothrow) FixedSet<2>();
+            case 3: return new(std::nothrow) FixedSet<3>();
+            case 4: return new(std::nothrow) FixedSet<4>();
+            case 5: return new(std::nothrow) FixedSet<5>();
+            case 6: return new(std::nothrow) FixedSet<6>();
+            case 7: return new(std::nothrow) FixedSet<7>();
+            case 8: return new(std::nothrow) FixedSet<8>();
+            default: return new(std::nothrow) Set();
+        }
+    }
+
     ILogger* Set::_logger = nullptr;
-    size_t const capacityGain = 2;
     size_t const startCapacity = 2;
+    double const defaultGarbageRatio = 0.25;
+    double const defaultGrowthFactor = 2.;
+    size_t const wordBits = 64;
+    // sets with fewer slots are scanned by one thread
+    size_t const parallelScanSlots = size_t(1) << 16;
+    size_t const scanPartSlots = size_t(1) << 14;
+    size_t const scanPartsPerThread = 4;
+    size_t const scanStopCheckSlots = 1024;
+    // batched lookups are split over ScanPool threads in parts of at least this many rows
+    size_t const batchPartRows = 256;
+
+    inline size_t bitmapWords(size_t bits){
+        return (bits + wordBits - 1) / wordBits;
+    }
+
+    inline size_t popCount(uint64_t word){
+#if defined(__GNUC__)
+        return static_cast<size_t>(__builtin_popcountll(word));
+#else
+        size_t count = 0;
+        for (; word != 0; word &= word - 1)
+            count++;
+        return count;
+#endif
+    }
+
+    // word must not be zero
+    inline size_t lowestBit(uint64_t word){
+#if defined(__GNUC__)
+        return static_cast<size_t>(__builtin_ctzll(word));
+#else
+        size_t bit = 0;
+        for (; (word & 1) == 0; word >>= 1)
+            bit++;
+        return bit;
+#endif
+    }
+
+    // word must not be zero
+    inline size_t highestBit(uint64_t word){
+#if defined(__GNUC__)
+        return wordBits - 1 - static_cast<size_t>(__builtin_clzll(word));
+#else
+        size_t bit = 0;
+        for (; word > 1; word >>= 1)
+            bit++;
+        return bit;
+#endif
+    }
 }
 
-RC SetControlBlock::getNext(IVector *const &vec, size_t &index, size_t indexInc) const {
+RC SetControlBlock::getNext(double *const &data, size_t &index, size_t &pos, size_t indexInc) const {
     if (!(*_setIsValid))
         return RC::SOURCE_SET_DESTROYED;
-    return _set->getNext(vec, index, indexInc);
+    return _set->getNext(data, index, pos, indexInc);
 }
 
-RC SetControlBlock::getPrevious(IVector *const &vec, size_t &index, size_t indexInc) const {
+RC SetControlBlock::getPrevious(double *const &data, size_t &index, size_t &pos, size_t indexInc) const {
     if (!(*_setIsValid))
         return RC::SOURCE_SET_DESTROYED;
-    return _set->getPrevious(vec, index, indexInc);
+    return _set->getPrevious(data, index, pos, indexInc);
 }
 
-RC SetControlBlock::getBegin(IVector *const &vec, size_t &index) const {
+RC SetControlBlock::getBegin(double *const &data, size_t &index, size_t &pos) const {
     if (!(*_setIsValid))
         return RC::SOURCE_SET_DESTROYED;
-    return _set->getBegin(vec, index);
+    return _set->getBegin(data, index, pos);
 }
 
-RC SetControlBlock::getEnd(IVector *const &vec, size_t &index) const {
+RC SetControlBlock::getEnd(double *const &data, size_t &index, size_t &pos) const {
     if (!(*_setIsValid))
         return RC::SOURCE_SET_DESTROYED;
-    return _set->getEnd(vec, index);
+    return _set->getEnd(data, index, pos);
 }
 
 SetControlBlock::~SetControlBlock(){
@@ -186,179 +534,60 @@ SetControlBlock::SetControlBlock(Set const *set, bool *setIsValid) :
 ISetControlBlock::~ISetControlBlock() = default;
 
 
-ISet::IIterator *Iterator::getNext(size_t indexInc) const {
-    auto it = clone();
-    if (it == nullptr){
-        SendInfo(_logger, RC::NULLPTR_ERROR);
-        return nullptr;
-    }
-    RC nextRC = it->next(indexInc);
-    if (nextRC != RC::SUCCESS){
-        SendInfo(_logger, nextRC);
-        delete it;
-        return nullptr;
-    }
-    return it;
-}
-
-ISet::IIterator *Iterator::getPrevious(size_t indexInc) const {
-    auto it = clone();
-    if (it == nullptr){
-        SendInfo(_logger, RC::NULLPTR_ERROR);
-        return nullptr;
-    }
-    RC nextRC = it->previous(indexInc);
-    if (nextRC != RC::SUCCESS){
-        SendInfo(_logger, nextRC);
-        delete it;
-        return nullptr;
-    }
-    return it;
-}
-
-ISet::IIterator *Iterator::clone() const {
-    if (_data == nullptr)
-        return nullptr;
-    auto it = new(std::nothrow) Iterator(_dim, _hash, _data, _setCB);
-    if (it == nullptr)
-        SendInfo(_logger, RC::ALLOCATION_ERROR);
-    return it;
-}
-
-RC Iterator::moveIterator(std::function<RC(IVector* const&, size_t&)> const & moveTo){
-    if (_data == nullptr){
-        SendInfo(_logger, RC::INDEX_OUT_OF_BOUND);
-        return RC::INDEX_OUT_OF_BOUND;
-    }
-    size_t hash = _hash;
-    IVector* vec = IVector::createVector(_dim, _data);
-    if (vec == nullptr){
-        SendInfo(_logger, RC::NULLPTR_ERROR);
-        return RC::NULLPTR_ERROR;
-    }
-
-    RC getNextRC = moveTo(vec, hash);
-    if (getNextRC == RC::SOURCE_SET_EMPTY ||
-        getNextRC == RC::SOURCE_SET_DESTROYED ||
-        getNextRC == RC::INDEX_OUT_OF_BOUND){
-        delete vec;
-        delete [] _data;
-        _data = nullptr;
-        return getNextRC;
-    }
-    if (getNextRC != RC::SUCCESS){
-        delete vec;
-        SendInfo(_logger, getNextRC);
-        return getNextRC;
-    }
-    _hash = hash;
-    std::memcpy(_data, vec->getData(), _dim * sizeof(double));
-    delete vec;
-
-    return RC::SUCCESS;
-}
+ISet::IIterator::~IIterator() = default;
 
-RC Iterator::next(size_t indexInc) {
-    auto moveTo = std::bind(&ISetControlBlock::getNext, _setCB.get(), std::placeholders::_1, std::placeholders::_2, indexInc);
-    return moveIterator(moveTo);
-}
+ISet::IChunkIterator::~IChunkIterator() = default;
 
-RC Iterator::previous(size_t indexInc) {
-    auto moveTo = std::bind(&ISetControlBlock::getPrevious, _setCB.get(), std::placeholders::_1, std::placeholders::_2, indexInc);
-    return moveIterator(moveTo);
+RC ISet::IIterator::setLogger(ILogger *const pLogger) {
+    return RC::INDEX_OUT_OF_BOUND;
 }
 
-bool Iterator::isValid() const {
-    return nullptr != _data;
-}
 
-RC Iterator::makeBegin() {
-    auto moveTo = std::bind(&ISetControlBlock::getBegin, _setCB.get(), std::placeholders::_1, std::placeholders::_2);
-    return moveIterator(moveTo);
-}
 
-RC Iterator::makeEnd() {
-    auto moveTo = std::bind(&ISetControlBlock::getEnd, _setCB.get(), std::placeholders::_1, std::placeholders::_2);
-    return moveIterator(moveTo);
-}
 
-RC Iterator::getVectorCopy(IVector *&val) const {
-    auto vec = IVector::createVector(_dim, _data);
-    if (vec == nullptr){
-        SendInfo(_logger, RC::UNKNOWN);
-        return RC::UNKNOWN;
+LIB_EXPORT RC ISet::setLogger(ILogger *const logger) {
+    if (logger == nullptr){
+        SendInfo(Set::_logger, RC::NULLPTR_ERROR);
+        return RC::NULLPTR_ERROR;
     }
-    val = vec;
+    Set::_logger = logger;
     return RC::SUCCESS;
 }
 
-RC Iterator::getVectorCoords(IVector *const &val) const {
-    if (val == nullptr){
-        SendInfo(_logger, RC::NULLPTR_ERROR);
-        return RC::NULLPTR_ERROR;
-    }
-    return val->setData(_dim, _data);
+LIB_EXPORT ILogger* ISet::getLogger(){
+    return Set::_logger;
 }
 
-Iterator::~Iterator() {
-    delete _data;
+LIB_EXPORT ISet *ISet::createSet() {
+    return new(std::nothrow) Set();
 }
 
-Iterator::Iterator(size_t dim, size_t hash, double const *const &data, std::shared_ptr<ISetControlBlock> setCB) :
-        _dim(dim),
-        _hash(hash),
-        _setCB(std::move(setCB))
-{
+LIB_EXPORT ISet *ISet::createSet(size_t dim) {
     if (dim == 0){
-        SendInfo(_logger, RC::MISMATCHING_DIMENSIONS);
-        return;
-    }
-    _data = new(std::nothrow) double[dim];
-    if (_data == nullptr) {
-        SendInfo(_logger, RC::ALLOCATION_ERROR);
-        return;
+        SendInfo(Set::_logger, RC::INVALID_ARGUMENT);
+        return nullptr;
     }
-    std::memcpy(_data, data, dim * sizeof(double));
-}
-
-Iterator *Iterator::createIterator(size_t dim, double const *const &data, size_t hash,
-                                   std::shared_ptr<ISetControlBlock> setCB) {
-    if (data == nullptr || dim == 0){
+    auto set = createSetOf(dim);
+    if (set == nullptr){
+        SendInfo(Set::_logger, RC::ALLOCATION_ERROR);
         return nullptr;
     }
-    auto* it = new(std::nothrow) Iterator(dim, hash, data, std::move(setCB));
-    if (it == nullptr){
-        SendInfo(_logger, RC::ALLOCATION_ERROR);
+    if (set->init(dim) != RC::SUCCESS){
+        delete set;
         return nullptr;
     }
-    return it;
-}
-
-
-ISet::IIterator::~IIterator() = default;
-
-RC ISet::IIterator::setLogger(ILogger *const pLogger) {
-    return RC::INDEX_OUT_OF_BOUND;
+    return set;
 }
 
-
-
-
-LIB_EXPORT RC ISet::setLogger(ILogger *const logger) {
-    if (logger == nullptr){
+LIB_EXPORT ISet *ISet::createSet(ISetAllocator* const& allocator) {
+    if (allocator == nullptr){
         SendInfo(Set::_logger, RC::NULLPTR_ERROR);
-        return RC::NULLPTR_ERROR;
+        return nullptr;
     }
-    Set::_logger = logger;
-    return RC::SUCCESS;
-}
-
-LIB_EXPORT ILogger* ISet::getLogger(){
-    return Set::_logger;
-}
-
-LIB_EXPORT ISet *ISet::createSet() {
-    return new(std::nothrow) Set();
+    auto set = new(std::nothrow) Set();
+    if (set != nullptr)
+        set->setAllocator(allocator);
+    return set;
 }
 
 LIB_EXPORT ISet *ISet::makeIntersection(const ISet *const &op1, const ISet *const &op2, IVector::NORM n, double tol) {
@@ -378,12 +607,41 @@ LIB_EXPORT ISet *ISet::makeIntersection(const ISet *const &op1, const ISet *cons
         SendInfo(Set::_logger, RC::MISMATCHING_DIMENSIONS);
         return nullptr;
     }
+    if (sharding::isSharded(op1))
+        return sharding::makeIntersection(op1, op2, n, tol);
 
     auto setRes = ISet::createSet();
     if (setRes == nullptr){
         SendInfo(Set::_logger, RC::NULLPTR_ERROR);
         return nullptr;
     }
+    // contiguous rows of op1 are looked up in op2 by one batch
+    double const* rows = nullptr;
+    size_t count = 0, dim = 0;
+    uint64_t version = 0;
+    ISetRawView const* view = ISetRawView::of(op1);
+    if (view != nullptr && view->getRawView(rows, count, dim, version) == RC::SUCCESS){
+        std::unique_ptr<size_t[]> indices(new(std::nothrow) size_t[count]);
+        RC rc = indices == nullptr ? RC::ALLOCATION_ERROR : op2->findFirstMany(rows, count, dim, n, tol, indices.get());
+        IVector* vec = rc == RC::SUCCESS ? IVector::createVector(dim, rows) : nullptr;
+        if (rc == RC::SUCCESS && vec == nullptr)
+            rc = RC::ALLOCATION_ERROR;
+        size_t size = op2->getSize();
+        for (size_t k = 0; rc == RC::SUCCESS && k < count; k++){
+            if (indices[k] >= size)
+                continue;
+            rc = vec->setData(dim, rows + k * dim);
+            if (rc == RC::SUCCESS)
+                rc = setRes->insert(vec, n, tol);
+        }
+        delete vec;
+        if (rc != RC::SUCCESS){
+            delete setRes;
+            SendInfo(Set::_logger, rc);
+            return nullptr;
+        }
+        return setRes;
+    }
     auto it = op1->getBegin();
     if (it == nullptr){
         delete setRes;
@@ -450,6 +708,8 @@ LIB_EXPORT ISet *ISet::makeUnion(const ISet *const &op1, const ISet *const &op2,
         SendInfo(Set::_logger, RC::MISMATCHING_DIMENSIONS);
         return nullptr;
     }
+    if (sharding::isSharded(op1))
+        return sharding::makeUnion(op1, op2, n, tol);
     auto setRes = op1->clone();
     if (setRes == nullptr){
         SendInfo(Set::_logger, RC::NULLPTR_ERROR);
@@ -517,6 +777,8 @@ LIB_EXPORT ISet *ISet::sub(const ISet *const &op1, const ISet *const &op2, IVect
         SendInfo(Set::_logger, RC::MISMATCHING_DIMENSIONS);
         return nullptr;
     }
+    if (sharding::isSharded(op1))
+        return sharding::sub(op1, op2, n, tol);
     auto setRes = op1->clone();
     if (setRes == nullptr){
         SendInfo(Set::_logger, RC::NULLPTR_ERROR);
@@ -583,12 +845,38 @@ LIB_EXPORT ISet *ISet::symSub(const ISet *const &op1, const ISet *const &op2, IV
         SendInfo(Set::_logger, RC::MISMATCHING_DIMENSIONS);
         return nullptr;
     }
-    auto setUnion = ISet::makeUnion(op1, op2, n, tol);
-    auto setInters = ISet::makeIntersection(op1, op2, n, tol);
-    auto symSub = ISet::sub(setUnion, setInters, n, tol);
-    delete setInters;
-    delete setUnion;
-    return symSub;
+    if (sharding::isSharded(op1))
+        return sharding::symSub(op1, op2, n, tol);
+
+    RowIndex rows1, rows2;
+    RC buildRC = rows1.build(op1);
+    if (buildRC == RC::SUCCESS)
+        buildRC = rows2.build(op2);
+    if (buildRC != RC::SUCCESS){
+        SendInfo(Set::_logger, buildRC);
+        return nullptr;
+    }
+    auto setRes = new(std::nothrow) Set();
+    if (setRes == nullptr){
+        SendInfo(Set::_logger, RC::ALLOCATION_ERROR);
+        return nullptr;
+    }
+    size_t dim = op1->getDim();
+    RowIndex const* sides[2][2] = {{&rows1, &rows2}, {&rows2, &rows1}};
+    for (auto const& side : sides){
+        for (size_t i = 0; i < side[0]->getSize(); i++){
+            double const* row = side[0]->getRow(i);
+            if (side[1]->contains(row, n, tol))
+                continue;
+            RC appendRC = setRes->append(dim, row);
+            if (appendRC != RC::SUCCESS){
+                delete setRes;
+                SendInfo(Set::_logger, appendRC);
+                return nullptr;
+            }
+        }
+    }
+    return setRes;
 }
 
 LIB_EXPORT bool ISet::equals(const ISet *const &op1, const ISet *const &op2, IVector::NORM n, double tol) {
@@ -613,53 +901,63 @@ LIB_EXPORT bool ISet::equals(const ISet *const &op1, const ISet *const &op2, IVe
     if (op1->getSize() == 0)
         return true;
 
-    auto it = op1->getBegin();
-    if (it == nullptr){
-        SendInfo(Set::_logger, RC::NULLPTR_ERROR);
+    if (n != IVector::NORM::FIRST && n != IVector::NORM::SECOND && n != IVector::NORM::CHEBYSHEV){
+        SendInfo(Set::_logger, RC::INVALID_ARGUMENT);
         return false;
     }
-    IVector* vec = nullptr;
-    RC setVectorRC = it->getVectorCopy(vec);
-    if (setVectorRC != RC::SUCCESS){
-        delete it;
-        delete vec;
-        SendInfo(Set::_logger, setVectorRC);
+    // vectors closer than tol may be kept in one set, so equal sizes do not make one inclusion enough
+    if (sharding::isSharded(op1) || sharding::isSharded(op2))
+        return sharding::contains(op2, op1, n, tol) && sharding::contains(op1, op2, n, tol);
+
+    /*
+     * Cells of both sets on the grid with step tol are merged in the order of their fingerprints, cells holding
+     * bitwise the same rows are skipped. Vectors of cells that disagree are looked up in the other set: in its cell
+     * first, then by RowIndex::contains for vectors moved over a cell border. So equal sets are confirmed in one pass
+     * and sets that differ by small moves cost lookups of the moved vectors only
+     */
+    RowIndex rows1, rows2;
+    CellPrints prints1, prints2;
+    RC buildRC = rows1.build(op1);
+    if (buildRC == RC::SUCCESS)
+        buildRC = rows2.build(op2);
+    if (buildRC == RC::SUCCESS)
+        buildRC = prints1.build(rows1, op1->getDim(), tol);
+    if (buildRC == RC::SUCCESS)
+        buildRC = prints2.build(rows2, op2->getDim(), tol);
+    if (buildRC != RC::SUCCESS){
+        SendInfo(Set::_logger, buildRC);
         return false;
     }
-
-    do{
-        RC foundVectorRC = op2->findFirst(vec, n, tol);
-        if (foundVectorRC == RC::VECTOR_NOT_FOUND){
-            delete it;
-            delete vec;
-            return false;
+    auto covered = [n, tol](CellPrints const& prints, CellPrints::Cell const& cell, CellPrints const& otherPrints, RowIndex const& otherRows){
+        for (size_t pos = cell.begin; pos < cell.end; pos++){
+            double const* row = prints.getRow(pos);
+            if (!otherPrints.contains(row, n, tol) && !otherRows.contains(row, n, tol))
+                return false;
         }
-        if (foundVectorRC != RC::SUCCESS){
-            delete it;
-            delete vec;
-            SendInfo(Set::_logger, foundVectorRC);
-            return false;
+        return true;
+    };
+    size_t c1 = 0, c2 = 0;
+    while (c1 < prints1.getCellCount() || c2 < prints2.getCellCount()){
+        CellPrints::Cell const* cell1 = c1 < prints1.getCellCount() ? &prints1.getCell(c1) : nullptr;
+        CellPrints::Cell const* cell2 = c2 < prints2.getCellCount() ? &prints2.getCell(c2) : nullptr;
+        if (cell1 != nullptr && cell2 != nullptr && cell1->print == cell2->print){
+            if (!prints1.sameRows(*cell1, prints2, *cell2) &&
+                (!covered(prints1, *cell1, prints2, rows2) || !covered(prints2, *cell2, prints1, rows1)))
+                return false;
+            c1++;
+            c2++;
         }
-        RC nextItRC = it->next();
-        if (nextItRC != RC::SUCCESS && nextItRC != RC::INDEX_OUT_OF_BOUND){
-            delete it;
-            delete vec;
-            SendInfo(Set::_logger, nextItRC);
-            return false;
+        else if (cell2 == nullptr || (cell1 != nullptr && cell1->print < cell2->print)){
+            if (!covered(prints1, *cell1, prints2, rows2))
+                return false;
+            c1++;
         }
-        if (!it->isValid())
-            break;
-        RC setVectorCordRC = it->getVectorCoords(vec);
-        if (setVectorCordRC != RC::SUCCESS){
-            delete it;
-            delete vec;
-            SendInfo(Set::_logger, setVectorCordRC);
-            return false;
+        else {
+            if (!covered(prints2, *cell2, prints1, rows1))
+                return false;
+            c2++;
         }
-    }while(true);
-
-    delete it;
-    delete vec;
+    }
     return true;
 }
 
@@ -680,6 +978,8 @@ LIB_EXPORT bool ISet::subSet(const ISet *const &op1, const ISet *const &op2, IVe
         return true;
     if (op1->getDim() == 0)
         return false;
+    if (sharding::isSharded(op1) || sharding::isSharded(op2))
+        return sharding::contains(op1, op2, n, tol);
     auto it = op2->getBegin();
     if (it == nullptr){
         SendInfo(Set::_logger, RC::NULLPTR_ERROR);
@@ -730,15 +1030,106 @@ LIB_EXPORT bool ISet::subSet(const ISet *const &op1, const ISet *const &op2, IVe
     return true;
 }
 
+LIB_EXPORT RC ISet::queryBox(ICompact const* const& box, ISet* const& out) const {
+    if (out == nullptr){
+        SendInfo(Set::_logger, RC::NULLPTR_ERROR);
+        return RC::NULLPTR_ERROR;
+    }
+    if (out == this){
+        SendInfo(Set::_logger, RC::INVALID_ARGUMENT);
+        return RC::INVALID_ARGUMENT;
+    }
+    // vectors of a set are already distinct, so an empty Set takes them without lookups
+    Set* outSet = out->getSize() == 0 ? dynamic_cast<Set*>(out) : nullptr;
+    IVector* buffer = nullptr;
+    RC insertRC = RC::SUCCESS;
+    RC rc = queryBox(box, [&](double const* row, size_t dim){
+        if (insertRC != RC::SUCCESS)
+            return;
+        if (outSet != nullptr){
+            insertRC = outSet->append(dim, row);
+            return;
+        }
+        if (buffer == nullptr)
+            buffer = IVector::createVector(dim, row);
+        else
+            buffer->setData(dim, row);
+        if (buffer == nullptr){
+            insertRC = RC::ALLOCATION_ERROR;
+            return;
+        }
+        insertRC = out->insert(buffer, IVector::NORM::CHEBYSHEV, 0.);
+        if (insertRC == RC::VECTOR_ALREADY_EXIST)
+            insertRC = RC::SUCCESS;
+    });
+    delete buffer;
+    if (rc == RC::SUCCESS)
+        rc = insertRC;
+    if (rc != RC::SUCCESS)
+        SendInfo(Set::_logger, rc);
+    return rc;
+}
+
+LIB_EXPORT RC ISet::save(char const* const& path) const {
+    if (path == nullptr){
+        SendInfo(Set::_logger, RC::NULLPTR_ERROR);
+        return RC::NULLPTR_ERROR;
+    }
+    auto set = dynamic_cast<Set const*>(this);
+    if (set != nullptr)
+        return set->saveFile(path);
+
+    // other implementations are copied into Set to share its file format
+    Set copy;
+    IIterator* it = getSize() == 0 ? nullptr : getBegin();
+    IVector* vec = nullptr;
+    RC rc = RC::SUCCESS;
+    if (it != nullptr)
+        rc = it->getVectorCopy(vec);
+    for (; it != nullptr && rc == RC::SUCCESS && it->isValid(); it->next()){
+        rc = it->getVectorCoords(vec);
+        if (rc == RC::SUCCESS)
+            rc = copy.append(vec->getDim(), vec->getData());
+    }
+    delete vec;
+    delete it;
+    if (rc == RC::SUCCESS)
+        rc = copy.saveFile(path);
+    if (rc != RC::SUCCESS)
+        SendInfo(Set::_logger, rc);
+    return rc;
+}
+
+LIB_EXPORT ISet* ISet::openFile(char const* const& path, FILE_MODE mode) {
+    if (path == nullptr){
+        SendInfo(Set::_logger, RC::NULLPTR_ERROR);
+        return nullptr;
+    }
+    return Set::openFile(path, mode);
+}
+
 ISet::~ISet() = default;
 
 Set::Set() :
-        _size(0),
         _dim(0),
+        _size(0),
+        _used(0),
         _capacity(0),
+        _storage(nullptr),
         _data(nullptr),
         _hashCodes(nullptr),
-        _nextHash(0){
+        _dead(nullptr),
+        _nextHash(0),
+        _version(0),
+        _garbageRatio(defaultGarbageRatio),
+        _allocator(ISetAllocator::getHeapAllocator()),
+        _growthFactor(defaultGrowthFactor),
+        _reserved(0),
+        _grid(nullptr),
+        _lshConfig{IVector::NORM::SECOND, 0, 0, 0., 0},
+        _lsh(nullptr),
+        _fd(-1),
+        _readOnly(false){
     _setIsValid = new(std::nothrow) bool[1]{true};
 ///IAA: вот Ваша идея предоставить setCB доступ к приватному массиву владеющего им Set'а - это потенциальная дыра.
 ///даже если Вы предоставляете его как const. Эта архитектура не выживет, если нужно будет переносить ее в многопоточное приложение,
@@ -747,8 +1138,11 @@ Set::Set() :
 }
 
 Set::~Set() {
-    delete [] _data;
-    delete [] _hashCodes;
+    if (_fd >= 0){
+        sync();
+        setfile::close(_fd);
+    }
+    delete [] _dead;
     _setIsValid[0] = false;
 }
 
@@ -760,8 +1154,380 @@ size_t Set::getSize() const {
     return _size;
 }
 
-RC Set::getCoords(size_t index, IVector *const &val) const {
-    if (_size == 0)
+bool Set::isDead(size_t slot) const {
+    return (_dead[slot / wordBits] >> (slot % wordBits)) & 1;
+}
+
+size_t Set::slotOf(size_t index) const {
+    if (_used == _size)
+        return index;
+    for (size_t word = 0; word * wordBits < _used; word++){
+        uint64_t alive = ~_dead[word];
+        size_t aliveCount = popCount(alive);
+        if (index < aliveCount){
+            for (; index > 0; index--)
+                alive &= alive - 1;
+            return word * wordBits + lowestBit(alive);
+        }
+        index -= aliveCount;
+    }
+    return _used;
+}
+
+size_t Set::nextAlive(size_t slot) const {
+    while (slot < _used){
+        uint64_t alive = ~_dead[slot / wordBits] >> (slot % wordBits);
+        if (alive != 0)
+            return std::min(slot + lowestBit(alive), _used);
+        slot = (slot / wordBits + 1) * wordBits;
+    }
+    return _used;
+}
+
+size_t Set::nextDead(size_t slot, size_t last) const {
+    while (slot < last){
+        uint64_t dead = _dead[slot / wordBits] >> (slot % wordBits);
+        if (dead != 0)
+            return std::min(slot + lowestBit(dead), last);
+        slot = (slot / wordBits + 1) * wordBits;
+    }
+    return last;
+}
+
+size_t Set::prevAlive(size_t slot) const {
+    while (slot > 0){
+        size_t last = slot - 1;
+        uint64_t alive = ~_dead[last / wordBits];
+        if (last % wordBits != wordBits - 1)
+            alive &= (uint64_t(1) << (last % wordBits + 1)) - 1;
+        if (alive != 0)
+            return last - last % wordBits + highestBit(alive);
+        slot = last - last % wordBits;
+    }
+    return _used;
+}
+
+void Set::dropTombstones() {
+    if (_used == _size)
+        return;
+    if (isShared()){
+        std::shared_ptr<SetStorage> storage = SetStorage::create(_capacity, _dim, _allocator);
+        if (storage != nullptr){
+            size_t dst = 0;
+            for (size_t slot = nextAlive(0); slot < _used; slot = nextAlive(slot + 1), dst++){
+                std::memcpy(storage->data + dst * _dim, _data + slot * _dim, _dim * sizeof(double));
+                storage->hashCodes[dst] = _hashCodes[slot];
+            }
+            std::memset(_dead, 0, bitmapWords(_used) * sizeof(uint64_t));
+            _used = dst;
+            adopt(storage);
+        }
+        // without memory for a copy tombstones stay, shared rows must not be moved
+        return;
+    }
+    size_t dst = 0;
+    for (size_t slot = nextAlive(0); slot < _used; slot = nextAlive(slot + 1), dst++){
+        if (slot == dst)
+            continue;
+        std::memcpy(_data + dst * _dim, _data + slot * _dim, _dim * sizeof(double));
+        _hashCodes[dst] = _hashCodes[slot];
+    }
+    std::memset(_dead, 0, bitmapWords(_used) * sizeof(uint64_t));
+    _used = dst;
+}
+
+RC Set::resize(size_t capacity) {
+    if (_fd >= 0)
+        return growFile(capacity);
+    auto* tmpDead = new(std::nothrow) uint64_t[bitmapWords(capacity)]();
+    if (tmpDead == nullptr){
+        Set::log(RC::ALLOCATION_ERROR, ILogger::Level::INFO, __FILE__, __FUNCTION__ , __LINE__);
+        return RC::ALLOCATION_ERROR;
+    }
+    if (_storage->image == nullptr && !isShared()){
+        bool resized = _storage->resize(capacity, _dim);
+        adopt(_storage);
+        if (!resized){
+            _capacity = std::min(_capacity, _storage->capacity);
+            delete [] tmpDead;
+            Set::log(RC::ALLOCATION_ERROR, ILogger::Level::INFO, __FILE__, __FUNCTION__ , __LINE__);
+            return RC::ALLOCATION_ERROR;
+        }
+    }
+    else {
+        std::shared_ptr<SetStorage> storage = SetStorage::copyOf(*_storage, _used, capacity, _dim, _allocator);
+        if (storage == nullptr){
+            delete [] tmpDead;
+            Set::log(RC::ALLOCATION_ERROR, ILogger::Level::INFO, __FILE__, __FUNCTION__ , __LINE__);
+            return RC::ALLOCATION_ERROR;
+        }
+        adopt(storage);
+    }
+    std::memcpy(tmpDead, _dead, bitmapWords(_used) * sizeof(uint64_t));
+    delete [] _dead;
+    _dead = tmpDead;
+    _capacity = capacity;
+    return RC::SUCCESS;
+}
+
+size_t Set::grownCapacity(size_t needed) const {
+    double grown = std::ceil(static_cast<double>(_capacity) * _growthFactor);
+    size_t capacity = grown < static_cast<double>(SIZE_MAX / 2) ? static_cast<size_t>(grown) : needed;
+    return std::max(std::max(capacity, _capacity + 1), needed);
+}
+
+RC Set::growFile(size_t capacity) {
+    auto* tmpDead = new(std::nothrow) uint64_t[bitmapWords(capacity)]();
+    if (tmpDead == nullptr){
+        Set::log(RC::ALLOCATION_ERROR, ILogger::Level::INFO, __FILE__, __FUNCTION__ , __LINE__);
+        return RC::ALLOCATION_ERROR;
+    }
+    std::shared_ptr<SetStorage> storage;
+    RC rc = setfile::grow(_fd, _dim, capacity, storage);
+    if (rc != RC::SUCCESS){
+        delete [] tmpDead;
+        Set::log(rc, ILogger::Level::INFO, __FILE__, __FUNCTION__ , __LINE__);
+        return rc;
+    }
+    if (_used != 0){
+        std::memcpy(storage->hashCodes, _hashCodes, _used * sizeof(size_t));
+        std::memcpy(tmpDead, _dead, bitmapWords(_used) * sizeof(uint64_t));
+    }
+    delete [] _dead;
+    _dead = tmpDead;
+    _capacity = capacity;
+    adopt(storage);
+    return RC::SUCCESS;
+}
+
+RC Set::sync() {
+    if (_fd < 0 || _storage == nullptr)
+        return RC::SUCCESS;
+    dropTombstones();
+    // saved index stays valid until the set is changed
+    std::vector<unsigned char> index;
+    if (_version != 0 && _grid != nullptr){
+        index.resize(_grid->getImageSize());
+        _grid->writeImage(index.data());
+    }
+    RC rc = setfile::sync(_fd, *_storage, _used, _capacity, _nextHash, _garbageRatio, _version != 0 ? &index : nullptr);
+    if (rc != RC::SUCCESS)
+        Set::log(rc, ILogger::Level::INFO, __FILE__, __FUNCTION__ , __LINE__);
+    return rc;
+}
+
+RC Set::saveFile(char const* const& path) const {
+    std::vector<unsigned char> index;
+    {
+        std::lock_guard<std::mutex> guard(_gridLock);
+        if (_grid != nullptr){
+            index.resize(_grid->getImageSize());
+            _grid->writeImage(index.data());
+        }
+        else if (_version == 0 && _storage != nullptr && _storage->gridImage != nullptr)
+            index.assign(_storage->gridImage, _storage->gridImage + _storage->gridImageSize);
+    }
+    RC rc = setfile::save(path, _dim, _size, startCapacity, _nextHash, _garbageRatio, [this](std::function<bool(double const*, size_t)> const& visit){
+        for (size_t slot = nextAlive(0); slot < _used; slot = nextAlive(slot + 1))
+            if (!visit(_data + slot * _dim, _hashCodes[slot]))
+                return false;
+        return true;
+    }, index);
+    if (rc != RC::SUCCESS)
+        Set::log(rc, ILogger::Level::INFO, __FILE__, __FUNCTION__ , __LINE__);
+    return rc;
+}
+
+Set* Set::openFile(char const* const& path, FILE_MODE mode) {
+    setfile::Header header;
+    std::shared_ptr<SetStorage> storage;
+    int fd = -1;
+    RC rc = setfile::open(path, mode == FILE_MODE::READ_WRITE, header, storage, fd);
+    if (rc != RC::SUCCESS){
+        Set::log(rc, ILogger::Level::INFO, __FILE__, __FUNCTION__ , __LINE__);
+        return nullptr;
+    }
+    auto set = new(std::nothrow) Set();
+    if (set != nullptr && header.dim != 0)
+        set->_dead = new(std::nothrow) uint64_t[bitmapWords(header.capacity)]();
+    if (set == nullptr || (header.dim != 0 && set->_dead == nullptr)){
+        delete set;
+        setfile::close(fd);
+        Set::log(RC::ALLOCATION_ERROR, ILogger::Level::INFO, __FILE__, __FUNCTION__ , __LINE__);
+        return nullptr;
+    }
+    if (header.dim != 0){
+        set->adopt(storage);
+        set->_dim = header.dim;
+        set->_size = header.count;
+        set->_used = header.count;
+        set->_capacity = header.capacity;
+    }
+    set->_nextHash = header.nextHash;
+    set->_garbageRatio = header.garbageRatio;
+    set->_fd = fd;
+    set->_readOnly = mode != FILE_MODE::READ_WRITE;
+    return set;
+}
+
+RC Set::checkWritable(const char* const& function, int line) const {
+    if (_readOnly){
+        Set::log(RC::OPERATION_NOT_SUPPORTED, ILogger::Level::INFO, __FILE__, function, line);
+        return RC::OPERATION_NOT_SUPPORTED;
+    }
+    return RC::SUCCESS;
+}
+
+bool Set::isShared() const {
+    if (_storage.use_count() > 1)
+        return true;
+    // pairs with release of the last snapshot, its reads happen before writes of the set
+    std::atomic_thread_fence(std::memory_order_acquire);
+    return false;
+}
+
+bool Set::claimSlot() const {
+    return _storage->claim(_used);
+}
+
+RC Set::detach() {
+    std::shared_ptr<SetStorage> storage = SetStorage::copyOf(*_storage, _used, _capacity, _dim, _allocator);
+    if (storage == nullptr){
+        Set::log(RC::ALLOCATION_ERROR, ILogger::Level::INFO, __FILE__, __FUNCTION__ , __LINE__);
+        return RC::ALLOCATION_ERROR;
+    }
+    adopt(storage);
+    return RC::SUCCESS;
+}
+
+void Set::adopt(std::shared_ptr<SetStorage> storage) {
+    _storage = std::move(storage);
+    _data = _storage->data;
+    _hashCodes = _storage->hashCodes;
+}
+
+RC Set::findSlot(IVector const * const& pat, IVector::NORM n, double tol, size_t& slot) const {
+    if (_size == 0)
+        return RC::VECTOR_NOT_FOUND;
+    double const* row = pat->getData();
+    if (row == nullptr){
+        log(RC::NULLPTR_ERROR, ILogger::Level::INFO, __FILE__, __FUNCTION__ , __LINE__);
+        return RC::NULLPTR_ERROR;
+    }
+
+    // buffers are kept by the thread, so a lookup allocates only while they grow
+    thread_local std::vector<double> box;
+    thread_local std::vector<size_t> hashes;
+    if (findHashed(row, n, tol, hashes, slot))
+        return slot < _used ? RC::SUCCESS : RC::VECTOR_NOT_FOUND;
+    bool indexed = false;
+    {
+        // index is used only if queryBox has built it
+        std::lock_guard<std::mutex> guard(_gridLock);
+        if (_grid != nullptr){
+            updateGrid();
+            indexed = collectNear(row, tol, box, hashes);
+        }
+    }
+    slot = indexed ? firstAmong(hashes, row, n, tol) : scanSlots(row, n, tol);
+    return slot < _used ? RC::SUCCESS : RC::VECTOR_NOT_FOUND;
+}
+
+bool Set::collectNear(double const* row, double tol, std::vector<double>& box, std::vector<size_t>& hashes) const {
+    if (_grid == nullptr)
+        return false;
+    box.resize(2 * _dim);
+    double* lower = box.data();
+    double* upper = box.data() + _dim;
+    for (size_t i = 0; i < _dim; i++){
+        lower[i] = row[i] - tol;
+        upper[i] = row[i] + tol;
+    }
+    hashes.clear();
+    return _grid->collect(lower, upper, hashes);
+}
+
+size_t Set::firstAmong(std::vector<size_t> const& hashes, double const* row, IVector::NORM n, double tol) const {
+    kernel::RowComparer equal = kernel::rowComparer(_dim, n);
+    size_t dim = _dim;
+    return firstAmongOf(hashes, [equal, dim, row, tol](double const* other){
+        return equal(dim, other, row, tol);
+    });
+}
+
+template<class Equal>
+size_t Set::firstAmongOf(std::vector<size_t> const& hashes, Equal const& equal) const {
+    size_t first = _used;
+    for (size_t hash : hashes){
+        // unique index is the slot of a vector until storage is compacted, so it is tried before the search
+        size_t slot = locate(hash, hash);
+        if (slot < first && _hashCodes[slot] == hash && !isDead(slot) && equal(_data + slot * _dim))
+            first = slot;
+    }
+    return first;
+}
+
+size_t Set::findIn(double const* rows, size_t count, double const* pat, IVector::NORM n, double tol) const {
+    return kernel::findRow(_dim, rows, count, pat, n, tol);
+}
+
+Set* Set::createEmpty() const {
+    return new(std::nothrow) Set();
+}
+
+size_t Set::scanSlots(double const* row, IVector::NORM n, double tol) const {
+    if (_used < parallelScanSlots)
+        return scanRange(0, _used, row, n, tol, nullptr);
+
+    ScanPool& pool = ScanPool::instance();
+    size_t parts = std::min(pool.getThreadCount() * scanPartsPerThread, _used / scanPartSlots);
+    size_t partSlots = (_used + parts - 1) / parts;
+    std::atomic<size_t> first(_used);
+    pool.run(parts, [&](size_t part){
+        size_t begin = part * partSlots;
+        size_t end = std::min(begin + partSlots, _used);
+        size_t found = scanRange(begin, end, row, n, tol, &first);
+        if (found == end)
+            return;
+        size_t current = first.load();
+        while (found < current && !first.compare_exchange_weak(current, found));
+    });
+    return first.load();
+}
+
+size_t Set::scanRange(size_t first, size_t last, double const* row, IVector::NORM n, double tol, std::atomic<size_t> const* stop) const {
+    // runs of alive slots are passed to the kernel whole, cut to check stop between pieces
+    size_t slot = std::min(nextAlive(first), last);
+    while (slot < last){
+        if (stop != nullptr && stop->load(std::memory_order_relaxed) <= slot)
+            return last;
+        size_t runEnd = nextDead(slot, std::min(last, slot + scanStopCheckSlots));
+        size_t found = findIn(_data + slot * _dim, runEnd - slot, row, n, tol);
+        if (found < runEnd - slot)
+            return slot + found;
+        slot = std::min(nextAlive(runEnd), last);
+    }
+    return last;
+}
+
+RC Set::removeSlot(size_t slot) {
+    if (_summary.getDim() == _dim)
+        _summary.remove(_data + slot * _dim);
+    _dead[slot / wordBits] |= uint64_t(1) << (slot % wordBits);
+    _size--;
+    _version++;
+    _journal.record(CHANGE::REMOVE, _hashCodes[slot], _version);
+    while (_used > 0 && isDead(_used - 1)){
+        _used--;
+        _dead[_used / wordBits] &= ~(uint64_t(1) << (_used % wordBits));
+    }
+    if (static_cast<double>(_used - _size) > _garbageRatio * static_cast<double>(_used))
+        dropTombstones();
+    return RC::SUCCESS;
+}
+
+RC Set::getCoords(size_t index, IVector *const &val) const {
+    if (_size == 0)
         return RC::VECTOR_NOT_FOUND;
     RC rc = RC::SUCCESS;
     vectorIsValid(val, rc, __FILE__, __FUNCTION__, __LINE__);
@@ -769,7 +1535,7 @@ RC Set::getCoords(size_t index, IVector *const &val) const {
     if (rc != RC::SUCCESS)
         return rc;
 
-    return val->setData(_dim, _data + index * _dim);
+    return val->setData(_dim, _data + slotOf(index) * _dim);
 }
 
 RC Set::findFirstAndCopyCoords(const IVector *const &pat, IVector::NORM n, double tol, IVector *const &val) const {
@@ -779,54 +1545,25 @@ RC Set::findFirstAndCopyCoords(const IVector *const &pat, IVector::NORM n, doubl
     if (validVectorRC != RC::SUCCESS)
         return validVectorRC;
 
-    if (_size == 0)
-        return RC::VECTOR_NOT_FOUND;
-
-    IVector* it = IVector::createVector(_dim, _data);
-    if (it == nullptr) {
-        Set::log(RC::NULLPTR_ERROR, ILogger::Level::INFO, __FILE__, __FUNCTION__ , __LINE__);
-        return RC::NULLPTR_ERROR;
-    }
+    size_t slot = 0;
+    RC findRC = findSlot(pat, n, tol, slot);
+    if (findRC != RC::SUCCESS)
+        return findRC;
 
-    size_t i = 0;
-    do{
-        if (IVector::equals(it, pat, n, tol)) {
-            RC setDataRC = val->setData(_dim, it->getData());
-            delete it;
-            if (setDataRC != RC::SUCCESS)
-                Set::log(setDataRC, ILogger::Level::INFO, __FILE__, __FUNCTION__ , __LINE__);
-            return setDataRC;
-        }
-        i++;
-        if (i < _size){
-            RC setDataRC = it->setData(_dim, _data + i * _dim);
-            if (setDataRC != RC::SUCCESS){
-                Set::log(setDataRC, ILogger::Level::INFO, __FILE__, __FUNCTION__ , __LINE__);
-                delete it;
-                return setDataRC;
-            }
-        }
-    }while(i < _size);
-
-
-    return RC::VECTOR_NOT_FOUND;
+    RC setDataRC = val->setData(_dim, _data + slot * _dim);
+    if (setDataRC != RC::SUCCESS)
+        Set::log(setDataRC, ILogger::Level::INFO, __FILE__, __FUNCTION__ , __LINE__);
+    return setDataRC;
 }
 
 RC Set::insert(const IVector *const &val, IVector::NORM n, double tol) {
+    RC writableRC = checkWritable(__FUNCTION__, __LINE__);
+    if (writableRC != RC::SUCCESS)
+        return writableRC;
     if (_dim == 0 && val != nullptr) {
-        _dim = val->getDim();
-        _capacity = startCapacity;
-        _data = new(std::nothrow) double[_capacity * _dim];
-        _hashCodes = new(std::nothrow) size_t[_capacity];
-        if (_data == nullptr || _hashCodes == nullptr){
-            delete [] _data;
-            delete [] _hashCodes;
-            _data = nullptr;
-            _hashCodes = nullptr;
-            _capacity = 0;
-            SendInfo(_logger, RC::NULLPTR_ERROR);
-            return RC::NULLPTR_ERROR;
-        }
+        RC initRC = init(val->getDim());
+        if (initRC != RC::SUCCESS)
+            return initRC;
     }
     RC checkValidVectorRC = RC::SUCCESS;
     vectorIsValid(val, checkValidVectorRC, __FILE__, __FUNCTION__ , __LINE__);
@@ -847,84 +1584,540 @@ RC Set::insert(const IVector *const &val, IVector::NORM n, double tol) {
         return RC::NULLPTR_ERROR;
     }
 
-    if (_size >= _capacity){
-        auto* tmpData = new(std::nothrow) double[_capacity * capacityGain * _dim];
-        auto* tmpHash = new(std::nothrow) size_t[_capacity * capacityGain];
-        if (tmpHash == nullptr || tmpData == nullptr){
-            delete [] tmpData;
-            delete [] tmpHash;
-            Set::log(RC::NULLPTR_ERROR, ILogger::Level::INFO, __FILE__, __FUNCTION__ , __LINE__);
-            return RC::NULLPTR_ERROR;
-        }
-        std::memcpy(tmpData, _data, _capacity * _dim * sizeof(double));
-        std::memcpy(tmpHash, _hashCodes, _capacity * sizeof(size_t));
-        delete [] _data;
-        delete [] _hashCodes;
-        _data = tmpData;
-        _hashCodes = tmpHash;
+    return append(_dim, vecData);
+}
 
-        _capacity *= capacityGain;
+RC Set::append(size_t dim, double const* row) {
+    RC writableRC = checkWritable(__FUNCTION__, __LINE__);
+    if (writableRC != RC::SUCCESS)
+        return writableRC;
+    if (row == nullptr){
+        Set::log(RC::NULLPTR_ERROR, ILogger::Level::INFO, __FILE__, __FUNCTION__, __LINE__);
+        return RC::NULLPTR_ERROR;
     }
-    std::memcpy(_data + _size * _dim, vecData, _dim * sizeof (double));
-    _hashCodes[_size] = _nextHash;
+    if (_dim == 0 && dim != 0) {
+        RC initRC = init(dim);
+        if (initRC != RC::SUCCESS)
+            return initRC;
+    }
+    if (dim != _dim){
+        Set::log(RC::MISMATCHING_DIMENSIONS, ILogger::Level::INFO, __FILE__, __FUNCTION__, __LINE__);
+        return RC::MISMATCHING_DIMENSIONS;
+    }
+
+    if (_used >= _capacity)
+        dropTombstones();
+    if (_used >= _capacity){
+        RC growRC = resize(grownCapacity(_used + 1));
+        if (growRC != RC::SUCCESS)
+            return growRC;
+    }
+    // slots freed by removal of trailing vectors may still be read by a snapshot, free slots may be taken by a clone
+    if (isShared() && !claimSlot()){
+        RC detachRC = detach();
+        if (detachRC != RC::SUCCESS)
+            return detachRC;
+    }
+    std::memcpy(_data + _used * _dim, row, _dim * sizeof (double));
+    if (_grid != nullptr && _grid->add(row, _nextHash) != RC::SUCCESS)
+        _grid.reset();
+    if (_lsh != nullptr && _lsh->add(row, _nextHash) != RC::SUCCESS)
+        _lsh.reset();
+    if (_summary.getDim() == _dim)
+        _summary.add(row);
+    _hashCodes[_used] = _nextHash;
     _nextHash++;
+    _used++;
     _size++;
+    _version++;
+    _journal.record(CHANGE::INSERT, _hashCodes[_used - 1], _version);
+    return RC::SUCCESS;
+}
+
+RC Set::insertBatch(double const* rows, size_t count, size_t dim, IVector::NORM n, double tol, size_t& inserted) {
+    inserted = 0;
+    RC writableRC = checkWritable(__FUNCTION__, __LINE__);
+    if (writableRC != RC::SUCCESS)
+        return writableRC;
+    if (count == 0)
+        return RC::SUCCESS;
+    if (rows == nullptr){
+        Set::log(RC::NULLPTR_ERROR, ILogger::Level::INFO, __FILE__, __FUNCTION__, __LINE__);
+        return RC::NULLPTR_ERROR;
+    }
+    if (std::isnan(tol) || tol < 0.){
+        Set::log(RC::INVALID_ARGUMENT, ILogger::Level::INFO, __FILE__, __FUNCTION__, __LINE__);
+        return RC::INVALID_ARGUMENT;
+    }
+    if (_dim == 0 && dim != 0) {
+        RC initRC = init(dim);
+        if (initRC != RC::SUCCESS)
+            return initRC;
+    }
+    if (dim != _dim){
+        Set::log(RC::MISMATCHING_DIMENSIONS, ILogger::Level::INFO, __FILE__, __FUNCTION__, __LINE__);
+        return RC::MISMATCHING_DIMENSIONS;
+    }
+
+    if (_used + count > _capacity)
+        dropTombstones();
+    if (_used + count > _capacity){
+        RC growRC = resize(grownCapacity(_used + count));
+        if (growRC != RC::SUCCESS)
+            return growRC;
+    }
+
+    // a mutator has no concurrent readers, so the grid built for the batch is used and extended without _gridLock
+    std::vector<double> box;
+    std::vector<size_t> hashes;
+    for (size_t i = 0; i < count; i++){
+        double const* row = rows + i * _dim;
+        if (_size != 0){
+            updateGrid();
+            if (containsRow(row, n, tol, box, hashes))
+                continue;
+        }
+        RC appendRC = append(_dim, row);
+        if (appendRC != RC::SUCCESS)
+            return appendRC;
+        inserted++;
+    }
+    return RC::SUCCESS;
+}
 
+bool Set::containsRow(double const* row, IVector::NORM n, double tol, std::vector<double>& box, std::vector<size_t>& hashes) const {
+    size_t slot = _used;
+    if (findHashed(row, n, tol, hashes, slot))
+        return slot < _used;
+    if (collectNear(row, tol, box, hashes))
+        return firstAmong(hashes, row, n, tol) < _used;
+    return scanSlots(row, n, tol) < _used;
+}
+
+RC Set::init(size_t dim) {
+    size_t capacity = std::max(startCapacity, _reserved);
+    if (_fd >= 0){
+        _dim = dim;
+        RC growRC = growFile(capacity);
+        if (growRC != RC::SUCCESS)
+            _dim = 0;
+        return growRC;
+    }
+    std::shared_ptr<SetStorage> storage = SetStorage::create(capacity, dim, _allocator);
+    _dead = new(std::nothrow) uint64_t[bitmapWords(capacity)]();
+    // summary failed to allocate is rebuilt by the first getter
+    _summary.reset(dim);
+    if (storage == nullptr || _dead == nullptr){
+        delete [] _dead;
+        _dead = nullptr;
+        SendInfo(_logger, RC::ALLOCATION_ERROR);
+        return RC::ALLOCATION_ERROR;
+    }
+    adopt(storage);
+    _dim = dim;
+    _capacity = capacity;
     return RC::SUCCESS;
 }
 
 RC Set::remove(size_t index) {
+    RC writableRC = checkWritable(__FUNCTION__, __LINE__);
+    if (writableRC != RC::SUCCESS)
+        return writableRC;
     RC validIndexRC = RC::SUCCESS;
     indexIsValid(index, validIndexRC, __FILE__, __FUNCTION__ , __LINE__);
     if (validIndexRC != RC::SUCCESS)
         return validIndexRC;
 
-    double * dest = _data + index * _dim;
-    double * src = dest + _dim;
-    size_t size = (_size - 1 - index) * _dim * sizeof(double);
-    std::memmove(dest, src, size);
-    std::memmove(_hashCodes + index, _hashCodes + index + 1, (_size - index - 1) * sizeof(size_t));
-    _size--;
-
-    return RC::SUCCESS;
+    return removeSlot(slotOf(index));
 }
 
 RC Set::remove(const IVector *const &pat, IVector::NORM n, double tol) {
+    RC writableRC = checkWritable(__FUNCTION__, __LINE__);
+    if (writableRC != RC::SUCCESS)
+        return writableRC;
     RC validVectorRC = RC::SUCCESS;
     vectorIsValid(pat, validVectorRC, __FILE__, __FUNCTION__ , __LINE__);
     if (validVectorRC != RC::SUCCESS)
         return validVectorRC;
 
-    if (_size == 0)
-        return RC::VECTOR_NOT_FOUND;
+    size_t slot = 0;
+    RC findRC = findSlot(pat, n, tol, slot);
+    if (findRC != RC::SUCCESS)
+        return findRC;
 
-    IVector* it = IVector::createVector(_dim, _data);
-    if (it == nullptr){
+    return removeSlot(slot);
+}
+
+RC Set::removeIf(std::function<bool(double const*, size_t)> const& pred) {
+    RC writableRC = checkWritable(__FUNCTION__, __LINE__);
+    if (writableRC != RC::SUCCESS)
+        return writableRC;
+    if (!pred){
         Set::log(RC::NULLPTR_ERROR, ILogger::Level::INFO, __FILE__, __FUNCTION__ , __LINE__);
         return RC::NULLPTR_ERROR;
     }
-    size_t i = 0;
-    do{
-        if (IVector::equals(it, pat, n, tol)){
-            RC removeRC = remove(i);
-            if (removeRC != RC::SUCCESS)
-                Set::log(removeRC, ILogger::Level::INFO, __FILE__, __FUNCTION__, __LINE__);
-            delete it;
-            return removeRC;
+    if (_dim != 0 && isShared()){
+        RC detachRC = detach();
+        if (detachRC != RC::SUCCESS)
+            return detachRC;
+    }
+    size_t dst = 0;
+    for (size_t slot = nextAlive(0); slot < _used; slot = nextAlive(slot + 1)){
+        if (pred(_data + slot * _dim, _dim)){
+            if (_summary.getDim() == _dim)
+                _summary.remove(_data + slot * _dim);
+            _journal.record(CHANGE::REMOVE, _hashCodes[slot], _version + 1);
+            continue;
         }
-        i++;
-        if (i < _size){
-            RC setDataRC = it->setData(_dim, _data + i * _dim);
-            if (setDataRC != RC::SUCCESS){
-                Set::log(setDataRC, ILogger::Level::INFO, __FILE__, __FUNCTION__ , __LINE__);
-                delete it;
-                return setDataRC;
-            }
+        if (slot != dst){
+            std::memcpy(_data + dst * _dim, _data + slot * _dim, _dim * sizeof(double));
+            _hashCodes[dst] = _hashCodes[slot];
+        }
+        dst++;
+    }
+    if (_dead != nullptr)
+        std::memset(_dead, 0, bitmapWords(_used) * sizeof(uint64_t));
+    if (dst != _size)
+        _version++;
+    _used = dst;
+    _size = dst;
+    return RC::SUCCESS;
+}
+
+void Set::updateGrid() const {
+    if (_grid == nullptr && _version == 0 && _storage != nullptr && _storage->gridImage != nullptr)
+        _grid.reset(GridIndex::readImage(_storage->gridImage, _storage->gridImageSize));
+    if (_grid != nullptr && _grid->getEntries() - _size <= _size && _size <= 4 * _grid->getBuiltFor() + gridCellLoad)
+        return;
+    _grid.reset();
+    std::vector<double> lower(_data + nextAlive(0) * _dim, _data + nextAlive(0) * _dim + _dim), upper(lower);
+    for (size_t slot = nextAlive(0); slot < _used; slot = nextAlive(slot + 1)){
+        for (size_t i = 0; i < _dim; i++){
+            lower[i] = std::min(lower[i], _data[slot * _dim + i]);
+            upper[i] = std::max(upper[i], _data[slot * _dim + i]);
         }
-    } while(i <= _size);
+    }
+    std::unique_ptr<GridIndex> grid(new(std::nothrow) GridIndex(_dim, lower.data(), upper.data(), _size));
+    if (grid == nullptr)
+        return;
+    for (size_t slot = nextAlive(0); slot < _used; slot = nextAlive(slot + 1))
+        if (grid->add(_data + slot * _dim, _hashCodes[slot]) != RC::SUCCESS)
+            return;
+    _grid = std::move(grid);
+}
 
-    delete it;
-    return RC::VECTOR_NOT_FOUND;
+bool Set::findHashed(double const* row, IVector::NORM n, double tol, std::vector<size_t>& hashes, size_t& slot) const {
+    if (_lshConfig.tables == 0 || n != _lshConfig.norm)
+        return false;
+    auto start = std::chrono::steady_clock::now();
+    hashes.clear();
+    {
+        std::lock_guard<std::mutex> guard(_lshLock);
+        updateLsh();
+        if (_lsh == nullptr)
+            return false;
+        _lsh->collect(row, hashes);
+    }
+    // a vector sharing buckets in several tables is verified once
+    std::sort(hashes.begin(), hashes.end());
+    hashes.erase(std::unique(hashes.begin(), hashes.end()), hashes.end());
+    slot = firstAmong(hashes, row, n, tol);
+    auto end = std::chrono::steady_clock::now();
+
+    uint64_t query = _lshCounters.queries.fetch_add(1, std::memory_order_relaxed) + 1;
+    _lshCounters.candidates.fetch_add(hashes.size(), std::memory_order_relaxed);
+    if (slot < _used)
+        _lshCounters.found.fetch_add(1, std::memory_order_relaxed);
+    _lshCounters.lookupNanos.fetch_add(std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count(), std::memory_order_relaxed);
+    if (_lshConfig.checkEvery == 0 || query % _lshConfig.checkEvery != 0)
+        return true;
+
+    size_t exact = scanSlots(row, n, tol);
+    _lshCounters.exactNanos.fetch_add(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - end).count(), std::memory_order_relaxed);
+    _lshCounters.checked.fetch_add(1, std::memory_order_relaxed);
+    if (exact < _used){
+        _lshCounters.checkedFound.fetch_add(1, std::memory_order_relaxed);
+        if (slot >= _used)
+            _lshCounters.checkedMissed.fetch_add(1, std::memory_order_relaxed);
+    }
+    return true;
+}
+
+void Set::updateLsh() const {
+    if (_lsh != nullptr && _lsh->getEntries() - _size <= _size)
+        return;
+    _lsh.reset(LshIndex::create(_dim, _lshConfig));
+    if (_lsh == nullptr)
+        return;
+    for (size_t slot = nextAlive(0); slot < _used; slot = nextAlive(slot + 1)){
+        if (_lsh->add(_data + slot * _dim, _hashCodes[slot]) != RC::SUCCESS){
+            _lsh.reset();
+            return;
+        }
+    }
+}
+
+bool Set::updateSummary() const {
+    if (_summary.getDim() != _dim || _summary.getCount() != _size){
+        if (!_summary.reset(_dim))
+            return false;
+        for (size_t slot = nextAlive(0); slot < _used; slot = nextAlive(slot + 1))
+            _summary.add(_data + slot * _dim);
+        return true;
+    }
+    if (_summary.boundsAreStale()){
+        _summary.clearBounds();
+        for (size_t slot = nextAlive(0); slot < _used; slot = nextAlive(slot + 1))
+            _summary.extendBounds(_data + slot * _dim);
+    }
+    return true;
+}
+
+bool Set::isInside(double const* row, double const* lower, double const* upper) const {
+    for (size_t i = 0; i < _dim; i++)
+        if (!(lower[i] <= row[i] && row[i] <= upper[i]))
+            return false;
+    return true;
+}
+
+RC Set::queryBox(ICompact const* const& box, std::function<void(double const*, size_t)> const& callback) const {
+    if (box == nullptr || !callback){
+        Set::log(RC::NULLPTR_ERROR, ILogger::Level::INFO, __FILE__, __FUNCTION__ , __LINE__);
+        return RC::NULLPTR_ERROR;
+    }
+    if (_size == 0)
+        return RC::SUCCESS;
+    if (box->getDim() != _dim){
+        Set::log(RC::MISMATCHING_DIMENSIONS, ILogger::Level::INFO, __FILE__, __FUNCTION__ , __LINE__);
+        return RC::MISMATCHING_DIMENSIONS;
+    }
+    IVector* lowerVec = nullptr;
+    IVector* upperVec = nullptr;
+    RC rc = box->getLeftBoundary(lowerVec);
+    if (rc == RC::SUCCESS)
+        rc = box->getRightBoundary(upperVec);
+    if (rc != RC::SUCCESS){
+        delete lowerVec;
+        Set::log(rc, ILogger::Level::INFO, __FILE__, __FUNCTION__ , __LINE__);
+        return rc;
+    }
+    double const* lower = lowerVec->getData();
+    double const* upper = upperVec->getData();
+
+    std::vector<size_t> slots;
+    std::vector<size_t> hashes;
+    bool indexed = false;
+    {
+        std::lock_guard<std::mutex> guard(_gridLock);
+        updateGrid();
+        indexed = _grid != nullptr && _grid->collect(lower, upper, hashes);
+    }
+    if (indexed){
+        for (size_t hash : hashes){
+            size_t slot = locate(hash, _used);
+            if (slot < _used && _hashCodes[slot] == hash && !isDead(slot) && isInside(_data + slot * _dim, lower, upper))
+                slots.push_back(slot);
+        }
+        std::sort(slots.begin(), slots.end());
+    }
+    else {
+        for (size_t slot = nextAlive(0); slot < _used; slot = nextAlive(slot + 1))
+            if (isInside(_data + slot * _dim, lower, upper))
+                slots.push_back(slot);
+    }
+    delete lowerVec;
+    delete upperVec;
+    for (size_t slot : slots)
+        callback(_data + slot * _dim, _dim);
+    return RC::SUCCESS;
+}
+
+RC Set::setGarbageRatio(double ratio) {
+    if (std::isnan(ratio) || ratio < 0. || ratio > 1.){
+        Set::log(RC::INVALID_ARGUMENT, ILogger::Level::INFO, __FILE__, __FUNCTION__ , __LINE__);
+        return RC::INVALID_ARGUMENT;
+    }
+    _garbageRatio = ratio;
+    if (static_cast<double>(_used - _size) > _garbageRatio * static_cast<double>(_used))
+        dropTombstones();
+    return RC::SUCCESS;
+}
+
+RC Set::compact() {
+    dropTombstones();
+    return RC::SUCCESS;
+}
+
+RC Set::reserve(size_t capacity) {
+    RC writableRC = checkWritable(__FUNCTION__, __LINE__);
+    if (writableRC != RC::SUCCESS)
+        return writableRC;
+    if (_dim == 0){
+        _reserved = capacity;
+        return RC::SUCCESS;
+    }
+    if (capacity <= _capacity)
+        return RC::SUCCESS;
+    return resize(capacity);
+}
+
+RC Set::shrinkToFit() {
+    RC writableRC = checkWritable(__FUNCTION__, __LINE__);
+    if (writableRC != RC::SUCCESS)
+        return writableRC;
+    _reserved = 0;
+    if (_dim == 0)
+        return RC::SUCCESS;
+    dropTombstones();
+    // file is not truncated, its capacity is kept for later growth
+    size_t capacity = std::max(_used, startCapacity);
+    if (_fd >= 0 || capacity >= _capacity)
+        return RC::SUCCESS;
+    return resize(capacity);
+}
+
+RC Set::setGrowthFactor(double factor) {
+    if (std::isnan(factor) || std::isinf(factor) || factor <= 1.){
+        Set::log(RC::INVALID_ARGUMENT, ILogger::Level::INFO, __FILE__, __FUNCTION__ , __LINE__);
+        return RC::INVALID_ARGUMENT;
+    }
+    _growthFactor = factor;
+    return RC::SUCCESS;
+}
+
+RC Set::enableLsh(IVector::NORM n, size_t tables, size_t hashesPerTable, double bucketWidth, size_t checkEvery) {
+    if ((n != IVector::NORM::FIRST && n != IVector::NORM::SECOND) || tables == 0 || hashesPerTable == 0 ||
+        std::isnan(bucketWidth) || std::isinf(bucketWidth) || bucketWidth <= 0.){
+        Set::log(RC::INVALID_ARGUMENT, ILogger::Level::INFO, __FILE__, __FUNCTION__ , __LINE__);
+        return RC::INVALID_ARGUMENT;
+    }
+    _lshConfig = LshConfig{n, tables, hashesPerTable, bucketWidth, checkEvery};
+    _lshCounters.reset();
+    _lsh.reset();
+    if (_dim == 0)
+        return RC::SUCCESS;
+    updateLsh();
+    if (_lsh == nullptr){
+        _lshConfig.tables = 0;
+        Set::log(RC::ALLOCATION_ERROR, ILogger::Level::INFO, __FILE__, __FUNCTION__ , __LINE__);
+        return RC::ALLOCATION_ERROR;
+    }
+    return RC::SUCCESS;
+}
+
+RC Set::disableLsh() {
+    _lshConfig.tables = 0;
+    _lsh.reset();
+    return RC::SUCCESS;
+}
+
+RC Set::getLshStats(LshStats& stats) const {
+    _lshCounters.read(stats);
+    return RC::SUCCESS;
+}
+
+RC Set::setJournalCapacity(size_t capacity) {
+    _journal.setCapacity(capacity, _version);
+    return RC::SUCCESS;
+}
+
+RC Set::getChangesSince(uint64_t version, std::function<void(Change const&, double const*)> const& callback, uint64_t& current) const {
+    if (!callback){
+        Set::log(RC::NULLPTR_ERROR, ILogger::Level::INFO, __FILE__, __FUNCTION__ , __LINE__);
+        return RC::NULLPTR_ERROR;
+    }
+    if (version > _version){
+        Set::log(RC::INVALID_ARGUMENT, ILogger::Level::INFO, __FILE__, __FUNCTION__ , __LINE__);
+        return RC::INVALID_ARGUMENT;
+    }
+    current = _version;
+    if (version != 0 && _journal.covers(version)){
+        _journal.forEachSince(version, [this, &callback](Change const& change){
+            double const* coords = nullptr;
+            if (change.kind == CHANGE::INSERT){
+                size_t slot = locate(change.hash, _used);
+                if (slot < _used && _hashCodes[slot] == change.hash && !isDead(slot))
+                    coords = _data + slot * _dim;
+            }
+            callback(change, coords);
+        });
+        return RC::SUCCESS;
+    }
+    callback(Change{CHANGE::RESET, _version, 0}, nullptr);
+    for (size_t slot = nextAlive(0); slot < _used; slot = nextAlive(slot + 1))
+        callback(Change{CHANGE::INSERT, _version, _hashCodes[slot]}, _data + slot * _dim);
+    return RC::SUCCESS;
+}
+
+RC Set::getBounds(IVector*& lower, IVector*& upper) const {
+    if (_size == 0)
+        return RC::SOURCE_SET_EMPTY;
+    std::lock_guard<std::mutex> guard(_summaryLock);
+    if (!updateSummary()){
+        Set::log(RC::ALLOCATION_ERROR, ILogger::Level::INFO, __FILE__, __FUNCTION__ , __LINE__);
+        return RC::ALLOCATION_ERROR;
+    }
+    IVector* lowerVec = IVector::createVector(_dim, _summary.getLower());
+    IVector* upperVec = IVector::createVector(_dim, _summary.getUpper());
+    if (lowerVec == nullptr || upperVec == nullptr){
+        delete lowerVec;
+        delete upperVec;
+        Set::log(RC::ALLOCATION_ERROR, ILogger::Level::INFO, __FILE__, __FUNCTION__ , __LINE__);
+        return RC::ALLOCATION_ERROR;
+    }
+    lower = lowerVec;
+    upper = upperVec;
+    return RC::SUCCESS;
+}
+
+RC Set::getCentroid(IVector*& centroid) const {
+    if (_size == 0)
+        return RC::SOURCE_SET_EMPTY;
+    std::lock_guard<std::mutex> guard(_summaryLock);
+    IVector* mean = updateSummary() ? IVector::createVector(_dim, _summary.getMean()) : nullptr;
+    if (mean == nullptr){
+        Set::log(RC::ALLOCATION_ERROR, ILogger::Level::INFO, __FILE__, __FUNCTION__ , __LINE__);
+        return RC::ALLOCATION_ERROR;
+    }
+    centroid = mean;
+    return RC::SUCCESS;
+}
+
+RC Set::getVariance(IVector*& variance) const {
+    if (_size == 0)
+        return RC::SOURCE_SET_EMPTY;
+    std::lock_guard<std::mutex> guard(_summaryLock);
+    std::vector<double> coords(_dim);
+    IVector* spread = nullptr;
+    if (updateSummary()){
+        _summary.getVariance(coords.data());
+        spread = IVector::createVector(_dim, coords.data());
+    }
+    if (spread == nullptr){
+        Set::log(RC::ALLOCATION_ERROR, ILogger::Level::INFO, __FILE__, __FUNCTION__ , __LINE__);
+        return RC::ALLOCATION_ERROR;
+    }
+    variance = spread;
+    return RC::SUCCESS;
+}
+
+void Set::setAllocator(ISetAllocator* allocator) {
+    _allocator = allocator;
+}
+
+RC Set::getRawView(double const*& rows, size_t& count, size_t& dim, uint64_t& version) const {
+    // removed vectors stay in storage until a mutator compacts it, a reader must not move rows
+    if (_used != _size)
+        return RC::OPERATION_NOT_SUPPORTED;
+    rows = _data;
+    count = _size;
+    dim = _dim;
+    version = _version;
+    return RC::SUCCESS;
+}
+
+uint64_t Set::getVersion() const {
+    return _version;
 }
 
 RC Set::getCopy(size_t index, IVector *&val) const {
@@ -933,7 +2126,7 @@ RC Set::getCopy(size_t index, IVector *&val) const {
     if (argsIsValidRC != RC::SUCCESS)
         return argsIsValidRC;
 
-    double* ptr_data = _data + index * _dim;
+    double* ptr_data = _data + slotOf(index) * _dim;
     val = IVector::createVector(_dim, ptr_data);
     if (val == nullptr) {
         log(RC::NULLPTR_ERROR, ILogger::Level::INFO, __FILE__, __FUNCTION__, __LINE__);
@@ -949,84 +2142,224 @@ RC Set::findFirstAndCopy(const IVector *const &pat, IVector::NORM n, double tol,
     if (argsIsValidRC != RC::SUCCESS)
         return argsIsValidRC;
 
-    if (_size == 0)
-        return RC::VECTOR_NOT_FOUND;
+    size_t slot = 0;
+    RC findRC = findSlot(pat, n, tol, slot);
+    if (findRC != RC::SUCCESS)
+        return findRC;
 
-    IVector* it = IVector::createVector(_dim, _data);
-    if (it == nullptr){
+    val = IVector::createVector(_dim, _data + slot * _dim);
+    if (val == nullptr){
         Set::log(RC::NULLPTR_ERROR, ILogger::Level::INFO, __FILE__, __FUNCTION__ , __LINE__);
         return RC::NULLPTR_ERROR;
     }
-    size_t i = 0;
-    do{
-        if (IVector::equals(it, pat, n, tol)){
-            val = it;
-            return RC::SUCCESS;
-        }
-        i++;
-        if (i < _size){
-            RC validCopyCordsRC = getCoords(i, it);
-            if (validCopyCordsRC != RC::SUCCESS){
-                delete it;
-                log(validCopyCordsRC, ILogger::Level::INFO, __FILE__, __FUNCTION__ ,__LINE__);
-                return validCopyCordsRC;
-            }
-        }
-    }while(i <= _size);
-
-    delete it;
-    return RC::VECTOR_NOT_FOUND;
+    return RC::SUCCESS;
 }
 
 ISet *Set::clone() const {
-    auto setClone = new(std::nothrow) Set();
-    setClone->_data = new double[_capacity * _dim ];
-    setClone->_hashCodes = new size_t[_capacity];
-    std::memcpy(setClone->_data, _data, _size * _dim * sizeof (double));
-    for (size_t hash = 0; hash < _size; hash++)
+    // rows of a set file are mapped or move when the file grows, so its clone is a copy
+    if (_fd >= 0 || (_dim != 0 && _storage->image != nullptr))
+        return copy();
+    auto setClone = createEmpty();
+    if (setClone == nullptr){
+        log(RC::ALLOCATION_ERROR, ILogger::Level::INFO, __FILE__, __FUNCTION__ , __LINE__);
+        return nullptr;
+    }
+    // indices of the clone are built by its first lookup
+    setClone->_lshConfig = _lshConfig;
+    setClone->_journal.setCapacity(_journal.getCapacity(), 0);
+    if (_dim == 0)
+        return setClone;
+    setClone->_dead = new(std::nothrow) uint64_t[bitmapWords(_capacity)]();
+    if (setClone->_dead == nullptr){
+        delete setClone;
+        log(RC::ALLOCATION_ERROR, ILogger::Level::INFO, __FILE__, __FUNCTION__ , __LINE__);
+        return nullptr;
+    }
+    // removed vectors of the shared storage stay marked in the bitmap of the clone
+    std::memcpy(setClone->_dead, _dead, bitmapWords(_used) * sizeof(uint64_t));
+    _storage->freeze(_used);
+    setClone->adopt(_storage);
+    setClone->_dim = _dim;
+    setClone->_size = _size;
+    setClone->_used = _used;
+    setClone->_capacity = _capacity;
+    setClone->_nextHash = _nextHash;
+    setClone->_garbageRatio = _garbageRatio;
+    setClone->_allocator = _allocator;
+    setClone->_growthFactor = _growthFactor;
+    std::lock_guard<std::mutex> guard(_summaryLock);
+    try {
+        setClone->_summary = _summary;
+    }
+    catch (std::bad_alloc const&){
+        // summary of the clone is built by its first call
+        setClone->_summary.reset(0);
+    }
+    return setClone;
+}
+
+Set* Set::copy() const {
+    auto setClone = createEmpty();
+    if (setClone == nullptr){
+        log(RC::ALLOCATION_ERROR, ILogger::Level::INFO, __FILE__, __FUNCTION__ , __LINE__);
+        return nullptr;
+    }
+    // index of the copy is built by its first lookup
+    setClone->_lshConfig = _lshConfig;
+    setClone->_journal.setCapacity(_journal.getCapacity(), 0);
+    if (_dim == 0)
+        return setClone;
+    setClone->_allocator = _allocator;
+    setClone->_growthFactor = _growthFactor;
+    size_t capacity = std::max(_size, startCapacity);
+    std::shared_ptr<SetStorage> storage = SetStorage::create(capacity, _dim, _allocator);
+    setClone->_dead = new(std::nothrow) uint64_t[bitmapWords(capacity)]();
+    if (storage == nullptr || setClone->_dead == nullptr){
+        delete setClone;
+        log(RC::ALLOCATION_ERROR, ILogger::Level::INFO, __FILE__, __FUNCTION__ , __LINE__);
+        return nullptr;
+    }
+    setClone->adopt(storage);
+    size_t hash = 0;
+    for (size_t slot = nextAlive(0); slot < _used; slot = nextAlive(slot + 1), hash++){
+        std::memcpy(setClone->_data + hash * _dim, _data + slot * _dim, _dim * sizeof(double));
         setClone->_hashCodes[hash] = hash;
+    }
     setClone->_size = _size;
+    setClone->_used = _size;
     setClone->_dim = _dim;
-    setClone->_capacity = _capacity;
+    setClone->_capacity = capacity;
     setClone->_nextHash = _size;
-
+    setClone->_garbageRatio = _garbageRatio;
     return setClone;
 }
 
+ISet const* Set::snapshot() const {
+    // rows of a writable file move when the file grows, so its snapshot is a copy
+    if (_fd >= 0)
+        return copy();
+    auto setSnapshot = createEmpty();
+    if (setSnapshot == nullptr){
+        log(RC::ALLOCATION_ERROR, ILogger::Level::INFO, __FILE__, __FUNCTION__ , __LINE__);
+        return nullptr;
+    }
+    setSnapshot->_lshConfig = _lshConfig;
+    if (_dim == 0)
+        return setSnapshot;
+    setSnapshot->_dead = new(std::nothrow) uint64_t[bitmapWords(_capacity)]();
+    if (setSnapshot->_dead == nullptr){
+        delete setSnapshot;
+        log(RC::ALLOCATION_ERROR, ILogger::Level::INFO, __FILE__, __FUNCTION__ , __LINE__);
+        return nullptr;
+    }
+    std::memcpy(setSnapshot->_dead, _dead, bitmapWords(_used) * sizeof(uint64_t));
+    _storage->freeze(_used);
+    setSnapshot->adopt(_storage);
+    setSnapshot->_dim = _dim;
+    setSnapshot->_size = _size;
+    setSnapshot->_used = _used;
+    setSnapshot->_capacity = _capacity;
+    setSnapshot->_nextHash = _nextHash;
+    setSnapshot->_version = _version;
+    setSnapshot->_journal.restart(_version);
+    setSnapshot->_garbageRatio = _garbageRatio;
+    setSnapshot->_allocator = _allocator;
+    setSnapshot->_growthFactor = _growthFactor;
+    return setSnapshot;
+}
+
 RC Set::findFirst(const IVector *const &pat, IVector::NORM n, double tol) const {
     RC validInputArgsRC = RC::SUCCESS;
     vectorIsValid(pat, validInputArgsRC, __FILE__, __FUNCTION__ , __LINE__);
     if (validInputArgsRC != RC::SUCCESS)
         return validInputArgsRC;
 
-    if (_size == 0)
-        return RC::VECTOR_NOT_FOUND;
+    size_t slot = 0;
+    return findSlot(pat, n, tol, slot);
+}
 
-    IVector* it = IVector::createVector(_dim, _data);
-    size_t i = 0;
-    if (it == nullptr) {
-        log(RC::NULLPTR_ERROR, ILogger::Level::INFO, __FILE__, __FUNCTION__ , __LINE__);
+RC Set::findFirstMany(double const* patterns, size_t count, size_t dim, IVector::NORM n, double tol, size_t * const& indices) const {
+    if (count == 0)
+        return RC::SUCCESS;
+    if (patterns == nullptr || indices == nullptr){
+        Set::log(RC::NULLPTR_ERROR, ILogger::Level::INFO, __FILE__, __FUNCTION__, __LINE__);
         return RC::NULLPTR_ERROR;
     }
-
-    do{
-        if (IVector::equals(it, pat, n, tol)){
-            delete it;
-            return RC::SUCCESS;
-        }
-        i++;
-        if (i < _size){
-            RC setDataRC = it->setData(_dim, _data + i * _dim);
-            if (setDataRC != RC::SUCCESS){
-                delete it;
-                log(setDataRC, ILogger::Level::INFO, __FILE__, __FUNCTION__ , __LINE__);
-                return setDataRC;
+    if (std::isnan(tol) || tol < 0.){
+        Set::log(RC::INVALID_ARGUMENT, ILogger::Level::INFO, __FILE__, __FUNCTION__, __LINE__);
+        return RC::INVALID_ARGUMENT;
+    }
+    if (dim != _dim){
+        Set::log(RC::MISMATCHING_DIMENSIONS, ILogger::Level::INFO, __FILE__, __FUNCTION__, __LINE__);
+        return RC::MISMATCHING_DIMENSIONS;
+    }
+    if (_size == 0){
+        std::fill(indices, indices + count, size_t(0));
+        return RC::SUCCESS;
+    }
+
+    std::vector<size_t> order, slots, before;
+    try {
+        curveOrder(patterns, count, _dim, order);
+        slots.resize(count);
+        if (_used != _size)
+            before.resize(bitmapWords(_used));
+    }
+    catch (std::bad_alloc const&){
+        Set::log(RC::ALLOCATION_ERROR, ILogger::Level::INFO, __FILE__, __FUNCTION__, __LINE__);
+        return RC::ALLOCATION_ERROR;
+    }
+    // the grid is built for the batch, pool threads only read it while the calling thread holds _gridLock for them,
+    // so no other reader rebuilds it meanwhile
+    bool hashed = _lshConfig.tables != 0 && n == _lshConfig.norm;
+    std::unique_lock<std::mutex> guard(_gridLock, std::defer_lock);
+    if (!hashed){
+        guard.lock();
+        updateGrid();
+    }
+    ScanPool& pool = ScanPool::instance();
+    size_t parts = std::max(size_t(1), std::min(pool.getThreadCount() * scanPartsPerThread, count / batchPartRows));
+    size_t partRows = (count + parts - 1) / parts;
+    std::atomic<bool> failed(false);
+    pool.run(parts, [&](size_t part){
+        std::vector<double> box;
+        std::vector<size_t> hashes;
+        try {
+            for (size_t k = part * partRows; k < std::min(count, (part + 1) * partRows); k++){
+                double const* row = patterns + order[k] * _dim;
+                size_t slot = _used;
+                bool narrowed = hashed ? findHashed(row, n, tol, hashes, slot) : collectNear(row, tol, box, hashes);
+                if (!narrowed)
+                    slot = scanSlots(row, n, tol);
+                else if (!hashed)
+                    slot = firstAmong(hashes, row, n, tol);
+                slots[order[k]] = slot;
             }
         }
-    }while(i <= _size);
-
-    delete it;
-    return RC::VECTOR_NOT_FOUND;
+        catch (std::bad_alloc const&){
+            failed.store(true);
+        }
+    });
+    if (guard.owns_lock())
+        guard.unlock();
+    if (failed.load()){
+        Set::log(RC::ALLOCATION_ERROR, ILogger::Level::INFO, __FILE__, __FUNCTION__, __LINE__);
+        return RC::ALLOCATION_ERROR;
+    }
+
+    // index of a slot is the number of alive slots before it
+    for (size_t word = 1; word < before.size(); word++)
+        before[word] = before[word - 1] + popCount(~_dead[word - 1]);
+    for (size_t k = 0; k < count; k++){
+        size_t slot = slots[k];
+        if (slot >= _used)
+            indices[k] = _size;
+        else if (before.empty())
+            indices[k] = slot;
+        else
+            indices[k] = before[slot / wordBits] + popCount(~_dead[slot / wordBits] & ((uint64_t(1) << (slot % wordBits)) - 1));
+    }
+    return RC::SUCCESS;
 }
 
 ISet::IIterator *Set::getIterator(size_t index) const {
@@ -1034,7 +2367,8 @@ ISet::IIterator *Set::getIterator(size_t index) const {
         SendInfo(_logger, RC::INDEX_OUT_OF_BOUND);
         return nullptr;
     }
-    return Iterator::createIterator(_dim, _data + index * _dim, _hashCodes[index], _setCB);
+    size_t slot = slotOf(index);
+    return SetIterator::createIterator(_dim, _data + slot * _dim, _hashCodes[slot], slot, _setCB);
 }
 
 ISet::IIterator *Set::getBegin() const {
@@ -1042,7 +2376,8 @@ ISet::IIterator *Set::getBegin() const {
         SendInfo(_logger, RC::SOURCE_SET_EMPTY);
         return nullptr;
     }
-    return Iterator::createIterator(_dim, _data, _hashCodes[0], _setCB);
+    size_t slot = nextAlive(0);
+    return SetIterator::createIterator(_dim, _data + slot * _dim, _hashCodes[slot], slot, _setCB);
 }
 
 ISet::IIterator *Set::getEnd() const {
@@ -1050,7 +2385,69 @@ ISet::IIterator *Set::getEnd() const {
         SendInfo(_logger, RC::SOURCE_SET_EMPTY);
         return nullptr;
     }
-    return Iterator::createIterator(_dim, _data + (_size - 1) * _dim, _hashCodes[_size - 1],_setCB);
+    size_t slot = prevAlive(_used);
+    return SetIterator::createIterator(_dim, _data + slot * _dim, _hashCodes[slot], slot, _setCB);
+}
+
+ISet::IChunkIterator *Set::getChunkIterator(size_t chunkRows) const {
+    if (chunkRows == 0){
+        Set::log(RC::INVALID_ARGUMENT, ILogger::Level::INFO, __FILE__, __FUNCTION__ , __LINE__);
+        return nullptr;
+    }
+    if (_size == 0){
+        SendInfo(_logger, RC::SOURCE_SET_EMPTY);
+        return nullptr;
+    }
+    std::shared_ptr<Set const> view;
+    try {
+        view.reset(static_cast<Set const*>(snapshot()));
+    }
+    catch (std::bad_alloc const&){
+        Set::log(RC::ALLOCATION_ERROR, ILogger::Level::INFO, __FILE__, __FUNCTION__ , __LINE__);
+        return nullptr;
+    }
+    if (view == nullptr)
+        return nullptr;
+    size_t slot = 0;
+    return ChunkIterator::createIterator(_dim, [view, slot, chunkRows](double const*& rows, size_t const*& hashes, size_t& count) mutable {
+        size_t used = view->_used, dim = view->_dim;
+        slot = view->nextAlive(slot);
+        size_t end = view->nextDead(slot, used - slot > chunkRows ? slot + chunkRows : used);
+        rows = view->_data + slot * dim;
+        hashes = view->_hashCodes + slot;
+        count = end - slot;
+        slot = view->nextAlive(end);
+        kernel::prefetch(view->_data + slot * dim, std::min(chunkRows, used - slot) * dim * sizeof(double));
+        return RC::SUCCESS;
+    });
+}
+
+RC Set::forEachChunk(size_t chunkRows, std::function<void(double const*, size_t const*, size_t, size_t)> const& callback) const {
+    if (!callback){
+        Set::log(RC::NULLPTR_ERROR, ILogger::Level::INFO, __FILE__, __FUNCTION__ , __LINE__);
+        return RC::NULLPTR_ERROR;
+    }
+    if (chunkRows == 0){
+        Set::log(RC::INVALID_ARGUMENT, ILogger::Level::INFO, __FILE__, __FUNCTION__ , __LINE__);
+        return RC::INVALID_ARGUMENT;
+    }
+    if (_size == 0)
+        return RC::SUCCESS;
+
+    ScanPool& pool = ScanPool::instance();
+    size_t parts = std::max(size_t(1), std::min(pool.getThreadCount() * scanPartsPerThread, _used / std::max(chunkRows, scanPartSlots)));
+    size_t partSlots = (_used + parts - 1) / parts;
+    pool.run(parts, [&](size_t part){
+        size_t last = std::min(_used, (part + 1) * partSlots);
+        for (size_t slot = nextAlive(part * partSlots); slot < last;){
+            size_t end = nextDead(slot, last - slot > chunkRows ? slot + chunkRows : last);
+            size_t next = std::min(nextAlive(end), last);
+            kernel::prefetch(_data + next * _dim, std::min(chunkRows, last - next) * _dim * sizeof(double));
+            callback(_data + slot * _dim, _hashCodes + slot, end - slot, _dim);
+            slot = next;
+        }
+    });
+    return RC::SUCCESS;
 }
 
 inline void Set::log(RC code, ILogger::Level level, const char* const& srcfile, const char* const& function, int line)
@@ -1064,7 +2461,7 @@ void Set::vectorIsValid(const IVector *const &vec, RC &rc, const char* const& sr
         Set::log(RC::NULLPTR_ERROR, ILogger::Level::INFO, srcfile, function, line);
         rc = RC::NULLPTR_ERROR;
     }
-    if (vec->getDim() != _dim) {
+    else if (vec->getDim() != _dim) {
         Set::log(RC::MISMATCHING_DIMENSIONS, ILogger::Level::INFO, srcfile, function, line);
         rc = RC::MISMATCHING_DIMENSIONS;
     }
@@ -1077,101 +2474,115 @@ void Set::indexIsValid(size_t index, RC &rc, const char* const& srcfile, const c
     }
 }
 
-RC Set::getNext(IVector *const &vec, size_t &index, size_t indexInc) const {
+size_t Set::locate(size_t index, size_t pos) const {
+    if (pos < _used && _hashCodes[pos] == index)
+        return pos;
+    return std::lower_bound(_hashCodes, _hashCodes + _used, index) - _hashCodes;
+}
+
+RC Set::getNext(double *const &data, size_t &index, size_t &pos, size_t indexInc) const {
     if (_size == 0)
         return RC::SOURCE_SET_EMPTY;
 
-    RC validArgumentsRC = RC::SUCCESS;
-    vectorIsValid(vec, validArgumentsRC, __FILE__, __FUNCTION__ , __LINE__);
+    if (data == nullptr){
+        SendInfo(_logger, RC::NULLPTR_ERROR);
+        return RC::NULLPTR_ERROR;
+    }
     if (indexInc == 0){
         SendInfo(_logger, RC::INVALID_ARGUMENT);
-        validArgumentsRC = RC::INVALID_ARGUMENT;
+        return RC::INVALID_ARGUMENT;
     }
-    if (validArgumentsRC != RC::SUCCESS)
-        return validArgumentsRC;
 
-    for (size_t i = 0; i < _size; i++)
-        if (index < _hashCodes[i]){
-            if (i + indexInc - 1 >= _size){
-                SendInfo(_logger, RC::INDEX_OUT_OF_BOUND);
-                return RC::INDEX_OUT_OF_BOUND;
-            }
-            RC setDataRC = vec->setData(_dim, _data + (i + indexInc - 1) * _dim);
-            if (setDataRC != RC::SUCCESS){
-                SendInfo(_logger, setDataRC);
-                return setDataRC;
-            }
-            index = _hashCodes[i + indexInc - 1];
-            return RC::SUCCESS;
+    size_t slot = locate(index, pos);
+    size_t steps = indexInc;
+    // slot of removed vector is already taken by the next one
+    if (slot == _used || _hashCodes[slot] != index || isDead(slot)){
+        slot = nextAlive(slot);
+        steps--;
+    }
+    if (_used == _size){
+        if (slot == _used || steps >= _used - slot){
+            SendInfo(_logger, RC::INDEX_OUT_OF_BOUND);
+            return RC::INDEX_OUT_OF_BOUND;
         }
-    return RC::INDEX_OUT_OF_BOUND;
+        slot += steps;
+    }
+    else
+        for (; slot < _used && steps > 0; steps--)
+            slot = nextAlive(slot + 1);
+    if (slot == _used){
+        SendInfo(_logger, RC::INDEX_OUT_OF_BOUND);
+        return RC::INDEX_OUT_OF_BOUND;
+    }
+    pos = slot;
+    std::memcpy(data, _data + pos * _dim, _dim * sizeof(double));
+    index = _hashCodes[pos];
+    return RC::SUCCESS;
 }
 
-RC Set::getPrevious(IVector *const &vec, size_t &index, size_t indexInc) const {
+RC Set::getPrevious(double *const &data, size_t &index, size_t &pos, size_t indexInc) const {
     if ( _size == 0)
         return RC::SOURCE_SET_EMPTY;
 
-    RC validArgumentsRC = RC::SUCCESS;
-    vectorIsValid(vec, validArgumentsRC, __FILE__, __FUNCTION__ , __LINE__);
+    if (data == nullptr){
+        SendInfo(_logger, RC::NULLPTR_ERROR);
+        return RC::NULLPTR_ERROR;
+    }
     if (indexInc == 0){
         SendInfo(_logger, RC::INVALID_ARGUMENT);
-        validArgumentsRC = RC::INVALID_ARGUMENT;
+        return RC::INVALID_ARGUMENT;
     }
-    if (validArgumentsRC != RC::SUCCESS)
-        return validArgumentsRC;
 
-    for (size_t i = 0; i < _size; i++)
-        if (index > _hashCodes[_size - 1 - i]) {
-            size_t newIndex = _size - 1 - i;
-            if (newIndex - 1 + indexInc >= _size){
+    // all vectors before the located slot precede the vector under iterator
+    size_t slot = locate(index, pos);
+    if (_used == _size){
+        if (indexInc > slot){
+            SendInfo(_logger, RC::INDEX_OUT_OF_BOUND);
+            return RC::INDEX_OUT_OF_BOUND;
+        }
+        slot -= indexInc;
+    }
+    else
+        for (size_t steps = indexInc; steps > 0; steps--){
+            slot = prevAlive(slot);
+            if (slot == _used){
                 SendInfo(_logger, RC::INDEX_OUT_OF_BOUND);
                 return RC::INDEX_OUT_OF_BOUND;
             }
-            RC setDataRC = vec->setData(_dim, _data + (newIndex - 1 + indexInc) * _dim);
-            if (setDataRC != RC::SUCCESS){
-                SendInfo(_logger, setDataRC);
-                return setDataRC;
-            }
-            index = _hashCodes[newIndex - 1 + indexInc];
-            return RC::SUCCESS;
         }
-    return RC::INDEX_OUT_OF_BOUND;
+    pos = slot;
+    std::memcpy(data, _data + pos * _dim, _dim * sizeof(double));
+    index = _hashCodes[pos];
+    return RC::SUCCESS;
 }
 
-RC Set::getBegin(IVector *const &vec, size_t &index) const {
+RC Set::getBegin(double *const &data, size_t &index, size_t &pos) const {
     if ( _size == 0)
         return RC::SOURCE_SET_EMPTY;
 
-    RC validArgumentsRC = RC::SUCCESS;
-    vectorIsValid(vec, validArgumentsRC, __FILE__, __FUNCTION__ , __LINE__);
-    if (validArgumentsRC != RC::SUCCESS)
-        return validArgumentsRC;
-
-    RC setDataRC = vec->setData(_dim, _data);
-    if (setDataRC != RC::SUCCESS){
-        SendInfo(_logger, setDataRC);
-        return setDataRC;
+    if (data == nullptr){
+        SendInfo(_logger, RC::NULLPTR_ERROR);
+        return RC::NULLPTR_ERROR;
     }
-    index = _hashCodes[0];
+
+    pos = nextAlive(0);
+    std::memcpy(data, _data + pos * _dim, _dim * sizeof(double));
+    index = _hashCodes[pos];
     return RC::SUCCESS;
 }
 
-RC Set::getEnd(IVector *const &vec, size_t &index) const {
+RC Set::getEnd(double *const &data, size_t &index, size_t &pos) const {
     if ( _size == 0)
         return RC::SOURCE_SET_EMPTY;
 
-    RC validArgumentsRC = RC::SUCCESS;
-    vectorIsValid(vec, validArgumentsRC, __FILE__, __FUNCTION__ , __LINE__);
-    if (validArgumentsRC != RC::SUCCESS)
-        return validArgumentsRC;
-
-    RC setDataRC = vec->setData(_dim, _data + (_size - 1) * _dim);
-    if (setDataRC != RC::SUCCESS){
-        SendInfo(_logger, setDataRC);
-        return setDataRC;
+    if (data == nullptr){
+        SendInfo(_logger, RC::NULLPTR_ERROR);
+        return RC::NULLPTR_ERROR;
     }
-    index = _hashCodes[_size - 1];
+
+    pos = prevAlive(_used);
+    std::memcpy(data, _data + pos * _dim, _dim * sizeof(double));
+    index = _hashCodes[pos];
     return RC::SUCCESS;
 }
 
-
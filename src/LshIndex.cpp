@@ -0,0 +1,110 @@
+#include "LshIndex.h"
+#include <cmath>
+#include <memory>
+#include <new>
+#include <random>
+
+LshCounters::LshCounters() {
+    reset();
+}
+
+void LshCounters::reset() {
+    queries.store(0);
+    candidates.store(0);
+    found.store(0);
+    checked.store(0);
+    checkedFound.store(0);
+    checkedMissed.store(0);
+    lookupNanos.store(0);
+    exactNanos.store(0);
+}
+
+void LshCounters::read(ISetLsh::LshStats& stats) const {
+    stats.queries = queries.load();
+    stats.candidates = candidates.load();
+    stats.found = found.load();
+    stats.checked = checked.load();
+    stats.checkedFound = checkedFound.load();
+    stats.checkedMissed = checkedMissed.load();
+    stats.lookupSeconds = static_cast<double>(lookupNanos.load()) * 1e-9;
+    stats.exactSeconds = static_cast<double>(exactNanos.load()) * 1e-9;
+}
+
+LshIndex::LshIndex(size_t dim, size_t tables, size_t hashes, double width) :
+        _dim(dim),
+        _tables(tables),
+        _hashes(hashes),
+        _width(width),
+        _entries(0){
+}
+
+LshIndex* LshIndex::create(size_t dim, LshConfig const& config) {
+    std::unique_ptr<LshIndex> index(new(std::nothrow) LshIndex(dim, config.tables, config.hashes, config.width));
+    if (index == nullptr)
+        return nullptr;
+    try {
+        size_t projections = config.tables * config.hashes;
+        index->_projections.resize(projections * dim);
+        index->_offsets.resize(projections);
+        index->_buckets.resize(config.tables);
+    }
+    catch (std::exception const&){
+        return nullptr;
+    }
+    std::mt19937_64 random(lshSeed);
+    std::normal_distribution<double> gauss(0., 1.);
+    std::cauchy_distribution<double> cauchy(0., 1.);
+    for (double& coord : index->_projections)
+        coord = config.norm == IVector::NORM::FIRST ? cauchy(random) : gauss(random);
+    std::uniform_real_distribution<double> offset(0., config.width);
+    for (double& shift : index->_offsets)
+        shift = offset(random);
+    return index.release();
+}
+
+uint64_t LshIndex::keyOf(size_t table, double const* row) const {
+    uint64_t key = 0xcbf29ce484222325ULL;
+    for (size_t j = table * _hashes; j < (table + 1) * _hashes; j++){
+        double const* projection = _projections.data() + j * _dim;
+        double dot = _offsets[j];
+        for (size_t i = 0; i < _dim; i++)
+            dot += projection[i] * row[i];
+        double cell = std::floor(dot / _width);
+        long long bucket = 0;
+        if (cell >= 9.0e18)
+            bucket = 9000000000000000000LL;
+        else if (cell <= -9.0e18 || std::isnan(cell))
+            bucket = -9000000000000000000LL;
+        else
+            bucket = static_cast<long long>(cell);
+        key ^= static_cast<uint64_t>(bucket);
+        key *= 0x100000001b3ULL;
+        key ^= key >> 29;
+    }
+    return key;
+}
+
+RC LshIndex::add(double const* row, size_t hash) {
+    for (size_t table = 0; table < _tables; table++){
+        try {
+            _buckets[table][keyOf(table, row)].push_back(hash);
+        }
+        catch (std::bad_alloc const&){
+            return RC::ALLOCATION_ERROR;
+        }
+    }
+    _entries++;
+    return RC::SUCCESS;
+}
+
+size_t LshIndex::getEntries() const {
+    return _entries;
+}
+
+void LshIndex::collect(double const* row, std::vector<size_t>& hashes) const {
+    for (size_t table = 0; table < _tables; table++){
+        auto bucket = _buckets[table].find(keyOf(table, row));
+        if (bucket != _buckets[table].end())
+            hashes.insert(hashes.end(), bucket->second.begin(), bucket->second.end());
+    }
+}
@@ -0,0 +1,78 @@
+#pragma once
+#include "../include/ISetLsh.h"
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+/*
+ * Parameters of ISetLsh::enableLsh, tables is 0 while lookups are exact
+ */
+struct LshConfig {
+    IVector::NORM norm;
+    size_t tables;
+    size_t hashes;
+    double width;
+    size_t checkEvery;
+};
+
+/*
+ * Counters of ISetLsh::getLshStats, lookups of concurrent readers update them without locks
+ */
+struct LshCounters {
+    std::atomic<uint64_t> queries;
+    std::atomic<uint64_t> candidates;
+    std::atomic<uint64_t> found;
+    std::atomic<uint64_t> checked;
+    std::atomic<uint64_t> checkedFound;
+    std::atomic<uint64_t> checkedMissed;
+    std::atomic<uint64_t> lookupNanos;
+    std::atomic<uint64_t> exactNanos;
+
+    LshCounters();
+
+    void reset();
+
+    void read(ISetLsh::LshStats& stats) const;
+};
+
+// seed of LSH projections, index rebuilt with the same parameters hashes vectors the same way
+uint64_t const lshSeed = 0x9e3779b97f4a7c15ULL;
+
+/*
+ * Unique indices of set vectors hashed by tables of p-stable projections h(v) = floor((a * v + b) / width).
+ * Coordinates of a are Gaussian for NORM::SECOND and Cauchy for NORM::FIRST, so a * (u - v) is distributed as
+ * the norm of u - v times a standard variable, and close vectors fall into one bucket of a table with high probability
+ */
+class LshIndex {
+private:
+    size_t _dim;
+    size_t _tables;
+    size_t _hashes;
+    double _width;
+    size_t _entries;
+    // hashes rows of dim coordinates per table
+    std::vector<double> _projections;
+    std::vector<double> _offsets;
+    std::vector<std::unordered_map<uint64_t, std::vector<size_t>>> _buckets;
+
+    LshIndex(size_t dim, size_t tables, size_t hashes, double width);
+
+    uint64_t keyOf(size_t table, double const* row) const;
+
+public:
+    /*
+     * nullptr if projections can not be allocated
+     */
+    static LshIndex* create(size_t dim, LshConfig const& config);
+
+    RC add(double const* row, size_t hash);
+
+    size_t getEntries() const;
+
+    /*
+     * Appends unique indices sharing a bucket with row in any table to hashes
+     */
+    void collect(double const* row, std::vector<size_t>& hashes) const;
+};
@@ -0,0 +1,1080 @@
+#include "../include/ISet.h"
+#include "../include/ISetRawView.h"
+#include "../include/ISetCapacity.h"
+#include "../include/ICompact.h"
+#include "../include/ISetControlBlock.h"
+#include "SetKernels.h"
+#include "ScanPool.h"
+#include "SetSummary.h"
+#include "SetIterator.h"
+#include "ChunkIterator.h"
+#include <cstdint>
+#include <cstring>
+#include <cmath>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <vector>
+#include <algorithm>
+#include <atomic>
+
+#define SendInfo(Logger, Code) if (Logger != nullptr) Logger->info((Code), __FILE__, __func__, __LINE__)
+
+
+namespace{
+    size_t const startCapacity = 16;
+    double const defaultGrowthFactor = 2.;
+    // batched lookups are split over ScanPool threads in parts of at least this many rows
+    size_t const batchPartRows = 64;
+
+    template<typename Code>
+    class QuantizedSet;
+
+    template<typename Code>
+    class QuantizedControlBlock : public ISetControlBlock {
+    private:
+        QuantizedSet<Code> const* _set;
+        bool* _setIsValid;
+
+    public:
+        QuantizedControlBlock(QuantizedSet<Code> const* set, bool* setIsValid);
+
+        RC getNext(double *const &data, size_t &index, size_t &pos, size_t indexInc) const override;
+        RC getPrevious(double *const &data, size_t &index, size_t &pos, size_t indexInc) const override;
+        RC getBegin(double *const &data, size_t &index, size_t &pos) const override;
+        RC getEnd(double *const &data, size_t &index, size_t &pos) const override;
+
+        ~QuantizedControlBlock() override;
+    };
+
+    /*
+     * ISet keeping every coordinate as a code of Code bits on a uniform grid over the box given at creation.
+     * Vectors are kept in the order of insertion, removal moves the following vectors at once
+     */
+    template<typename Code>
+    class QuantizedSet : public ISet, public ISetCapacity {
+    private:
+        size_t _dim;
+        std::vector<double> _lower;
+        std::vector<double> _upper;
+        std::vector<double> _step;
+        // bounds of the distance between a vector and its decoded copy in every norm
+        double _errorFirst;
+        double _errorSecond;
+        double _errorChebyshev;
+        std::vector<Code> _codes;
+        std::vector<size_t> _hashCodes;
+        size_t _nextHash;
+        uint64_t _version;
+        double _growthFactor;
+        // summary of decoded vectors, bounds are rescanned after removal of a vector on the border
+        mutable SetSummary _summary;
+        mutable std::mutex _summaryLock;
+        std::shared_ptr<ISetControlBlock> _setCB;
+        bool* _setIsValid;
+
+        static Code const maxCode = std::numeric_limits<Code>::max();
+
+        QuantizedSet();
+
+        /*
+         * Codes of row, returns false if row is outside of the box
+         */
+        bool encode(double const* row, Code* codes) const;
+        void decode(size_t slot, double* row) const;
+
+        /*
+         * tol widened by the largest distance between a vector and its decoded copy in norm n
+         */
+        double widen(IVector::NORM n, double tol) const;
+
+        /*
+         * Slot of the first vector decoded within tol of row in norm n, size of the set if there is none.
+         * Codes are first checked against the interval every coordinate of a match must fall into
+         */
+        size_t findSlot(double const* row, IVector::NORM n, double tol) const;
+
+        RC append(Code const* codes);
+        /*
+         * Rows of the set are distinct, so they are appended without lookups
+         */
+        RC appendRows(double const* rows, size_t count);
+        void removeSlot(size_t slot);
+        RC checkVector(IVector const* const& vec) const;
+        bool updateSummary() const;
+
+        /*
+         * Slot of the vector with unique index or, if it was removed, of the first vector added after it
+         */
+        size_t locate(size_t index, size_t pos) const;
+
+    public:
+        static QuantizedSet* create(double const* lower, double const* upper, size_t dim);
+        /*
+         * Quantized copy of source over the box [lower, upper] holding all its vectors
+         */
+        static QuantizedSet* create(ISet const* source, double const* lower, double const* upper);
+
+        RC getNext(double *const &data, size_t &index, size_t &pos, size_t indexInc) const;
+        RC getPrevious(double *const &data, size_t &index, size_t &pos, size_t indexInc) const;
+        RC getBegin(double *const &data, size_t &index, size_t &pos) const;
+        RC getEnd(double *const &data, size_t &index, size_t &pos) const;
+
+        ISet* clone() const override;
+
+        /*
+         * Snapshot is a copy, quantized sets are meant for archives which are rarely changed
+         */
+        ISet const* snapshot() const override;
+
+        size_t getDim() const override;
+        size_t getSize() const override;
+
+        RC getCopy(size_t index, IVector *& val) const override;
+        RC findFirstAndCopy(IVector const * const& pat, IVector::NORM n, double tol, IVector *& val) const override;
+
+        RC getCoords(size_t index, IVector * const& val) const override;
+        RC findFirstAndCopyCoords(IVector const * const& pat, IVector::NORM n, double tol, IVector * const& val) const override;
+        RC findFirst(IVector const * const& pat, IVector::NORM n, double tol) const override;
+        RC findFirstMany(double const* patterns, size_t count, size_t dim, IVector::NORM n, double tol, size_t * const& indices) const override;
+
+        RC insert(IVector const * const& val, IVector::NORM n, double tol) override;
+        RC insertBatch(double const* rows, size_t count, size_t dim, IVector::NORM n, double tol, size_t& inserted) override;
+
+        RC remove(size_t index) override;
+        RC remove(IVector const * const& pat, IVector::NORM n, double tol) override;
+        RC removeIf(std::function<bool(double const*, size_t)> const& pred) override;
+
+        using ISet::queryBox;
+
+        RC queryBox(ICompact const* const& box, std::function<void(double const*, size_t)> const& callback) const override;
+
+        /*
+         * Removal does not leave dead vectors, so there is nothing to compact
+         */
+        RC setGarbageRatio(double ratio) override;
+        RC compact() override;
+
+        RC reserve(size_t capacity) override;
+        RC shrinkToFit() override;
+        RC setGrowthFactor(double factor) override;
+
+        RC getBounds(IVector*& lower, IVector*& upper) const override;
+        RC getCentroid(IVector*& centroid) const override;
+        RC getVariance(IVector*& variance) const override;
+
+        uint64_t getVersion() const override;
+
+        RC sync() override;
+
+        IIterator *getIterator(size_t index) const override;
+        IIterator *getBegin() const override;
+        IIterator *getEnd() const override;
+
+        /*
+         * Chunks are decoded into buffers, so they take 8 bytes per coordinate only for the rows being read
+         */
+        IChunkIterator *getChunkIterator(size_t chunkRows) const override;
+        RC forEachChunk(size_t chunkRows, std::function<void(double const*, size_t const*, size_t, size_t)> const& callback) const override;
+
+        ~QuantizedSet() override;
+    };
+}
+
+template<typename Code>
+Code const QuantizedSet<Code>::maxCode;
+
+template<typename Code>
+QuantizedControlBlock<Code>::QuantizedControlBlock(QuantizedSet<Code> const* set, bool* setIsValid) :
+        _set(set),
+        _setIsValid(setIsValid){
+}
+
+template<typename Code>
+RC QuantizedControlBlock<Code>::getNext(double *const &data, size_t &index, size_t &pos, size_t indexInc) const {
+    if (!(*_setIsValid))
+        return RC::SOURCE_SET_DESTROYED;
+    return _set->getNext(data, index, pos, indexInc);
+}
+
+template<typename Code>
+RC QuantizedControlBlock<Code>::getPrevious(double *const &data, size_t &index, size_t &pos, size_t indexInc) const {
+    if (!(*_setIsValid))
+        return RC::SOURCE_SET_DESTROYED;
+    return _set->getPrevious(data, index, pos, indexInc);
+}
+
+template<typename Code>
+RC QuantizedControlBlock<Code>::getBegin(double *const &data, size_t &index, size_t &pos) const {
+    if (!(*_setIsValid))
+        return RC::SOURCE_SET_DESTROYED;
+    return _set->getBegin(data, index, pos);
+}
+
+template<typename Code>
+RC QuantizedControlBlock<Code>::getEnd(double *const &data, size_t &index, size_t &pos) const {
+    if (!(*_setIsValid))
+        return RC::SOURCE_SET_DESTROYED;
+    return _set->getEnd(data, index, pos);
+}
+
+template<typename Code>
+QuantizedControlBlock<Code>::~QuantizedControlBlock() {
+    delete [] _setIsValid;
+}
+
+template<typename Code>
+QuantizedSet<Code>::QuantizedSet() :
+        _dim(0),
+        _errorFirst(0.),
+        _errorSecond(0.),
+        _errorChebyshev(0.),
+        _nextHash(0),
+        _version(0),
+        _growthFactor(defaultGrowthFactor),
+        _setCB(nullptr),
+        _setIsValid(nullptr){
+}
+
+template<typename Code>
+QuantizedSet<Code>* QuantizedSet<Code>::create(double const* lower, double const* upper, size_t dim) {
+    std::unique_ptr<QuantizedSet> set(new(std::nothrow) QuantizedSet());
+    if (set == nullptr){
+        SendInfo(ISet::getLogger(), RC::ALLOCATION_ERROR);
+        return nullptr;
+    }
+    try {
+        set->_lower.assign(lower, lower + dim);
+        set->_upper.assign(upper, upper + dim);
+        set->_step.assign(dim, 0.);
+    }
+    catch (std::bad_alloc const&){
+        SendInfo(ISet::getLogger(), RC::ALLOCATION_ERROR);
+        return nullptr;
+    }
+    set->_dim = dim;
+    double sumSquares = 0.;
+    for (size_t i = 0; i < dim; i++){
+        set->_step[i] = (upper[i] - lower[i]) / static_cast<double>(maxCode);
+        // half of the step plus rounding of encoding and decoding
+        double error = 0.5 * set->_step[i] + 4. * std::numeric_limits<double>::epsilon() * (std::fabs(lower[i]) + std::fabs(upper[i]));
+        set->_errorFirst += error;
+        sumSquares += error * error;
+        set->_errorChebyshev = std::max(set->_errorChebyshev, error);
+    }
+    set->_errorSecond = std::sqrt(sumSquares);
+    if (!set->_summary.reset(dim)){
+        SendInfo(ISet::getLogger(), RC::ALLOCATION_ERROR);
+        return nullptr;
+    }
+    set->_setIsValid = new(std::nothrow) bool[1]{true};
+    if (set->_setIsValid == nullptr){
+        SendInfo(ISet::getLogger(), RC::ALLOCATION_ERROR);
+        return nullptr;
+    }
+    set->_setCB = std::shared_ptr<ISetControlBlock>(new(std::nothrow) QuantizedControlBlock<Code>(set.get(), set->_setIsValid));
+    if (set->_setCB == nullptr){
+        delete [] set->_setIsValid;
+        set->_setIsValid = nullptr;
+        SendInfo(ISet::getLogger(), RC::ALLOCATION_ERROR);
+        return nullptr;
+    }
+    return set.release();
+}
+
+template<typename Code>
+QuantizedSet<Code>* QuantizedSet<Code>::create(ISet const* source, double const* lower, double const* upper) {
+    std::unique_ptr<QuantizedSet> set(create(lower, upper, source->getDim()));
+    if (set == nullptr)
+        return nullptr;
+    RC rc = set->reserve(source->getSize());
+    double const* rows = nullptr;
+    size_t count = 0, dim = 0;
+    uint64_t version = 0;
+    ISetRawView const* view = ISetRawView::of(source);
+    if (rc == RC::SUCCESS && view != nullptr && view->getRawView(rows, count, dim, version) == RC::SUCCESS)
+        rc = set->appendRows(rows, count);
+    else if (rc == RC::SUCCESS){
+        IIterator* it = source->getBegin();
+        IVector* vec = nullptr;
+        rc = it == nullptr ? RC::NULLPTR_ERROR : it->getVectorCopy(vec);
+        for (; rc == RC::SUCCESS && it->isValid(); it->next()){
+            rc = it->getVectorCoords(vec);
+            if (rc == RC::SUCCESS)
+                rc = set->appendRows(vec->getData(), 1);
+        }
+        delete vec;
+        delete it;
+    }
+    if (rc != RC::SUCCESS){
+        SendInfo(ISet::getLogger(), rc);
+        return nullptr;
+    }
+    return set.release();
+}
+
+template<typename Code>
+QuantizedSet<Code>::~QuantizedSet() {
+    if (_setIsValid != nullptr)
+        _setIsValid[0] = false;
+}
+
+template<typename Code>
+bool QuantizedSet<Code>::encode(double const* row, Code* codes) const {
+    for (size_t i = 0; i < _dim; i++){
+        if (!(_lower[i] <= row[i] && row[i] <= _upper[i]))
+            return false;
+        double cell = _step[i] > 0. ? (row[i] - _lower[i]) / _step[i] + 0.5 : 0.;
+        codes[i] = cell >= static_cast<double>(maxCode) ? maxCode : static_cast<Code>(cell);
+    }
+    return true;
+}
+
+template<typename Code>
+void QuantizedSet<Code>::decode(size_t slot, double* row) const {
+    Code const* codes = _codes.data() + slot * _dim;
+    for (size_t i = 0; i < _dim; i++)
+        row[i] = _lower[i] + static_cast<double>(codes[i]) * _step[i];
+}
+
+template<typename Code>
+double QuantizedSet<Code>::widen(IVector::NORM n, double tol) const {
+    if (n == IVector::NORM::FIRST)
+        return tol + _errorFirst;
+    if (n == IVector::NORM::SECOND)
+        return tol + _errorSecond;
+    return tol + _errorChebyshev;
+}
+
+template<typename Code>
+size_t QuantizedSet<Code>::findSlot(double const* row, IVector::NORM n, double tol) const {
+    size_t size = _hashCodes.size();
+    double widened = widen(n, tol);
+    // every coordinate of a match is within widened of the pattern in any norm
+    std::vector<Code> least(_dim), greatest(_dim);
+    for (size_t i = 0; i < _dim; i++){
+        double low = row[i] - widened, high = row[i] + widened;
+        if (!(low <= _upper[i] && _lower[i] <= high))
+            return size;
+        if (_step[i] > 0.){
+            // one more code on both sides absorbs rounding of the division
+            double first = std::floor((low - _lower[i]) / _step[i]) - 1.;
+            double last = std::ceil((high - _lower[i]) / _step[i]) + 1.;
+            least[i] = first <= 0. ? 0 : first >= static_cast<double>(maxCode) ? maxCode : static_cast<Code>(first);
+            greatest[i] = last >= static_cast<double>(maxCode) ? maxCode : last <= 0. ? 0 : static_cast<Code>(last);
+        }
+        else {
+            least[i] = 0;
+            greatest[i] = 0;
+        }
+    }
+    std::vector<double> decoded(_dim);
+    kernel::RowComparer equal = kernel::rowComparer(_dim, n);
+    Code const* codes = _codes.data();
+    for (size_t slot = 0; slot < size; slot++, codes += _dim){
+        size_t i = 0;
+        for (; i < _dim && least[i] <= codes[i] && codes[i] <= greatest[i]; i++);
+        if (i != _dim)
+            continue;
+        decode(slot, decoded.data());
+        if (equal(_dim, decoded.data(), row, widened))
+            return slot;
+    }
+    return size;
+}
+
+template<typename Code>
+RC QuantizedSet<Code>::append(Code const* codes) {
+    try {
+        if (_hashCodes.size() == _hashCodes.capacity()){
+            size_t capacity = std::max(startCapacity, static_cast<size_t>(std::ceil(static_cast<double>(_hashCodes.size()) * _growthFactor)));
+            _codes.reserve(capacity * _dim);
+            _hashCodes.reserve(capacity);
+        }
+        _codes.insert(_codes.end(), codes, codes + _dim);
+        _hashCodes.push_back(_nextHash);
+    }
+    catch (std::bad_alloc const&){
+        _codes.resize(_hashCodes.size() * _dim);
+        SendInfo(ISet::getLogger(), RC::ALLOCATION_ERROR);
+        return RC::ALLOCATION_ERROR;
+    }
+    _nextHash++;
+    _version++;
+    std::vector<double> decoded(_dim);
+    decode(_hashCodes.size() - 1, decoded.data());
+    _summary.add(decoded.data());
+    return RC::SUCCESS;
+}
+
+template<typename Code>
+RC QuantizedSet<Code>::appendRows(double const* rows, size_t count) {
+    std::vector<Code> codes(_dim);
+    for (size_t k = 0; k < count; k++){
+        if (!encode(rows + k * _dim, codes.data())){
+            SendInfo(ISet::getLogger(), RC::INVALID_ARGUMENT);
+            return RC::INVALID_ARGUMENT;
+        }
+        RC rc = append(codes.data());
+        if (rc != RC::SUCCESS)
+            return rc;
+    }
+    return RC::SUCCESS;
+}
+
+template<typename Code>
+void QuantizedSet<Code>::removeSlot(size_t slot) {
+    std::vector<double> decoded(_dim);
+    decode(slot, decoded.data());
+    _summary.remove(decoded.data());
+    _codes.erase(_codes.begin() + slot * _dim, _codes.begin() + (slot + 1) * _dim);
+    _hashCodes.erase(_hashCodes.begin() + slot);
+    _version++;
+}
+
+template<typename Code>
+RC QuantizedSet<Code>::checkVector(IVector const* const& vec) const {
+    if (vec == nullptr || vec->getData() == nullptr){
+        SendInfo(ISet::getLogger(), RC::NULLPTR_ERROR);
+        return RC::NULLPTR_ERROR;
+    }
+    if (vec->getDim() != _dim){
+        SendInfo(ISet::getLogger(), RC::MISMATCHING_DIMENSIONS);
+        return RC::MISMATCHING_DIMENSIONS;
+    }
+    return RC::SUCCESS;
+}
+
+template<typename Code>
+bool QuantizedSet<Code>::updateSummary() const {
+    if (!_summary.boundsAreStale())
+        return true;
+    std::vector<double> decoded(_dim);
+    _summary.clearBounds();
+    for (size_t slot = 0; slot < _hashCodes.size(); slot++){
+        decode(slot, decoded.data());
+        _summary.extendBounds(decoded.data());
+    }
+    return true;
+}
+
+template<typename Code>
+size_t QuantizedSet<Code>::locate(size_t index, size_t pos) const {
+    if (pos < _hashCodes.size() && _hashCodes[pos] == index)
+        return pos;
+    return std::lower_bound(_hashCodes.begin(), _hashCodes.end(), index) - _hashCodes.begin();
+}
+
+template<typename Code>
+RC QuantizedSet<Code>::getNext(double *const &data, size_t &index, size_t &pos, size_t indexInc) const {
+    size_t size = _hashCodes.size();
+    if (size == 0)
+        return RC::SOURCE_SET_EMPTY;
+    if (data == nullptr){
+        SendInfo(ISet::getLogger(), RC::NULLPTR_ERROR);
+        return RC::NULLPTR_ERROR;
+    }
+    if (indexInc == 0){
+        SendInfo(ISet::getLogger(), RC::INVALID_ARGUMENT);
+        return RC::INVALID_ARGUMENT;
+    }
+    size_t slot = locate(index, pos);
+    size_t steps = indexInc;
+    // slot of removed vector is already taken by the next one
+    if (slot == size || _hashCodes[slot] != index)
+        steps--;
+    if (slot == size || steps >= size - slot){
+        SendInfo(ISet::getLogger(), RC::INDEX_OUT_OF_BOUND);
+        return RC::INDEX_OUT_OF_BOUND;
+    }
+    pos = slot + steps;
+    decode(pos, data);
+    index = _hashCodes[pos];
+    return RC::SUCCESS;
+}
+
+template<typename Code>
+RC QuantizedSet<Code>::getPrevious(double *const &data, size_t &index, size_t &pos, size_t indexInc) const {
+    if (_hashCodes.empty())
+        return RC::SOURCE_SET_EMPTY;
+    if (data == nullptr){
+        SendInfo(ISet::getLogger(), RC::NULLPTR_ERROR);
+        return RC::NULLPTR_ERROR;
+    }
+    if (indexInc == 0){
+        SendInfo(ISet::getLogger(), RC::INVALID_ARGUMENT);
+        return RC::INVALID_ARGUMENT;
+    }
+    // all vectors before the located slot precede the vector under iterator
+    size_t slot = locate(index, pos);
+    if (indexInc > slot){
+        SendInfo(ISet::getLogger(), RC::INDEX_OUT_OF_BOUND);
+        return RC::INDEX_OUT_OF_BOUND;
+    }
+    pos = slot - indexInc;
+    decode(pos, data);
+    index = _hashCodes[pos];
+    return RC::SUCCESS;
+}
+
+template<typename Code>
+RC QuantizedSet<Code>::getBegin(double *const &data, size_t &index, size_t &pos) const {
+    if (_hashCodes.empty())
+        return RC::SOURCE_SET_EMPTY;
+    if (data == nullptr){
+        SendInfo(ISet::getLogger(), RC::NULLPTR_ERROR);
+        return RC::NULLPTR_ERROR;
+    }
+    pos = 0;
+    decode(pos, data);
+    index = _hashCodes[pos];
+    return RC::SUCCESS;
+}
+
+template<typename Code>
+RC QuantizedSet<Code>::getEnd(double *const &data, size_t &index, size_t &pos) const {
+    if (_hashCodes.empty())
+        return RC::SOURCE_SET_EMPTY;
+    if (data == nullptr){
+        SendInfo(ISet::getLogger(), RC::NULLPTR_ERROR);
+        return RC::NULLPTR_ERROR;
+    }
+    pos = _hashCodes.size() - 1;
+    decode(pos, data);
+    index = _hashCodes[pos];
+    return RC::SUCCESS;
+}
+
+template<typename Code>
+ISet* QuantizedSet<Code>::clone() const {
+    QuantizedSet* set = create(_lower.data(), _upper.data(), _dim);
+    if (set == nullptr)
+        return nullptr;
+    try {
+        set->_codes = _codes;
+        set->_hashCodes = _hashCodes;
+        std::lock_guard<std::mutex> guard(_summaryLock);
+        set->_summary = _summary;
+    }
+    catch (std::bad_alloc const&){
+        delete set;
+        SendInfo(ISet::getLogger(), RC::ALLOCATION_ERROR);
+        return nullptr;
+    }
+    set->_nextHash = _nextHash;
+    set->_growthFactor = _growthFactor;
+    return set;
+}
+
+template<typename Code>
+ISet const* QuantizedSet<Code>::snapshot() const {
+    return clone();
+}
+
+template<typename Code>
+size_t QuantizedSet<Code>::getDim() const {
+    return _dim;
+}
+
+template<typename Code>
+size_t QuantizedSet<Code>::getSize() const {
+    return _hashCodes.size();
+}
+
+template<typename Code>
+RC QuantizedSet<Code>::getCopy(size_t index, IVector *& val) const {
+    if (index >= _hashCodes.size()){
+        SendInfo(ISet::getLogger(), RC::INDEX_OUT_OF_BOUND);
+        return RC::INDEX_OUT_OF_BOUND;
+    }
+    std::vector<double> decoded(_dim);
+    decode(index, decoded.data());
+    val = IVector::createVector(_dim, decoded.data());
+    if (val == nullptr){
+        SendInfo(ISet::getLogger(), RC::NULLPTR_ERROR);
+        return RC::NULLPTR_ERROR;
+    }
+    return RC::SUCCESS;
+}
+
+template<typename Code>
+RC QuantizedSet<Code>::findFirstAndCopy(IVector const * const& pat, IVector::NORM n, double tol, IVector *& val) const {
+    RC rc = checkVector(pat);
+    if (rc != RC::SUCCESS)
+        return rc;
+    size_t slot = findSlot(pat->getData(), n, tol);
+    if (slot == _hashCodes.size())
+        return RC::VECTOR_NOT_FOUND;
+    return getCopy(slot, val);
+}
+
+template<typename Code>
+RC QuantizedSet<Code>::getCoords(size_t index, IVector * const& val) const {
+    if (val == nullptr){
+        SendInfo(ISet::getLogger(), RC::NULLPTR_ERROR);
+        return RC::NULLPTR_ERROR;
+    }
+    if (index >= _hashCodes.size()){
+        SendInfo(ISet::getLogger(), RC::INDEX_OUT_OF_BOUND);
+        return RC::INDEX_OUT_OF_BOUND;
+    }
+    std::vector<double> decoded(_dim);
+    decode(index, decoded.data());
+    return val->setData(_dim, decoded.data());
+}
+
+template<typename Code>
+RC QuantizedSet<Code>::findFirstAndCopyCoords(IVector const * const& pat, IVector::NORM n, double tol, IVector * const& val) const {
+    RC rc = checkVector(pat);
+    if (rc != RC::SUCCESS)
+        return rc;
+    size_t slot = findSlot(pat->getData(), n, tol);
+    if (slot == _hashCodes.size())
+        return RC::VECTOR_NOT_FOUND;
+    return getCoords(slot, val);
+}
+
+template<typename Code>
+RC QuantizedSet<Code>::findFirst(IVector const * const& pat, IVector::NORM n, double tol) const {
+    RC rc = checkVector(pat);
+    if (rc != RC::SUCCESS)
+        return rc;
+    return findSlot(pat->getData(), n, tol) == _hashCodes.size() ? RC::VECTOR_NOT_FOUND : RC::SUCCESS;
+}
+
+template<typename Code>
+RC QuantizedSet<Code>::findFirstMany(double const* patterns, size_t count, size_t dim, IVector::NORM n, double tol, size_t * const& indices) const {
+    if ((patterns == nullptr || indices == nullptr) && count != 0){
+        SendInfo(ISet::getLogger(), RC::NULLPTR_ERROR);
+        return RC::NULLPTR_ERROR;
+    }
+    if (dim != _dim){
+        SendInfo(ISet::getLogger(), RC::MISMATCHING_DIMENSIONS);
+        return RC::MISMATCHING_DIMENSIONS;
+    }
+    // every lookup scans all codes, so rows are only spread over threads
+    ScanPool& pool = ScanPool::instance();
+    size_t parts = std::max(size_t(1), std::min(pool.getThreadCount(), count / batchPartRows));
+    size_t partRows = (count + parts - 1) / parts;
+    std::atomic<bool> failed(false);
+    pool.run(parts, [&](size_t part){
+        try {
+            for (size_t k = part * partRows; k < std::min(count, (part + 1) * partRows); k++)
+                indices[k] = findSlot(patterns + k * _dim, n, tol);
+        }
+        catch (std::bad_alloc const&){
+            failed.store(true);
+        }
+    });
+    if (failed.load()){
+        SendInfo(ISet::getLogger(), RC::ALLOCATION_ERROR);
+        return RC::ALLOCATION_ERROR;
+    }
+    return RC::SUCCESS;
+}
+
+template<typename Code>
+RC QuantizedSet<Code>::insert(IVector const * const& val, IVector::NORM n, double tol) {
+    RC rc = checkVector(val);
+    if (rc != RC::SUCCESS)
+        return rc;
+    size_t inserted = 0;
+    rc = insertBatch(val->getData(), 1, _dim, n, tol, inserted);
+    if (rc == RC::SUCCESS && inserted == 0)
+        return RC::VECTOR_ALREADY_EXIST;
+    return rc;
+}
+
+template<typename Code>
+RC QuantizedSet<Code>::insertBatch(double const* rows, size_t count, size_t dim, IVector::NORM n, double tol, size_t& inserted) {
+    inserted = 0;
+    if (rows == nullptr && count != 0){
+        SendInfo(ISet::getLogger(), RC::NULLPTR_ERROR);
+        return RC::NULLPTR_ERROR;
+    }
+    if (dim != _dim){
+        SendInfo(ISet::getLogger(), RC::MISMATCHING_DIMENSIONS);
+        return RC::MISMATCHING_DIMENSIONS;
+    }
+    std::vector<Code> codes(_dim);
+    for (size_t k = 0; k < count; k++){
+        double const* row = rows + k * _dim;
+        if (!encode(row, codes.data())){
+            SendInfo(ISet::getLogger(), RC::INVALID_ARGUMENT);
+            return RC::INVALID_ARGUMENT;
+        }
+        // earlier rows of the batch are already in the set
+        if (findSlot(row, n, tol) != _hashCodes.size())
+            continue;
+        RC rc = append(codes.data());
+        if (rc != RC::SUCCESS)
+            return rc;
+        inserted++;
+    }
+    return RC::SUCCESS;
+}
+
+template<typename Code>
+RC QuantizedSet<Code>::remove(size_t index) {
+    if (index >= _hashCodes.size()){
+        SendInfo(ISet::getLogger(), RC::INDEX_OUT_OF_BOUND);
+        return RC::INDEX_OUT_OF_BOUND;
+    }
+    removeSlot(index);
+    return RC::SUCCESS;
+}
+
+template<typename Code>
+RC QuantizedSet<Code>::remove(IVector const * const& pat, IVector::NORM n, double tol) {
+    RC rc = checkVector(pat);
+    if (rc != RC::SUCCESS)
+        return rc;
+    size_t slot = findSlot(pat->getData(), n, tol);
+    if (slot == _hashCodes.size())
+        return RC::VECTOR_NOT_FOUND;
+    removeSlot(slot);
+    return RC::SUCCESS;
+}
+
+template<typename Code>
+RC QuantizedSet<Code>::removeIf(std::function<bool(double const*, size_t)> const& pred) {
+    if (!pred){
+        SendInfo(ISet::getLogger(), RC::NULLPTR_ERROR);
+        return RC::NULLPTR_ERROR;
+    }
+    std::vector<double> decoded(_dim);
+    size_t dst = 0;
+    for (size_t slot = 0; slot < _hashCodes.size(); slot++){
+        decode(slot, decoded.data());
+        if (pred(decoded.data(), _dim)){
+            _summary.remove(decoded.data());
+            continue;
+        }
+        if (slot != dst){
+            std::memcpy(_codes.data() + dst * _dim, _codes.data() + slot * _dim, _dim * sizeof(Code));
+            _hashCodes[dst] = _hashCodes[slot];
+        }
+        dst++;
+    }
+    if (dst != _hashCodes.size())
+        _version++;
+    _codes.resize(dst * _dim);
+    _hashCodes.resize(dst);
+    return RC::SUCCESS;
+}
+
+template<typename Code>
+RC QuantizedSet<Code>::queryBox(ICompact const* const& box, std::function<void(double const*, size_t)> const& callback) const {
+    if (box == nullptr || !callback){
+        SendInfo(ISet::getLogger(), RC::NULLPTR_ERROR);
+        return RC::NULLPTR_ERROR;
+    }
+    if (box->getDim() != _dim){
+        SendInfo(ISet::getLogger(), RC::MISMATCHING_DIMENSIONS);
+        return RC::MISMATCHING_DIMENSIONS;
+    }
+    IVector* lowerVec = nullptr;
+    IVector* upperVec = nullptr;
+    RC rc = box->getLeftBoundary(lowerVec);
+    if (rc == RC::SUCCESS)
+        rc = box->getRightBoundary(upperVec);
+    if (rc != RC::SUCCESS){
+        delete lowerVec;
+        SendInfo(ISet::getLogger(), rc);
+        return rc;
+    }
+    double const* lower = lowerVec->getData();
+    double const* upper = upperVec->getData();
+    std::vector<double> decoded(_dim);
+    for (size_t slot = 0; slot < _hashCodes.size(); slot++){
+        decode(slot, decoded.data());
+        size_t i = 0;
+        for (; i < _dim && lower[i] <= decoded[i] && decoded[i] <= upper[i]; i++);
+        if (i == _dim)
+            callback(decoded.data(), _dim);
+    }
+    delete lowerVec;
+    delete upperVec;
+    return RC::SUCCESS;
+}
+
+template<typename Code>
+RC QuantizedSet<Code>::setGarbageRatio(double ratio) {
+    if (std::isnan(ratio) || ratio < 0. || ratio > 1.){
+        SendInfo(ISet::getLogger(), RC::INVALID_ARGUMENT);
+        return RC::INVALID_ARGUMENT;
+    }
+    return RC::SUCCESS;
+}
+
+template<typename Code>
+RC QuantizedSet<Code>::compact() {
+    return RC::SUCCESS;
+}
+
+template<typename Code>
+RC QuantizedSet<Code>::reserve(size_t capacity) {
+    try {
+        _codes.reserve(capacity * _dim);
+        _hashCodes.reserve(capacity);
+    }
+    catch (std::bad_alloc const&){
+        SendInfo(ISet::getLogger(), RC::ALLOCATION_ERROR);
+        return RC::ALLOCATION_ERROR;
+    }
+    return RC::SUCCESS;
+}
+
+template<typename Code>
+RC QuantizedSet<Code>::shrinkToFit() {
+    try {
+        _codes.shrink_to_fit();
+        _hashCodes.shrink_to_fit();
+    }
+    catch (std::bad_alloc const&){
+        SendInfo(ISet::getLogger(), RC::ALLOCATION_ERROR);
+        return RC::ALLOCATION_ERROR;
+    }
+    return RC::SUCCESS;
+}
+
+template<typename Code>
+RC QuantizedSet<Code>::setGrowthFactor(double factor) {
+    if (std::isnan(factor) || std::isinf(factor) || factor <= 1.){
+        SendInfo(ISet::getLogger(), RC::INVALID_ARGUMENT);
+        return RC::INVALID_ARGUMENT;
+    }
+    _growthFactor = factor;
+    return RC::SUCCESS;
+}
+
+template<typename Code>
+RC QuantizedSet<Code>::getBounds(IVector*& lower, IVector*& upper) const {
+    if (_hashCodes.empty())
+        return RC::SOURCE_SET_EMPTY;
+    std::lock_guard<std::mutex> guard(_summaryLock);
+    updateSummary();
+    IVector* lowerVec = IVector::createVector(_dim, _summary.getLower());
+    IVector* upperVec = IVector::createVector(_dim, _summary.getUpper());
+    if (lowerVec == nullptr || upperVec == nullptr){
+        delete lowerVec;
+        delete upperVec;
+        SendInfo(ISet::getLogger(), RC::ALLOCATION_ERROR);
+        return RC::ALLOCATION_ERROR;
+    }
+    lower = lowerVec;
+    upper = upperVec;
+    return RC::SUCCESS;
+}
+
+template<typename Code>
+RC QuantizedSet<Code>::getCentroid(IVector*& centroid) const {
+    if (_hashCodes.empty())
+        return RC::SOURCE_SET_EMPTY;
+    std::lock_guard<std::mutex> guard(_summaryLock);
+    IVector* mean = IVector::createVector(_dim, _summary.getMean());
+    if (mean == nullptr){
+        SendInfo(ISet::getLogger(), RC::ALLOCATION_ERROR);
+        return RC::ALLOCATION_ERROR;
+    }
+    centroid = mean;
+    return RC::SUCCESS;
+}
+
+template<typename Code>
+RC QuantizedSet<Code>::getVariance(IVector*& variance) const {
+    if (_hashCodes.empty())
+        return RC::SOURCE_SET_EMPTY;
+    std::vector<double> coords(_dim);
+    {
+        std::lock_guard<std::mutex> guard(_summaryLock);
+        _summary.getVariance(coords.data());
+    }
+    IVector* spread = IVector::createVector(_dim, coords.data());
+    if (spread == nullptr){
+        SendInfo(ISet::getLogger(), RC::ALLOCATION_ERROR);
+        return RC::ALLOCATION_ERROR;
+    }
+    variance = spread;
+    return RC::SUCCESS;
+}
+
+template<typename Code>
+uint64_t QuantizedSet<Code>::getVersion() const {
+    return _version;
+}
+
+template<typename Code>
+RC QuantizedSet<Code>::sync() {
+    return RC::SUCCESS;
+}
+
+template<typename Code>
+ISet::IIterator* QuantizedSet<Code>::getIterator(size_t index) const {
+    if (index >= _hashCodes.size()){
+        SendInfo(ISet::getLogger(), RC::INDEX_OUT_OF_BOUND);
+        return nullptr;
+    }
+    std::vector<double> decoded(_dim);
+    decode(index, decoded.data());
+    return SetIterator::createIterator(_dim, decoded.data(), _hashCodes[index], index, _setCB);
+}
+
+template<typename Code>
+ISet::IIterator* QuantizedSet<Code>::getBegin() const {
+    if (_hashCodes.empty()){
+        SendInfo(ISet::getLogger(), RC::SOURCE_SET_EMPTY);
+        return nullptr;
+    }
+    return getIterator(0);
+}
+
+template<typename Code>
+ISet::IIterator* QuantizedSet<Code>::getEnd() const {
+    if (_hashCodes.empty()){
+        SendInfo(ISet::getLogger(), RC::SOURCE_SET_EMPTY);
+        return nullptr;
+    }
+    return getIterator(_hashCodes.size() - 1);
+}
+
+template<typename Code>
+ISet::IChunkIterator* QuantizedSet<Code>::getChunkIterator(size_t chunkRows) const {
+    if (chunkRows == 0){
+        SendInfo(ISet::getLogger(), RC::INVALID_ARGUMENT);
+        return nullptr;
+    }
+    if (_hashCodes.empty()){
+        SendInfo(ISet::getLogger(), RC::SOURCE_SET_EMPTY);
+        return nullptr;
+    }
+    chunkRows = std::min(chunkRows, _hashCodes.size());
+    std::shared_ptr<std::vector<double>> rowBuffer;
+    std::shared_ptr<std::vector<size_t>> hashBuffer;
+    try {
+        rowBuffer = std::make_shared<std::vector<double>>(chunkRows * _dim);
+        hashBuffer = std::make_shared<std::vector<size_t>>(chunkRows);
+    }
+    catch (std::bad_alloc const&){
+        SendInfo(ISet::getLogger(), RC::ALLOCATION_ERROR);
+        return nullptr;
+    }
+    // control block keeps the flag telling that the set is alive
+    std::shared_ptr<ISetControlBlock> block = _setCB;
+    bool const* setIsValid = _setIsValid;
+    QuantizedSet<Code> const* set = this;
+    uint64_t version = _version;
+    size_t index = 0;
+    return ChunkIterator::createIterator(_dim, [block, setIsValid, set, version, rowBuffer, hashBuffer, index, chunkRows](double const*& rows, size_t const*& hashes, size_t& count) mutable {
+        if (!setIsValid[0])
+            return RC::SOURCE_SET_DESTROYED;
+        if (set->_version != version)
+            return RC::SOURCE_SET_CHANGED;
+        size_t size = set->_hashCodes.size(), dim = set->_dim;
+        count = std::min(chunkRows, size - index);
+        for (size_t k = 0; k < count; k++)
+            set->decode(index + k, rowBuffer->data() + k * dim);
+        std::copy(set->_hashCodes.begin() + index, set->_hashCodes.begin() + index + count, hashBuffer->begin());
+        index += count;
+        kernel::prefetch(set->_codes.data() + index * dim, std::min(chunkRows, size - index) * dim * sizeof(Code));
+        rows = rowBuffer->data();
+        hashes = hashBuffer->data();
+        return RC::SUCCESS;
+    });
+}
+
+template<typename Code>
+RC QuantizedSet<Code>::forEachChunk(size_t chunkRows, std::function<void(double const*, size_t const*, size_t, size_t)> const& callback) const {
+    if (!callback){
+        SendInfo(ISet::getLogger(), RC::NULLPTR_ERROR);
+        return RC::NULLPTR_ERROR;
+    }
+    if (chunkRows == 0){
+        SendInfo(ISet::getLogger(), RC::INVALID_ARGUMENT);
+        return RC::INVALID_ARGUMENT;
+    }
+    size_t size = _hashCodes.size();
+    if (size == 0)
+        return RC::SUCCESS;
+    chunkRows = std::min(chunkRows, size);
+    ScanPool& pool = ScanPool::instance();
+    size_t parts = std::max(size_t(1), std::min(pool.getThreadCount(), size / chunkRows));
+    size_t partRows = (size + parts - 1) / parts;
+    std::atomic<bool> failed(false);
+    pool.run(parts, [&](size_t part){
+        std::vector<double> decoded;
+        try {
+            decoded.resize(chunkRows * _dim);
+        }
+        catch (std::bad_alloc const&){
+            failed.store(true);
+            return;
+        }
+        size_t last = std::min(size, (part + 1) * partRows);
+        for (size_t index = part * partRows; index < last;){
+            size_t count = std::min(chunkRows, last - index);
+            for (size_t k = 0; k < count; k++)
+                decode(index + k, decoded.data() + k * _dim);
+            kernel::prefetch(_codes.data() + (index + count) * _dim, std::min(chunkRows, last - index - count) * _dim * sizeof(Code));
+            callback(decoded.data(), _hashCodes.data() + index, count, _dim);
+            index += count;
+        }
+    });
+    if (failed.load()){
+        SendInfo(ISet::getLogger(), RC::ALLOCATION_ERROR);
+        return RC::ALLOCATION_ERROR;
+    }
+    return RC::SUCCESS;
+}
+
+LIB_EXPORT ISet* ISet::createQuantizedSet(IVector const* const& lower, IVector const* const& upper, size_t bits) {
+    if (lower == nullptr || upper == nullptr || lower->getData() == nullptr || upper->getData() == nullptr){
+        SendInfo(ISet::getLogger(), RC::NULLPTR_ERROR);
+        return nullptr;
+    }
+    if (lower->getDim() != upper->getDim()){
+        SendInfo(ISet::getLogger(), RC::MISMATCHING_DIMENSIONS);
+        return nullptr;
+    }
+    size_t dim = lower->getDim();
+    double const* lowerData = lower->getData();
+    double const* upperData = upper->getData();
+    for (size_t i = 0; i < dim; i++)
+        if (std::isnan(lowerData[i]) || std::isinf(lowerData[i]) || std::isnan(upperData[i]) || std::isinf(upperData[i]) || lowerData[i] > upperData[i]){
+            SendInfo(ISet::getLogger(), RC::INVALID_ARGUMENT);
+            return nullptr;
+        }
+    if (dim == 0 || (bits != 8 && bits != 16)){
+        SendInfo(ISet::getLogger(), RC::INVALID_ARGUMENT);
+        return nullptr;
+    }
+    if (bits == 8)
+        return QuantizedSet<uint8_t>::create(lowerData, upperData, dim);
+    return QuantizedSet<uint16_t>::create(lowerData, upperData, dim);
+}
+
+LIB_EXPORT ISet* ISet::createQuantizedSet(ISet const* const& source, size_t bits) {
+    if (source == nullptr){
+        SendInfo(ISet::getLogger(), RC::NULLPTR_ERROR);
+        return nullptr;
+    }
+    if (bits != 8 && bits != 16){
+        SendInfo(ISet::getLogger(), RC::INVALID_ARGUMENT);
+        return nullptr;
+    }
+    IVector* lower = nullptr;
+    IVector* upper = nullptr;
+    RC rc = source->getBounds(lower, upper);
+    if (rc != RC::SUCCESS){
+        SendInfo(ISet::getLogger(), rc);
+        return nullptr;
+    }
+    ISet* set = nullptr;
+    if (bits == 8)
+        set = QuantizedSet<uint8_t>::create(source, lower->getData(), upper->getData());
+    else
+        set = QuantizedSet<uint16_t>::create(source, lower->getData(), upper->getData());
+    delete lower;
+    delete upper;
+    return set;
+}
@@ -0,0 +1,114 @@
+#include "RowIndex.h"
+#include "../include/ISetRawView.h"
+#include "SetKernels.h"
+#include <algorithm>
+#include <cstring>
+#include <new>
+
+RowIndex::RowIndex() :
+        _dim(0),
+        _size(0),
+        _axis(0),
+        _rows(nullptr){
+}
+
+RC RowIndex::build(ISet const* const& set) {
+    if (set == nullptr)
+        return RC::NULLPTR_ERROR;
+    uint64_t version = 0;
+    ISetRawView const* view = ISetRawView::of(set);
+    RC viewRC = view != nullptr ? view->getRawView(_rows, _size, _dim, version) : RC::OPERATION_NOT_SUPPORTED;
+    if (viewRC == RC::OPERATION_NOT_SUPPORTED)
+        viewRC = copyRows(set);
+    if (viewRC != RC::SUCCESS)
+        return viewRC;
+    _axis = 0;
+    if (_size == 0)
+        return RC::SUCCESS;
+
+    _order.reset(new(std::nothrow) size_t[_size]);
+    if (_order == nullptr)
+        return RC::ALLOCATION_ERROR;
+
+    double maxSpread = -1.;
+    for (size_t axis = 0; axis < _dim; axis++){
+        double min = _rows[axis], max = _rows[axis];
+        for (size_t row = 1; row < _size; row++){
+            min = std::min(min, _rows[row * _dim + axis]);
+            max = std::max(max, _rows[row * _dim + axis]);
+        }
+        if (max - min > maxSpread){
+            maxSpread = max - min;
+            _axis = axis;
+        }
+    }
+    for (size_t row = 0; row < _size; row++)
+        _order[row] = row;
+    double const* rows = _rows;
+    size_t const dim = _dim, axis = _axis;
+    std::sort(_order.get(), _order.get() + _size, [rows, dim, axis](size_t lhs, size_t rhs){
+        return rows[lhs * dim + axis] < rows[rhs * dim + axis];
+    });
+    return RC::SUCCESS;
+}
+
+RC RowIndex::copyRows(ISet const* const& set) {
+    _dim = set->getDim();
+    _size = set->getSize();
+    _rows = nullptr;
+    if (_size == 0)
+        return RC::SUCCESS;
+
+    _copy.reset(new(std::nothrow) double[_size * _dim]);
+    if (_copy == nullptr)
+        return RC::ALLOCATION_ERROR;
+    _rows = _copy.get();
+
+    auto it = set->getBegin();
+    if (it == nullptr)
+        return RC::NULLPTR_ERROR;
+    IVector* vec = nullptr;
+    RC rc = it->getVectorCopy(vec);
+    size_t i = 0;
+    while (rc == RC::SUCCESS && i < _size){
+        std::memcpy(_copy.get() + i * _dim, vec->getData(), _dim * sizeof(double));
+        i++;
+        rc = it->next();
+        if (rc == RC::INDEX_OUT_OF_BOUND || !it->isValid()){
+            rc = RC::SUCCESS;
+            break;
+        }
+        if (rc == RC::SUCCESS)
+            rc = it->getVectorCoords(vec);
+    }
+    delete vec;
+    delete it;
+    _size = i;
+    return rc;
+}
+
+size_t RowIndex::getSize() const {
+    return _size;
+}
+
+double const* RowIndex::getRow(size_t index) const {
+    return _rows + index * _dim;
+}
+
+bool RowIndex::contains(double const* pat, IVector::NORM n, double tol) const {
+    double const* rows = _rows;
+    size_t const dim = _dim, axis = _axis;
+    size_t const* first = std::lower_bound(_order.get(), _order.get() + _size, pat[axis] - tol,
+                                           [rows, dim, axis](size_t row, double key){
+        return rows[row * dim + axis] < key;
+    });
+    kernel::RowComparer equal = kernel::rowComparer(dim, n);
+    for (size_t const* it = first; it != _order.get() + _size; it++){
+        double const* row = rows + *it * dim;
+        if (row[axis] > pat[axis] + tol)
+            break;
+        if (equal(dim, row, pat, tol))
+            return true;
+    }
+    return false;
+}
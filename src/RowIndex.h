@@ -0,0 +1,33 @@
+#pragma once
+#include "../include/ISet.h"
+#include <cstddef>
+#include <memory>
+
+/*
+ * Vectors of a set ordered along the axis with the largest spread, rows are read through ISetRawView::getRawView
+ * or copied with the set iterator if the set has no contiguous storage.
+ * Vectors closer than tol in any of IVector::NORM are closer than tol along every axis,
+ * so lookup checks only rows with axis coordinate in [pat_axis - tol, pat_axis + tol]
+ */
+class RowIndex {
+private:
+    size_t _dim;
+    size_t _size;
+    size_t _axis;
+    double const* _rows;
+    std::unique_ptr<double[]> _copy;
+    std::unique_ptr<size_t[]> _order;
+
+    RC copyRows(ISet const* const& set);
+
+public:
+    RowIndex();
+
+    RC build(ISet const* const& set);
+
+    size_t getSize() const;
+
+    double const* getRow(size_t index) const;
+
+    bool contains(double const* pat, IVector::NORM n, double tol) const;
+};
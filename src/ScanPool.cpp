@@ -0,0 +1,112 @@
+#include "ScanPool.h"
+#include <atomic>
+#include <algorithm>
+#include <system_error>
+#include <new>
+
+struct ScanPool::Job {
+    std::function<void(size_t)> const* task;
+    size_t parts;
+    std::atomic<size_t> next;
+    std::atomic<size_t> pending;
+    std::mutex lock;
+    std::condition_variable done;
+};
+
+ScanPool& ScanPool::instance() {
+    static ScanPool pool;
+    return pool;
+}
+
+ScanPool::ScanPool() :
+        _started(false),
+        _stopped(false){
+}
+
+ScanPool::~ScanPool() {
+    {
+        std::lock_guard<std::mutex> guard(_lock);
+        _stopped = true;
+    }
+    _wake.notify_all();
+    for (auto& worker : _workers)
+        worker.join();
+}
+
+void ScanPool::start() {
+    std::lock_guard<std::mutex> guard(_lock);
+    if (_started)
+        return;
+    _started = true;
+    size_t threads = std::max(std::thread::hardware_concurrency(), 1u);
+    try {
+        for (size_t i = 1; i < threads; i++)
+            _workers.emplace_back(&ScanPool::loop, this);
+    }
+    catch (std::system_error const&){
+    }
+    catch (std::bad_alloc const&){
+    }
+}
+
+size_t ScanPool::getThreadCount() {
+    start();
+    return _workers.size() + 1;
+}
+
+void ScanPool::work(std::shared_ptr<Job> const& job) {
+    for (size_t part = job->next++; part < job->parts; part = job->next++){
+        (*job->task)(part);
+        if (--job->pending == 0){
+            std::lock_guard<std::mutex> guard(job->lock);
+            job->done.notify_all();
+        }
+    }
+}
+
+void ScanPool::loop() {
+    std::shared_ptr<Job> seen;
+    while (true){
+        std::shared_ptr<Job> job;
+        {
+            std::unique_lock<std::mutex> guard(_lock);
+            _wake.wait(guard, [this, &seen](){ return _stopped || (_job != nullptr && _job != seen); });
+            if (_stopped)
+                return;
+            job = _job;
+        }
+        seen = job;
+        work(job);
+    }
+}
+
+void ScanPool::run(size_t parts, std::function<void(size_t)> const& task) {
+    std::unique_lock<std::mutex> busy(_runLock, std::try_to_lock);
+    if (parts <= 1 || !busy.owns_lock() || getThreadCount() == 1){
+        for (size_t part = 0; part < parts; part++)
+            task(part);
+        return;
+    }
+    std::shared_ptr<Job> job(new(std::nothrow) Job());
+    if (job == nullptr){
+        for (size_t part = 0; part < parts; part++)
+            task(part);
+        return;
+    }
+    job->task = &task;
+    job->parts = parts;
+    job->next = 0;
+    job->pending = parts;
+    {
+        std::lock_guard<std::mutex> guard(_lock);
+        _job = job;
+    }
+    _wake.notify_all();
+    work(job);
+    {
+        std::unique_lock<std::mutex> guard(job->lock);
+        job->done.wait(guard, [&job](){ return job->pending == 0; });
+    }
+    std::lock_guard<std::mutex> guard(_lock);
+    _job.reset();
+}
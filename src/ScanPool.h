@@ -0,0 +1,49 @@
+#pragma once
+#include <cstddef>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <vector>
+
+/*
+ * Process wide pool of threads splitting scans of large sets, the calling thread takes part in the work
+ */
+class ScanPool {
+public:
+    static ScanPool& instance();
+
+    /*
+     * Quantity of threads a job is spread over, the calling thread included
+     */
+    size_t getThreadCount();
+
+    /*
+     * Calls task(part) for every part in [0, parts) and returns when all calls are finished.
+     * Parts are started in ascending order. A job started while another one runs is done by the calling thread alone
+     */
+    void run(size_t parts, std::function<void(size_t)> const& task);
+
+    ~ScanPool();
+
+private:
+    struct Job;
+
+    std::mutex _lock;
+    std::mutex _runLock;
+    std::condition_variable _wake;
+    std::vector<std::thread> _workers;
+    std::shared_ptr<Job> _job;
+    bool _started;
+    bool _stopped;
+
+    ScanPool();
+
+    void start();
+    void work(std::shared_ptr<Job> const& job);
+    void loop();
+
+    ScanPool(const ScanPool&) = delete;
+    ScanPool& operator=(const ScanPool&) = delete;
+};
@@ -0,0 +1,124 @@
+#include "../include/ISetAllocator.h"
+#include <cstdlib>
+#include <cstring>
+#include <new>
+
+#if defined(__unix__) || defined(__APPLE__)
+#define SET_PAGE_ALLOCATOR
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+
+namespace{
+    class HeapAllocator : public ISetAllocator {
+    public:
+        void* allocate(size_t size) override;
+        void* reallocate(void* block, size_t size, size_t newSize) override;
+        void deallocate(void* block, size_t size) override;
+    };
+
+#if defined(SET_PAGE_ALLOCATOR)
+    class PageAllocator : public ISetAllocator {
+    private:
+        bool _hugePages;
+        size_t _pageSize;
+
+        inline size_t roundUp(size_t size) const;
+
+        void advise(void* block, size_t size) const;
+
+    public:
+        explicit PageAllocator(bool hugePages);
+
+        void* allocate(size_t size) override;
+        void* reallocate(void* block, size_t size, size_t newSize) override;
+        void deallocate(void* block, size_t size) override;
+    };
+#endif
+}
+
+void* HeapAllocator::allocate(size_t size) {
+    return std::malloc(size == 0 ? 1 : size);
+}
+
+void* HeapAllocator::reallocate(void* block, size_t, size_t newSize) {
+    return std::realloc(block, newSize == 0 ? 1 : newSize);
+}
+
+void HeapAllocator::deallocate(void* block, size_t) {
+    std::free(block);
+}
+
+#if defined(SET_PAGE_ALLOCATOR)
+PageAllocator::PageAllocator(bool hugePages) :
+        _hugePages(hugePages),
+        _pageSize(static_cast<size_t>(sysconf(_SC_PAGESIZE))){
+}
+
+size_t PageAllocator::roundUp(size_t size) const {
+    if (size == 0)
+        return _pageSize;
+    return (size + _pageSize - 1) / _pageSize * _pageSize;
+}
+
+void PageAllocator::advise(void* block, size_t size) const {
+#if defined(MADV_HUGEPAGE)
+    if (_hugePages)
+        madvise(block, size, MADV_HUGEPAGE);
+#endif
+}
+
+void* PageAllocator::allocate(size_t size) {
+    size = roundUp(size);
+    void* block = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (block == MAP_FAILED)
+        return nullptr;
+    advise(block, size);
+    return block;
+}
+
+void* PageAllocator::reallocate(void* block, size_t size, size_t newSize) {
+    size = roundUp(size);
+    newSize = roundUp(newSize);
+    if (newSize == size)
+        return block;
+#if defined(MREMAP_MAYMOVE)
+    // pages are moved by the kernel, rows are not copied
+    void* moved = mremap(block, size, newSize, MREMAP_MAYMOVE);
+    if (moved == MAP_FAILED)
+        return nullptr;
+    advise(moved, newSize);
+    return moved;
+#else
+    if (newSize < size){
+        munmap(static_cast<char*>(block) + newSize, size - newSize);
+        return block;
+    }
+    void* moved = allocate(newSize);
+    if (moved == nullptr)
+        return nullptr;
+    std::memcpy(moved, block, size);
+    munmap(block, size);
+    return moved;
+#endif
+}
+
+void PageAllocator::deallocate(void* block, size_t size) {
+    if (block != nullptr)
+        munmap(block, roundUp(size));
+}
+#endif
+
+ISetAllocator* ISetAllocator::getHeapAllocator() {
+    static HeapAllocator allocator;
+    return &allocator;
+}
+
+ISetAllocator* ISetAllocator::createPageAllocator(bool hugePages) {
+#if defined(SET_PAGE_ALLOCATOR)
+    return new(std::nothrow) PageAllocator(hugePages);
+#else
+    return nullptr;
+#endif
+}
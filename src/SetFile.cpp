@@ -0,0 +1,178 @@
+#include "SetFile.h"
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+
+#if defined(SET_FILE_MMAP)
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+namespace{
+    char const fileMagic[8] = {'G', 'L', 'S', 'E', 'T', 0, 0, 0};
+    uint32_t const fileFormatVersion = 1;
+    uint32_t const fileByteOrder = 0x01020304;
+
+    inline bool writeZeros(FILE* file, size_t bytes){
+        static unsigned char const zeros[4096] = {};
+        for (; bytes > 0; bytes -= std::min(bytes, sizeof(zeros)))
+            if (std::fwrite(zeros, 1, std::min(bytes, sizeof(zeros)), file) != std::min(bytes, sizeof(zeros)))
+                return false;
+        return true;
+    }
+
+    inline bool headerIsValid(setfile::Header const& header, size_t fileSize){
+        if (std::memcmp(header.magic, fileMagic, sizeof(fileMagic)) != 0 || header.formatVersion != fileFormatVersion ||
+            header.byteOrder != fileByteOrder || sizeof(size_t) != sizeof(uint64_t))
+            return false;
+        if (header.count > header.capacity || (header.dim == 0 && header.count != 0) || header.nextHash < header.count)
+            return false;
+        if (!(header.garbageRatio >= 0. && header.garbageRatio <= 1.))
+            return false;
+        uint64_t const limit = fileSize;
+        uint64_t rowBytes = header.dim * sizeof(double);
+        if (header.dim > limit || (rowBytes != 0 && header.capacity > limit / rowBytes) || header.capacity > limit / sizeof(uint64_t))
+            return false;
+        uint64_t hashesEnd = header.hashesOffset + header.capacity * sizeof(uint64_t);
+        if (header.hashesOffset != setfile::rowsOffset + header.capacity * rowBytes || hashesEnd > limit)
+            return false;
+        if (header.indexOffset != 0 && (header.indexOffset < hashesEnd || header.indexOffset % sizeof(uint64_t) != 0 ||
+                                        header.indexSize > limit || header.indexOffset + header.indexSize > limit))
+            return false;
+        return true;
+    }
+}
+
+RC setfile::save(char const* const& path, size_t dim, size_t count, size_t minCapacity, size_t nextHash, double garbageRatio,
+                 RowSource const& rows, std::vector<unsigned char> const& index) {
+    FILE* file = std::fopen(path, "wb");
+    if (file == nullptr)
+        return RC::IO_ERROR;
+    size_t capacity = std::max(count, minCapacity);
+    Header header = {};
+    std::memcpy(header.magic, fileMagic, sizeof(fileMagic));
+    header.formatVersion = fileFormatVersion;
+    header.byteOrder = fileByteOrder;
+    header.dim = dim;
+    header.count = count;
+    header.capacity = capacity;
+    header.nextHash = nextHash;
+    header.hashesOffset = rowsOffset + capacity * dim * sizeof(double);
+    header.indexOffset = index.empty() ? 0 : header.hashesOffset + capacity * sizeof(uint64_t);
+    header.indexSize = index.size();
+    header.garbageRatio = garbageRatio;
+
+    bool written = std::fwrite(&header, sizeof(header), 1, file) == 1 && writeZeros(file, rowsOffset - sizeof(header));
+    written = written && rows([file, dim](double const* row, size_t){
+        return std::fwrite(row, sizeof(double), dim, file) == dim;
+    });
+    written = written && writeZeros(file, (capacity - count) * dim * sizeof(double));
+    written = written && rows([file](double const*, size_t hash){
+        uint64_t code = hash;
+        return std::fwrite(&code, sizeof(code), 1, file) == 1;
+    });
+    written = written && writeZeros(file, (capacity - count) * sizeof(uint64_t));
+    if (written && !index.empty())
+        written = std::fwrite(index.data(), 1, index.size(), file) == index.size();
+    written = std::fclose(file) == 0 && written;
+    return written ? RC::SUCCESS : RC::IO_ERROR;
+}
+
+RC setfile::open(char const* const& path, bool writable, Header& header, std::shared_ptr<SetStorage>& storage, int& fd) {
+    fd = -1;
+#if defined(SET_FILE_MMAP)
+    int file = ::open(path, writable ? O_RDWR : O_RDONLY);
+    if (file < 0)
+        return RC::FILE_NOT_FOUND;
+    struct stat fileStat;
+    bool valid = fstat(file, &fileStat) == 0 && static_cast<size_t>(fileStat.st_size) >= rowsOffset &&
+                 pread(file, &header, sizeof(header), 0) == static_cast<ssize_t>(sizeof(header)) &&
+                 headerIsValid(header, static_cast<size_t>(fileStat.st_size));
+    if (valid)
+        storage = SetStorage::mapFile(file, static_cast<size_t>(fileStat.st_size), writable);
+    // mapping of a read-only set outlives the descriptor
+    if (writable && storage != nullptr)
+        fd = file;
+    else
+        ::close(file);
+#else
+    if (writable)
+        return RC::OPERATION_NOT_SUPPORTED;
+    FILE* file = std::fopen(path, "rb");
+    if (file == nullptr)
+        return RC::FILE_NOT_FOUND;
+    long fileSize = std::fseek(file, 0, SEEK_END) == 0 ? std::ftell(file) : -1;
+    bool valid = fileSize >= static_cast<long>(rowsOffset) && std::fseek(file, 0, SEEK_SET) == 0 &&
+                 std::fread(&header, sizeof(header), 1, file) == 1 && headerIsValid(header, static_cast<size_t>(fileSize));
+    if (valid)
+        storage = SetStorage::readFile(file, static_cast<size_t>(fileSize));
+    std::fclose(file);
+#endif
+    if (!valid)
+        return RC::INVALID_ARGUMENT;
+    if (storage == nullptr)
+        return RC::IO_ERROR;
+    if (header.dim != 0){
+        storage->data = reinterpret_cast<double*>(storage->image + rowsOffset);
+        storage->hashCodes = reinterpret_cast<size_t*>(storage->image + header.hashesOffset);
+        storage->capacity = header.capacity;
+        if (header.indexOffset != 0){
+            storage->gridImage = storage->image + header.indexOffset;
+            storage->gridImageSize = header.indexSize;
+        }
+    }
+    return RC::SUCCESS;
+}
+
+RC setfile::grow(int fd, size_t dim, size_t capacity, std::shared_ptr<SetStorage>& storage) {
+    size_t hashesOffset = rowsOffset + capacity * dim * sizeof(double);
+    storage = SetStorage::mapFile(fd, hashesOffset + capacity * sizeof(uint64_t), true);
+    if (storage == nullptr)
+        return RC::IO_ERROR;
+    storage->data = reinterpret_cast<double*>(storage->image + rowsOffset);
+    storage->hashCodes = reinterpret_cast<size_t*>(storage->image + hashesOffset);
+    storage->capacity = capacity;
+    auto header = reinterpret_cast<Header*>(storage->image);
+    header->dim = dim;
+    header->capacity = capacity;
+    header->hashesOffset = hashesOffset;
+    header->indexOffset = 0;
+    header->indexSize = 0;
+    return RC::SUCCESS;
+}
+
+RC setfile::sync(int fd, SetStorage const& storage, size_t count, size_t capacity, size_t nextHash, double garbageRatio,
+                 std::vector<unsigned char> const* index) {
+#if defined(SET_FILE_MMAP)
+    auto header = reinterpret_cast<Header*>(storage.image);
+    header->count = count;
+    header->capacity = capacity;
+    header->nextHash = nextHash;
+    header->garbageRatio = garbageRatio;
+    if (index != nullptr){
+        uint64_t indexOffset = header->hashesOffset + capacity * sizeof(uint64_t);
+        header->indexOffset = 0;
+        header->indexSize = 0;
+        if (!index->empty()){
+            size_t fileSize = std::max<size_t>(storage.imageSize, indexOffset + index->size());
+            if (ftruncate(fd, static_cast<off_t>(fileSize)) != 0 ||
+                pwrite(fd, index->data(), index->size(), static_cast<off_t>(indexOffset)) != static_cast<ssize_t>(index->size()))
+                return RC::IO_ERROR;
+            header->indexOffset = indexOffset;
+            header->indexSize = index->size();
+        }
+    }
+    if (msync(storage.image, storage.imageSize, MS_SYNC) != 0 || fsync(fd) != 0)
+        return RC::IO_ERROR;
+#endif
+    return RC::SUCCESS;
+}
+
+void setfile::close(int fd) {
+#if defined(SET_FILE_MMAP)
+    if (fd >= 0)
+        ::close(fd);
+#endif
+}
@@ -0,0 +1,63 @@
+#pragma once
+#include "../include/RC.h"
+#include "SetStorage.h"
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <vector>
+
+/*
+ * Set file: header, capacity rows of dim coordinates at rowsOffset, capacity unique indices
+ * at hashesOffset and optional image of GridIndex. Only first count rows and indices are meaningful.
+ * Sets opened from a file keep their rows and indices in a SetStorage over the mapped file
+ */
+namespace setfile {
+    struct Header {
+        char magic[8];
+        uint32_t formatVersion;
+        uint32_t byteOrder;
+        uint64_t dim;
+        uint64_t count;
+        uint64_t capacity;
+        uint64_t nextHash;
+        uint64_t hashesOffset;
+        uint64_t indexOffset;
+        uint64_t indexSize;
+        double garbageRatio;
+    };
+
+    size_t const rowsOffset = 4096;
+
+    /*
+     * Calls visit(row, hash) for every vector written into the file until it returns false, returns false then
+     */
+    typedef std::function<bool(std::function<bool(double const*, size_t)> const& visit)> RowSource;
+
+    /*
+     * Writes count vectors of rows into a new file at path, capacity of the file is count but at least minCapacity
+     */
+    RC save(char const* const& path, size_t dim, size_t count, size_t minCapacity, size_t nextHash, double garbageRatio,
+            RowSource const& rows, std::vector<unsigned char> const& index);
+
+    /*
+     * Maps the file at path, or reads it into memory where files can not be mapped. Rows and indices of storage point
+     * into the image, fd is the descriptor of a writable file the set keeps open and -1 otherwise
+     */
+    RC open(char const* const& path, bool writable, Header& header, std::shared_ptr<SetStorage>& storage, int& fd);
+
+    /*
+     * Extends writable file fd for capacity rows of dim coordinates and maps it again. Indices move behind the grown
+     * rows, the caller copies them into the new storage, saved index is dropped
+     */
+    RC grow(int fd, size_t dim, size_t capacity, std::shared_ptr<SetStorage>& storage);
+
+    /*
+     * Writes counters of the set into the header of the mapped file, writes index if it is not nullptr
+     * and flushes the file to disk
+     */
+    RC sync(int fd, SetStorage const& storage, size_t count, size_t capacity, size_t nextHash, double garbageRatio,
+            std::vector<unsigned char> const* index);
+
+    void close(int fd);
+}
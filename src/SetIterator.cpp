@@ -0,0 +1,149 @@
+#include "SetIterator.h"
+#include <cstring>
+#include <new>
+
+#define SendInfo(Logger, Code) if (Logger != nullptr) Logger->info((Code), __FILE__, __func__, __LINE__)
+
+ILogger* SetIterator::_logger = nullptr;
+
+ISet::IIterator *SetIterator::getNext(size_t indexInc) const {
+    auto it = clone();
+    if (it == nullptr){
+        SendInfo(_logger, RC::NULLPTR_ERROR);
+        return nullptr;
+    }
+    RC nextRC = it->next(indexInc);
+    if (nextRC != RC::SUCCESS){
+        SendInfo(_logger, nextRC);
+        delete it;
+        return nullptr;
+    }
+    return it;
+}
+
+ISet::IIterator *SetIterator::getPrevious(size_t indexInc) const {
+    auto it = clone();
+    if (it == nullptr){
+        SendInfo(_logger, RC::NULLPTR_ERROR);
+        return nullptr;
+    }
+    RC nextRC = it->previous(indexInc);
+    if (nextRC != RC::SUCCESS){
+        SendInfo(_logger, nextRC);
+        delete it;
+        return nullptr;
+    }
+    return it;
+}
+
+ISet::IIterator *SetIterator::clone() const {
+    if (_data == nullptr)
+        return nullptr;
+    auto it = new(std::nothrow) SetIterator(_dim, _hash, _pos, _data, _setCB);
+    if (it == nullptr)
+        SendInfo(_logger, RC::ALLOCATION_ERROR);
+    return it;
+}
+
+RC SetIterator::checkMove(RC moveRC){
+    if (moveRC == RC::SOURCE_SET_EMPTY ||
+        moveRC == RC::SOURCE_SET_DESTROYED ||
+        moveRC == RC::INDEX_OUT_OF_BOUND){
+        delete [] _data;
+        _data = nullptr;
+        return moveRC;
+    }
+    if (moveRC != RC::SUCCESS)
+        SendInfo(_logger, moveRC);
+    return moveRC;
+}
+
+RC SetIterator::next(size_t indexInc) {
+    if (_data == nullptr){
+        SendInfo(_logger, RC::INDEX_OUT_OF_BOUND);
+        return RC::INDEX_OUT_OF_BOUND;
+    }
+    return checkMove(_setCB->getNext(_data, _hash, _pos, indexInc));
+}
+
+RC SetIterator::previous(size_t indexInc) {
+    if (_data == nullptr){
+        SendInfo(_logger, RC::INDEX_OUT_OF_BOUND);
+        return RC::INDEX_OUT_OF_BOUND;
+    }
+    return checkMove(_setCB->getPrevious(_data, _hash, _pos, indexInc));
+}
+
+bool SetIterator::isValid() const {
+    return nullptr != _data;
+}
+
+RC SetIterator::makeBegin() {
+    if (_data == nullptr){
+        SendInfo(_logger, RC::INDEX_OUT_OF_BOUND);
+        return RC::INDEX_OUT_OF_BOUND;
+    }
+    return checkMove(_setCB->getBegin(_data, _hash, _pos));
+}
+
+RC SetIterator::makeEnd() {
+    if (_data == nullptr){
+        SendInfo(_logger, RC::INDEX_OUT_OF_BOUND);
+        return RC::INDEX_OUT_OF_BOUND;
+    }
+    return checkMove(_setCB->getEnd(_data, _hash, _pos));
+}
+
+RC SetIterator::getVectorCopy(IVector *&val) const {
+    auto vec = IVector::createVector(_dim, _data);
+    if (vec == nullptr){
+        SendInfo(_logger, RC::UNKNOWN);
+        return RC::UNKNOWN;
+    }
+    val = vec;
+    return RC::SUCCESS;
+}
+
+RC SetIterator::getVectorCoords(IVector *const &val) const {
+    if (val == nullptr){
+        SendInfo(_logger, RC::NULLPTR_ERROR);
+        return RC::NULLPTR_ERROR;
+    }
+    return val->setData(_dim, _data);
+}
+
+SetIterator::~SetIterator() {
+    delete [] _data;
+}
+
+SetIterator::SetIterator(size_t dim, size_t hash, size_t pos, double const *const &data, std::shared_ptr<ISetControlBlock> setCB) :
+        _data(nullptr),
+        _dim(dim),
+        _hash(hash),
+        _pos(pos),
+        _setCB(std::move(setCB))
+{
+    if (dim == 0){
+        SendInfo(_logger, RC::MISMATCHING_DIMENSIONS);
+        return;
+    }
+    _data = new(std::nothrow) double[dim];
+    if (_data == nullptr) {
+        SendInfo(_logger, RC::ALLOCATION_ERROR);
+        return;
+    }
+    std::memcpy(_data, data, dim * sizeof(double));
+}
+
+SetIterator *SetIterator::createIterator(size_t dim, double const *const &data, size_t hash, size_t pos,
+                                         std::shared_ptr<ISetControlBlock> setCB) {
+    if (data == nullptr || dim == 0){
+        return nullptr;
+    }
+    auto* it = new(std::nothrow) SetIterator(dim, hash, pos, data, std::move(setCB));
+    if (it == nullptr){
+        SendInfo(_logger, RC::ALLOCATION_ERROR);
+        return nullptr;
+    }
+    return it;
+}
@@ -0,0 +1,52 @@
+#pragma once
+#include "../include/ISet.h"
+#include "../include/ISetControlBlock.h"
+#include <memory>
+
+/*
+ * Iterator of ISet implementations that copy coordinates of the vector under iterator into its buffer
+ * through the control block of the set, so it stays valid while the set is changed
+ */
+class SetIterator : public ISet::IIterator{
+private:
+    static ILogger * _logger;
+
+    double* _data;
+    size_t _dim;
+    size_t _hash;
+    size_t _pos;
+    std::shared_ptr<ISetControlBlock> _setCB;
+
+    SetIterator(size_t dim, size_t hash, size_t pos, double const *const &data, std::shared_ptr<ISetControlBlock> setCB);
+
+    /*
+     * Invalidates iterator if it was moved out of the set
+     */
+    inline RC checkMove(RC moveRC);
+
+public:
+
+    IIterator * getNext(size_t indexInc) const override;
+
+    IIterator * getPrevious(size_t indexInc) const override;
+
+    IIterator * clone() const override;
+
+    RC next(size_t indexInc) override;
+
+    RC previous(size_t indexInc) override;
+
+    bool isValid() const override;
+
+    RC makeBegin() override;
+
+    RC makeEnd() override;
+
+    RC getVectorCopy(IVector *& val) const override;
+
+    RC getVectorCoords(IVector * const& val) const override;
+
+    ~SetIterator() override;
+
+    static SetIterator *createIterator(size_t dim, double const *const &data, size_t hash, size_t pos, std::shared_ptr<ISetControlBlock> setCB);
+};
@@ -0,0 +1,270 @@
+#pragma once
+#include "../include/IVector.h"
+#include <cstddef>
+#include <cstdint>
+#include <cmath>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define SET_KERNEL_SSE2
+#include <emmintrin.h>
+#endif
+
+#if defined(__GNUC__) || defined(__clang__)
+#define SET_KERNEL_PREFETCH(address) __builtin_prefetch((address), 0, 3)
+#elif defined(SET_KERNEL_SSE2)
+#define SET_KERNEL_PREFETCH(address) _mm_prefetch((address), _MM_HINT_T0)
+#endif
+
+/*
+ * Row routines shared by ISet implementations, rows are raw arrays of dim coordinates
+ */
+namespace kernel {
+    inline double rowDistance(size_t dim, double const* op1, double const* op2, IVector::NORM n){
+        double dist = 0.;
+        for (size_t i = 0; i < dim; i++){
+            double diff = std::fabs(op1[i] - op2[i]);
+            if (n == IVector::NORM::FIRST)
+                dist += diff;
+            else if (n == IVector::NORM::SECOND)
+                dist += diff * diff;
+            else if (dist < diff)
+                dist = diff;
+        }
+        if (n == IVector::NORM::SECOND)
+            dist = std::sqrt(dist);
+        return dist;
+    }
+
+    /*
+     * Same comparison as IVector::equals, but on raw coordinates
+     */
+    inline bool rowsAreEqual(size_t dim, double const* op1, double const* op2, IVector::NORM n, double tol){
+        if (n != IVector::NORM::FIRST && n != IVector::NORM::SECOND && n != IVector::NORM::CHEBYSHEV)
+            return false;
+        return rowDistance(dim, op1, op2, n) <= tol;
+    }
+
+    // rows compared per iteration of findRow
+    size_t const blockRows = 4;
+
+    template<IVector::NORM N>
+    inline double accumulate(double dist, double diff){
+        if (N == IVector::NORM::FIRST)
+            return dist + diff;
+        if (N == IVector::NORM::SECOND)
+            return dist + diff * diff;
+        return dist < diff ? diff : dist;
+    }
+
+#if defined(SET_KERNEL_SSE2)
+    template<IVector::NORM N>
+    inline __m128d accumulate(__m128d dist, __m128d diff){
+        if (N == IVector::NORM::FIRST)
+            return _mm_add_pd(dist, diff);
+        if (N == IVector::NORM::SECOND)
+            return _mm_add_pd(dist, _mm_mul_pd(diff, diff));
+        // max takes dist if diff is NaN, as accumulate on doubles does
+        return _mm_max_pd(diff, dist);
+    }
+
+    /*
+     * Bit i of the result is set if row i of the block is equal to pat, lanes of a register are rows,
+     * so every row is summed in the order of rowDistance
+     */
+    template<IVector::NORM N>
+    inline int compareBlock(size_t dim, double const* rows, double const* pat, double tol){
+        double const* row0 = rows;
+        double const* row1 = rows + dim;
+        double const* row2 = rows + 2 * dim;
+        double const* row3 = rows + 3 * dim;
+        __m128d const sign = _mm_set1_pd(-0.);
+        __m128d dist01 = _mm_setzero_pd();
+        __m128d dist23 = _mm_setzero_pd();
+        for (size_t i = 0; i < dim; i++){
+            __m128d coord = _mm_set1_pd(pat[i]);
+            __m128d diff01 = _mm_andnot_pd(sign, _mm_sub_pd(_mm_set_pd(row1[i], row0[i]), coord));
+            __m128d diff23 = _mm_andnot_pd(sign, _mm_sub_pd(_mm_set_pd(row3[i], row2[i]), coord));
+            dist01 = accumulate<N>(dist01, diff01);
+            dist23 = accumulate<N>(dist23, diff23);
+        }
+        if (N == IVector::NORM::SECOND){
+            dist01 = _mm_sqrt_pd(dist01);
+            dist23 = _mm_sqrt_pd(dist23);
+        }
+        __m128d bound = _mm_set1_pd(tol);
+        return _mm_movemask_pd(_mm_cmple_pd(dist01, bound)) | _mm_movemask_pd(_mm_cmple_pd(dist23, bound)) << 2;
+    }
+#else
+    template<IVector::NORM N>
+    inline int compareBlock(size_t dim, double const* rows, double const* pat, double tol){
+        double dist[blockRows] = {0., 0., 0., 0.};
+        for (size_t i = 0; i < dim; i++)
+            for (size_t row = 0; row < blockRows; row++)
+                dist[row] = accumulate<N>(dist[row], std::fabs(rows[row * dim + i] - pat[i]));
+        int mask = 0;
+        for (size_t row = 0; row < blockRows; row++){
+            double rowDist = N == IVector::NORM::SECOND ? std::sqrt(dist[row]) : dist[row];
+            if (rowDist <= tol)
+                mask |= 1 << row;
+        }
+        return mask;
+    }
+#endif
+
+    template<IVector::NORM N>
+    inline size_t findRowIn(size_t dim, double const* rows, size_t count, double const* pat, double tol){
+        size_t row = 0;
+        for (; row + blockRows <= count; row += blockRows){
+            int mask = compareBlock<N>(dim, rows + row * dim, pat, tol);
+            if (mask != 0){
+                size_t first = 0;
+                while ((mask & 1) == 0){
+                    mask >>= 1;
+                    first++;
+                }
+                return row + first;
+            }
+        }
+        for (; row < count; row++)
+            if (rowsAreEqual(dim, rows + row * dim, pat, N, tol))
+                return row;
+        return count;
+    }
+
+    typedef bool (*RowComparer)(size_t dim, double const* op1, double const* op2, double tol);
+    typedef size_t (*RowFinder)(size_t dim, double const* rows, size_t count, double const* pat, double tol);
+
+    // largest dimension with kernels specialized at compile time
+    size_t const maxFixedDim = 8;
+
+    template<IVector::NORM N>
+    inline bool compareRows(size_t dim, double const* op1, double const* op2, double tol){
+        double dist = 0.;
+        for (size_t i = 0; i < dim; i++)
+            dist = accumulate<N>(dist, std::fabs(op1[i] - op2[i]));
+        if (N == IVector::NORM::SECOND)
+            dist = std::sqrt(dist);
+        return dist <= tol;
+    }
+
+    /*
+     * Kernels of rows of Dim coordinates, the dim argument is ignored. Stride and trip counts are constants,
+     * so the compiler unrolls loops over coordinates and keeps the pattern in registers
+     */
+    template<size_t Dim, IVector::NORM N>
+    inline bool compareFixedRows(size_t, double const* op1, double const* op2, double tol){
+        return compareRows<N>(Dim, op1, op2, tol);
+    }
+
+    template<size_t Dim, IVector::NORM N>
+    inline size_t findFixedRow(size_t, double const* rows, size_t count, double const* pat, double tol){
+        return findRowIn<N>(Dim, rows, count, pat, tol);
+    }
+
+    inline bool compareNone(size_t, double const*, double const*, double){
+        return false;
+    }
+
+    inline size_t findNone(size_t, double const*, size_t count, double const*, double){
+        return count;
+    }
+
+    template<IVector::NORM N>
+    inline RowComparer comparerOf(size_t dim){
+        switch (dim){
+            case 1: return compareFixedRows<1, N>;
+            case 2: return compareFixedRows<2, N>;
+            case 3: return compareFixedRows<3, N>;
+            case 4: return compareFixedRows<4, N>;
+            case 5: return compareFixedRows<5, N>;
+            case 6: return compareFixedRows<6, N>;
+            case 7: return compareFixedRows<7, N>;
+            case 8: return compareFixedRows<8, N>;
+            default: return compareRows<N>;
+        }
+    }
+
+    template<IVector::NORM N>
+    inline RowFinder finderOf(size_t dim){
+        switch (dim){
+            case 1: return findFixedRow<1, N>;
+            case 2: return findFixedRow<2, N>;
+            case 3: return findFixedRow<3, N>;
+            case 4: return findFixedRow<4, N>;
+            case 5: return findFixedRow<5, N>;
+            case 6: return findFixedRow<6, N>;
+            case 7: return findFixedRow<7, N>;
+            case 8: return findFixedRow<8, N>;
+            default: return findRowIn<N>;
+        }
+    }
+
+    /*
+     * Comparison of rows of dim coordinates in norm n with the result of rowsAreEqual, chosen once for a loop
+     * over many rows. Dimensions up to maxFixedDim get kernels specialized for them
+     */
+    inline RowComparer rowComparer(size_t dim, IVector::NORM n){
+        switch (n){
+            case IVector::NORM::FIRST:
+                return comparerOf<IVector::NORM::FIRST>(dim);
+            case IVector::NORM::SECOND:
+                return comparerOf<IVector::NORM::SECOND>(dim);
+            case IVector::NORM::CHEBYSHEV:
+                return comparerOf<IVector::NORM::CHEBYSHEV>(dim);
+            default:
+                return compareNone;
+        }
+    }
+
+    inline RowFinder rowFinder(size_t dim, IVector::NORM n){
+        switch (n){
+            case IVector::NORM::FIRST:
+                return finderOf<IVector::NORM::FIRST>(dim);
+            case IVector::NORM::SECOND:
+                return finderOf<IVector::NORM::SECOND>(dim);
+            case IVector::NORM::CHEBYSHEV:
+                return finderOf<IVector::NORM::CHEBYSHEV>(dim);
+            default:
+                return findNone;
+        }
+    }
+
+    /*
+     * Position of the first of count rows stored one after another that is equal to pat, or count if there is none.
+     * Rows are compared by blocks without allocations, results are the same as of rowsAreEqual
+     */
+    inline size_t findRow(size_t dim, double const* rows, size_t count, double const* pat, IVector::NORM n, double tol){
+        return rowFinder(dim, n)(dim, rows, count, pat, tol);
+    }
+
+    /*
+     * Position of a cell along the Z-order (Morton) curve: bits of the cell coordinates interleaved from the highest,
+     * axes * bits must not exceed 64
+     */
+    inline uint64_t mortonKey(size_t axes, uint32_t const* cells, size_t bits){
+        uint64_t key = 0;
+        for (size_t bit = bits; bit-- > 0;)
+            for (size_t axis = 0; axis < axes; axis++)
+                key = key << 1 | ((cells[axis] >> bit) & 1);
+        return key;
+    }
+
+    size_t const cacheLineBytes = 64;
+    // chunk readers prefetch at most this much of the next chunk, the hardware prefetcher follows the rest
+    size_t const prefetchBytes = size_t(16) << 10;
+
+    /*
+     * Asks the processor to bring up to prefetchBytes starting at data into cache before they are read,
+     * does nothing for compilers without a prefetch instruction
+     */
+    inline void prefetch(void const* data, size_t bytes){
+#if defined(SET_KERNEL_PREFETCH)
+        char const* begin = static_cast<char const*>(data);
+        for (size_t offset = 0; offset < bytes && offset < prefetchBytes; offset += cacheLineBytes)
+            SET_KERNEL_PREFETCH(begin + offset);
+#else
+        (void)data;
+        (void)bytes;
+#endif
+    }
+}
@@ -0,0 +1,397 @@
+#include "../include/ISet.h"
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <deque>
+#include <memory>
+#include <vector>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cmath>
+#include <algorithm>
+#include <system_error>
+
+#define SendInfo(Logger, Code) if (Logger != nullptr) Logger->info((Code), __FILE__, __func__, __LINE__)
+
+
+namespace{
+    size_t const chunkBytes = size_t(1) << 22;
+    size_t const chunksPerThread = 2;
+
+    /*
+     * Piece of file cut at a line end (CSV) or at a vector end (BINARY)
+     */
+    struct Chunk {
+        std::vector<char> bytes;
+        std::vector<double> rows;
+        size_t fileBytes;
+        bool skipHeader;
+        RC rc;
+        bool ready;
+
+        Chunk() :
+                fileBytes(0),
+                skipHeader(false),
+                rc(RC::SUCCESS),
+                ready(false){
+        }
+    };
+
+    /*
+     * Chunks in file order, parsing threads take them in any order, single writer merges them in file order
+     */
+    class ChunkQueue {
+    public:
+        explicit ChunkQueue(size_t limit);
+
+        bool isFull();
+        bool isEmpty();
+        void push(std::unique_ptr<Chunk> chunk);
+        /*
+         * Waits until the first chunk is parsed and takes it out of the queue
+         */
+        std::unique_ptr<Chunk> popReady();
+
+        /*
+         * Waits for a chunk to parse, returns nullptr when the queue is stopped
+         */
+        Chunk* take();
+        void done(Chunk* chunk);
+        void stop();
+
+    private:
+        size_t const _limit;
+        std::mutex _lock;
+        std::condition_variable _work;
+        std::condition_variable _ready;
+        std::deque<std::unique_ptr<Chunk>> _order;
+        std::deque<Chunk*> _pending;
+        bool _stopped;
+    };
+}
+
+ChunkQueue::ChunkQueue(size_t limit) :
+        _limit(limit),
+        _stopped(false){
+}
+
+bool ChunkQueue::isFull() {
+    std::lock_guard<std::mutex> guard(_lock);
+    return _order.size() >= _limit;
+}
+
+bool ChunkQueue::isEmpty() {
+    std::lock_guard<std::mutex> guard(_lock);
+    return _order.empty();
+}
+
+void ChunkQueue::push(std::unique_ptr<Chunk> chunk) {
+    {
+        std::lock_guard<std::mutex> guard(_lock);
+        _pending.push_back(chunk.get());
+        _order.push_back(std::move(chunk));
+    }
+    _work.notify_one();
+}
+
+std::unique_ptr<Chunk> ChunkQueue::popReady() {
+    std::unique_lock<std::mutex> guard(_lock);
+    _ready.wait(guard, [this](){ return _order.empty() || _order.front()->ready; });
+    if (_order.empty())
+        return nullptr;
+    std::unique_ptr<Chunk> chunk = std::move(_order.front());
+    _order.pop_front();
+    return chunk;
+}
+
+Chunk* ChunkQueue::take() {
+    std::unique_lock<std::mutex> guard(_lock);
+    _work.wait(guard, [this](){ return _stopped || !_pending.empty(); });
+    if (_stopped)
+        return nullptr;
+    Chunk* chunk = _pending.front();
+    _pending.pop_front();
+    return chunk;
+}
+
+void ChunkQueue::done(Chunk* chunk) {
+    {
+        std::lock_guard<std::mutex> guard(_lock);
+        chunk->ready = true;
+    }
+    _ready.notify_one();
+}
+
+void ChunkQueue::stop() {
+    {
+        std::lock_guard<std::mutex> guard(_lock);
+        _stopped = true;
+    }
+    _work.notify_all();
+}
+
+namespace{
+    /*
+     * Appends coordinates of line [begin, end) to rows, returns their quantity or 0 if line is not a vector
+     */
+    size_t parseLine(char const* begin, char const* end, std::vector<double>& rows) {
+        size_t first = rows.size();
+        char const* pos = begin;
+        while (true){
+            char* next = nullptr;
+            double value = std::strtod(pos, &next);
+            // strtod skips leading line ends, number must not start on the next line
+            if (next == pos || next > end){
+                rows.resize(first);
+                return 0;
+            }
+            rows.push_back(value);
+            pos = next;
+            while (pos < end && (*pos == ' ' || *pos == '\t' || *pos == '\r'))
+                pos++;
+            if (pos == end)
+                break;
+            if (*pos != ','){
+                rows.resize(first);
+                return 0;
+            }
+            pos++;
+        }
+        return rows.size() - first;
+    }
+
+    inline bool isBlank(char const* begin, char const* end) {
+        for (; begin < end; begin++)
+            if (*begin != ' ' && *begin != '\t' && *begin != '\r')
+                return false;
+        return true;
+    }
+
+    void parseCsv(Chunk& chunk, size_t dim) {
+        char const* pos = chunk.bytes.data();
+        char const* end = pos + chunk.bytes.size() - 1;
+        bool header = chunk.skipHeader;
+        while (pos < end && chunk.rc == RC::SUCCESS){
+            char const* lineEnd = static_cast<char const*>(std::memchr(pos, '\n', end - pos));
+            if (lineEnd == nullptr)
+                lineEnd = end;
+            if (!isBlank(pos, lineEnd)){
+                if (header)
+                    header = false;
+                else if (parseLine(pos, lineEnd, chunk.rows) != dim)
+                    chunk.rc = RC::INVALID_ARGUMENT;
+            }
+            pos = lineEnd + 1;
+        }
+        for (size_t i = 0; i < chunk.rows.size() && chunk.rc == RC::SUCCESS; i++){
+            if (std::isnan(chunk.rows[i]))
+                chunk.rc = RC::NOT_NUMBER;
+            else if (std::isinf(chunk.rows[i]))
+                chunk.rc = RC::INFINITY_OVERFLOW;
+        }
+    }
+
+    void parseBinary(Chunk& chunk, size_t dim) {
+        size_t count = chunk.bytes.size() / sizeof(double);
+        chunk.rows.resize(count);
+        std::memcpy(chunk.rows.data(), chunk.bytes.data(), count * sizeof(double));
+        uint16_t probe = 1;
+        unsigned char lowByte;
+        std::memcpy(&lowByte, &probe, 1);
+        if (lowByte == 0){
+            for (double& value : chunk.rows){
+                unsigned char bytes[sizeof(double)];
+                std::memcpy(bytes, &value, sizeof(double));
+                std::reverse(bytes, bytes + sizeof(double));
+                std::memcpy(&value, bytes, sizeof(double));
+            }
+        }
+        if (chunk.bytes.size() % (dim * sizeof(double)) != 0)
+            chunk.rc = RC::INVALID_ARGUMENT;
+        for (size_t i = 0; i < count && chunk.rc == RC::SUCCESS; i++){
+            if (std::isnan(chunk.rows[i]))
+                chunk.rc = RC::NOT_NUMBER;
+            else if (std::isinf(chunk.rows[i]))
+                chunk.rc = RC::INFINITY_OVERFLOW;
+        }
+    }
+
+    void parseChunks(ChunkQueue* queue, ISet::LOAD_FORMAT format, size_t dim) {
+        for (Chunk* chunk = queue->take(); chunk != nullptr; chunk = queue->take()){
+            if (format == ISet::LOAD_FORMAT::CSV)
+                parseCsv(*chunk, dim);
+            else
+                parseBinary(*chunk, dim);
+            std::vector<char>().swap(chunk->bytes);
+            queue->done(chunk);
+        }
+    }
+
+    /*
+     * Reads next chunk of the file, carry keeps the unfinished last line of CSV chunk for the next one
+     */
+    RC readChunk(FILE* file, ISet::LOAD_FORMAT format, size_t rowBytes, std::vector<char>& carry, Chunk& chunk, bool& eof) {
+        chunk.bytes.swap(carry);
+        carry.clear();
+        // the carried line was taken out of the previous chunk's bytes of file
+        chunk.fileBytes = chunk.bytes.size();
+        size_t want = chunkBytes;
+        if (format == ISet::LOAD_FORMAT::BINARY)
+            want = std::max(chunkBytes / rowBytes, size_t(1)) * rowBytes;
+        while (true){
+            size_t had = chunk.bytes.size();
+            try {
+                chunk.bytes.resize(had + want);
+            }
+            catch (std::bad_alloc const&){
+                return RC::ALLOCATION_ERROR;
+            }
+            size_t got = std::fread(chunk.bytes.data() + had, 1, want, file);
+            chunk.bytes.resize(had + got);
+            chunk.fileBytes += got;
+            if (got < want){
+                if (std::ferror(file))
+                    return RC::IO_ERROR;
+                eof = true;
+            }
+            if (format == ISet::LOAD_FORMAT::BINARY)
+                return RC::SUCCESS;
+            if (eof)
+                break;
+            // line longer than a chunk is read on until its end
+            auto lastEnd = std::find(chunk.bytes.rbegin(), chunk.bytes.rend(), '\n');
+            if (lastEnd != chunk.bytes.rend()){
+                carry.assign(lastEnd.base(), chunk.bytes.end());
+                chunk.bytes.erase(lastEnd.base(), chunk.bytes.end());
+                chunk.fileBytes -= carry.size();
+                break;
+            }
+        }
+        // strtod needs terminated text
+        chunk.bytes.push_back('\0');
+        return RC::SUCCESS;
+    }
+
+    /*
+     * Dimension taken from the first vector line of the first CSV chunk, the line before it is a header
+     */
+    RC inspectCsv(Chunk& chunk, size_t& dim) {
+        char const* pos = chunk.bytes.data();
+        char const* end = pos + chunk.bytes.size() - 1;
+        std::vector<double> values;
+        bool firstLine = true;
+        while (pos < end){
+            char const* lineEnd = static_cast<char const*>(std::memchr(pos, '\n', end - pos));
+            if (lineEnd == nullptr)
+                lineEnd = end;
+            if (!isBlank(pos, lineEnd)){
+                size_t fields = parseLine(pos, lineEnd, values);
+                if (fields != 0){
+                    if (dim == 0)
+                        dim = fields;
+                    return RC::SUCCESS;
+                }
+                if (!firstLine)
+                    return RC::INVALID_ARGUMENT;
+                chunk.skipHeader = true;
+                firstLine = false;
+            }
+            pos = lineEnd + 1;
+        }
+        return RC::SUCCESS;
+    }
+}
+
+RC ISet::load(ISet* const& set, char const* const& path, LOAD_FORMAT format, size_t dim, IVector::NORM n, double tol,
+              std::function<void(size_t, size_t)> const& progress, size_t threadCount) {
+    if (set == nullptr || path == nullptr){
+        SendInfo(getLogger(), RC::NULLPTR_ERROR);
+        return RC::NULLPTR_ERROR;
+    }
+    if (dim == 0)
+        dim = set->getDim();
+    if (set->getDim() != 0 && dim != set->getDim()){
+        SendInfo(getLogger(), RC::MISMATCHING_DIMENSIONS);
+        return RC::MISMATCHING_DIMENSIONS;
+    }
+    if (format == LOAD_FORMAT::BINARY && dim == 0){
+        SendInfo(getLogger(), RC::INVALID_ARGUMENT);
+        return RC::INVALID_ARGUMENT;
+    }
+    FILE* file = std::fopen(path, "rb");
+    if (file == nullptr){
+        SendInfo(getLogger(), RC::FILE_NOT_FOUND);
+        return RC::FILE_NOT_FOUND;
+    }
+    size_t fileSize = 0;
+    if (std::fseek(file, 0, SEEK_END) == 0){
+        long end = std::ftell(file);
+        fileSize = end > 0 ? static_cast<size_t>(end) : 0;
+    }
+    std::rewind(file);
+
+    std::vector<char> carry;
+    bool eof = false;
+    std::unique_ptr<Chunk> first(new(std::nothrow) Chunk());
+    if (first == nullptr){
+        std::fclose(file);
+        SendInfo(getLogger(), RC::ALLOCATION_ERROR);
+        return RC::ALLOCATION_ERROR;
+    }
+    RC rc = readChunk(file, format, dim * sizeof(double), carry, *first, eof);
+    if (rc == RC::SUCCESS && format == LOAD_FORMAT::CSV)
+        rc = inspectCsv(*first, dim);
+    if (rc != RC::SUCCESS || dim == 0){
+        std::fclose(file);
+        if (rc != RC::SUCCESS)
+            SendInfo(getLogger(), rc);
+        return rc;
+    }
+
+    if (threadCount == 0)
+        threadCount = std::max(std::thread::hardware_concurrency(), 1u);
+    ChunkQueue queue(chunksPerThread * threadCount);
+    std::vector<std::thread> workers;
+    try {
+        for (size_t i = 0; i < threadCount; i++)
+            workers.emplace_back(parseChunks, &queue, format, dim);
+    }
+    catch (std::system_error const&){
+        if (workers.empty())
+            rc = RC::ALLOCATION_ERROR;
+    }
+    catch (std::bad_alloc const&){
+        if (workers.empty())
+            rc = RC::ALLOCATION_ERROR;
+    }
+
+    size_t processed = 0;
+    if (rc == RC::SUCCESS)
+        queue.push(std::move(first));
+    while (rc == RC::SUCCESS && !(eof && queue.isEmpty())){
+        while (rc == RC::SUCCESS && !eof && !queue.isFull()){
+            std::unique_ptr<Chunk> chunk(new(std::nothrow) Chunk());
+            rc = chunk == nullptr ? RC::ALLOCATION_ERROR : readChunk(file, format, dim * sizeof(double), carry, *chunk, eof);
+            if (rc == RC::SUCCESS)
+                queue.push(std::move(chunk));
+        }
+        std::unique_ptr<Chunk> chunk = rc == RC::SUCCESS ? queue.popReady() : nullptr;
+        if (chunk == nullptr)
+            continue;
+        rc = chunk->rc;
+        size_t inserted = 0;
+        if (rc == RC::SUCCESS && !chunk->rows.empty())
+            rc = set->insertBatch(chunk->rows.data(), chunk->rows.size() / dim, dim, n, tol, inserted);
+        processed += chunk->fileBytes;
+        if (rc == RC::SUCCESS && progress)
+            progress(processed, std::max(fileSize, processed));
+    }
+    queue.stop();
+    for (auto& worker : workers)
+        worker.join();
+    std::fclose(file);
+    if (rc != RC::SUCCESS)
+        SendInfo(getLogger(), rc);
+    return rc;
+}
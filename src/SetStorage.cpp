@@ -0,0 +1,137 @@
+#include "SetStorage.h"
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <new>
+
+#if defined(SET_FILE_MMAP)
+#include <sys/mman.h>
+#include <sys/types.h>
+#include <unistd.h>
+#endif
+
+SetStorage::SetStorage() :
+        data(nullptr),
+        hashCodes(nullptr),
+        capacity(0),
+        frozen(0),
+        image(nullptr),
+        imageSize(0),
+        gridImage(nullptr),
+        gridImageSize(0),
+        _mapped(false),
+        _allocator(nullptr),
+        _dataSize(0),
+        _hashesSize(0){
+}
+
+std::shared_ptr<SetStorage> SetStorage::mapFile(int fd, size_t size, bool writable) {
+#if defined(SET_FILE_MMAP)
+    std::shared_ptr<SetStorage> storage(new(std::nothrow) SetStorage());
+    if (storage == nullptr)
+        return nullptr;
+    if (writable && ftruncate(fd, static_cast<off_t>(size)) != 0)
+        return nullptr;
+    void* image = mmap(nullptr, size, writable ? PROT_READ | PROT_WRITE : PROT_READ, MAP_SHARED, fd, 0);
+    if (image == MAP_FAILED)
+        return nullptr;
+    storage->image = static_cast<unsigned char*>(image);
+    storage->imageSize = size;
+    storage->_mapped = true;
+    return storage;
+#else
+    return nullptr;
+#endif
+}
+
+#if !defined(SET_FILE_MMAP)
+std::shared_ptr<SetStorage> SetStorage::readFile(FILE* file, size_t size) {
+    std::shared_ptr<SetStorage> storage(new(std::nothrow) SetStorage());
+    if (storage == nullptr)
+        return nullptr;
+    // uint64_t keeps image aligned for rows and indices
+    storage->image = reinterpret_cast<unsigned char*>(new(std::nothrow) uint64_t[(size + sizeof(uint64_t) - 1) / sizeof(uint64_t)]);
+    if (storage->image == nullptr)
+        return nullptr;
+    storage->imageSize = size;
+    if (std::fseek(file, 0, SEEK_SET) != 0 || std::fread(storage->image, 1, size, file) != size)
+        return nullptr;
+    return storage;
+}
+#endif
+
+std::shared_ptr<SetStorage> SetStorage::create(size_t capacity, size_t dim, ISetAllocator* allocator) {
+    std::shared_ptr<SetStorage> storage(new(std::nothrow) SetStorage());
+    if (storage == nullptr)
+        return nullptr;
+    storage->_allocator = allocator;
+    storage->data = static_cast<double*>(allocator->allocate(capacity * dim * sizeof(double)));
+    if (storage->data == nullptr)
+        return nullptr;
+    storage->_dataSize = capacity * dim * sizeof(double);
+    storage->hashCodes = static_cast<size_t*>(allocator->allocate(capacity * sizeof(size_t)));
+    if (storage->hashCodes == nullptr)
+        return nullptr;
+    storage->_hashesSize = capacity * sizeof(size_t);
+    storage->capacity = capacity;
+    return storage;
+}
+
+std::shared_ptr<SetStorage> SetStorage::copyOf(SetStorage const& source, size_t used, size_t capacity, size_t dim, ISetAllocator* allocator) {
+    std::shared_ptr<SetStorage> storage = create(capacity, dim, allocator);
+    if (storage == nullptr)
+        return nullptr;
+    std::memcpy(storage->data, source.data, used * dim * sizeof(double));
+    std::memcpy(storage->hashCodes, source.hashCodes, used * sizeof(size_t));
+    return storage;
+}
+
+void SetStorage::freeze(size_t used) {
+    size_t current = frozen.load();
+    while (current < used)
+        if (frozen.compare_exchange_weak(current, used))
+            return;
+}
+
+bool SetStorage::claim(size_t slot) {
+    size_t current = frozen.load();
+    while (current <= slot)
+        if (frozen.compare_exchange_weak(current, slot + 1))
+            return true;
+    return false;
+}
+
+bool SetStorage::resize(size_t newCapacity, size_t dim) {
+    void* newData = _allocator->reallocate(data, _dataSize, newCapacity * dim * sizeof(double));
+    if (newData == nullptr)
+        return false;
+    data = static_cast<double*>(newData);
+    _dataSize = newCapacity * dim * sizeof(double);
+    capacity = std::min(capacity, newCapacity);
+    void* newHashCodes = _allocator->reallocate(hashCodes, _hashesSize, newCapacity * sizeof(size_t));
+    if (newHashCodes == nullptr)
+        return false;
+    hashCodes = static_cast<size_t*>(newHashCodes);
+    _hashesSize = newCapacity * sizeof(size_t);
+    capacity = newCapacity;
+    return true;
+}
+
+SetStorage::~SetStorage() {
+#if defined(SET_FILE_MMAP)
+    if (_mapped){
+        munmap(image, imageSize);
+        return;
+    }
+#endif
+    if (image != nullptr){
+        delete [] reinterpret_cast<uint64_t*>(image);
+        return;
+    }
+    if (_allocator == nullptr)
+        return;
+    if (data != nullptr)
+        _allocator->deallocate(data, _dataSize);
+    if (hashCodes != nullptr)
+        _allocator->deallocate(hashCodes, _hashesSize);
+}
@@ -0,0 +1,75 @@
+#pragma once
+#include "../include/ISetAllocator.h"
+#include <atomic>
+#include <cstddef>
+#include <cstdio>
+#include <memory>
+
+#if defined(__unix__) || defined(__APPLE__)
+// set files are mapped into memory, elsewhere they are read into it
+#define SET_FILE_MMAP
+#endif
+
+/*
+ * Rows and unique indices of a Set, shared between the set, its snapshots and clones.
+ * Rows below frozen may be read by a set sharing the storage, they are never rewritten while storage is shared.
+ * Sets sharing storage claim free slots past frozen before appending into them
+ */
+class SetStorage {
+public:
+    double* data;
+    size_t* hashCodes;
+    size_t capacity;
+    std::atomic<size_t> frozen;
+    // image of set file rows and indices point into, nullptr for storage allocated on heap
+    unsigned char* image;
+    size_t imageSize;
+    // GridIndex saved in the file, valid until the set is changed
+    unsigned char const* gridImage;
+    size_t gridImageSize;
+
+    static std::shared_ptr<SetStorage> create(size_t capacity, size_t dim, ISetAllocator* allocator);
+
+    /*
+     * Storage of capacity rows allocated by allocator with the first used rows and indices of source
+     */
+    static std::shared_ptr<SetStorage> copyOf(SetStorage const& source, size_t used, size_t capacity, size_t dim, ISetAllocator* allocator);
+
+    /*
+     * Resizes heap storage through its allocator. On failure capacity is the least of the sizes the blocks got
+     */
+    bool resize(size_t newCapacity, size_t dim);
+
+    /*
+     * Raises frozen to used, the first used rows are going to be read by one more set
+     */
+    void freeze(size_t used);
+
+    /*
+     * Claims slot for append by one of the sets sharing the storage, false if another of them may read the slot
+     */
+    bool claim(size_t slot);
+
+    /*
+     * Maps size bytes of file fd, data and hashCodes are left to the caller
+     */
+    static std::shared_ptr<SetStorage> mapFile(int fd, size_t size, bool writable);
+
+#if !defined(SET_FILE_MMAP)
+    /*
+     * Reads size bytes of file into heap image, used where files can not be mapped
+     */
+    static std::shared_ptr<SetStorage> readFile(FILE* file, size_t size);
+#endif
+
+    ~SetStorage();
+
+private:
+    bool _mapped;
+    // allocator of data and hashCodes, nullptr for storage in an image
+    ISetAllocator* _allocator;
+    size_t _dataSize;
+    size_t _hashesSize;
+
+    SetStorage();
+};
@@ -0,0 +1,143 @@
+#include "SetSummary.h"
+#include <algorithm>
+#include <new>
+
+SetSummary::SetSummary() :
+        _dim(0),
+        _count(0),
+        _boundsStale(false){
+}
+
+bool SetSummary::reset(size_t dim) {
+    try {
+        _lower.assign(dim, 0.);
+        _upper.assign(dim, 0.);
+        _mean.assign(dim, 0.);
+        _m2.assign(dim, 0.);
+    }
+    catch (std::bad_alloc const&){
+        _dim = 0;
+        _count = 0;
+        return false;
+    }
+    _dim = dim;
+    _count = 0;
+    _boundsStale = false;
+    return true;
+}
+
+void SetSummary::add(double const* row) {
+    if (_count == 0){
+        _lower.assign(row, row + _dim);
+        _upper.assign(row, row + _dim);
+        _boundsStale = false;
+    }
+    _count++;
+    double count = static_cast<double>(_count);
+    for (size_t i = 0; i < _dim; i++){
+        double delta = row[i] - _mean[i];
+        _mean[i] += delta / count;
+        _m2[i] += delta * (row[i] - _mean[i]);
+        if (row[i] < _lower[i])
+            _lower[i] = row[i];
+        if (row[i] > _upper[i])
+            _upper[i] = row[i];
+    }
+}
+
+void SetSummary::remove(double const* row) {
+    if (_count <= 1){
+        reset(_dim);
+        return;
+    }
+    _count--;
+    double count = static_cast<double>(_count);
+    for (size_t i = 0; i < _dim; i++){
+        double delta = row[i] - _mean[i];
+        _mean[i] -= delta / count;
+        _m2[i] -= delta * (row[i] - _mean[i]);
+        // rounding must not make variance negative
+        if (_m2[i] < 0.)
+            _m2[i] = 0.;
+        if (!(_lower[i] < row[i] && row[i] < _upper[i]))
+            _boundsStale = true;
+    }
+}
+
+void SetSummary::merge(SetSummary const& other) {
+    if (other._count == 0)
+        return;
+    if (_count == 0){
+        std::copy(other._lower.begin(), other._lower.end(), _lower.begin());
+        std::copy(other._upper.begin(), other._upper.end(), _upper.begin());
+        std::copy(other._mean.begin(), other._mean.end(), _mean.begin());
+        std::copy(other._m2.begin(), other._m2.end(), _m2.begin());
+        _count = other._count;
+        _boundsStale = other._boundsStale;
+        return;
+    }
+    double count = static_cast<double>(_count);
+    double otherCount = static_cast<double>(other._count);
+    double total = count + otherCount;
+    for (size_t i = 0; i < _dim; i++){
+        double delta = other._mean[i] - _mean[i];
+        _mean[i] += delta * otherCount / total;
+        _m2[i] += other._m2[i] + delta * delta * count * otherCount / total;
+        if (other._lower[i] < _lower[i])
+            _lower[i] = other._lower[i];
+        if (other._upper[i] > _upper[i])
+            _upper[i] = other._upper[i];
+    }
+    _count += other._count;
+    _boundsStale = _boundsStale || other._boundsStale;
+}
+
+void SetSummary::clearBounds() {
+    _lower.assign(_dim, 0.);
+    _upper.assign(_dim, 0.);
+    _boundsStale = true;
+}
+
+void SetSummary::extendBounds(double const* row) {
+    if (_boundsStale){
+        _lower.assign(row, row + _dim);
+        _upper.assign(row, row + _dim);
+        _boundsStale = false;
+        return;
+    }
+    for (size_t i = 0; i < _dim; i++){
+        if (row[i] < _lower[i])
+            _lower[i] = row[i];
+        if (row[i] > _upper[i])
+            _upper[i] = row[i];
+    }
+}
+
+size_t SetSummary::getDim() const {
+    return _dim;
+}
+
+size_t SetSummary::getCount() const {
+    return _count;
+}
+
+bool SetSummary::boundsAreStale() const {
+    return _boundsStale;
+}
+
+double const* SetSummary::getLower() const {
+    return _lower.data();
+}
+
+double const* SetSummary::getUpper() const {
+    return _upper.data();
+}
+
+double const* SetSummary::getMean() const {
+    return _mean.data();
+}
+
+void SetSummary::getVariance(double* dst) const {
+    for (size_t i = 0; i < _dim; i++)
+        dst[i] = _count == 0 ? 0. : _m2[i] / static_cast<double>(_count);
+}
@@ -0,0 +1,54 @@
+#pragma once
+#include <cstddef>
+#include <vector>
+
+/*
+ * Bounding box, mean and sum of squared deviations from it (Welford) of vectors of a set, updated by every
+ * insertion and removal. Removal of a vector lying on the border of the box can not shrink the box in O(1),
+ * the box is marked stale instead and the owner recomputes it with clearBounds and extendBounds
+ */
+class SetSummary {
+public:
+    SetSummary();
+
+    /*
+     * Empty summary of vectors of dimension dim, returns false if memory can not be allocated
+     */
+    bool reset(size_t dim);
+
+    /*
+     * Summary must be reset for dimension of row
+     */
+    void add(double const* row);
+    void remove(double const* row);
+
+    /*
+     * Adds vectors summarized by other (Chan et al. update), both must be of the same dimension and have fresh bounds
+     */
+    void merge(SetSummary const& other);
+
+    void clearBounds();
+    void extendBounds(double const* row);
+
+    size_t getDim() const;
+    size_t getCount() const;
+    bool boundsAreStale() const;
+
+    double const* getLower() const;
+    double const* getUpper() const;
+    double const* getMean() const;
+
+    /*
+     * Writes population variance along every axis into dst of getDim() coordinates
+     */
+    void getVariance(double* dst) const;
+
+private:
+    size_t _dim;
+    size_t _count;
+    bool _boundsStale;
+    std::vector<double> _lower;
+    std::vector<double> _upper;
+    std::vector<double> _mean;
+    std::vector<double> _m2;
+};
@@ -0,0 +1,1626 @@
+#include "ShardedSet.h"
+#include "../include/ISetCapacity.h"
+#include "../include/ISetLsh.h"
+#include "../include/ICompact.h"
+#include "../include/ISetAllocator.h"
+#include "CellRouter.h"
+#include "ChunkIterator.h"
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <system_error>
+#include <thread>
+#include <vector>
+
+#define SendInfo(Logger, Code) if (Logger != nullptr) Logger->info((Code), __FILE__, __func__, __LINE__)
+
+
+namespace{
+    // set on shard threads, jobs started from them are done by the calling thread
+    thread_local bool onShardThread = false;
+
+    /*
+     * Threads and allocators of shards, every shard has its own thread and its own allocator of memory pages,
+     * so pages of a shard are first touched by its thread. Shared by sets derived from one sharded set.
+     * Shards live in this process and are called directly, there is no transport to move them out of it
+     */
+    class ShardGroup {
+    public:
+        static std::shared_ptr<ShardGroup> create(size_t shardCount);
+
+        ISetAllocator* getAllocator(size_t shard) const;
+
+        /*
+         * Calls task(shard) on the thread of every shard of ids and returns when all calls are finished
+         */
+        void run(std::vector<size_t> const& ids, std::function<void(size_t)> const& task);
+
+        ~ShardGroup();
+
+    private:
+        struct Worker {
+            std::thread thread;
+            std::mutex lock;
+            std::condition_variable wake;
+            std::vector<std::function<void()>> tasks;
+            bool stopped;
+            std::unique_ptr<ISetAllocator> pageAllocator;
+            ISetAllocator* allocator;
+        };
+
+        struct Pending {
+            std::mutex lock;
+            std::condition_variable done;
+            size_t left;
+        };
+
+        std::unique_ptr<Worker[]> _workers;
+        size_t _count;
+
+        explicit ShardGroup(size_t count);
+
+        static void loop(Worker* worker);
+        static void finish(Pending& pending);
+
+        ShardGroup(ShardGroup const&) = delete;
+        ShardGroup& operator=(ShardGroup const&) = delete;
+    };
+
+    /*
+     * Shards of a sharded set, shared with its iterators. Sets are deleted by the sharded set,
+     * the group is kept alive while storage of the shards may be used
+     */
+    struct ShardList {
+        std::shared_ptr<ShardGroup> group;
+        CellRouter router;
+        std::vector<ISet*> sets;
+        std::atomic<bool> isValid;
+
+        ShardList(std::shared_ptr<ShardGroup> group, CellRouter const& router);
+    };
+
+    /*
+     * Iterator over shards one after another, inside of a shard it is the iterator of the shard
+     */
+    class ShardedIterator : public ISet::IIterator {
+    private:
+        std::shared_ptr<ShardList> _list;
+        size_t _shard;
+        std::unique_ptr<ISet::IIterator> _inner;
+
+        ShardedIterator(std::shared_ptr<ShardList> list, size_t shard, ISet::IIterator* inner);
+
+        /*
+         * Moves one vector forward or backward, crossing into the next non-empty shard
+         */
+        RC step(bool forward);
+        inline RC invalidate(RC rc);
+
+    public:
+        /*
+         * Takes ownership of inner, nullptr if inner is nullptr
+         */
+        static ShardedIterator* create(std::shared_ptr<ShardList> list, size_t shard, ISet::IIterator* inner);
+
+        IIterator * getNext(size_t indexInc = 1) const override;
+        IIterator * getPrevious(size_t indexInc = 1) const override;
+        IIterator * clone() const override;
+
+        RC next(size_t indexInc = 1) override;
+        RC previous(size_t indexInc = 1) override;
+
+        bool isValid() const override;
+
+        RC makeBegin() override;
+        RC makeEnd() override;
+
+        RC getVectorCopy(IVector *& val) const override;
+        RC getVectorCoords(IVector * const& val) const override;
+
+        ~ShardedIterator() override;
+    };
+
+    /*
+     * ISet partitioned by CellRouter: every shard is a set of its own with its own allocator and thread.
+     * Vectors are ordered shard by shard, inside of a shard by the order of the shard, unique index of a vector
+     * is its unique index in the shard times the number of shards plus the shard.
+     * Calls on single vectors run on the calling thread and visit only shards near the vector, batches and scans
+     * of the whole set run on all shard threads at once. Like Set, it must be changed from one thread at a time
+     */
+    class ShardedSet : public ISet, public ISetCapacity, public ISetLsh {
+    private:
+        std::shared_ptr<ShardList> _list;
+        size_t _dim;
+
+        explicit ShardedSet(std::shared_ptr<ShardList> list);
+
+        inline ISet* shard(size_t id) const;
+        inline size_t shardCount() const;
+
+        /*
+         * Shard keeping the vector of index and index of the vector inside of the shard
+         */
+        bool locate(size_t index, size_t& id, size_t& local) const;
+        RC checkPattern(IVector const* const& pat) const;
+        /*
+         * Calls lookup for shards near row in ascending order until it returns anything but VECTOR_NOT_FOUND
+         */
+        RC findIn(double const* row, double tol, std::function<RC(ISet*)> const& lookup) const;
+        RC insertRow(IVector const* const& val, IVector::NORM n, double tol);
+        /*
+         * Calls op on the thread of every shard, returns the first error
+         */
+        RC forAll(std::function<RC(ISet*)> const& op) const;
+        /*
+         * Rows of every shard are passed to its thread, rows that are near other shards are returned in border
+         */
+        RC route(double const* rows, size_t count, double tol, std::vector<std::vector<double>>& interior,
+                 std::vector<size_t>& border) const;
+
+    public:
+        /*
+         * Sharded set of group, its shards are made by makeShard
+         */
+        static ShardedSet* assemble(std::shared_ptr<ShardGroup> group, CellRouter const& router, size_t dim,
+                                    std::function<ISet*(size_t)> const& makeShard);
+        static ShardedSet* create(size_t shardCount, double cellSize);
+
+        /*
+         * Empty set of the same shards and threads
+         */
+        ShardedSet* createEmpty() const;
+
+        /*
+         * Removes a vector within tol of every row, as remove does for every row in turn.
+         * Rows near a single shard are removed by its thread, rows near shard borders after them
+         */
+        RC removeRows(double const* rows, size_t count, IVector::NORM n, double tol);
+
+        ISet* clone() const override;
+
+        ISet const* snapshot() const override;
+
+        size_t getDim() const override;
+        size_t getSize() const override;
+
+        RC getCopy(size_t index, IVector *& val) const override;
+        RC findFirstAndCopy(IVector const * const& pat, IVector::NORM n, double tol, IVector *& val) const override;
+
+        RC getCoords(size_t index, IVector * const& val) const override;
+        RC findFirstAndCopyCoords(IVector const * const& pat, IVector::NORM n, double tol, IVector * const& val) const override;
+        RC findFirst(IVector const * const& pat, IVector::NORM n, double tol) const override;
+
+        /*
+         * Patterns are handed to the threads of the shards near them, every shard looks up its patterns by one batch
+         */
+        RC findFirstMany(double const* patterns, size_t count, size_t dim, IVector::NORM n, double tol, size_t * const& indices) const override;
+
+        RC insert(IVector const * const& val, IVector::NORM n, double tol) override;
+
+        /*
+         * Rows near a single shard are inserted by its thread, rows near shard borders are inserted after them,
+         * so of rows within tol of each other the kept one may differ from the one kept by Set
+         */
+        RC insertBatch(double const* rows, size_t count, size_t dim, IVector::NORM n, double tol, size_t& inserted) override;
+
+        RC remove(size_t index) override;
+        RC remove(IVector const * const& pat, IVector::NORM n, double tol) override;
+
+        /*
+         * Shards are filtered by their threads at once, so pred is called from several threads
+         */
+        RC removeIf(std::function<bool(double const*, size_t)> const& pred) override;
+
+        using ISet::queryBox;
+
+        RC queryBox(ICompact const* const& box, std::function<void(double const*, size_t)> const& callback) const override;
+
+        RC setGarbageRatio(double ratio) override;
+        RC compact() override;
+
+        /*
+         * Every shard reserves an equal share of capacity
+         */
+        RC reserve(size_t capacity) override;
+        RC shrinkToFit() override;
+        RC setGrowthFactor(double factor) override;
+
+        /*
+         * Summaries of shards are merged
+         */
+        RC getBounds(IVector*& lower, IVector*& upper) const override;
+        RC getCentroid(IVector*& centroid) const override;
+        RC getVariance(IVector*& variance) const override;
+
+        /*
+         * Every shard keeps its own index, stats are summed over shards
+         */
+        RC enableLsh(IVector::NORM n, size_t tables, size_t hashesPerTable, double bucketWidth, size_t checkEvery) override;
+        RC disableLsh() override;
+        RC getLshStats(LshStats& stats) const override;
+
+        /*
+         * Sum of versions of shards
+         */
+        uint64_t getVersion() const override;
+
+        RC sync() override;
+
+        IIterator *getIterator(size_t index) const override;
+        IIterator *getBegin() const override;
+        IIterator *getEnd() const override;
+
+        /*
+         * Chunks of shard iterators one after another, they are taken at the call, so like the iterator
+         * of Set it reads a snapshot
+         */
+        IChunkIterator *getChunkIterator(size_t chunkRows) const override;
+
+        /*
+         * Every shard splits its chunks on its own thread
+         */
+        RC forEachChunk(size_t chunkRows, std::function<void(double const*, size_t const*, size_t, size_t)> const& callback) const override;
+
+        ~ShardedSet() override;
+    };
+
+    /*
+     * Rows of set one after another, read by its chunk iterator
+     */
+    RC readRows(ISet const* set, std::vector<double>& rows){
+        rows.clear();
+        size_t size = set->getSize();
+        if (size == 0)
+            return RC::SUCCESS;
+        std::unique_ptr<ISet::IChunkIterator> it(set->getChunkIterator(size));
+        if (it == nullptr)
+            return RC::NULLPTR_ERROR;
+        try {
+            rows.reserve(size * set->getDim());
+            while (it->isValid()){
+                rows.insert(rows.end(), it->getRows(), it->getRows() + it->getCount() * it->getDim());
+                RC rc = it->next();
+                if (rc != RC::SUCCESS && rc != RC::INDEX_OUT_OF_BOUND)
+                    return rc;
+            }
+        }
+        catch (std::bad_alloc const&){
+            return RC::ALLOCATION_ERROR;
+        }
+        return RC::SUCCESS;
+    }
+
+    /*
+     * Marks rows of set found in other by found, which is resized to the number of rows
+     */
+    RC lookupRows(ISet const* other, std::vector<double> const& rows, size_t dim, IVector::NORM n, double tol,
+                  std::vector<bool>& found){
+        size_t count = rows.size() / dim;
+        std::unique_ptr<size_t[]> indices(new(std::nothrow) size_t[count]);
+        if (indices == nullptr)
+            return RC::ALLOCATION_ERROR;
+        RC rc = other->findFirstMany(rows.data(), count, dim, n, tol, indices.get());
+        if (rc != RC::SUCCESS)
+            return rc;
+        try {
+            found.assign(count, false);
+        }
+        catch (std::bad_alloc const&){
+            return RC::ALLOCATION_ERROR;
+        }
+        size_t size = other->getSize();
+        for (size_t k = 0; k < count; k++)
+            found[k] = indices[k] < size;
+        return RC::SUCCESS;
+    }
+
+    /*
+     * Appends rows marked by keep == mark to dst
+     */
+    RC selectRows(std::vector<double> const& rows, size_t dim, std::vector<bool> const& found, bool keep,
+                  std::vector<double>& dst){
+        try {
+            for (size_t k = 0; k < found.size(); k++)
+                if (found[k] == keep)
+                    dst.insert(dst.end(), rows.begin() + k * dim, rows.begin() + (k + 1) * dim);
+        }
+        catch (std::bad_alloc const&){
+            return RC::ALLOCATION_ERROR;
+        }
+        return RC::SUCCESS;
+    }
+}
+
+
+std::shared_ptr<ShardGroup> ShardGroup::create(size_t shardCount) {
+    std::shared_ptr<ShardGroup> group(new(std::nothrow) ShardGroup(shardCount));
+    if (group == nullptr || group->_workers == nullptr)
+        return nullptr;
+    for (size_t i = 0; i < shardCount; i++){
+        Worker& worker = group->_workers[i];
+        worker.pageAllocator.reset(ISetAllocator::createPageAllocator(false));
+        worker.allocator = worker.pageAllocator != nullptr ? worker.pageAllocator.get() : ISetAllocator::getHeapAllocator();
+        try {
+            worker.thread = std::thread(&ShardGroup::loop, &worker);
+        }
+        catch (std::system_error const&){
+            return nullptr;
+        }
+    }
+    return group;
+}
+
+ShardGroup::ShardGroup(size_t count) :
+        _workers(new(std::nothrow) Worker[count]),
+        _count(count){
+    if (_workers == nullptr)
+        return;
+    for (size_t i = 0; i < count; i++){
+        _workers[i].stopped = false;
+        _workers[i].allocator = nullptr;
+    }
+}
+
+ShardGroup::~ShardGroup() {
+    if (_workers == nullptr)
+        return;
+    for (size_t i = 0; i < _count; i++){
+        Worker& worker = _workers[i];
+        if (!worker.thread.joinable())
+            continue;
+        {
+            std::lock_guard<std::mutex> guard(worker.lock);
+            worker.stopped = true;
+        }
+        worker.wake.notify_one();
+        worker.thread.join();
+    }
+}
+
+ISetAllocator* ShardGroup::getAllocator(size_t shard) const {
+    return _workers[shard].allocator;
+}
+
+void ShardGroup::loop(Worker* worker) {
+    onShardThread = true;
+    std::vector<std::function<void()>> tasks;
+    std::unique_lock<std::mutex> guard(worker->lock);
+    while (true){
+        worker->wake.wait(guard, [worker](){ return worker->stopped || !worker->tasks.empty(); });
+        if (worker->tasks.empty())
+            return;
+        tasks.swap(worker->tasks);
+        guard.unlock();
+        for (auto& task : tasks)
+            task();
+        tasks.clear();
+        guard.lock();
+    }
+}
+
+void ShardGroup::finish(Pending& pending) {
+    std::lock_guard<std::mutex> guard(pending.lock);
+    if (--pending.left == 0)
+        pending.done.notify_all();
+}
+
+void ShardGroup::run(std::vector<size_t> const& ids, std::function<void(size_t)> const& task) {
+    // waiting for shard threads from one of them could wait for itself
+    if (onShardThread){
+        for (size_t id : ids)
+            task(id);
+        return;
+    }
+    Pending pending;
+    pending.left = ids.size();
+    for (size_t id : ids){
+        Worker& worker = _workers[id];
+        bool queued = false;
+        try {
+            std::lock_guard<std::mutex> guard(worker.lock);
+            worker.tasks.emplace_back([&task, &pending, id](){
+                task(id);
+                finish(pending);
+            });
+            queued = true;
+        }
+        catch (std::bad_alloc const&){
+        }
+        if (queued){
+            worker.wake.notify_one();
+            continue;
+        }
+        task(id);
+        finish(pending);
+    }
+    std::unique_lock<std::mutex> guard(pending.lock);
+    pending.done.wait(guard, [&pending](){ return pending.left == 0; });
+}
+
+
+ShardList::ShardList(std::shared_ptr<ShardGroup> group, CellRouter const& router) :
+        group(std::move(group)),
+        router(router),
+        isValid(true){
+}
+
+
+ShardedIterator::ShardedIterator(std::shared_ptr<ShardList> list, size_t shard, ISet::IIterator* inner) :
+        _list(std::move(list)),
+        _shard(shard),
+        _inner(inner){
+}
+
+ShardedIterator* ShardedIterator::create(std::shared_ptr<ShardList> list, size_t shard, ISet::IIterator* inner) {
+    if (inner == nullptr)
+        return nullptr;
+    auto it = new(std::nothrow) ShardedIterator(std::move(list), shard, inner);
+    if (it == nullptr){
+        delete inner;
+        SendInfo(ISet::getLogger(), RC::ALLOCATION_ERROR);
+    }
+    return it;
+}
+
+RC ShardedIterator::invalidate(RC rc) {
+    _inner.reset();
+    if (rc != RC::INDEX_OUT_OF_BOUND && rc != RC::SOURCE_SET_DESTROYED && rc != RC::SOURCE_SET_EMPTY)
+        SendInfo(ISet::getLogger(), rc);
+    return rc;
+}
+
+RC ShardedIterator::step(bool forward) {
+    RC rc = forward ? _inner->next() : _inner->previous();
+    if (rc == RC::SUCCESS)
+        return RC::SUCCESS;
+    if (rc != RC::INDEX_OUT_OF_BOUND)
+        return invalidate(rc);
+    if (!_list->isValid.load())
+        return invalidate(RC::SOURCE_SET_DESTROYED);
+    size_t count = _list->sets.size();
+    for (size_t id = forward ? _shard + 1 : _shard; forward ? id < count : id-- > 0; forward ? id++ : 0){
+        ISet* set = _list->sets[id];
+        if (set->getSize() == 0)
+            continue;
+        ISet::IIterator* inner = forward ? set->getBegin() : set->getEnd();
+        if (inner == nullptr)
+            return invalidate(RC::ALLOCATION_ERROR);
+        _inner.reset(inner);
+        _shard = id;
+        return RC::SUCCESS;
+    }
+    return invalidate(RC::INDEX_OUT_OF_BOUND);
+}
+
+ISet::IIterator *ShardedIterator::getNext(size_t indexInc) const {
+    auto it = clone();
+    if (it == nullptr){
+        SendInfo(ISet::getLogger(), RC::NULLPTR_ERROR);
+        return nullptr;
+    }
+    RC nextRC = it->next(indexInc);
+    if (nextRC != RC::SUCCESS){
+        SendInfo(ISet::getLogger(), nextRC);
+        delete it;
+        return nullptr;
+    }
+    return it;
+}
+
+ISet::IIterator *ShardedIterator::getPrevious(size_t indexInc) const {
+    auto it = clone();
+    if (it == nullptr){
+        SendInfo(ISet::getLogger(), RC::NULLPTR_ERROR);
+        return nullptr;
+    }
+    RC previousRC = it->previous(indexInc);
+    if (previousRC != RC::SUCCESS){
+        SendInfo(ISet::getLogger(), previousRC);
+        delete it;
+        return nullptr;
+    }
+    return it;
+}
+
+ISet::IIterator *ShardedIterator::clone() const {
+    if (_inner == nullptr)
+        return nullptr;
+    return create(_list, _shard, _inner->clone());
+}
+
+RC ShardedIterator::next(size_t indexInc) {
+    if (_inner == nullptr){
+        SendInfo(ISet::getLogger(), RC::INDEX_OUT_OF_BOUND);
+        return RC::INDEX_OUT_OF_BOUND;
+    }
+    for (; indexInc > 0; indexInc--){
+        RC rc = step(true);
+        if (rc != RC::SUCCESS)
+            return rc;
+    }
+    return RC::SUCCESS;
+}
+
+RC ShardedIterator::previous(size_t indexInc) {
+    if (_inner == nullptr){
+        SendInfo(ISet::getLogger(), RC::INDEX_OUT_OF_BOUND);
+        return RC::INDEX_OUT_OF_BOUND;
+    }
+    for (; indexInc > 0; indexInc--){
+        RC rc = step(false);
+        if (rc != RC::SUCCESS)
+            return rc;
+    }
+    return RC::SUCCESS;
+}
+
+bool ShardedIterator::isValid() const {
+    return _inner != nullptr && _inner->isValid();
+}
+
+RC ShardedIterator::makeBegin() {
+    if (_inner == nullptr){
+        SendInfo(ISet::getLogger(), RC::INDEX_OUT_OF_BOUND);
+        return RC::INDEX_OUT_OF_BOUND;
+    }
+    if (!_list->isValid.load())
+        return invalidate(RC::SOURCE_SET_DESTROYED);
+    for (size_t id = 0; id < _list->sets.size(); id++){
+        if (_list->sets[id]->getSize() == 0)
+            continue;
+        ISet::IIterator* inner = _list->sets[id]->getBegin();
+        if (inner == nullptr)
+            return invalidate(RC::ALLOCATION_ERROR);
+        _inner.reset(inner);
+        _shard = id;
+        return RC::SUCCESS;
+    }
+    return invalidate(RC::SOURCE_SET_EMPTY);
+}
+
+RC ShardedIterator::makeEnd() {
+    if (_inner == nullptr){
+        SendInfo(ISet::getLogger(), RC::INDEX_OUT_OF_BOUND);
+        return RC::INDEX_OUT_OF_BOUND;
+    }
+    if (!_list->isValid.load())
+        return invalidate(RC::SOURCE_SET_DESTROYED);
+    for (size_t id = _list->sets.size(); id-- > 0;){
+        if (_list->sets[id]->getSize() == 0)
+            continue;
+        ISet::IIterator* inner = _list->sets[id]->getEnd();
+        if (inner == nullptr)
+            return invalidate(RC::ALLOCATION_ERROR);
+        _inner.reset(inner);
+        _shard = id;
+        return RC::SUCCESS;
+    }
+    return invalidate(RC::SOURCE_SET_EMPTY);
+}
+
+RC ShardedIterator::getVectorCopy(IVector *&val) const {
+    if (_inner == nullptr){
+        SendInfo(ISet::getLogger(), RC::INDEX_OUT_OF_BOUND);
+        return RC::INDEX_OUT_OF_BOUND;
+    }
+    return _inner->getVectorCopy(val);
+}
+
+RC ShardedIterator::getVectorCoords(IVector *const &val) const {
+    if (_inner == nullptr){
+        SendInfo(ISet::getLogger(), RC::INDEX_OUT_OF_BOUND);
+        return RC::INDEX_OUT_OF_BOUND;
+    }
+    return _inner->getVectorCoords(val);
+}
+
+ShardedIterator::~ShardedIterator() = default;
+
+
+ShardedSet::ShardedSet(std::shared_ptr<ShardList> list) :
+        _list(std::move(list)),
+        _dim(0){
+}
+
+ShardedSet* ShardedSet::assemble(std::shared_ptr<ShardGroup> group, CellRouter const& router, size_t dim,
+                                 std::function<ISet*(size_t)> const& makeShard) {
+    std::shared_ptr<ShardList> list(new(std::nothrow) ShardList(std::move(group), router));
+    if (list == nullptr)
+        return nullptr;
+    try {
+        list->sets.assign(router.getShardCount(), nullptr);
+    }
+    catch (std::bad_alloc const&){
+        return nullptr;
+    }
+    auto res = new(std::nothrow) ShardedSet(list);
+    if (res == nullptr)
+        return nullptr;
+    res->_dim = dim;
+    for (size_t id = 0; id < list->sets.size(); id++){
+        list->sets[id] = makeShard(id);
+        if (list->sets[id] == nullptr){
+            delete res;
+            return nullptr;
+        }
+    }
+    return res;
+}
+
+ShardedSet* ShardedSet::create(size_t shardCount, double cellSize) {
+    std::shared_ptr<ShardGroup> group = ShardGroup::create(shardCount);
+    if (group == nullptr)
+        return nullptr;
+    ShardGroup* threads = group.get();
+    return assemble(group, CellRouter(shardCount, cellSize), 0, [threads](size_t id){
+        return ISet::createSet(threads->getAllocator(id));
+    });
+}
+
+ShardedSet* ShardedSet::createEmpty() const {
+    ShardGroup* threads = _list->group.get();
+    return assemble(_list->group, _list->router, _dim, [threads](size_t id){
+        return ISet::createSet(threads->getAllocator(id));
+    });
+}
+
+ISet* ShardedSet::shard(size_t id) const {
+    return _list->sets[id];
+}
+
+size_t ShardedSet::shardCount() const {
+    return _list->sets.size();
+}
+
+bool ShardedSet::locate(size_t index, size_t& id, size_t& local) const {
+    for (id = 0; id < shardCount(); id++){
+        size_t size = shard(id)->getSize();
+        if (index < size){
+            local = index;
+            return true;
+        }
+        index -= size;
+    }
+    return false;
+}
+
+RC ShardedSet::checkPattern(IVector const* const& pat) const {
+    if (pat == nullptr){
+        SendInfo(ISet::getLogger(), RC::NULLPTR_ERROR);
+        return RC::NULLPTR_ERROR;
+    }
+    if (pat->getDim() != _dim){
+        SendInfo(ISet::getLogger(), RC::MISMATCHING_DIMENSIONS);
+        return RC::MISMATCHING_DIMENSIONS;
+    }
+    return RC::SUCCESS;
+}
+
+RC ShardedSet::findIn(double const* row, double tol, std::function<RC(ISet*)> const& lookup) const {
+    std::vector<size_t> ids;
+    try {
+        _list->router.candidateShards(row, _dim, tol, ids);
+    }
+    catch (std::bad_alloc const&){
+        SendInfo(ISet::getLogger(), RC::ALLOCATION_ERROR);
+        return RC::ALLOCATION_ERROR;
+    }
+    // indices go shard by shard, so the first match is in the first shard having one
+    for (size_t id : ids){
+        if (shard(id)->getSize() == 0)
+            continue;
+        RC rc = lookup(shard(id));
+        if (rc != RC::VECTOR_NOT_FOUND)
+            return rc;
+    }
+    return RC::VECTOR_NOT_FOUND;
+}
+
+RC ShardedSet::forAll(std::function<RC(ISet*)> const& op) const {
+    std::vector<size_t> ids;
+    std::vector<RC> rcs;
+    try {
+        _list->router.allShards(ids);
+        rcs.assign(ids.size(), RC::SUCCESS);
+    }
+    catch (std::bad_alloc const&){
+        SendInfo(ISet::getLogger(), RC::ALLOCATION_ERROR);
+        return RC::ALLOCATION_ERROR;
+    }
+    _list->group->run(ids, [this, &op, &rcs](size_t id){
+        rcs[id] = op(shard(id));
+    });
+    for (RC rc : rcs)
+        if (rc != RC::SUCCESS)
+            return rc;
+    return RC::SUCCESS;
+}
+
+RC ShardedSet::route(double const* rows, size_t count, double tol, std::vector<std::vector<double>>& interior,
+                     std::vector<size_t>& border) const {
+    try {
+        interior.assign(shardCount(), std::vector<double>());
+        border.clear();
+        std::vector<size_t> ids;
+        for (size_t k = 0; k < count; k++){
+            double const* row = rows + k * _dim;
+            _list->router.candidateShards(row, _dim, tol, ids);
+            // the only shard near a row is the one of its cell
+            if (ids.size() == 1)
+                interior[ids[0]].insert(interior[ids[0]].end(), row, row + _dim);
+            else
+                border.push_back(k);
+        }
+    }
+    catch (std::bad_alloc const&){
+        return RC::ALLOCATION_ERROR;
+    }
+    return RC::SUCCESS;
+}
+
+ISet* ShardedSet::clone() const {
+    auto res = assemble(_list->group, _list->router, _dim, [this](size_t id){
+        return shard(id)->clone();
+    });
+    if (res == nullptr)
+        SendInfo(ISet::getLogger(), RC::ALLOCATION_ERROR);
+    return res;
+}
+
+ISet const* ShardedSet::snapshot() const {
+    auto res = assemble(_list->group, _list->router, _dim, [this](size_t id){
+        // snapshot is handed out as const, its shards are never changed
+        return const_cast<ISet*>(shard(id)->snapshot());
+    });
+    if (res == nullptr)
+        SendInfo(ISet::getLogger(), RC::ALLOCATION_ERROR);
+    return res;
+}
+
+size_t ShardedSet::getDim() const {
+    return _dim;
+}
+
+size_t ShardedSet::getSize() const {
+    size_t size = 0;
+    for (size_t id = 0; id < shardCount(); id++)
+        size += shard(id)->getSize();
+    return size;
+}
+
+RC ShardedSet::getCopy(size_t index, IVector *&val) const {
+    size_t id = 0, local = 0;
+    if (!locate(index, id, local)){
+        SendInfo(ISet::getLogger(), RC::INDEX_OUT_OF_BOUND);
+        return RC::INDEX_OUT_OF_BOUND;
+    }
+    return shard(id)->getCopy(local, val);
+}
+
+RC ShardedSet::getCoords(size_t index, IVector *const &val) const {
+    size_t id = 0, local = 0;
+    if (!locate(index, id, local)){
+        SendInfo(ISet::getLogger(), RC::INDEX_OUT_OF_BOUND);
+        return RC::INDEX_OUT_OF_BOUND;
+    }
+    return shard(id)->getCoords(local, val);
+}
+
+RC ShardedSet::findFirstAndCopy(IVector const *const &pat, IVector::NORM n, double tol, IVector *&val) const {
+    RC rc = checkPattern(pat);
+    if (rc != RC::SUCCESS)
+        return rc;
+    return findIn(pat->getData(), tol, [&](ISet* set){
+        return set->findFirstAndCopy(pat, n, tol, val);
+    });
+}
+
+RC ShardedSet::findFirstAndCopyCoords(IVector const *const &pat, IVector::NORM n, double tol, IVector *const &val) const {
+    RC rc = checkPattern(pat);
+    if (rc != RC::SUCCESS)
+        return rc;
+    return findIn(pat->getData(), tol, [&](ISet* set){
+        return set->findFirstAndCopyCoords(pat, n, tol, val);
+    });
+}
+
+RC ShardedSet::findFirst(IVector const *const &pat, IVector::NORM n, double tol) const {
+    RC rc = checkPattern(pat);
+    if (rc != RC::SUCCESS)
+        return rc;
+    return findIn(pat->getData(), tol, [&](ISet* set){
+        return set->findFirst(pat, n, tol);
+    });
+}
+
+RC ShardedSet::findFirstMany(double const* patterns, size_t count, size_t dim, IVector::NORM n, double tol, size_t * const& indices) const {
+    if (count == 0)
+        return RC::SUCCESS;
+    if (patterns == nullptr || indices == nullptr){
+        SendInfo(ISet::getLogger(), RC::NULLPTR_ERROR);
+        return RC::NULLPTR_ERROR;
+    }
+    if (std::isnan(tol) || tol < 0.){
+        SendInfo(ISet::getLogger(), RC::INVALID_ARGUMENT);
+        return RC::INVALID_ARGUMENT;
+    }
+    if (dim != _dim){
+        SendInfo(ISet::getLogger(), RC::MISMATCHING_DIMENSIONS);
+        return RC::MISMATCHING_DIMENSIONS;
+    }
+    size_t size = getSize();
+    std::fill(indices, indices + count, size);
+    if (size == 0)
+        return RC::SUCCESS;
+
+    // a pattern near several shards is looked up in each of them
+    size_t shards = shardCount();
+    std::vector<std::vector<size_t>> numbers;
+    std::vector<std::vector<double>> rows;
+    std::vector<std::vector<size_t>> found;
+    std::vector<RC> rcs;
+    std::vector<size_t> active;
+    try {
+        numbers.resize(shards);
+        rows.resize(shards);
+        found.resize(shards);
+        rcs.assign(shards, RC::SUCCESS);
+        std::vector<size_t> ids;
+        for (size_t k = 0; k < count; k++){
+            double const* pat = patterns + k * dim;
+            _list->router.candidateShards(pat, dim, tol, ids);
+            for (size_t id : ids){
+                if (shard(id)->getSize() == 0)
+                    continue;
+                numbers[id].push_back(k);
+                rows[id].insert(rows[id].end(), pat, pat + dim);
+            }
+        }
+        for (size_t id = 0; id < shards; id++){
+            if (numbers[id].empty())
+                continue;
+            found[id].resize(numbers[id].size());
+            active.push_back(id);
+        }
+    }
+    catch (std::bad_alloc const&){
+        SendInfo(ISet::getLogger(), RC::ALLOCATION_ERROR);
+        return RC::ALLOCATION_ERROR;
+    }
+    _list->group->run(active, [&](size_t id){
+        rcs[id] = shard(id)->findFirstMany(rows[id].data(), numbers[id].size(), dim, n, tol, found[id].data());
+    });
+    for (RC rc : rcs){
+        if (rc != RC::SUCCESS){
+            SendInfo(ISet::getLogger(), rc);
+            return rc;
+        }
+    }
+    std::vector<size_t> offsets(shards, 0);
+    for (size_t id = 1; id < shards; id++)
+        offsets[id] = offsets[id - 1] + shard(id - 1)->getSize();
+    // shards are merged from the last one, so a pattern keeps the match with the least index
+    for (size_t id = shards; id-- > 0;){
+        size_t shardSize = shard(id)->getSize();
+        for (size_t j = 0; j < numbers[id].size(); j++)
+            if (found[id][j] < shardSize)
+                indices[numbers[id][j]] = offsets[id] + found[id][j];
+    }
+    return RC::SUCCESS;
+}
+
+RC ShardedSet::insertRow(IVector const* const& val, IVector::NORM n, double tol) {
+    double const* row = val->getData();
+    size_t dim = val->getDim();
+    size_t home = _list->router.shardOf(row, dim);
+    std::vector<size_t> ids;
+    try {
+        _list->router.candidateShards(row, dim, tol, ids);
+    }
+    catch (std::bad_alloc const&){
+        SendInfo(ISet::getLogger(), RC::ALLOCATION_ERROR);
+        return RC::ALLOCATION_ERROR;
+    }
+    // the shard of the cell checks its own vectors on insertion
+    for (size_t id : ids){
+        if (id == home || shard(id)->getSize() == 0)
+            continue;
+        RC rc = shard(id)->findFirst(val, n, tol);
+        if (rc == RC::SUCCESS)
+            return RC::VECTOR_ALREADY_EXIST;
+        if (rc != RC::VECTOR_NOT_FOUND)
+            return rc;
+    }
+    RC rc = shard(home)->insert(val, n, tol);
+    if (shard(home)->getDim() == dim)
+        _dim = dim;
+    return rc;
+}
+
+RC ShardedSet::insert(IVector const *const &val, IVector::NORM n, double tol) {
+    if (val == nullptr){
+        SendInfo(ISet::getLogger(), RC::NULLPTR_ERROR);
+        return RC::NULLPTR_ERROR;
+    }
+    if (val->getDim() == 0 || (_dim != 0 && val->getDim() != _dim)){
+        SendInfo(ISet::getLogger(), RC::MISMATCHING_DIMENSIONS);
+        return RC::MISMATCHING_DIMENSIONS;
+    }
+    return insertRow(val, n, tol);
+}
+
+RC ShardedSet::insertBatch(double const* rows, size_t count, size_t dim, IVector::NORM n, double tol, size_t& inserted) {
+    inserted = 0;
+    if (count == 0)
+        return RC::SUCCESS;
+    if (rows == nullptr){
+        SendInfo(ISet::getLogger(), RC::NULLPTR_ERROR);
+        return RC::NULLPTR_ERROR;
+    }
+    if (std::isnan(tol) || tol < 0.){
+        SendInfo(ISet::getLogger(), RC::INVALID_ARGUMENT);
+        return RC::INVALID_ARGUMENT;
+    }
+    if (dim == 0 || (_dim != 0 && dim != _dim)){
+        SendInfo(ISet::getLogger(), RC::MISMATCHING_DIMENSIONS);
+        return RC::MISMATCHING_DIMENSIONS;
+    }
+    _dim = dim;
+
+    /*
+     * Vectors within tol of a row near a single shard lie in cells of that shard, so such rows are checked
+     * by their shard alone and shards insert them at once. Rows near shard borders are checked against every
+     * shard near them after that
+     */
+    std::vector<std::vector<double>> interior;
+    std::vector<size_t> border;
+    std::vector<RC> rcs;
+    std::vector<size_t> added, ids;
+    RC rc = route(rows, count, tol, interior, border);
+    if (rc == RC::SUCCESS){
+        try {
+            rcs.assign(shardCount(), RC::SUCCESS);
+            added.assign(shardCount(), 0);
+            for (size_t id = 0; id < shardCount(); id++)
+                if (!interior[id].empty())
+                    ids.push_back(id);
+        }
+        catch (std::bad_alloc const&){
+            rc = RC::ALLOCATION_ERROR;
+        }
+    }
+    if (rc != RC::SUCCESS){
+        SendInfo(ISet::getLogger(), rc);
+        return rc;
+    }
+    _list->group->run(ids, [&](size_t id){
+        rcs[id] = shard(id)->insertBatch(interior[id].data(), interior[id].size() / dim, dim, n, tol, added[id]);
+    });
+    for (size_t id = 0; id < shardCount(); id++){
+        inserted += added[id];
+        if (rc == RC::SUCCESS)
+            rc = rcs[id];
+    }
+    if (rc != RC::SUCCESS || border.empty())
+        return rc;
+
+    IVector* vec = IVector::createVector(dim, rows + border[0] * dim);
+    if (vec == nullptr){
+        SendInfo(ISet::getLogger(), RC::ALLOCATION_ERROR);
+        return RC::ALLOCATION_ERROR;
+    }
+    for (size_t k : border){
+        vec->setData(dim, rows + k * dim);
+        rc = insertRow(vec, n, tol);
+        if (rc == RC::SUCCESS)
+            inserted++;
+        else if (rc != RC::VECTOR_ALREADY_EXIST)
+            break;
+        rc = RC::SUCCESS;
+    }
+    delete vec;
+    return rc;
+}
+
+RC ShardedSet::remove(size_t index) {
+    size_t id = 0, local = 0;
+    if (!locate(index, id, local)){
+        SendInfo(ISet::getLogger(), RC::INDEX_OUT_OF_BOUND);
+        return RC::INDEX_OUT_OF_BOUND;
+    }
+    return shard(id)->remove(local);
+}
+
+RC ShardedSet::remove(IVector const *const &pat, IVector::NORM n, double tol) {
+    RC rc = checkPattern(pat);
+    if (rc != RC::SUCCESS)
+        return rc;
+    return findIn(pat->getData(), tol, [&](ISet* set){
+        return set->remove(pat, n, tol);
+    });
+}
+
+RC ShardedSet::removeRows(double const* rows, size_t count, IVector::NORM n, double tol) {
+    if (count == 0 || getSize() == 0)
+        return RC::SUCCESS;
+    std::vector<std::vector<double>> interior;
+    std::vector<size_t> border, ids;
+    std::vector<RC> rcs;
+    RC rc = route(rows, count, tol, interior, border);
+    if (rc == RC::SUCCESS){
+        try {
+            rcs.assign(shardCount(), RC::SUCCESS);
+            for (size_t id = 0; id < shardCount(); id++)
+                if (!interior[id].empty() && shard(id)->getSize() != 0)
+                    ids.push_back(id);
+        }
+        catch (std::bad_alloc const&){
+            rc = RC::ALLOCATION_ERROR;
+        }
+    }
+    if (rc != RC::SUCCESS){
+        SendInfo(ISet::getLogger(), rc);
+        return rc;
+    }
+    size_t dim = _dim;
+    _list->group->run(ids, [&](size_t id){
+        std::vector<double> const& part = interior[id];
+        IVector* vec = IVector::createVector(dim, part.data());
+        if (vec == nullptr){
+            rcs[id] = RC::ALLOCATION_ERROR;
+            return;
+        }
+        for (size_t offset = 0; offset < part.size(); offset += dim){
+            vec->setData(dim, part.data() + offset);
+            RC removeRC = shard(id)->remove(vec, n, tol);
+            if (removeRC != RC::SUCCESS && removeRC != RC::VECTOR_NOT_FOUND){
+                rcs[id] = removeRC;
+                break;
+            }
+        }
+        delete vec;
+    });
+    for (RC shardRC : rcs){
+        if (shardRC != RC::SUCCESS){
+            SendInfo(ISet::getLogger(), shardRC);
+            return shardRC;
+        }
+    }
+    if (border.empty())
+        return RC::SUCCESS;
+    IVector* vec = IVector::createVector(dim, rows + border[0] * dim);
+    if (vec == nullptr){
+        SendInfo(ISet::getLogger(), RC::ALLOCATION_ERROR);
+        return RC::ALLOCATION_ERROR;
+    }
+    for (size_t k : border){
+        vec->setData(dim, rows + k * dim);
+        rc = remove(vec, n, tol);
+        if (rc != RC::SUCCESS && rc != RC::VECTOR_NOT_FOUND)
+            break;
+        rc = RC::SUCCESS;
+    }
+    delete vec;
+    return rc;
+}
+
+RC ShardedSet::removeIf(std::function<bool(double const*, size_t)> const& pred) {
+    if (!pred){
+        SendInfo(ISet::getLogger(), RC::NULLPTR_ERROR);
+        return RC::NULLPTR_ERROR;
+    }
+    return forAll([&pred](ISet* set){
+        return set->removeIf(pred);
+    });
+}
+
+RC ShardedSet::queryBox(ICompact const* const& box, std::function<void(double const*, size_t)> const& callback) const {
+    if (box == nullptr || !callback){
+        SendInfo(ISet::getLogger(), RC::NULLPTR_ERROR);
+        return RC::NULLPTR_ERROR;
+    }
+    if (_dim == 0)
+        return RC::SUCCESS;
+    if (box->getDim() != _dim){
+        SendInfo(ISet::getLogger(), RC::MISMATCHING_DIMENSIONS);
+        return RC::MISMATCHING_DIMENSIONS;
+    }
+    IVector* lowerVec = nullptr;
+    IVector* upperVec = nullptr;
+    RC rc = box->getLeftBoundary(lowerVec);
+    if (rc == RC::SUCCESS)
+        rc = box->getRightBoundary(upperVec);
+    std::vector<size_t> ids;
+    if (rc == RC::SUCCESS){
+        try {
+            _list->router.boxShards(lowerVec->getData(), upperVec->getData(), _dim, ids);
+        }
+        catch (std::bad_alloc const&){
+            rc = RC::ALLOCATION_ERROR;
+        }
+    }
+    delete lowerVec;
+    delete upperVec;
+    if (rc != RC::SUCCESS){
+        SendInfo(ISet::getLogger(), rc);
+        return rc;
+    }
+    // callback is called on this thread in the order of the set
+    for (size_t id : ids){
+        if (shard(id)->getSize() == 0)
+            continue;
+        rc = shard(id)->queryBox(box, callback);
+        if (rc != RC::SUCCESS)
+            return rc;
+    }
+    return RC::SUCCESS;
+}
+
+RC ShardedSet::setGarbageRatio(double ratio) {
+    if (std::isnan(ratio) || ratio < 0. || ratio > 1.){
+        SendInfo(ISet::getLogger(), RC::INVALID_ARGUMENT);
+        return RC::INVALID_ARGUMENT;
+    }
+    return forAll([ratio](ISet* set){
+        return set->setGarbageRatio(ratio);
+    });
+}
+
+RC ShardedSet::compact() {
+    return forAll([](ISet* set){
+        return set->compact();
+    });
+}
+
+RC ShardedSet::reserve(size_t capacity) {
+    size_t share = capacity / shardCount() + (capacity % shardCount() != 0 ? 1 : 0);
+    return forAll([share](ISet* set){
+        ISetCapacity* capacity = ISetCapacity::of(set);
+        return capacity != nullptr ? capacity->reserve(share) : RC::OPERATION_NOT_SUPPORTED;
+    });
+}
+
+RC ShardedSet::shrinkToFit() {
+    return forAll([](ISet* set){
+        ISetCapacity* capacity = ISetCapacity::of(set);
+        return capacity != nullptr ? capacity->shrinkToFit() : RC::OPERATION_NOT_SUPPORTED;
+    });
+}
+
+RC ShardedSet::setGrowthFactor(double factor) {
+    if (std::isnan(factor) || std::isinf(factor) || factor <= 1.){
+        SendInfo(ISet::getLogger(), RC::INVALID_ARGUMENT);
+        return RC::INVALID_ARGUMENT;
+    }
+    for (size_t id = 0; id < shardCount(); id++){
+        ISetCapacity* capacity = ISetCapacity::of(shard(id));
+        if (capacity != nullptr)
+            capacity->setGrowthFactor(factor);
+    }
+    return RC::SUCCESS;
+}
+
+RC ShardedSet::getBounds(IVector*& lower, IVector*& upper) const {
+    if (getSize() == 0)
+        return RC::SOURCE_SET_EMPTY;
+    IVector* resLower = nullptr;
+    IVector* resUpper = nullptr;
+    for (size_t id = 0; id < shardCount(); id++){
+        if (shard(id)->getSize() == 0)
+            continue;
+        IVector* shardLower = nullptr;
+        IVector* shardUpper = nullptr;
+        RC rc = shard(id)->getBounds(shardLower, shardUpper);
+        if (rc != RC::SUCCESS){
+            delete resLower;
+            delete resUpper;
+            return rc;
+        }
+        if (resLower == nullptr){
+            resLower = shardLower;
+            resUpper = shardUpper;
+            continue;
+        }
+        double const* a = shardLower->getData();
+        double const* b = shardUpper->getData();
+        for (size_t i = 0; i < _dim; i++){
+            double x = 0., y = 0.;
+            resLower->getCord(i, x);
+            resUpper->getCord(i, y);
+            resLower->setCord(i, std::min(x, a[i]));
+            resUpper->setCord(i, std::max(y, b[i]));
+        }
+        delete shardLower;
+        delete shardUpper;
+    }
+    lower = resLower;
+    upper = resUpper;
+    return RC::SUCCESS;
+}
+
+RC ShardedSet::getCentroid(IVector*& centroid) const {
+    size_t size = getSize();
+    if (size == 0)
+        return RC::SOURCE_SET_EMPTY;
+    std::vector<double> mean(_dim, 0.);
+    for (size_t id = 0; id < shardCount(); id++){
+        size_t count = shard(id)->getSize();
+        if (count == 0)
+            continue;
+        IVector* shardMean = nullptr;
+        RC rc = shard(id)->getCentroid(shardMean);
+        if (rc != RC::SUCCESS)
+            return rc;
+        double weight = static_cast<double>(count) / static_cast<double>(size);
+        for (size_t i = 0; i < _dim; i++)
+            mean[i] += weight * shardMean->getData()[i];
+        delete shardMean;
+    }
+    IVector* res = IVector::createVector(_dim, mean.data());
+    if (res == nullptr){
+        SendInfo(ISet::getLogger(), RC::ALLOCATION_ERROR);
+        return RC::ALLOCATION_ERROR;
+    }
+    centroid = res;
+    return RC::SUCCESS;
+}
+
+RC ShardedSet::getVariance(IVector*& variance) const {
+    size_t size = getSize();
+    if (size == 0)
+        return RC::SOURCE_SET_EMPTY;
+    IVector* centroid = nullptr;
+    RC rc = getCentroid(centroid);
+    if (rc != RC::SUCCESS)
+        return rc;
+    std::vector<double> mean(centroid->getData(), centroid->getData() + _dim);
+    delete centroid;
+    // variance of the union is the mean of variances of shards plus the variance of their means
+    std::vector<double> spread(_dim, 0.);
+    for (size_t id = 0; id < shardCount(); id++){
+        size_t count = shard(id)->getSize();
+        if (count == 0)
+            continue;
+        IVector* shardMean = nullptr;
+        IVector* shardSpread = nullptr;
+        rc = shard(id)->getCentroid(shardMean);
+        if (rc == RC::SUCCESS)
+            rc = shard(id)->getVariance(shardSpread);
+        if (rc != RC::SUCCESS){
+            delete shardMean;
+            return rc;
+        }
+        double weight = static_cast<double>(count) / static_cast<double>(size);
+        for (size_t i = 0; i < _dim; i++){
+            double shift = shardMean->getData()[i] - mean[i];
+            spread[i] += weight * (shardSpread->getData()[i] + shift * shift);
+        }
+        delete shardMean;
+        delete shardSpread;
+    }
+    IVector* res = IVector::createVector(_dim, spread.data());
+    if (res == nullptr){
+        SendInfo(ISet::getLogger(), RC::ALLOCATION_ERROR);
+        return RC::ALLOCATION_ERROR;
+    }
+    variance = res;
+    return RC::SUCCESS;
+}
+
+RC ShardedSet::enableLsh(IVector::NORM n, size_t tables, size_t hashesPerTable, double bucketWidth, size_t checkEvery) {
+    return forAll([=](ISet* set){
+        ISetLsh* lsh = ISetLsh::of(set);
+        return lsh != nullptr ? lsh->enableLsh(n, tables, hashesPerTable, bucketWidth, checkEvery) : RC::OPERATION_NOT_SUPPORTED;
+    });
+}
+
+RC ShardedSet::disableLsh() {
+    return forAll([](ISet* set){
+        ISetLsh* lsh = ISetLsh::of(set);
+        return lsh != nullptr ? lsh->disableLsh() : RC::SUCCESS;
+    });
+}
+
+RC ShardedSet::getLshStats(LshStats& stats) const {
+    stats = LshStats{0, 0, 0, 0, 0, 0, 0., 0.};
+    for (size_t id = 0; id < shardCount(); id++){
+        LshStats shardStats;
+        ISetLsh const* lsh = ISetLsh::of(shard(id));
+        RC rc = lsh != nullptr ? lsh->getLshStats(shardStats) : RC::OPERATION_NOT_SUPPORTED;
+        if (rc != RC::SUCCESS)
+            return rc;
+        stats.queries += shardStats.queries;
+        stats.candidates += shardStats.candidates;
+        stats.found += shardStats.found;
+        stats.checked += shardStats.checked;
+        stats.checkedFound += shardStats.checkedFound;
+        stats.checkedMissed += shardStats.checkedMissed;
+        stats.lookupSeconds += shardStats.lookupSeconds;
+        stats.exactSeconds += shardStats.exactSeconds;
+    }
+    return RC::SUCCESS;
+}
+
+uint64_t ShardedSet::getVersion() const {
+    uint64_t version = 0;
+    for (size_t id = 0; id < shardCount(); id++)
+        version += shard(id)->getVersion();
+    return version;
+}
+
+RC ShardedSet::sync() {
+    return RC::SUCCESS;
+}
+
+ISet::IIterator* ShardedSet::getIterator(size_t index) const {
+    size_t id = 0, local = 0;
+    if (!locate(index, id, local)){
+        SendInfo(ISet::getLogger(), RC::INDEX_OUT_OF_BOUND);
+        return nullptr;
+    }
+    return ShardedIterator::create(_list, id, shard(id)->getIterator(local));
+}
+
+ISet::IIterator* ShardedSet::getBegin() const {
+    for (size_t id = 0; id < shardCount(); id++)
+        if (shard(id)->getSize() != 0)
+            return ShardedIterator::create(_list, id, shard(id)->getBegin());
+    SendInfo(ISet::getLogger(), RC::SOURCE_SET_EMPTY);
+    return nullptr;
+}
+
+ISet::IIterator* ShardedSet::getEnd() const {
+    for (size_t id = shardCount(); id-- > 0;)
+        if (shard(id)->getSize() != 0)
+            return ShardedIterator::create(_list, id, shard(id)->getEnd());
+    SendInfo(ISet::getLogger(), RC::SOURCE_SET_EMPTY);
+    return nullptr;
+}
+
+ISet::IChunkIterator* ShardedSet::getChunkIterator(size_t chunkRows) const {
+    if (chunkRows == 0){
+        SendInfo(ISet::getLogger(), RC::INVALID_ARGUMENT);
+        return nullptr;
+    }
+    if (getSize() == 0){
+        SendInfo(ISet::getLogger(), RC::SOURCE_SET_EMPTY);
+        return nullptr;
+    }
+    struct Cursor {
+        // shard iterators may read storage of the group, so it is released after them
+        std::shared_ptr<ShardList> list;
+        std::vector<std::unique_ptr<IChunkIterator>> chunks;
+        std::vector<size_t> ids;
+        std::vector<size_t> hashes;
+        size_t pos;
+        bool delivered;
+    };
+    std::shared_ptr<Cursor> cursor;
+    try {
+        cursor = std::make_shared<Cursor>();
+        cursor->list = _list;
+        cursor->pos = 0;
+        cursor->delivered = false;
+        for (size_t id = 0; id < shardCount(); id++){
+            if (shard(id)->getSize() == 0)
+                continue;
+            std::unique_ptr<IChunkIterator> chunk(shard(id)->getChunkIterator(chunkRows));
+            if (chunk == nullptr){
+                SendInfo(ISet::getLogger(), RC::ALLOCATION_ERROR);
+                return nullptr;
+            }
+            cursor->chunks.push_back(std::move(chunk));
+            cursor->ids.push_back(id);
+        }
+    }
+    catch (std::bad_alloc const&){
+        SendInfo(ISet::getLogger(), RC::ALLOCATION_ERROR);
+        return nullptr;
+    }
+    size_t shards = shardCount();
+    return ChunkIterator::createIterator(_dim, [cursor, shards](double const*& rows, size_t const*& hashes, size_t& count){
+        count = 0;
+        while (cursor->pos < cursor->chunks.size()){
+            IChunkIterator* chunk = cursor->chunks[cursor->pos].get();
+            RC rc = cursor->delivered ? chunk->next() : RC::SUCCESS;
+            if (rc == RC::INDEX_OUT_OF_BOUND || !chunk->isValid()){
+                cursor->pos++;
+                cursor->delivered = false;
+                continue;
+            }
+            if (rc != RC::SUCCESS)
+                return rc;
+            cursor->delivered = true;
+            try {
+                cursor->hashes.resize(chunk->getCount());
+            }
+            catch (std::bad_alloc const&){
+                return RC::ALLOCATION_ERROR;
+            }
+            for (size_t j = 0; j < chunk->getCount(); j++)
+                cursor->hashes[j] = chunk->getHashes()[j] * shards + cursor->ids[cursor->pos];
+            rows = chunk->getRows();
+            hashes = cursor->hashes.data();
+            count = chunk->getCount();
+            return RC::SUCCESS;
+        }
+        return RC::SUCCESS;
+    });
+}
+
+RC ShardedSet::forEachChunk(size_t chunkRows, std::function<void(double const*, size_t const*, size_t, size_t)> const& callback) const {
+    if (!callback){
+        SendInfo(ISet::getLogger(), RC::NULLPTR_ERROR);
+        return RC::NULLPTR_ERROR;
+    }
+    if (chunkRows == 0){
+        SendInfo(ISet::getLogger(), RC::INVALID_ARGUMENT);
+        return RC::INVALID_ARGUMENT;
+    }
+    size_t shards = shardCount();
+    std::atomic<bool> failed(false);
+    std::vector<size_t> ids;
+    std::vector<RC> rcs;
+    try {
+        _list->router.allShards(ids);
+        rcs.assign(shards, RC::SUCCESS);
+    }
+    catch (std::bad_alloc const&){
+        SendInfo(ISet::getLogger(), RC::ALLOCATION_ERROR);
+        return RC::ALLOCATION_ERROR;
+    }
+    _list->group->run(ids, [&](size_t id){
+        if (shard(id)->getSize() == 0)
+            return;
+        rcs[id] = shard(id)->forEachChunk(chunkRows, [&callback, &failed, shards, id](double const* rows, size_t const* hashes, size_t count, size_t dim){
+            // chunks of a shard are read by several threads, each of them maps hashes into a buffer of its own
+            thread_local std::vector<size_t> mapped;
+            try {
+                mapped.resize(count);
+            }
+            catch (std::bad_alloc const&){
+                failed.store(true);
+                return;
+            }
+            for (size_t j = 0; j < count; j++)
+                mapped[j] = hashes[j] * shards + id;
+            callback(rows, mapped.data(), count, dim);
+        });
+    });
+    if (failed.load()){
+        SendInfo(ISet::getLogger(), RC::ALLOCATION_ERROR);
+        return RC::ALLOCATION_ERROR;
+    }
+    for (RC rc : rcs)
+        if (rc != RC::SUCCESS)
+            return rc;
+    return RC::SUCCESS;
+}
+
+ShardedSet::~ShardedSet() {
+    _list->isValid.store(false);
+    for (auto& set : _list->sets){
+        delete set;
+        set = nullptr;
+    }
+}
+
+
+bool sharding::isSharded(ISet const* const& set) {
+    return dynamic_cast<ShardedSet const*>(set) != nullptr;
+}
+
+ISet* sharding::makeIntersection(ISet const* const& op1, ISet const* const& op2, IVector::NORM n, double tol) {
+    auto sharded = dynamic_cast<ShardedSet const*>(op1);
+    size_t dim = op1->getDim();
+    std::vector<double> rows, kept;
+    std::vector<bool> found;
+    RC rc = readRows(op1, rows);
+    if (rc == RC::SUCCESS)
+        rc = lookupRows(op2, rows, dim, n, tol, found);
+    if (rc == RC::SUCCESS)
+        rc = selectRows(rows, dim, found, true, kept);
+    ShardedSet* res = rc == RC::SUCCESS ? sharded->createEmpty() : nullptr;
+    if (rc == RC::SUCCESS && res == nullptr)
+        rc = RC::ALLOCATION_ERROR;
+    size_t inserted = 0;
+    if (rc == RC::SUCCESS)
+        rc = res->insertBatch(kept.data(), kept.size() / dim, dim, n, tol, inserted);
+    if (rc != RC::SUCCESS){
+        delete res;
+        SendInfo(ISet::getLogger(), rc);
+        return nullptr;
+    }
+    return res;
+}
+
+ISet* sharding::makeUnion(ISet const* const& op1, ISet const* const& op2, IVector::NORM n, double tol) {
+    std::vector<double> rows;
+    RC rc = readRows(op2, rows);
+    ISet* res = rc == RC::SUCCESS ? op1->clone() : nullptr;
+    if (rc == RC::SUCCESS && res == nullptr)
+        rc = RC::ALLOCATION_ERROR;
+    size_t inserted = 0;
+    // vectors of op2 equal to vectors of op1 are skipped by the batch
+    if (rc == RC::SUCCESS)
+        rc = res->insertBatch(rows.data(), rows.size() / op2->getDim(), op2->getDim(), n, tol, inserted);
+    if (rc != RC::SUCCESS){
+        delete res;
+        SendInfo(ISet::getLogger(), rc);
+        return nullptr;
+    }
+    return res;
+}
+
+ISet* sharding::sub(ISet const* const& op1, ISet const* const& op2, IVector::NORM n, double tol) {
+    std::vector<double> rows;
+    RC rc = readRows(op2, rows);
+    auto res = rc == RC::SUCCESS ? static_cast<ShardedSet*>(op1->clone()) : nullptr;
+    if (rc == RC::SUCCESS && res == nullptr)
+        rc = RC::ALLOCATION_ERROR;
+    if (rc == RC::SUCCESS)
+        rc = res->removeRows(rows.data(), rows.size() / op2->getDim(), n, tol);
+    if (rc != RC::SUCCESS){
+        delete res;
+        SendInfo(ISet::getLogger(), rc);
+        return nullptr;
+    }
+    return res;
+}
+
+ISet* sharding::symSub(ISet const* const& op1, ISet const* const& op2, IVector::NORM n, double tol) {
+    auto sharded = dynamic_cast<ShardedSet const*>(op1);
+    size_t dim = op1->getDim();
+    std::vector<double> rows1, rows2, kept;
+    std::vector<bool> found1, found2;
+    RC rc = readRows(op1, rows1);
+    if (rc == RC::SUCCESS)
+        rc = readRows(op2, rows2);
+    if (rc == RC::SUCCESS)
+        rc = lookupRows(op2, rows1, dim, n, tol, found1);
+    if (rc == RC::SUCCESS)
+        rc = lookupRows(op1, rows2, dim, n, tol, found2);
+    if (rc == RC::SUCCESS)
+        rc = selectRows(rows1, dim, found1, false, kept);
+    if (rc == RC::SUCCESS)
+        rc = selectRows(rows2, dim, found2, false, kept);
+    ShardedSet* res = rc == RC::SUCCESS ? sharded->createEmpty() : nullptr;
+    if (rc == RC::SUCCESS && res == nullptr)
+        rc = RC::ALLOCATION_ERROR;
+    size_t inserted = 0;
+    if (rc == RC::SUCCESS)
+        rc = res->insertBatch(kept.data(), kept.size() / dim, dim, n, tol, inserted);
+    if (rc != RC::SUCCESS){
+        delete res;
+        SendInfo(ISet::getLogger(), rc);
+        return nullptr;
+    }
+    return res;
+}
+
+bool sharding::contains(ISet const* const& whole, ISet const* const& part, IVector::NORM n, double tol) {
+    std::vector<double> rows;
+    std::vector<bool> found;
+    RC rc = readRows(part, rows);
+    if (rc == RC::SUCCESS)
+        rc = lookupRows(whole, rows, part->getDim(), n, tol, found);
+    if (rc != RC::SUCCESS){
+        SendInfo(ISet::getLogger(), rc);
+        return false;
+    }
+    return std::find(found.begin(), found.end(), false) == found.end();
+}
+
+LIB_EXPORT ISet* ISet::createShardedSet(size_t shardCount, double cellSize) {
+    if (shardCount == 0 || std::isnan(cellSize) || std::isinf(cellSize) || cellSize <= 0.){
+        SendInfo(ISet::getLogger(), RC::INVALID_ARGUMENT);
+        return nullptr;
+    }
+    auto res = ShardedSet::create(shardCount, cellSize);
+    if (res == nullptr)
+        SendInfo(ISet::getLogger(), RC::ALLOCATION_ERROR);
+    return res;
+}
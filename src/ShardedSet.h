@@ -0,0 +1,21 @@
+#pragma once
+#include "../include/ISet.h"
+
+/*
+ * Set algebra of sets created by ISet::createShardedSet, called by the static operations of ISet after their checks.
+ * Vectors are looked up by findFirstMany, which a sharded set splits over its shard threads, results are sharded sets
+ * with the shards of op1 filled by insertBatch
+ */
+namespace sharding {
+    bool isSharded(ISet const* const& set);
+
+    ISet* makeIntersection(ISet const* const& op1, ISet const* const& op2, IVector::NORM n, double tol);
+    ISet* makeUnion(ISet const* const& op1, ISet const* const& op2, IVector::NORM n, double tol);
+    ISet* sub(ISet const* const& op1, ISet const* const& op2, IVector::NORM n, double tol);
+    ISet* symSub(ISet const* const& op1, ISet const* const& op2, IVector::NORM n, double tol);
+
+    /*
+     * True if every vector of part is within tol of a vector of whole, either of them may be sharded
+     */
+    bool contains(ISet const* const& whole, ISet const* const& part, IVector::NORM n, double tol);
+}
@@ -0,0 +1,1373 @@
+#include "../include/ISet.h"
+#include "../include/ISetRawView.h"
+#include "../include/ICompact.h"
+#include "../include/ISetControlBlock.h"
+#include "SetKernels.h"
+#include "ScanPool.h"
+#include "SetSummary.h"
+#include "SetIterator.h"
+#include "ChunkIterator.h"
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <cmath>
+#include <map>
+#include <memory>
+#include <new>
+#include <string>
+#include <thread>
+#include <vector>
+#include <algorithm>
+
+#if defined(__unix__) || defined(__APPLE__)
+#define SET_SHARED_MEMORY
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+#define SendInfo(Logger, Code) if (Logger != nullptr) Logger->info((Code), __FILE__, __func__, __LINE__)
+
+
+#if defined(SET_SHARED_MEMORY)
+namespace{
+    size_t const wordBits = 64;
+    // batched lookups are split over ScanPool threads in parts of at least this many rows
+    size_t const batchPartRows = 64;
+    double const defaultGarbageRatio = 0.25;
+    char const sharedMagic[8] = {'G', 'L', 'S', 'H', 'S', 'E', 'T', '1'};
+    uint64_t const sharedFormatVersion = 1;
+    size_t const sharedAlignment = 64;
+
+    /*
+     * Header of a shared memory segment: rows follow the header, unique indices and bitmap of removed rows follow rows.
+     * Rows below used are published by the writer and never rewritten while sequence stays the same,
+     * the writer keeps sequence odd while it moves rows to drop removed ones
+     */
+    struct SharedHeader {
+        char magic[8];
+        uint64_t formatVersion;
+        uint64_t dim;
+        uint64_t capacity;
+        uint64_t rowsOffset;
+        uint64_t hashesOffset;
+        uint64_t deadOffset;
+        uint64_t segmentSize;
+        std::atomic<uint64_t> sequence;
+        std::atomic<uint64_t> used;
+        std::atomic<uint64_t> size;
+        std::atomic<uint64_t> version;
+    };
+
+    inline size_t alignUp(size_t bytes){
+        return (bytes + sharedAlignment - 1) / sharedAlignment * sharedAlignment;
+    }
+
+    inline size_t bitmapWords(size_t bits){
+        return (bits + wordBits - 1) / wordBits;
+    }
+
+    inline size_t popCount(uint64_t word){
+#if defined(__GNUC__)
+        return static_cast<size_t>(__builtin_popcountll(word));
+#else
+        size_t count = 0;
+        for (; word != 0; word &= word - 1)
+            count++;
+        return count;
+#endif
+    }
+
+    // word must not be zero
+    inline size_t lowestBit(uint64_t word){
+#if defined(__GNUC__)
+        return static_cast<size_t>(__builtin_ctzll(word));
+#else
+        size_t bit = 0;
+        for (; (word & 1) == 0; word >>= 1)
+            bit++;
+        return bit;
+#endif
+    }
+
+    /*
+     * Fills offsets and size of the segment for capacity vectors of dim coordinates, returns false on overflow
+     */
+    bool layOut(SharedHeader& header, size_t dim, size_t capacity){
+        size_t const maxSize = static_cast<size_t>(-1) / 2;
+        if (capacity > maxSize / sizeof(double) / dim)
+            return false;
+        header.dim = dim;
+        header.capacity = capacity;
+        header.rowsOffset = alignUp(sizeof(SharedHeader));
+        header.hashesOffset = alignUp(header.rowsOffset + capacity * dim * sizeof(double));
+        header.deadOffset = alignUp(header.hashesOffset + capacity * sizeof(uint64_t));
+        header.segmentSize = header.deadOffset + bitmapWords(capacity) * sizeof(uint64_t);
+        return true;
+    }
+
+    class SharedSet;
+
+    class SharedControlBlock : public ISetControlBlock {
+    private:
+        SharedSet const* _set;
+        bool* _setIsValid;
+
+    public:
+        SharedControlBlock(SharedSet const* set, bool* setIsValid);
+
+        RC getNext(double *const &data, size_t &index, size_t &pos, size_t indexInc) const override;
+        RC getPrevious(double *const &data, size_t &index, size_t &pos, size_t indexInc) const override;
+        RC getBegin(double *const &data, size_t &index, size_t &pos) const override;
+        RC getEnd(double *const &data, size_t &index, size_t &pos) const override;
+
+        ~SharedControlBlock() override;
+    };
+
+    /*
+     * ISet in a POSIX shared memory segment written by one process and read by any number of processes.
+     * Readers take no locks: appended rows are published by the release store of used and removal only sets
+     * a bit of the removed row, so rows a reader sees are never changed under it. Rows are moved only when
+     * the writer drops removed rows, reads overlapped by that are retried (sequence lock)
+     */
+    class SharedSet : public ISet, public ISetRawView {
+    private:
+        unsigned char* _image;
+        size_t _imageSize;
+        int _fd;
+        bool _writable;
+        std::string _name;
+        SharedHeader* _header;
+        double* _rows;
+        uint64_t* _hashes;
+        std::atomic<uint64_t>* _dead;
+        size_t _dim;
+        size_t _capacity;
+        // writer only: next unique index, garbage ratio and unique indices of vectors ordered by the first coordinate
+        size_t _nextHash;
+        double _garbageRatio;
+        std::multimap<double, size_t> _byFirst;
+        std::shared_ptr<ISetControlBlock> _setCB;
+        bool* _setIsValid;
+
+        SharedSet();
+
+        static SharedSet* attach(unsigned char* image, size_t imageSize, int fd, bool writable, char const* name);
+
+        /*
+         * Runs read until no compaction overlapped it, read must not have side effects outside of its own buffers
+         */
+        template<typename Read>
+        RC readConsistent(Read const& read) const;
+
+        bool isDead(size_t slot) const;
+        /*
+         * Slot of the alive vector skip alive vectors after the first alive slot >= slot, used if there is none
+         */
+        size_t findAlive(size_t slot, size_t skip, size_t used) const;
+        /*
+         * First removed slot >= slot, used if there is none
+         */
+        size_t findDead(size_t slot, size_t used) const;
+        /*
+         * Slot of the skip-th alive vector before slot, counting from 1, used if there is none
+         */
+        size_t findAliveBefore(size_t slot, size_t skip, size_t used) const;
+        /*
+         * Slot of the vector with unique index or, if it was removed, of the first vector added after it
+         */
+        size_t locate(size_t index, size_t pos, size_t used) const;
+
+        /*
+         * Slot of the first vector within tol of row, used if there is none. The writer looks through _byFirst,
+         * readers scan runs of alive rows
+         */
+        size_t findSlot(double const* row, IVector::NORM n, double tol, size_t used) const;
+        RC findCopy(IVector const* const& pat, IVector::NORM n, double tol, std::vector<double>& row) const;
+        RC copyRow(size_t index, std::vector<double>& row) const;
+        /*
+         * Copies up to maxRows alive vectors of slots [slot, last) and moves slot past them by one consistent read,
+         * SOURCE_SET_CHANGED if the set is not of the given version anymore
+         */
+        RC copyChunk(size_t& slot, size_t last, size_t maxRows, uint64_t version, double* rows, size_t* hashes, size_t& count) const;
+
+        RC checkWritable() const;
+        RC checkVector(IVector const* const& vec) const;
+        RC checkPattern(IVector const* const& pat, double tol) const;
+        RC append(double const* row);
+        void removeSlot(size_t slot);
+        void compactIfNeeded();
+        void compactRows();
+
+        RC summarize(SetSummary& summary) const;
+
+    public:
+        static SharedSet* create(char const* name, size_t dim, size_t capacity);
+        static SharedSet* open(char const* name);
+
+        RC getNext(double *const &data, size_t &index, size_t &pos, size_t indexInc) const;
+        RC getPrevious(double *const &data, size_t &index, size_t &pos, size_t indexInc) const;
+        RC getBegin(double *const &data, size_t &index, size_t &pos) const;
+        RC getEnd(double *const &data, size_t &index, size_t &pos) const;
+
+        /*
+         * Clone and snapshot are private copies in memory of the calling process
+         */
+        ISet* clone() const override;
+        ISet const* snapshot() const override;
+
+        size_t getDim() const override;
+        size_t getSize() const override;
+
+        RC getCopy(size_t index, IVector *& val) const override;
+        RC findFirstAndCopy(IVector const * const& pat, IVector::NORM n, double tol, IVector *& val) const override;
+
+        RC getCoords(size_t index, IVector * const& val) const override;
+        RC findFirstAndCopyCoords(IVector const * const& pat, IVector::NORM n, double tol, IVector * const& val) const override;
+        RC findFirst(IVector const * const& pat, IVector::NORM n, double tol) const override;
+        /*
+         * The whole batch is one consistent read, it is repeated if the writer compacts the set meanwhile
+         */
+        RC findFirstMany(double const* patterns, size_t count, size_t dim, IVector::NORM n, double tol, size_t * const& indices) const override;
+
+        RC insert(IVector const * const& val, IVector::NORM n, double tol) override;
+        RC insertBatch(double const* rows, size_t count, size_t dim, IVector::NORM n, double tol, size_t& inserted) override;
+
+        RC remove(size_t index) override;
+        RC remove(IVector const * const& pat, IVector::NORM n, double tol) override;
+        RC removeIf(std::function<bool(double const*, size_t)> const& pred) override;
+
+        using ISet::queryBox;
+
+        RC queryBox(ICompact const* const& box, std::function<void(double const*, size_t)> const& callback) const override;
+
+        RC setGarbageRatio(double ratio) override;
+        RC compact() override;
+
+        /*
+         * Summary is not kept in the segment, every call scans the vectors
+         */
+        RC getBounds(IVector*& lower, IVector*& upper) const override;
+        RC getCentroid(IVector*& centroid) const override;
+        RC getVariance(IVector*& variance) const override;
+
+        /*
+         * Rows are contiguous only while there are no removed rows among them
+         */
+        RC getRawView(double const*& rows, size_t& count, size_t& dim, uint64_t& version) const override;
+        uint64_t getVersion() const override;
+
+        RC sync() override;
+
+        IIterator *getIterator(size_t index) const override;
+        IIterator *getBegin() const override;
+        IIterator *getEnd() const override;
+
+        /*
+         * Chunks are copied out of the segment, every chunk by one consistent read
+         */
+        IChunkIterator *getChunkIterator(size_t chunkRows) const override;
+        RC forEachChunk(size_t chunkRows, std::function<void(double const*, size_t const*, size_t, size_t)> const& callback) const override;
+
+        ~SharedSet() override;
+    };
+}
+
+SharedControlBlock::SharedControlBlock(SharedSet const* set, bool* setIsValid) :
+        _set(set),
+        _setIsValid(setIsValid){
+}
+
+RC SharedControlBlock::getNext(double *const &data, size_t &index, size_t &pos, size_t indexInc) const {
+    if (!(*_setIsValid))
+        return RC::SOURCE_SET_DESTROYED;
+    return _set->getNext(data, index, pos, indexInc);
+}
+
+RC SharedControlBlock::getPrevious(double *const &data, size_t &index, size_t &pos, size_t indexInc) const {
+    if (!(*_setIsValid))
+        return RC::SOURCE_SET_DESTROYED;
+    return _set->getPrevious(data, index, pos, indexInc);
+}
+
+RC SharedControlBlock::getBegin(double *const &data, size_t &index, size_t &pos) const {
+    if (!(*_setIsValid))
+        return RC::SOURCE_SET_DESTROYED;
+    return _set->getBegin(data, index, pos);
+}
+
+RC SharedControlBlock::getEnd(double *const &data, size_t &index, size_t &pos) const {
+    if (!(*_setIsValid))
+        return RC::SOURCE_SET_DESTROYED;
+    return _set->getEnd(data, index, pos);
+}
+
+SharedControlBlock::~SharedControlBlock() {
+    delete [] _setIsValid;
+}
+
+SharedSet::SharedSet() :
+        _image(nullptr),
+        _imageSize(0),
+        _fd(-1),
+        _writable(false),
+        _header(nullptr),
+        _rows(nullptr),
+        _hashes(nullptr),
+        _dead(nullptr),
+        _dim(0),
+        _capacity(0),
+        _nextHash(0),
+        _garbageRatio(defaultGarbageRatio),
+        _setCB(nullptr),
+        _setIsValid(nullptr){
+}
+
+SharedSet* SharedSet::attach(unsigned char* image, size_t imageSize, int fd, bool writable, char const* name) {
+    std::unique_ptr<SharedSet> set(new(std::nothrow) SharedSet());
+    bool allocated = set != nullptr;
+    if (allocated){
+        try {
+            set->_name = name;
+        }
+        catch (std::bad_alloc const&){
+            allocated = false;
+        }
+    }
+    if (allocated)
+        set->_setIsValid = new(std::nothrow) bool[1]{true};
+    if (allocated && set->_setIsValid != nullptr){
+        set->_setCB = std::shared_ptr<ISetControlBlock>(new(std::nothrow) SharedControlBlock(set.get(), set->_setIsValid));
+        if (set->_setCB == nullptr){
+            delete [] set->_setIsValid;
+            set->_setIsValid = nullptr;
+        }
+    }
+    if (!allocated || set->_setCB == nullptr){
+        munmap(image, imageSize);
+        if (fd >= 0)
+            close(fd);
+        if (writable)
+            shm_unlink(name);
+        SendInfo(ISet::getLogger(), RC::ALLOCATION_ERROR);
+        return nullptr;
+    }
+    set->_image = image;
+    set->_imageSize = imageSize;
+    set->_fd = fd;
+    set->_writable = writable;
+    set->_header = reinterpret_cast<SharedHeader*>(image);
+    set->_dim = set->_header->dim;
+    set->_capacity = set->_header->capacity;
+    set->_rows = reinterpret_cast<double*>(image + set->_header->rowsOffset);
+    set->_hashes = reinterpret_cast<uint64_t*>(image + set->_header->hashesOffset);
+    set->_dead = reinterpret_cast<std::atomic<uint64_t>*>(image + set->_header->deadOffset);
+    return set.release();
+}
+
+SharedSet* SharedSet::create(char const* name, size_t dim, size_t capacity) {
+    SharedHeader layout;
+    if (!layOut(layout, dim, capacity)){
+        SendInfo(ISet::getLogger(), RC::INVALID_ARGUMENT);
+        return nullptr;
+    }
+    int fd = shm_open(name, O_RDWR | O_CREAT | O_EXCL, 0644);
+    if (fd < 0){
+        SendInfo(ISet::getLogger(), RC::IO_ERROR);
+        return nullptr;
+    }
+    void* image = MAP_FAILED;
+    if (ftruncate(fd, static_cast<off_t>(layout.segmentSize)) == 0)
+        image = mmap(nullptr, layout.segmentSize, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (image == MAP_FAILED){
+        close(fd);
+        shm_unlink(name);
+        SendInfo(ISet::getLogger(), RC::IO_ERROR);
+        return nullptr;
+    }
+    // the segment is zero filled, so the bitmap marks no rows removed
+    auto header = new(image) SharedHeader();
+    header->formatVersion = sharedFormatVersion;
+    header->dim = layout.dim;
+    header->capacity = layout.capacity;
+    header->rowsOffset = layout.rowsOffset;
+    header->hashesOffset = layout.hashesOffset;
+    header->deadOffset = layout.deadOffset;
+    header->segmentSize = layout.segmentSize;
+    header->sequence.store(0, std::memory_order_relaxed);
+    header->used.store(0, std::memory_order_relaxed);
+    header->size.store(0, std::memory_order_relaxed);
+    header->version.store(0, std::memory_order_relaxed);
+    // readers check magic first, it is written after the rest of the header
+    std::atomic_thread_fence(std::memory_order_release);
+    std::memcpy(header->magic, sharedMagic, sizeof(sharedMagic));
+    return attach(static_cast<unsigned char*>(image), layout.segmentSize, fd, true, name);
+}
+
+SharedSet* SharedSet::open(char const* name) {
+    int fd = shm_open(name, O_RDONLY, 0);
+    if (fd < 0){
+        SendInfo(ISet::getLogger(), RC::FILE_NOT_FOUND);
+        return nullptr;
+    }
+    struct stat segmentStat;
+    void* image = MAP_FAILED;
+    size_t imageSize = 0;
+    if (fstat(fd, &segmentStat) == 0 && static_cast<size_t>(segmentStat.st_size) >= sizeof(SharedHeader)){
+        imageSize = static_cast<size_t>(segmentStat.st_size);
+        image = mmap(nullptr, imageSize, PROT_READ, MAP_SHARED, fd, 0);
+    }
+    // mapping outlives the descriptor
+    close(fd);
+    if (image == MAP_FAILED){
+        SendInfo(ISet::getLogger(), RC::IO_ERROR);
+        return nullptr;
+    }
+    auto header = static_cast<SharedHeader const*>(image);
+    bool valid = std::memcmp(header->magic, sharedMagic, sizeof(sharedMagic)) == 0;
+    std::atomic_thread_fence(std::memory_order_acquire);
+    SharedHeader layout;
+    valid = valid && header->formatVersion == sharedFormatVersion && header->dim != 0 &&
+            layOut(layout, header->dim, header->capacity) &&
+            layout.rowsOffset == header->rowsOffset && layout.hashesOffset == header->hashesOffset &&
+            layout.deadOffset == header->deadOffset && layout.segmentSize == header->segmentSize &&
+            header->segmentSize <= imageSize;
+    if (!valid){
+        munmap(image, imageSize);
+        SendInfo(ISet::getLogger(), RC::INVALID_ARGUMENT);
+        return nullptr;
+    }
+    return attach(static_cast<unsigned char*>(image), imageSize, -1, false, name);
+}
+
+SharedSet::~SharedSet() {
+    if (_setIsValid != nullptr)
+        _setIsValid[0] = false;
+    if (_image != nullptr)
+        munmap(_image, _imageSize);
+    if (_fd >= 0)
+        close(_fd);
+    // attached readers keep their mappings, new ones can not attach without the writer
+    if (_writable)
+        shm_unlink(_name.c_str());
+}
+
+template<typename Read>
+RC SharedSet::readConsistent(Read const& read) const {
+    while (true){
+        uint64_t sequence = _header->sequence.load(std::memory_order_acquire);
+        if (sequence & 1){
+            std::this_thread::yield();
+            continue;
+        }
+        RC rc = read();
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (_header->sequence.load(std::memory_order_relaxed) == sequence)
+            return rc;
+    }
+}
+
+bool SharedSet::isDead(size_t slot) const {
+    return (_dead[slot / wordBits].load(std::memory_order_acquire) >> (slot % wordBits)) & 1;
+}
+
+size_t SharedSet::findAlive(size_t slot, size_t skip, size_t used) const {
+    while (slot < used){
+        size_t word = slot / wordBits;
+        size_t end = std::min(used, (word + 1) * wordBits);
+        uint64_t bits = ~_dead[word].load(std::memory_order_acquire) & (~uint64_t(0) << (slot % wordBits));
+        if (end % wordBits != 0)
+            bits &= (uint64_t(1) << (end % wordBits)) - 1;
+        size_t count = popCount(bits);
+        if (skip < count){
+            for (; skip > 0; skip--)
+                bits &= bits - 1;
+            return word * wordBits + lowestBit(bits);
+        }
+        skip -= count;
+        slot = end;
+    }
+    return used;
+}
+
+size_t SharedSet::findDead(size_t slot, size_t used) const {
+    while (slot < used){
+        size_t word = slot / wordBits;
+        uint64_t bits = _dead[word].load(std::memory_order_acquire) & (~uint64_t(0) << (slot % wordBits));
+        if (bits != 0)
+            return std::min(used, word * wordBits + lowestBit(bits));
+        slot = (word + 1) * wordBits;
+    }
+    return used;
+}
+
+size_t SharedSet::findAliveBefore(size_t slot, size_t skip, size_t used) const {
+    for (slot = std::min(slot, used); slot > 0 && skip > 0;){
+        slot--;
+        if (!isDead(slot) && --skip == 0)
+            return slot;
+    }
+    return used;
+}
+
+size_t SharedSet::locate(size_t index, size_t pos, size_t used) const {
+    if (pos < used && _hashes[pos] == index)
+        return pos;
+    return std::lower_bound(_hashes, _hashes + used, static_cast<uint64_t>(index)) - _hashes;
+}
+
+size_t SharedSet::findSlot(double const* row, IVector::NORM n, double tol, size_t used) const {
+    if (_writable){
+        size_t best = used;
+        kernel::RowComparer equal = kernel::rowComparer(_dim, n);
+        auto last = _byFirst.upper_bound(row[0] + tol);
+        for (auto it = _byFirst.lower_bound(row[0] - tol); it != last; ++it){
+            size_t slot = locate(it->second, used, used);
+            if (slot < best && equal(_dim, _rows + slot * _dim, row, tol))
+                best = slot;
+        }
+        return best;
+    }
+    for (size_t slot = findAlive(0, 0, used); slot < used;){
+        size_t end = findDead(slot, used);
+        size_t found = kernel::findRow(_dim, _rows + slot * _dim, end - slot, row, n, tol);
+        if (found != end - slot)
+            return slot + found;
+        slot = findAlive(end, 0, used);
+    }
+    return used;
+}
+
+RC SharedSet::findCopy(IVector const* const& pat, IVector::NORM n, double tol, std::vector<double>& row) const {
+    RC rc = checkPattern(pat, tol);
+    if (rc != RC::SUCCESS)
+        return rc;
+    try {
+        row.resize(_dim);
+    }
+    catch (std::bad_alloc const&){
+        SendInfo(ISet::getLogger(), RC::ALLOCATION_ERROR);
+        return RC::ALLOCATION_ERROR;
+    }
+    double const* data = pat->getData();
+    return readConsistent([&]() {
+        size_t used = _header->used.load(std::memory_order_acquire);
+        size_t slot = findSlot(data, n, tol, used);
+        if (slot == used)
+            return RC::VECTOR_NOT_FOUND;
+        std::memcpy(row.data(), _rows + slot * _dim, _dim * sizeof(double));
+        return RC::SUCCESS;
+    });
+}
+
+RC SharedSet::copyRow(size_t index, std::vector<double>& row) const {
+    try {
+        row.resize(_dim);
+    }
+    catch (std::bad_alloc const&){
+        SendInfo(ISet::getLogger(), RC::ALLOCATION_ERROR);
+        return RC::ALLOCATION_ERROR;
+    }
+    RC rc = readConsistent([&]() {
+        size_t used = _header->used.load(std::memory_order_acquire);
+        // without removed rows index is the slot
+        size_t slot = _header->size.load(std::memory_order_acquire) == used ? std::min(index, used) : findAlive(0, index, used);
+        if (slot == used)
+            return RC::INDEX_OUT_OF_BOUND;
+        std::memcpy(row.data(), _rows + slot * _dim, _dim * sizeof(double));
+        return RC::SUCCESS;
+    });
+    if (rc != RC::SUCCESS)
+        SendInfo(ISet::getLogger(), rc);
+    return rc;
+}
+
+RC SharedSet::copyChunk(size_t& slot, size_t last, size_t maxRows, uint64_t version, double* rows, size_t* hashes, size_t& count) const {
+    size_t next = slot;
+    RC rc = readConsistent([&]() {
+        if (_header->version.load(std::memory_order_acquire) != version)
+            return RC::SOURCE_SET_CHANGED;
+        size_t used = _header->used.load(std::memory_order_acquire);
+        size_t end = std::min(last, used);
+        count = 0;
+        next = std::min(findAlive(slot, 0, used), end);
+        while (next < end && count < maxRows){
+            size_t runEnd = std::min(findDead(next, used), end);
+            size_t take = std::min(runEnd - next, maxRows - count);
+            std::memcpy(rows + count * _dim, _rows + next * _dim, take * _dim * sizeof(double));
+            for (size_t k = 0; k < take; k++)
+                hashes[count + k] = static_cast<size_t>(_hashes[next + k]);
+            count += take;
+            next += take;
+            if (next == runEnd)
+                next = std::min(findAlive(runEnd, 0, used), end);
+        }
+        kernel::prefetch(_rows + next * _dim, std::min(maxRows, end - next) * _dim * sizeof(double));
+        return RC::SUCCESS;
+    });
+    if (rc == RC::SUCCESS)
+        slot = next;
+    return rc;
+}
+
+RC SharedSet::checkWritable() const {
+    if (_writable)
+        return RC::SUCCESS;
+    SendInfo(ISet::getLogger(), RC::OPERATION_NOT_SUPPORTED);
+    return RC::OPERATION_NOT_SUPPORTED;
+}
+
+RC SharedSet::checkVector(IVector const* const& vec) const {
+    if (vec == nullptr || vec->getData() == nullptr){
+        SendInfo(ISet::getLogger(), RC::NULLPTR_ERROR);
+        return RC::NULLPTR_ERROR;
+    }
+    if (vec->getDim() != _dim){
+        SendInfo(ISet::getLogger(), RC::MISMATCHING_DIMENSIONS);
+        return RC::MISMATCHING_DIMENSIONS;
+    }
+    return RC::SUCCESS;
+}
+
+RC SharedSet::checkPattern(IVector const* const& pat, double tol) const {
+    RC rc = checkVector(pat);
+    if (rc != RC::SUCCESS)
+        return rc;
+    if (std::isnan(tol) || tol < 0.){
+        SendInfo(ISet::getLogger(), RC::INVALID_ARGUMENT);
+        return RC::INVALID_ARGUMENT;
+    }
+    return RC::SUCCESS;
+}
+
+RC SharedSet::append(double const* row) {
+    size_t used = _header->used.load(std::memory_order_relaxed);
+    size_t size = _header->size.load(std::memory_order_relaxed);
+    if (used == _capacity && size != used){
+        compactRows();
+        used = size;
+    }
+    if (used == _capacity){
+        SendInfo(ISet::getLogger(), RC::ALLOCATION_ERROR);
+        return RC::ALLOCATION_ERROR;
+    }
+    try {
+        _byFirst.emplace(row[0], _nextHash);
+    }
+    catch (std::bad_alloc const&){
+        SendInfo(ISet::getLogger(), RC::ALLOCATION_ERROR);
+        return RC::ALLOCATION_ERROR;
+    }
+    std::memcpy(_rows + used * _dim, row, _dim * sizeof(double));
+    _hashes[used] = _nextHash++;
+    // row is visible to readers only after it is written
+    _header->used.store(used + 1, std::memory_order_release);
+    _header->size.store(size + 1, std::memory_order_release);
+    _header->version.fetch_add(1, std::memory_order_release);
+    return RC::SUCCESS;
+}
+
+void SharedSet::removeSlot(size_t slot) {
+    double const* row = _rows + slot * _dim;
+    auto range = _byFirst.equal_range(row[0]);
+    for (auto it = range.first; it != range.second; ++it)
+        if (it->second == _hashes[slot]){
+            _byFirst.erase(it);
+            break;
+        }
+    _dead[slot / wordBits].fetch_or(uint64_t(1) << (slot % wordBits), std::memory_order_release);
+    _header->size.fetch_sub(1, std::memory_order_release);
+    _header->version.fetch_add(1, std::memory_order_release);
+}
+
+void SharedSet::compactIfNeeded() {
+    size_t used = _header->used.load(std::memory_order_relaxed);
+    size_t size = _header->size.load(std::memory_order_relaxed);
+    if (static_cast<double>(used - size) > _garbageRatio * static_cast<double>(used))
+        compactRows();
+}
+
+void SharedSet::compactRows() {
+    size_t used = _header->used.load(std::memory_order_relaxed);
+    if (_header->size.load(std::memory_order_relaxed) == used)
+        return;
+    uint64_t sequence = _header->sequence.load(std::memory_order_relaxed);
+    _header->sequence.store(sequence + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    size_t dst = 0;
+    for (size_t slot = 0; slot < used; slot++){
+        if (isDead(slot))
+            continue;
+        if (slot != dst){
+            std::memmove(_rows + dst * _dim, _rows + slot * _dim, _dim * sizeof(double));
+            _hashes[dst] = _hashes[slot];
+        }
+        dst++;
+    }
+    for (size_t word = 0; word < bitmapWords(used); word++)
+        _dead[word].store(0, std::memory_order_relaxed);
+    _header->used.store(dst, std::memory_order_relaxed);
+    _header->version.fetch_add(1, std::memory_order_relaxed);
+    _header->sequence.store(sequence + 2, std::memory_order_release);
+}
+
+RC SharedSet::summarize(SetSummary& summary) const {
+    if (!summary.reset(_dim)){
+        SendInfo(ISet::getLogger(), RC::ALLOCATION_ERROR);
+        return RC::ALLOCATION_ERROR;
+    }
+    return readConsistent([&]() {
+        summary.reset(_dim);
+        size_t used = _header->used.load(std::memory_order_acquire);
+        for (size_t slot = findAlive(0, 0, used); slot < used; slot = findAlive(slot + 1, 0, used))
+            summary.add(_rows + slot * _dim);
+        return summary.getCount() == 0 ? RC::SOURCE_SET_EMPTY : RC::SUCCESS;
+    });
+}
+
+RC SharedSet::getNext(double *const &data, size_t &index, size_t &pos, size_t indexInc) const {
+    if (data == nullptr){
+        SendInfo(ISet::getLogger(), RC::NULLPTR_ERROR);
+        return RC::NULLPTR_ERROR;
+    }
+    if (indexInc == 0){
+        SendInfo(ISet::getLogger(), RC::INVALID_ARGUMENT);
+        return RC::INVALID_ARGUMENT;
+    }
+    std::vector<double> row(_dim);
+    size_t nextIndex = index, nextPos = pos;
+    RC rc = readConsistent([&]() {
+        size_t used = _header->used.load(std::memory_order_acquire);
+        if (_header->size.load(std::memory_order_acquire) == 0)
+            return RC::SOURCE_SET_EMPTY;
+        size_t slot = locate(index, pos, used);
+        // vector after a removed one is already its first step
+        if (slot < used && _hashes[slot] == index && !isDead(slot))
+            slot++;
+        slot = findAlive(slot, indexInc - 1, used);
+        if (slot == used)
+            return RC::INDEX_OUT_OF_BOUND;
+        std::memcpy(row.data(), _rows + slot * _dim, _dim * sizeof(double));
+        nextIndex = _hashes[slot];
+        nextPos = slot;
+        return RC::SUCCESS;
+    });
+    if (rc == RC::INDEX_OUT_OF_BOUND)
+        SendInfo(ISet::getLogger(), rc);
+    if (rc != RC::SUCCESS)
+        return rc;
+    std::memcpy(data, row.data(), _dim * sizeof(double));
+    index = nextIndex;
+    pos = nextPos;
+    return RC::SUCCESS;
+}
+
+RC SharedSet::getPrevious(double *const &data, size_t &index, size_t &pos, size_t indexInc) const {
+    if (data == nullptr){
+        SendInfo(ISet::getLogger(), RC::NULLPTR_ERROR);
+        return RC::NULLPTR_ERROR;
+    }
+    if (indexInc == 0){
+        SendInfo(ISet::getLogger(), RC::INVALID_ARGUMENT);
+        return RC::INVALID_ARGUMENT;
+    }
+    std::vector<double> row(_dim);
+    size_t previousIndex = index, previousPos = pos;
+    RC rc = readConsistent([&]() {
+        size_t used = _header->used.load(std::memory_order_acquire);
+        if (_header->size.load(std::memory_order_acquire) == 0)
+            return RC::SOURCE_SET_EMPTY;
+        // all alive vectors before the located slot precede the vector under iterator
+        size_t slot = findAliveBefore(locate(index, pos, used), indexInc, used);
+        if (slot == used)
+            return RC::INDEX_OUT_OF_BOUND;
+        std::memcpy(row.data(), _rows + slot * _dim, _dim * sizeof(double));
+        previousIndex = _hashes[slot];
+        previousPos = slot;
+        return RC::SUCCESS;
+    });
+    if (rc == RC::INDEX_OUT_OF_BOUND)
+        SendInfo(ISet::getLogger(), rc);
+    if (rc != RC::SUCCESS)
+        return rc;
+    std::memcpy(data, row.data(), _dim * sizeof(double));
+    index = previousIndex;
+    pos = previousPos;
+    return RC::SUCCESS;
+}
+
+RC SharedSet::getBegin(double *const &data, size_t &index, size_t &pos) const {
+    if (data == nullptr){
+        SendInfo(ISet::getLogger(), RC::NULLPTR_ERROR);
+        return RC::NULLPTR_ERROR;
+    }
+    std::vector<double> row(_dim);
+    RC rc = readConsistent([&]() {
+        size_t used = _header->used.load(std::memory_order_acquire);
+        size_t slot = findAlive(0, 0, used);
+        if (slot == used)
+            return RC::SOURCE_SET_EMPTY;
+        std::memcpy(row.data(), _rows + slot * _dim, _dim * sizeof(double));
+        index = _hashes[slot];
+        pos = slot;
+        return RC::SUCCESS;
+    });
+    if (rc == RC::SUCCESS)
+        std::memcpy(data, row.data(), _dim * sizeof(double));
+    return rc;
+}
+
+RC SharedSet::getEnd(double *const &data, size_t &index, size_t &pos) const {
+    if (data == nullptr){
+        SendInfo(ISet::getLogger(), RC::NULLPTR_ERROR);
+        return RC::NULLPTR_ERROR;
+    }
+    std::vector<double> row(_dim);
+    RC rc = readConsistent([&]() {
+        size_t used = _header->used.load(std::memory_order_acquire);
+        size_t slot = findAliveBefore(used, 1, used);
+        if (slot == used)
+            return RC::SOURCE_SET_EMPTY;
+        std::memcpy(row.data(), _rows + slot * _dim, _dim * sizeof(double));
+        index = _hashes[slot];
+        pos = slot;
+        return RC::SUCCESS;
+    });
+    if (rc == RC::SUCCESS)
+        std::memcpy(data, row.data(), _dim * sizeof(double));
+    return rc;
+}
+
+ISet* SharedSet::clone() const {
+    std::vector<double> rows;
+    RC rc = readConsistent([&]() {
+        size_t used = _header->used.load(std::memory_order_acquire);
+        try {
+            rows.clear();
+            rows.reserve(_header->size.load(std::memory_order_acquire) * _dim);
+            for (size_t slot = findAlive(0, 0, used); slot < used; slot = findAlive(slot + 1, 0, used))
+                rows.insert(rows.end(), _rows + slot * _dim, _rows + (slot + 1) * _dim);
+        }
+        catch (std::bad_alloc const&){
+            return RC::ALLOCATION_ERROR;
+        }
+        return RC::SUCCESS;
+    });
+    if (rc != RC::SUCCESS){
+        SendInfo(ISet::getLogger(), rc);
+        return nullptr;
+    }
+    ISet* set = ISet::createSet();
+    if (set == nullptr)
+        return nullptr;
+    // vectors of the set are distinct, so none of them is merged with another one with tol 0
+    size_t inserted = 0;
+    rc = set->insertBatch(rows.data(), rows.size() / _dim, _dim, IVector::NORM::CHEBYSHEV, 0., inserted);
+    if (rc != RC::SUCCESS){
+        delete set;
+        return nullptr;
+    }
+    return set;
+}
+
+ISet const* SharedSet::snapshot() const {
+    return clone();
+}
+
+size_t SharedSet::getDim() const {
+    return _dim;
+}
+
+size_t SharedSet::getSize() const {
+    return _header->size.load(std::memory_order_acquire);
+}
+
+RC SharedSet::getCopy(size_t index, IVector *& val) const {
+    std::vector<double> row;
+    RC rc = copyRow(index, row);
+    if (rc != RC::SUCCESS)
+        return rc;
+    val = IVector::createVector(_dim, row.data());
+    if (val == nullptr){
+        SendInfo(ISet::getLogger(), RC::NULLPTR_ERROR);
+        return RC::NULLPTR_ERROR;
+    }
+    return RC::SUCCESS;
+}
+
+RC SharedSet::findFirstAndCopy(IVector const * const& pat, IVector::NORM n, double tol, IVector *& val) const {
+    std::vector<double> row;
+    RC rc = findCopy(pat, n, tol, row);
+    if (rc != RC::SUCCESS)
+        return rc;
+    val = IVector::createVector(_dim, row.data());
+    if (val == nullptr){
+        SendInfo(ISet::getLogger(), RC::NULLPTR_ERROR);
+        return RC::NULLPTR_ERROR;
+    }
+    return RC::SUCCESS;
+}
+
+RC SharedSet::getCoords(size_t index, IVector * const& val) const {
+    if (val == nullptr){
+        SendInfo(ISet::getLogger(), RC::NULLPTR_ERROR);
+        return RC::NULLPTR_ERROR;
+    }
+    std::vector<double> row;
+    RC rc = copyRow(index, row);
+    if (rc != RC::SUCCESS)
+        return rc;
+    return val->setData(_dim, row.data());
+}
+
+RC SharedSet::findFirstAndCopyCoords(IVector const * const& pat, IVector::NORM n, double tol, IVector * const& val) const {
+    if (val == nullptr){
+        SendInfo(ISet::getLogger(), RC::NULLPTR_ERROR);
+        return RC::NULLPTR_ERROR;
+    }
+    std::vector<double> row;
+    RC rc = findCopy(pat, n, tol, row);
+    if (rc != RC::SUCCESS)
+        return rc;
+    return val->setData(_dim, row.data());
+}
+
+RC SharedSet::findFirst(IVector const * const& pat, IVector::NORM n, double tol) const {
+    RC rc = checkPattern(pat, tol);
+    if (rc != RC::SUCCESS)
+        return rc;
+    double const* data = pat->getData();
+    return readConsistent([&]() {
+        size_t used = _header->used.load(std::memory_order_acquire);
+        return findSlot(data, n, tol, used) == used ? RC::VECTOR_NOT_FOUND : RC::SUCCESS;
+    });
+}
+
+RC SharedSet::findFirstMany(double const* patterns, size_t count, size_t dim, IVector::NORM n, double tol, size_t * const& indices) const {
+    if (count == 0)
+        return RC::SUCCESS;
+    if (patterns == nullptr || indices == nullptr){
+        SendInfo(ISet::getLogger(), RC::NULLPTR_ERROR);
+        return RC::NULLPTR_ERROR;
+    }
+    if (std::isnan(tol) || tol < 0.){
+        SendInfo(ISet::getLogger(), RC::INVALID_ARGUMENT);
+        return RC::INVALID_ARGUMENT;
+    }
+    if (dim != _dim){
+        SendInfo(ISet::getLogger(), RC::MISMATCHING_DIMENSIONS);
+        return RC::MISMATCHING_DIMENSIONS;
+    }
+    std::vector<size_t> before;
+    try {
+        before.resize(bitmapWords(_capacity));
+    }
+    catch (std::bad_alloc const&){
+        SendInfo(ISet::getLogger(), RC::ALLOCATION_ERROR);
+        return RC::ALLOCATION_ERROR;
+    }
+    ScanPool& pool = ScanPool::instance();
+    size_t parts = std::max(size_t(1), std::min(pool.getThreadCount(), count / batchPartRows));
+    size_t partRows = (count + parts - 1) / parts;
+    return readConsistent([&]() {
+        size_t used = _header->used.load(std::memory_order_acquire);
+        size_t size = _header->size.load(std::memory_order_acquire);
+        // slots are written to indices first and turned into indices once all rows are found
+        pool.run(parts, [&](size_t part){
+            for (size_t k = part * partRows; k < std::min(count, (part + 1) * partRows); k++)
+                indices[k] = findSlot(patterns + k * _dim, n, tol, used);
+        });
+        for (size_t word = 1; word < bitmapWords(used); word++)
+            before[word] = before[word - 1] + popCount(~_dead[word - 1].load(std::memory_order_acquire));
+        for (size_t k = 0; k < count; k++){
+            size_t slot = indices[k];
+            if (slot == used)
+                indices[k] = size;
+            else if (size != used)
+                indices[k] = before[slot / wordBits] + popCount(~_dead[slot / wordBits].load(std::memory_order_acquire) & ((uint64_t(1) << (slot % wordBits)) - 1));
+        }
+        return RC::SUCCESS;
+    });
+}
+
+RC SharedSet::insert(IVector const * const& val, IVector::NORM n, double tol) {
+    RC rc = checkVector(val);
+    if (rc != RC::SUCCESS)
+        return rc;
+    size_t inserted = 0;
+    rc = insertBatch(val->getData(), 1, _dim, n, tol, inserted);
+    if (rc == RC::SUCCESS && inserted == 0)
+        return RC::VECTOR_ALREADY_EXIST;
+    return rc;
+}
+
+RC SharedSet::insertBatch(double const* rows, size_t count, size_t dim, IVector::NORM n, double tol, size_t& inserted) {
+    inserted = 0;
+    RC rc = checkWritable();
+    if (rc != RC::SUCCESS)
+        return rc;
+    if (rows == nullptr && count != 0){
+        SendInfo(ISet::getLogger(), RC::NULLPTR_ERROR);
+        return RC::NULLPTR_ERROR;
+    }
+    if (dim != _dim){
+        SendInfo(ISet::getLogger(), RC::MISMATCHING_DIMENSIONS);
+        return RC::MISMATCHING_DIMENSIONS;
+    }
+    if (std::isnan(tol) || tol < 0.){
+        SendInfo(ISet::getLogger(), RC::INVALID_ARGUMENT);
+        return RC::INVALID_ARGUMENT;
+    }
+    for (size_t k = 0; k < count; k++){
+        double const* row = rows + k * _dim;
+        // earlier rows of the batch are already in the set
+        size_t used = _header->used.load(std::memory_order_relaxed);
+        if (findSlot(row, n, tol, used) != used)
+            continue;
+        rc = append(row);
+        if (rc != RC::SUCCESS)
+            return rc;
+        inserted++;
+    }
+    return RC::SUCCESS;
+}
+
+RC SharedSet::remove(size_t index) {
+    RC rc = checkWritable();
+    if (rc != RC::SUCCESS)
+        return rc;
+    size_t used = _header->used.load(std::memory_order_relaxed);
+    size_t slot = findAlive(0, index, used);
+    if (slot == used){
+        SendInfo(ISet::getLogger(), RC::INDEX_OUT_OF_BOUND);
+        return RC::INDEX_OUT_OF_BOUND;
+    }
+    removeSlot(slot);
+    compactIfNeeded();
+    return RC::SUCCESS;
+}
+
+RC SharedSet::remove(IVector const * const& pat, IVector::NORM n, double tol) {
+    RC rc = checkWritable();
+    if (rc == RC::SUCCESS)
+        rc = checkPattern(pat, tol);
+    if (rc != RC::SUCCESS)
+        return rc;
+    size_t used = _header->used.load(std::memory_order_relaxed);
+    size_t slot = findSlot(pat->getData(), n, tol, used);
+    if (slot == used)
+        return RC::VECTOR_NOT_FOUND;
+    removeSlot(slot);
+    compactIfNeeded();
+    return RC::SUCCESS;
+}
+
+RC SharedSet::removeIf(std::function<bool(double const*, size_t)> const& pred) {
+    RC rc = checkWritable();
+    if (rc != RC::SUCCESS)
+        return rc;
+    if (!pred){
+        SendInfo(ISet::getLogger(), RC::NULLPTR_ERROR);
+        return RC::NULLPTR_ERROR;
+    }
+    size_t used = _header->used.load(std::memory_order_relaxed);
+    for (size_t slot = findAlive(0, 0, used); slot < used; slot = findAlive(slot + 1, 0, used))
+        if (pred(_rows + slot * _dim, _dim))
+            removeSlot(slot);
+    compactIfNeeded();
+    return RC::SUCCESS;
+}
+
+RC SharedSet::queryBox(ICompact const* const& box, std::function<void(double const*, size_t)> const& callback) const {
+    if (box == nullptr || !callback){
+        SendInfo(ISet::getLogger(), RC::NULLPTR_ERROR);
+        return RC::NULLPTR_ERROR;
+    }
+    if (box->getDim() != _dim){
+        SendInfo(ISet::getLogger(), RC::MISMATCHING_DIMENSIONS);
+        return RC::MISMATCHING_DIMENSIONS;
+    }
+    IVector* lowerVec = nullptr;
+    IVector* upperVec = nullptr;
+    RC rc = box->getLeftBoundary(lowerVec);
+    if (rc == RC::SUCCESS)
+        rc = box->getRightBoundary(upperVec);
+    if (rc != RC::SUCCESS){
+        delete lowerVec;
+        SendInfo(ISet::getLogger(), rc);
+        return rc;
+    }
+    double const* lower = lowerVec->getData();
+    double const* upper = upperVec->getData();
+    // callback sees only rows of a consistent read, so they are collected first
+    std::vector<double> found;
+    rc = readConsistent([&]() {
+        size_t used = _header->used.load(std::memory_order_acquire);
+        try {
+            found.clear();
+            for (size_t slot = findAlive(0, 0, used); slot < used; slot = findAlive(slot + 1, 0, used)){
+                double const* row = _rows + slot * _dim;
+                size_t i = 0;
+                for (; i < _dim && lower[i] <= row[i] && row[i] <= upper[i]; i++);
+                if (i == _dim)
+                    found.insert(found.end(), row, row + _dim);
+            }
+        }
+        catch (std::bad_alloc const&){
+            return RC::ALLOCATION_ERROR;
+        }
+        return RC::SUCCESS;
+    });
+    delete lowerVec;
+    delete upperVec;
+    if (rc != RC::SUCCESS){
+        SendInfo(ISet::getLogger(), rc);
+        return rc;
+    }
+    for (size_t offset = 0; offset < found.size(); offset += _dim)
+        callback(found.data() + offset, _dim);
+    return RC::SUCCESS;
+}
+
+RC SharedSet::setGarbageRatio(double ratio) {
+    if (std::isnan(ratio) || ratio < 0. || ratio > 1.){
+        SendInfo(ISet::getLogger(), RC::INVALID_ARGUMENT);
+        return RC::INVALID_ARGUMENT;
+    }
+    RC rc = checkWritable();
+    if (rc != RC::SUCCESS)
+        return rc;
+    _garbageRatio = ratio;
+    compactIfNeeded();
+    return RC::SUCCESS;
+}
+
+RC SharedSet::compact() {
+    RC rc = checkWritable();
+    if (rc != RC::SUCCESS)
+        return rc;
+    compactRows();
+    return RC::SUCCESS;
+}
+
+RC SharedSet::getBounds(IVector*& lower, IVector*& upper) const {
+    SetSummary summary;
+    RC rc = summarize(summary);
+    if (rc != RC::SUCCESS)
+        return rc;
+    IVector* lowerVec = IVector::createVector(_dim, summary.getLower());
+    IVector* upperVec = IVector::createVector(_dim, summary.getUpper());
+    if (lowerVec == nullptr || upperVec == nullptr){
+        delete lowerVec;
+        delete upperVec;
+        SendInfo(ISet::getLogger(), RC::ALLOCATION_ERROR);
+        return RC::ALLOCATION_ERROR;
+    }
+    lower = lowerVec;
+    upper = upperVec;
+    return RC::SUCCESS;
+}
+
+RC SharedSet::getCentroid(IVector*& centroid) const {
+    SetSummary summary;
+    RC rc = summarize(summary);
+    if (rc != RC::SUCCESS)
+        return rc;
+    IVector* mean = IVector::createVector(_dim, summary.getMean());
+    if (mean == nullptr){
+        SendInfo(ISet::getLogger(), RC::ALLOCATION_ERROR);
+        return RC::ALLOCATION_ERROR;
+    }
+    centroid = mean;
+    return RC::SUCCESS;
+}
+
+RC SharedSet::getVariance(IVector*& variance) const {
+    SetSummary summary;
+    RC rc = summarize(summary);
+    if (rc != RC::SUCCESS)
+        return rc;
+    std::vector<double> coords(_dim);
+    summary.getVariance(coords.data());
+    IVector* spread = IVector::createVector(_dim, coords.data());
+    if (spread == nullptr){
+        SendInfo(ISet::getLogger(), RC::ALLOCATION_ERROR);
+        return RC::ALLOCATION_ERROR;
+    }
+    variance = spread;
+    return RC::SUCCESS;
+}
+
+RC SharedSet::getRawView(double const*& rows, size_t& count, size_t& dim, uint64_t& version) const {
+    return readConsistent([&]() {
+        size_t used = _header->used.load(std::memory_order_acquire);
+        if (_header->size.load(std::memory_order_acquire) != used)
+            return RC::OPERATION_NOT_SUPPORTED;
+        rows = _rows;
+        count = used;
+        dim = _dim;
+        version = _header->version.load(std::memory_order_acquire);
+        return RC::SUCCESS;
+    });
+}
+
+uint64_t SharedSet::getVersion() const {
+    return _header->version.load(std::memory_order_acquire);
+}
+
+RC SharedSet::sync() {
+    return RC::SUCCESS;
+}
+
+ISet::IIterator* SharedSet::getIterator(size_t index) const {
+    std::vector<double> row(_dim);
+    size_t hash = 0, pos = 0;
+    RC rc = readConsistent([&]() {
+        size_t used = _header->used.load(std::memory_order_acquire);
+        size_t slot = findAlive(0, index, used);
+        if (slot == used)
+            return RC::INDEX_OUT_OF_BOUND;
+        std::memcpy(row.data(), _rows + slot * _dim, _dim * sizeof(double));
+        hash = _hashes[slot];
+        pos = slot;
+        return RC::SUCCESS;
+    });
+    if (rc != RC::SUCCESS){
+        SendInfo(ISet::getLogger(), rc);
+        return nullptr;
+    }
+    return SetIterator::createIterator(_dim, row.data(), hash, pos, _setCB);
+}
+
+ISet::IIterator* SharedSet::getBegin() const {
+    if (getSize() == 0){
+        SendInfo(ISet::getLogger(), RC::SOURCE_SET_EMPTY);
+        return nullptr;
+    }
+    return getIterator(0);
+}
+
+ISet::IIterator* SharedSet::getEnd() const {
+    std::vector<double> row(_dim);
+    size_t hash = 0, pos = 0;
+    if (getEnd(row.data(), hash, pos) != RC::SUCCESS){
+        SendInfo(ISet::getLogger(), RC::SOURCE_SET_EMPTY);
+        return nullptr;
+    }
+    return SetIterator::createIterator(_dim, row.data(), hash, pos, _setCB);
+}
+
+ISet::IChunkIterator* SharedSet::getChunkIterator(size_t chunkRows) const {
+    if (chunkRows == 0){
+        SendInfo(ISet::getLogger(), RC::INVALID_ARGUMENT);
+        return nullptr;
+    }
+    if (getSize() == 0){
+        SendInfo(ISet::getLogger(), RC::SOURCE_SET_EMPTY);
+        return nullptr;
+    }
+    chunkRows = std::min(chunkRows, _capacity);
+    std::shared_ptr<std::vector<double>> rowBuffer;
+    std::shared_ptr<std::vector<size_t>> hashBuffer;
+    try {
+        rowBuffer = std::make_shared<std::vector<double>>(chunkRows * _dim);
+        hashBuffer = std::make_shared<std::vector<size_t>>(chunkRows);
+    }
+    catch (std::bad_alloc const&){
+        SendInfo(ISet::getLogger(), RC::ALLOCATION_ERROR);
+        return nullptr;
+    }
+    // control block keeps the flag telling that the set is alive
+    std::shared_ptr<ISetControlBlock> block = _setCB;
+    bool const* setIsValid = _setIsValid;
+    SharedSet const* set = this;
+    uint64_t version = getVersion();
+    size_t slot = 0;
+    return ChunkIterator::createIterator(_dim, [block, setIsValid, set, version, rowBuffer, hashBuffer, slot, chunkRows](double const*& rows, size_t const*& hashes, size_t& count) mutable {
+        if (!setIsValid[0])
+            return RC::SOURCE_SET_DESTROYED;
+        rows = rowBuffer->data();
+        hashes = hashBuffer->data();
+        return set->copyChunk(slot, set->_capacity, chunkRows, version, rowBuffer->data(), hashBuffer->data(), count);
+    });
+}
+
+RC SharedSet::forEachChunk(size_t chunkRows, std::function<void(double const*, size_t const*, size_t, size_t)> const& callback) const {
+    if (!callback){
+        SendInfo(ISet::getLogger(), RC::NULLPTR_ERROR);
+        return RC::NULLPTR_ERROR;
+    }
+    if (chunkRows == 0){
+        SendInfo(ISet::getLogger(), RC::INVALID_ARGUMENT);
+        return RC::INVALID_ARGUMENT;
+    }
+    chunkRows = std::min(chunkRows, _capacity);
+    uint64_t version = getVersion();
+    size_t used = _header->used.load(std::memory_order_acquire);
+    if (used == 0)
+        return RC::SUCCESS;
+    ScanPool& pool = ScanPool::instance();
+    size_t parts = std::max(size_t(1), std::min(pool.getThreadCount(), used / chunkRows));
+    size_t partSlots = (used + parts - 1) / parts;
+    std::atomic<bool> changed(false), failed(false);
+    pool.run(parts, [&](size_t part){
+        std::vector<double> rows;
+        std::vector<size_t> hashes;
+        try {
+            rows.resize(chunkRows * _dim);
+            hashes.resize(chunkRows);
+        }
+        catch (std::bad_alloc const&){
+            failed.store(true);
+            return;
+        }
+        size_t last = std::min(used, (part + 1) * partSlots);
+        size_t count = 0;
+        for (size_t slot = part * partSlots; slot < last;){
+            RC rc = copyChunk(slot, last, chunkRows, version, rows.data(), hashes.data(), count);
+            if (rc != RC::SUCCESS){
+                changed.store(true);
+                return;
+            }
+            if (count == 0)
+                break;
+            callback(rows.data(), hashes.data(), count, _dim);
+        }
+    });
+    RC rc = failed.load() ? RC::ALLOCATION_ERROR : changed.load() ? RC::SOURCE_SET_CHANGED : RC::SUCCESS;
+    if (rc != RC::SUCCESS)
+        SendInfo(ISet::getLogger(), rc);
+    return rc;
+}
+#endif
+
+LIB_EXPORT ISet* ISet::createSharedSet(char const* const& name, size_t dim, size_t capacity) {
+    if (name == nullptr){
+        SendInfo(ISet::getLogger(), RC::NULLPTR_ERROR);
+        return nullptr;
+    }
+    if (dim == 0){
+        SendInfo(ISet::getLogger(), RC::INVALID_ARGUMENT);
+        return nullptr;
+    }
+#if defined(SET_SHARED_MEMORY)
+    return SharedSet::create(name, dim, capacity);
+#else
+    SendInfo(ISet::getLogger(), RC::OPERATION_NOT_SUPPORTED);
+    return nullptr;
+#endif
+}
+
+LIB_EXPORT ISet* ISet::openSharedSet(char const* const& name) {
+    if (name == nullptr){
+        SendInfo(ISet::getLogger(), RC::NULLPTR_ERROR);
+        return nullptr;
+    }
+#if defined(SET_SHARED_MEMORY)
+    return SharedSet::open(name);
+#else
+    SendInfo(ISet::getLogger(), RC::OPERATION_NOT_SUPPORTED);
+    return nullptr;
+#endif
+}
@@ -9,6 +9,10 @@ void testIVector();
 
 void testISet();
 
+void testConcurrentSet();
+
+size_t failedChecks();
+
 namespace comp{
     void testICompact();
 }
@@ -49,9 +53,11 @@ int main()
     b.boo();
     //testIVector();
 
-    //testISet();
+    testISet();
+
+    testConcurrentSet();
 
     //comp::testICompact();
 
-    return 0;
+    return failedChecks() == 0 ? 0 : 1;
 }
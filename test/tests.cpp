@@ -1,10 +1,21 @@
 //#include <windows.h>
 #include <iostream>
 #include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <algorithm>
 #include <vector>
+#include <thread>
+#include <atomic>
+#include <utility>
 #include "../include/IVector.h"
 #include "../include/ILogger.h"
 #include "../include/ISet.h"
+#include "../include/ISetRawView.h"
+#include "../include/ISetCapacity.h"
+#include "../include/ISetLsh.h"
+#include "../include/ISetJournal.h"
+#include "../include/ISetAllocator.h"
 #include "../include/ICompact.h"
 #include "../include/IBroker.h"
 #include "../include/IProblem.h"
@@ -88,136 +99,477 @@ void testIVector(){
     delete logger;
 }
 
-void printSet(ISet const* const& set){
-    if (set == nullptr){
-        std::cout << "set == nullptr" << std::endl;
-        return;
-    }
-    auto it = set->getEnd();
-    if (it == nullptr) {
-        std::cout << "it == nullptr" << std::endl;
+size_t failures = 0;
+
+/*
+ * Counts and reports a failed expectation, main returns non-zero if any check failed
+ */
+void check(bool condition, char const* const& what){
+    if (condition)
         return;
+    failures++;
+    std::cout << "FAILED: " << what << std::endl;
+}
+
+size_t failedChecks(){
+    return failures;
+}
+
+bool sameRow(IVector const* const& vec, double const* const& row){
+    return vec != nullptr && std::memcmp(vec->getData(), row, vec->getDim() * sizeof(double)) == 0;
+}
+
+/*
+ * Rows of set in the order of its indices, read through getCopy so sets without a raw view are read as well
+ */
+std::vector<double> rowsOf(ISet const* const& set){
+    std::vector<double> rows;
+    for (size_t index = 0; index < set->getSize(); index++){
+        IVector* vec = nullptr;
+        if (set->getCopy(index, vec) != RC::SUCCESS){
+            check(false, "getCopy of every index succeeds");
+            return rows;
+        }
+        rows.insert(rows.end(), vec->getData(), vec->getData() + vec->getDim());
+        delete vec;
     }
-    std::cout << "set:" << std::endl;
-    while (it->isValid()){
-           IVector* vec = nullptr;
-           it->getVectorCopy(vec);
-           printVector(vec);
-           it->previous();
-           delete vec;
+    return rows;
+}
+
+ISet* createSetOf(std::vector<double const*> const& rows){
+    auto set = ISet::createSet();
+    for (auto const& row : rows){
+        auto vec = IVector::createVector(dim, row);
+        check(set->insert(vec, IVector::NORM::SECOND, epsilon) == RC::SUCCESS, "insert of a new vector succeeds");
+        delete vec;
     }
-    delete it;
+    return set;
 }
 
+bool contains(ISet const* const& set, double const* const& row){
+    auto vec = IVector::createVector(dim, row);
+    bool found = set->findFirst(vec, IVector::NORM::SECOND, epsilon) == RC::SUCCESS;
+    delete vec;
+    return found;
+}
 
-void testInsert(ISet* const& set, size_t _dim, double const* const& data){
-    auto vec = IVector::createVector(_dim, data);
-    std::cout << "insert ";
-    printVector(vec);
-    RC rc = set->insert(vec, IVector::NORM::SECOND, epsilon);
-    std::cout << "RC\t" << static_cast<int>(rc) << std::endl;
+void testInsert(ISet* const& set){
+    size_t size = set->getSize();
+    auto vec = IVector::createVector(dim, vectors.back());
+    check(set->insert(vec, IVector::NORM::SECOND, epsilon) == RC::VECTOR_ALREADY_EXIST, "insert of a present vector is reported");
+    check(set->getSize() == size, "insert of a present vector keeps size");
+    auto wrongDim = IVector::createVector(4, big);
+    check(set->insert(wrongDim, IVector::NORM::SECOND, epsilon) == RC::MISMATCHING_DIMENSIONS, "insert of another dimension is rejected");
+    delete wrongDim;
     delete vec;
 }
 
 void testIntersection(ISet const* set1, ISet const* set2){
-
-    std::cout << "intersection:" << std::endl;
     auto intersection = ISet::makeIntersection(set1, set2, IVector::NORM::SECOND, epsilon);
-    printSet(intersection);
+    check(intersection != nullptr && intersection->getSize() == 2 && contains(intersection, e2) && contains(intersection, e3),
+          "intersection holds e2 and e3");
     delete intersection;
 }
 
 void testUnion(ISet const* set1, ISet const* set2){
-    std::cout << "union: " << std::endl;
     auto setUnion = ISet::makeUnion(set1, set2, IVector::NORM::SECOND, epsilon);
-    printSet(setUnion);
+    check(setUnion != nullptr && setUnion->getSize() == vectors.size(), "union holds every vector once");
+    check(setUnion != nullptr && ISet::subSet(setUnion, set1, IVector::NORM::SECOND, epsilon) &&
+          ISet::subSet(setUnion, set2, IVector::NORM::SECOND, epsilon), "union contains both operands");
     delete setUnion;
 }
 
 void testSub(ISet const* set1, ISet const* set2){
-    std::cout << "sub: " << std::endl;
     auto setSub = ISet::sub(set1, set2, IVector::NORM::SECOND, epsilon);
-    printSet(setSub);
+    check(setSub != nullptr && setSub->getSize() == 2 && contains(setSub, zero) && contains(setSub, e1), "sub holds zero and e1");
     delete setSub;
 }
 
 void testSymSub(ISet const* set1, ISet const* set2){
-    std::cout << "symsub: " << std::endl;
     auto symSub = ISet::symSub(set1, set2, IVector::NORM::SECOND, epsilon);
-    printSet(symSub);
+    auto sub1 = ISet::sub(set1, set2, IVector::NORM::SECOND, epsilon);
+    auto sub2 = ISet::sub(set2, set1, IVector::NORM::SECOND, epsilon);
+    auto expected = ISet::makeUnion(sub1, sub2, IVector::NORM::SECOND, epsilon);
+    check(symSub != nullptr && symSub->getSize() == vectors.size() - 2, "symSub drops the common vectors");
+    check(ISet::equals(symSub, expected, IVector::NORM::SECOND, epsilon), "symSub equals the union of both subs");
+    delete expected;
+    delete sub2;
+    delete sub1;
     delete symSub;
+
+    /*
+     * Pairs within tol on both sides of a line of the grid with step tol must cancel, a pair just farther than tol
+     * must not, for every norm and in both orders of the operands
+     */
+    double const tol = 0.1;
+    double const a1[] = {0.0999, 0, 0}, b1[] = {0.1001, 0, 0},
+                 a2[] = {-0.02, 0.5, 0}, b2[] = {0.02, 0.5, 0},
+                 a3[] = {0.3, 0.3, 0}, b3[] = {0.3, 0.3, 0.15};
+    auto near1 = createSetOf({a1, a2, a3, v1});
+    auto near2 = createSetOf({b1, b2, b3, v2});
+    for (IVector::NORM n : {IVector::NORM::FIRST, IVector::NORM::SECOND, IVector::NORM::CHEBYSHEV}){
+        for (auto const& ops : {std::make_pair(near1, near2), std::make_pair(near2, near1)}){
+            auto result = ISet::symSub(ops.first, ops.second, n, tol);
+            auto left = ISet::sub(ops.first, ops.second, n, tol);
+            auto right = ISet::sub(ops.second, ops.first, n, tol);
+            auto both = ISet::makeUnion(left, right, n, tol);
+            check(result != nullptr && result->getSize() == 4 && contains(result, a3) && contains(result, b3) &&
+                  contains(result, v1) && contains(result, v2), "symSub cancels vectors within tol across a cell border");
+            check(ISet::equals(result, both, n, tol), "symSub equals the union of both subs near cell borders");
+            delete both;
+            delete right;
+            delete left;
+            delete result;
+        }
+    }
+    delete near2;
+    delete near1;
 }
 
 void testEquals(ISet const* set1, ISet const* set2){
-    std::cout << "equals" << std::endl;
-    printSet(set1);
-    printSet(set2);
-    std::cout << ISet::equals(set1, set2, IVector::NORM::SECOND, epsilon);
+    check(!ISet::equals(set1, set2, IVector::NORM::SECOND, epsilon), "different sets are not equal");
+    auto copy = createSetOf({e3, e2, e1, zero});
+    check(ISet::equals(set1, copy, IVector::NORM::SECOND, epsilon), "sets with the same vectors in another order are equal");
+    delete copy;
+
+    // vectors closer than tol are kept apart by insertion with a smaller tolerance
+    double const near[] = {0.1, 0, 0}, moved[] = {epsilon / 10, 0, 0};
+    auto duplicates = createSetOf({zero, near});
+    auto distinct = createSetOf({zero, v5});
+    check(!ISet::equals(duplicates, distinct, IVector::NORM::SECOND, 0.2), "equal sizes with duplicates within tol do not make sets equal");
+    check(!ISet::equals(distinct, duplicates, IVector::NORM::SECOND, 0.2), "equality of sets does not depend on the order of operands");
+    auto shifted = createSetOf({moved, near});
+    check(ISet::equals(duplicates, shifted, IVector::NORM::SECOND, epsilon), "sets differing within tol are equal");
+    delete shifted;
+    delete distinct;
+    delete duplicates;
 }
 
-void testSubSet(ISet const* set1, ISet const * set2){
-    std::cout << "subset" << std::endl;
-    printSet(set1);
-    printSet(set2);
-    std::cout << ISet::subSet(set1, set2, IVector::NORM::SECOND, epsilon);
+void testSubSet(ISet const* set1, ISet const* set2){
+    auto intersection = ISet::makeIntersection(set1, set2, IVector::NORM::SECOND, epsilon);
+    check(ISet::subSet(set1, set1, IVector::NORM::SECOND, epsilon), "set is a subset of itself");
+    check(ISet::subSet(set2, intersection, IVector::NORM::SECOND, epsilon), "intersection is a subset of the operand");
+    check(!ISet::subSet(set1, set2, IVector::NORM::SECOND, epsilon), "set2 is not a subset of set1");
+    delete intersection;
 }
 
-void testIterators(ISet const* const& set, ISet::IIterator* (ISet::*_getBegin)() const, RC (ISet::IIterator::*_next)(size_t)){
-    if (set == nullptr){
-        std::cout << "set == nullptr" << std::endl;
+void testIterators(ISet const* const& set){
+    std::vector<double> rows = rowsOf(set);
+    size_t visited = 0;
+    auto it = set->getBegin();
+    for (; it != nullptr && it->isValid(); it->next(), visited++){
+        IVector* vec = nullptr;
+        it->getVectorCopy(vec);
+        check(visited < set->getSize() && sameRow(vec, rows.data() + visited * dim), "forward iterator visits vectors by index");
+        delete vec;
+    }
+    delete it;
+    check(visited == set->getSize(), "forward iterator visits every vector");
+    visited = 0;
+    it = set->getEnd();
+    for (; it != nullptr && it->isValid(); it->previous(), visited++){
+        IVector* vec = nullptr;
+        it->getVectorCopy(vec);
+        check(visited < set->getSize() && sameRow(vec, rows.data() + (set->getSize() - 1 - visited) * dim),
+              "backward iterator visits vectors by index");
+        delete vec;
+    }
+    delete it;
+    check(visited == set->getSize(), "backward iterator visits every vector");
+}
+
+void testSpanIterator(ISet const* const& set){
+    std::vector<double> rows = rowsOf(set);
+    check(ISetRawView::of(set) != nullptr, "set made by createSet has a raw view");
+    size_t visited = 0;
+    for (ISetRawView::SpanIterator it(set); it.isValid(); it.next(), visited++)
+        check(it.getDim() == dim && std::memcmp(it.getRow(), rows.data() + visited * dim, dim * sizeof(double)) == 0,
+              "span iterator reads rows by index");
+    check(visited == set->getSize(), "span iterator visits every vector");
+}
+
+void testSnapshot(ISet const* const& source){
+    auto set = source->clone();
+    std::vector<double> rows = rowsOf(set);
+    auto snapshot = set->snapshot();
+    set->remove(0);
+    check(snapshot->getSize() == source->getSize(), "snapshot keeps its size after removal from the set");
+    check(rowsOf(snapshot) == rows, "snapshot keeps its vectors after removal from the set");
+    check(!contains(set, rows.data()) && contains(snapshot, rows.data()), "removed vector stays only in the snapshot");
+    delete snapshot;
+    delete set;
+}
+
+void testClone(ISet const* const& set){
+    auto clone = set->clone();
+    clone->remove(0);
+    check(clone->getSize() == set->getSize() - 1, "clone loses the removed vector");
+    check(ISet::subSet(set, clone, IVector::NORM::SECOND, epsilon), "clone is a subset of the set");
+    check(!ISet::subSet(clone, set, IVector::NORM::SECOND, epsilon), "removal from the clone does not change the set");
+    delete clone;
+}
+
+void testFixedDim(ISet const* const& set){
+    auto fixed = ISet::createSet(set->getDim());
+    check(fixed != nullptr, "fixed dimension set is created");
+    if (fixed == nullptr)
         return;
+    std::vector<double> rows = rowsOf(set);
+    size_t inserted = 0;
+    fixed->insertBatch(rows.data(), set->getSize(), dim, IVector::NORM::CHEBYSHEV, epsilon, inserted);
+    check(inserted == set->getSize(), "insertBatch inserts every distinct row");
+    for (auto n : {IVector::NORM::FIRST, IVector::NORM::SECOND, IVector::NORM::CHEBYSHEV})
+        check(ISet::equals(fixed, set, n, epsilon), "fixed dimension set equals set");
+    delete fixed;
+}
+
+void testFindFirstMany(ISet const* const& set1, ISet const* const& set2){
+    std::vector<double> rows = rowsOf(set1);
+    std::vector<size_t> indices(set1->getSize());
+    check(set2->findFirstMany(rows.data(), indices.size(), dim, IVector::NORM::SECOND, epsilon, indices.data()) == RC::SUCCESS,
+          "findFirstMany succeeds");
+    // zero and e1 are absent from set2, e2 and e3 are its first vectors
+    check(indices == std::vector<size_t>({set2->getSize(), set2->getSize(), 0, 1}), "findFirstMany finds indices of every row");
+}
+
+void testChunkIterator(ISet const* const& set){
+    size_t total = 0;
+    auto it = set->getChunkIterator(2);
+    for (; it != nullptr && it->isValid(); it->next()){
+        check(it->getCount() <= 2, "chunk holds at most chunkRows vectors");
+        total += it->getCount();
     }
-    auto it = (set->*_getBegin)();
-    if (it == nullptr){
-        std::cout << "it == nullptr" << std::endl;
+    delete it;
+    check(total == set->getSize(), "chunk iterator reads every vector");
+    std::atomic<size_t> read(0);
+    set->forEachChunk(2, [&read](double const*, size_t const*, size_t count, size_t){ read += count; });
+    check(read == set->getSize(), "forEachChunk reads every vector");
+}
+
+void testJournal(ISet* const& set){
+    auto journal = ISetJournal::of(set);
+    check(journal != nullptr, "set made by createSet keeps a journal");
+    if (journal == nullptr)
+        return;
+    journal->setJournalCapacity(16);
+    uint64_t version = 0;
+    journal->getChangesSince(version, [](ISetJournal::Change const&, double const*){}, version);
+    auto vector = IVector::createVector(dim, v5);
+    set->remove(vector, IVector::NORM::SECOND, epsilon);
+    set->insert(vector, IVector::NORM::SECOND, epsilon);
+    delete vector;
+    std::vector<ISetJournal::CHANGE> kinds;
+    journal->getChangesSince(version, [&kinds](ISetJournal::Change const& change, double const*){
+        kinds.push_back(change.kind);
+    }, version);
+    check(kinds == std::vector<ISetJournal::CHANGE>({ISetJournal::CHANGE::REMOVE, ISetJournal::CHANGE::INSERT}), "journal holds removal and insertion");
+    check(version == set->getVersion(), "journal consumer is up to date");
+    journal->setJournalCapacity(0);
+}
+
+void testQuantizedSet(ISet const* const& set){
+    auto quantized = ISet::createQuantizedSet(set, 16);
+    check(quantized != nullptr && quantized->getSize() == set->getSize(), "quantized set holds every vector");
+    if (quantized == nullptr)
+        return;
+    check(ISet::subSet(set, quantized, IVector::NORM::CHEBYSHEV, 1e-3), "quantized set is a subset of the set within a grid step");
+    check(ISet::subSet(quantized, set, IVector::NORM::CHEBYSHEV, 1e-3), "set is a subset of the quantized set within a grid step");
+    delete quantized;
+}
+
+void testSharedSet(ISet const* const& set){
+    char const name[] = "/gradient_lib_test_set";
+    auto shared = ISet::createSharedSet(name, set->getDim(), set->getSize());
+    auto attached = ISet::openSharedSet(name);
+    // shared memory may be unavailable on the machine, which is not a failure of the set
+    if (shared == nullptr || attached == nullptr){
+        delete attached;
+        delete shared;
         return;
     }
-    while (it->isValid()){
-        IVector* vec;
-        RC getVectorRC = it->getVectorCopy(vec);
-        if (getVectorRC != RC::SUCCESS){
-            std::cout << "getVectorCopy return " << static_cast<int>(getVectorRC) << std::endl;
-            delete vec;
-            delete it;
-            return;
+    std::vector<double> rows = rowsOf(set);
+    size_t inserted = 0;
+    shared->insertBatch(rows.data(), set->getSize(), dim, IVector::NORM::SECOND, epsilon, inserted);
+    check(ISet::equals(attached, set, IVector::NORM::SECOND, epsilon), "attached set sees vectors of the creator");
+    auto vec = IVector::createVector(dim, zero);
+    check(attached->insert(vec, IVector::NORM::SECOND, epsilon) != RC::SUCCESS, "attached set rejects insertion");
+    delete vec;
+    delete attached;
+    delete shared;
+}
+
+void testShardedSet(ISet const* const& set1, ISet const* const& set2){
+    auto sharded = ISet::createShardedSet(4, 1.);
+    std::vector<double> rows = rowsOf(set2);
+    size_t inserted = 0;
+    sharded->insertBatch(rows.data(), set2->getSize(), dim, IVector::NORM::SECOND, epsilon, inserted);
+    check(ISet::equals(sharded, set2, IVector::NORM::SECOND, epsilon), "sharded set equals set2");
+    auto intersection = ISet::makeIntersection(sharded, set1, IVector::NORM::SECOND, epsilon);
+    auto expected = ISet::makeIntersection(set2, set1, IVector::NORM::SECOND, epsilon);
+    check(ISet::equals(intersection, expected, IVector::NORM::SECOND, epsilon), "intersection of sharded set matches plain intersection");
+    delete expected;
+    delete intersection;
+    delete sharded;
+}
+
+void testQueryBox(ISet const* const& set){
+    size_t const gridArr[] = {1, 1, 1};
+    auto lower = IVector::createVector(dim, zero);
+    auto upper = IVector::createVector(dim, v2);
+    auto grid = IMultiIndex::createMultiIndex(dim, gridArr);
+    auto box = ICompact::createCompact(lower, upper, grid);
+    size_t inside = 0;
+    set->queryBox(box, [&inside](double const* coords, size_t dim){
+        for (size_t i = 0; i < dim; i++)
+            check(coords[i] >= 0. && coords[i] <= 2., "queryBox reports only vectors inside of the box");
+        inside++;
+    });
+    // e2, e3, v1 and v2 of set2
+    check(inside == 4, "queryBox reports every vector inside of the box");
+    delete box;
+    delete grid;
+    delete upper;
+    delete lower;
+}
+
+void testSummary(ISet const* const& set){
+    IVector* lower = nullptr;
+    IVector* upper = nullptr;
+    IVector* centroid = nullptr;
+    IVector* variance = nullptr;
+    if (set->getBounds(lower, upper) != RC::SUCCESS || set->getCentroid(centroid) != RC::SUCCESS ||
+        set->getVariance(variance) != RC::SUCCESS){
+        check(false, "summary of a non-empty set succeeds");
+        return;
+    }
+    std::vector<double> rows = rowsOf(set);
+    double const count = static_cast<double>(set->getSize());
+    for (size_t i = 0; i < dim; i++){
+        double min = rows[i], max = rows[i], sum = 0., squares = 0.;
+        for (size_t row = 0; row < set->getSize(); row++){
+            min = std::min(min, rows[row * dim + i]);
+            max = std::max(max, rows[row * dim + i]);
+            sum += rows[row * dim + i];
         }
-        printVector(vec);
-        delete vec;
-        vec = nullptr;
-        RC nextItRC = (it->*_next)(1);
-        if (nextItRC != RC::SUCCESS && nextItRC != RC::INDEX_OUT_OF_BOUND){
-            std::cout << "ISet::Iterator::next return " << static_cast<int>(nextItRC) << std::endl;;
+        for (size_t row = 0; row < set->getSize(); row++)
+            squares += (rows[row * dim + i] - sum / count) * (rows[row * dim + i] - sum / count);
+        check(lower->getData()[i] == min && upper->getData()[i] == max, "bounds are the least and greatest coordinates");
+        check(std::fabs(centroid->getData()[i] - sum / count) < epsilon, "centroid is the mean of vectors");
+        check(std::fabs(variance->getData()[i] - squares / count) < epsilon, "variance is the population variance");
+    }
+    delete lower;
+    delete upper;
+    delete centroid;
+    delete variance;
+}
+
+void testFile(ISet const* const& set){
+    char const* path = "set.bin";
+    check(set->save(path) == RC::SUCCESS, "save succeeds");
+    auto opened = ISet::openFile(path, ISet::FILE_MODE::READ_ONLY);
+    check(opened != nullptr && ISet::equals(set, opened, IVector::NORM::SECOND, epsilon), "opened set equals saved one");
+    check(opened != nullptr && rowsOf(opened) == rowsOf(set), "opened set keeps the order of vectors");
+    delete opened;
+    auto writable = ISet::openFile(path, ISet::FILE_MODE::READ_WRITE);
+    if (writable != nullptr){
+        // inserted vectors grow the file past the capacity it was saved with
+        auto expected = set->clone();
+        for (size_t k = 0; k < 8; k++){
+            double coords[dim] = {10. + static_cast<double>(k), 0., 0.};
+            auto vec = IVector::createVector(dim, coords);
+            writable->insert(vec, IVector::NORM::SECOND, epsilon);
+            expected->insert(vec, IVector::NORM::SECOND, epsilon);
             delete vec;
-            delete it;
-            return;
         }
-        delete vec;
-        vec = nullptr;
+        writable->remove(0);
+        expected->remove(0);
+        check(writable->sync() == RC::SUCCESS, "sync of a writable set file succeeds");
+        delete writable;
+        auto reopened = ISet::openFile(path, ISet::FILE_MODE::READ_ONLY);
+        check(reopened != nullptr && rowsOf(reopened) == rowsOf(expected), "changes of a writable set file are kept in the file");
+        delete reopened;
+        delete expected;
     }
-    std::cout << "test passed" << std::endl << std::endl;
-    delete it;
+    std::remove(path);
 }
 
-void testIterators(ISet const* const& set){
-    testIterators(set, &ISet::getBegin, &ISet::IIterator::next);
-    testIterators(set, &ISet::getEnd, &ISet::IIterator::previous);
+void testLoad(ISet const* const& set){
+    char const* path = "set.csv";
+    FILE* file = std::fopen(path, "w");
+    check(file != nullptr, "csv file is written");
+    if (file == nullptr)
+        return;
+    std::fprintf(file, "x,y,z\n");
+    std::vector<double> rows = rowsOf(set);
+    for (size_t row = 0; row < set->getSize(); row++)
+        std::fprintf(file, "%.17g,%.17g,%.17g\n", rows[row * dim], rows[row * dim + 1], rows[row * dim + 2]);
+    std::fclose(file);
+    auto loaded = ISet::createSet();
+    size_t reported = 0;
+    RC rc = ISet::load(loaded, path, ISet::LOAD_FORMAT::CSV, 0, IVector::NORM::SECOND, epsilon, [&reported](size_t done, size_t total){
+        check(done <= total, "load progress does not exceed the file size");
+        reported = done;
+    });
+    check(rc == RC::SUCCESS && reported != 0, "load succeeds and reports progress");
+    check(ISet::equals(set, loaded, IVector::NORM::SECOND, epsilon), "loaded set equals written one");
+    delete loaded;
+    std::remove(path);
+}
+
+void testAllocator(){
+    auto allocator = ISetAllocator::createPageAllocator(false);
+    auto set = allocator == nullptr ? ISet::createSet() : ISet::createSet(allocator);
+    auto capacity = ISetCapacity::of(set);
+    check(capacity != nullptr, "set made by createSet controls its capacity");
+    if (capacity == nullptr){
+        delete set;
+        delete allocator;
+        return;
+    }
+    check(capacity->setGrowthFactor(1.5) == RC::SUCCESS, "growth factor above 1 is accepted");
+    check(capacity->setGrowthFactor(1.) != RC::SUCCESS, "growth factor 1 is rejected");
+    check(capacity->reserve(vectors.size()) == RC::SUCCESS, "reserve succeeds");
+    for (auto const& vector : vectors){
+        auto vec = IVector::createVector(dim, vector);
+        set->insert(vec, IVector::NORM::SECOND, epsilon);
+        delete vec;
+    }
+    check(capacity->shrinkToFit() == RC::SUCCESS && set->getSize() == vectors.size(), "shrinkToFit keeps every vector");
+    delete set;
+    delete allocator;
 }
 
+void testLsh(ISet* const& set){
+    size_t size = set->getSize();
+    auto lsh = ISetLsh::of(set);
+    check(lsh != nullptr, "set made by createSet has approximate lookups");
+    if (lsh == nullptr)
+        return;
+    check(lsh->enableLsh(IVector::NORM::SECOND, 8, 4, 4 * epsilon, 1) == RC::SUCCESS, "enableLsh succeeds");
+    for (auto const& vector : vectors){
+        auto vec = IVector::createVector(dim, vector);
+        set->insert(vec, IVector::NORM::SECOND, epsilon);
+        delete vec;
+    }
+    ISetLsh::LshStats stats;
+    lsh->getLshStats(stats);
+    check(stats.queries != 0 && stats.checked == stats.queries, "every lookup is checked against a scan");
+    check(stats.checkedMissed == 0, "lookups of exact copies are not missed");
+    check(set->getSize() == size + 2, "only zero and e1 are added");
+    lsh->disableLsh();
+}
 
 void testISet(){
-    auto set1 = ISet::createSet();
-    auto set2 = ISet::createSet();
-    std::cout << "fill set1:" << std::endl;
-    size_t i = 0;
-    for (i = 0; i < 4; i++)
-        testInsert(set1, dim, vectors[i]);
-    std::cout << "fill set2" << std::endl;
-    for (i = 2; i < vectors.size(); i++)
-        testInsert(set2, dim, vectors[i]);
+    // set1 holds zero, e1, e2 and e3, set2 holds e2, e3 and v1 ... v5
+    auto set1 = createSetOf(std::vector<double const*>(vectors.begin(), vectors.begin() + 4));
+    auto set2 = createSetOf(std::vector<double const*>(vectors.begin() + 2, vectors.end()));
 
+    testInsert(set2);
 
     testIterators(set1);
 
+    testSpanIterator(set1);
+
     testIntersection(set1, set2);
 
     testUnion(set1, set2);
@@ -228,13 +580,69 @@ void testISet(){
 
     testEquals(set1, set2);
 
-    testSubSet(set1, set1);
+    testSubSet(set1, set2);
+
+    testQueryBox(set2);
+
+    testSummary(set2);
+
+    testFile(set1);
+
+    testLoad(set2);
+
+    testSnapshot(set2);
+
+    testClone(set2);
+
+    testFixedDim(set2);
+
+    testFindFirstMany(set1, set2);
+
+    testChunkIterator(set2);
+
+    testJournal(set2);
+
+    testQuantizedSet(set2);
+
+    testSharedSet(set2);
+
+    testShardedSet(set1, set2);
+
+    testAllocator();
+
+    testLsh(set2);
 
     delete set1;
     delete set2;
 }
 
 
+void testConcurrentSet(){
+    auto set = ISet::createConcurrentSet(4, 1.);
+    std::vector<std::thread> writers;
+    for (size_t t = 0; t < 3; t++)
+        writers.emplace_back([set, t](){
+            for (size_t i = t; i < vectors.size(); i++){
+                auto vec = IVector::createVector(dim, vectors[i]);
+                set->insert(vec, IVector::NORM::SECOND, epsilon);
+                delete vec;
+            }
+        });
+    for (auto& writer : writers)
+        writer.join();
+    check(set->getSize() == vectors.size(), "concurrent insertion of the same vectors keeps one copy of each");
+    for (auto const& vector : vectors)
+        check(contains(set, vector), "concurrent set holds every inserted vector");
+    check(ISetRawView::of(set) == nullptr, "concurrent set has no raw view");
+    check(ISetCapacity::of(set) == nullptr, "concurrent set does not control its capacity");
+    check(ISetLsh::of(set) == nullptr, "concurrent set has no approximate lookups");
+    check(ISetJournal::of(set) == nullptr, "concurrent set keeps no journal");
+    ISetRawView::SpanIterator span(set);
+    check(!span.isValid(), "span iterator over a set without a raw view is empty");
+    testIterators(set);
+    delete set;
+}
+
 namespace comp {
     double const
     e11[] = {1, 1},